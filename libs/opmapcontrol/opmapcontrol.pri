@@ -9,6 +9,7 @@ HEADERS += opmapcontrol.h \
            src/core/cache.h \
            src/core/cacheitemqueue.h \
            src/core/debugheader.h \
+           src/core/decodedtilecache.h \
            src/core/diagnostics.h \
            src/core/geodecoderstatus.h \
            src/core/kibertilecache.h \
@@ -24,6 +25,7 @@ HEADERS += opmapcontrol.h \
            src/core/rawtile.h \
            src/core/size.h \
            src/core/tilecachequeue.h \
+           src/core/tilepack.h \
            src/core/urlfactory.h \
            src/internals/copyrightstrings.h \
            src/internals/core.h \
@@ -46,6 +48,7 @@ HEADERS += opmapcontrol.h \
            src/mapwidget/opmapwidget.h \
            src/mapwidget/trailitem.h \
            src/mapwidget/traillineitem.h \
+           src/mapwidget/trailpathitem.h \
            src/mapwidget/uavitem.h \
            src/mapwidget/uavmapfollowtype.h \
            src/mapwidget/uavtrailtype.h \
@@ -60,6 +63,7 @@ FORMS += src/mapwidget/mapripform.ui
 SOURCES += src/core/alllayersoftype.cpp \
            src/core/cache.cpp \
            src/core/cacheitemqueue.cpp \
+           src/core/decodedtilecache.cpp \
            src/core/diagnostics.cpp \
            src/core/kibertilecache.cpp \
            src/core/languagetype.cpp \
@@ -73,6 +77,7 @@ SOURCES += src/core/alllayersoftype.cpp \
            src/core/rawtile.cpp \
            src/core/size.cpp \
            src/core/tilecachequeue.cpp \
+           src/core/tilepack.cpp \
            src/core/urlfactory.cpp \
            src/internals/core.cpp \
            src/internals/loadtask.cpp \
@@ -93,6 +98,7 @@ SOURCES += src/core/alllayersoftype.cpp \
            src/mapwidget/opmapwidget.cpp \
            src/mapwidget/trailitem.cpp \
            src/mapwidget/traillineitem.cpp \
+           src/mapwidget/trailpathitem.cpp \
            src/mapwidget/uavitem.cpp \
            src/mapwidget/waypointitem.cpp \
            src/internals/projections/lks94projection.cpp \
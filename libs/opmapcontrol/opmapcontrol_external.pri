@@ -15,6 +15,7 @@ HEADERS += libs/opmapcontrol/opmapcontrol.h \
            libs/opmapcontrol/src/core/cache.h \
            libs/opmapcontrol/src/core/cacheitemqueue.h \
            libs/opmapcontrol/src/core/debugheader.h \
+           libs/opmapcontrol/src/core/decodedtilecache.h \
            libs/opmapcontrol/src/core/diagnostics.h \
            libs/opmapcontrol/src/core/geodecoderstatus.h \
            libs/opmapcontrol/src/core/kibertilecache.h \
@@ -30,6 +31,7 @@ HEADERS += libs/opmapcontrol/opmapcontrol.h \
            libs/opmapcontrol/src/core/rawtile.h \
            libs/opmapcontrol/src/core/size.h \
            libs/opmapcontrol/src/core/tilecachequeue.h \
+           libs/opmapcontrol/src/core/tilepack.h \
            libs/opmapcontrol/src/core/urlfactory.h \
            libs/opmapcontrol/src/internals/copyrightstrings.h \
            libs/opmapcontrol/src/internals/core.h \
@@ -51,6 +53,7 @@ HEADERS += libs/opmapcontrol/opmapcontrol.h \
            libs/opmapcontrol/src/mapwidget/opmapwidget.h \
            libs/opmapcontrol/src/mapwidget/trailitem.h \
            libs/opmapcontrol/src/mapwidget/traillineitem.h \
+           libs/opmapcontrol/src/mapwidget/trailpathitem.h \
            libs/opmapcontrol/src/mapwidget/uavitem.h \
            libs/opmapcontrol/src/mapwidget/uavmapfollowtype.h \
            libs/opmapcontrol/src/mapwidget/uavtrailtype.h \
@@ -66,6 +69,7 @@ FORMS += libs/opmapcontrol/src/mapwidget/mapripform.ui
 SOURCES += libs/opmapcontrol/src/core/alllayersoftype.cpp \
            libs/opmapcontrol/src/core/cache.cpp \
            libs/opmapcontrol/src/core/cacheitemqueue.cpp \
+           libs/opmapcontrol/src/core/decodedtilecache.cpp \
            libs/opmapcontrol/src/core/diagnostics.cpp \
            libs/opmapcontrol/src/core/kibertilecache.cpp \
            libs/opmapcontrol/src/core/languagetype.cpp \
@@ -79,6 +83,7 @@ SOURCES += libs/opmapcontrol/src/core/alllayersoftype.cpp \
            libs/opmapcontrol/src/core/rawtile.cpp \
            libs/opmapcontrol/src/core/size.cpp \
            libs/opmapcontrol/src/core/tilecachequeue.cpp \
+           libs/opmapcontrol/src/core/tilepack.cpp \
            libs/opmapcontrol/src/core/urlfactory.cpp \
            libs/opmapcontrol/src/internals/core.cpp \
            libs/opmapcontrol/src/internals/loadtask.cpp \
@@ -99,6 +104,7 @@ SOURCES += libs/opmapcontrol/src/core/alllayersoftype.cpp \
            libs/opmapcontrol/src/mapwidget/opmapwidget.cpp \
            libs/opmapcontrol/src/mapwidget/trailitem.cpp \
            libs/opmapcontrol/src/mapwidget/traillineitem.cpp \
+           libs/opmapcontrol/src/mapwidget/trailpathitem.cpp \
            libs/opmapcontrol/src/mapwidget/uavitem.cpp \
            libs/opmapcontrol/src/mapwidget/waypointitem.cpp \
            libs/opmapcontrol/src/internals/projections/lks94projection.cpp \
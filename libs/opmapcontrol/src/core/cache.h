@@ -28,6 +28,7 @@
 #define CACHE_H
 
 #include "pureimagecache.h"
+#include "tilepack.h"
 #include "debugheader.h"
 
 namespace core {
@@ -38,6 +39,8 @@ namespace core {
 
 
         PureImageCache ImageCache;
+        /** Offline tiles, looked up ahead of ImageCache while a pack is open */
+        TilePack ImagePack;
         QString CacheLocation();
         void setCacheLocation(const QString& value);
         void CacheGeocoder(const QString &urlEnd,const QString &content);
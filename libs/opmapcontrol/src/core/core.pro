@@ -10,12 +10,14 @@ SOURCES += opmaps.cpp \
     providerstrings.cpp \
     cacheitemqueue.cpp \
     tilecachequeue.cpp \
+    tilepack.cpp \
     alllayersoftype.cpp \
     urlfactory.cpp \
     placemark.cpp \
     point.cpp \
     size.cpp \
     kibertilecache.cpp \
+    decodedtilecache.cpp \
     diagnostics.cpp
 HEADERS += opmaps.h \
     size.h \
@@ -30,11 +32,13 @@ HEADERS += opmaps.h \
     providerstrings.h \
     cacheitemqueue.h \
     tilecachequeue.h \
+    tilepack.h \
     alllayersoftype.h \
     urlfactory.h \
     geodecoderstatus.h \
     placemark.h \
     point.h \
     kibertilecache.h \
+    decodedtilecache.h \
     debugheader.h \
     diagnostics.h
@@ -0,0 +1,118 @@
+/**
+******************************************************************************
+*
+* @file       decodedtilecache.cpp
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      Memory cache of decoded tiles, ready to be drawn
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#include "decodedtilecache.h"
+#include <QDebug>
+//#define DEBUG_DECODEDTILECACHE
+namespace core {
+    DecodedTileCache::DecodedTileCache():hits(0),misses(0),evictions(0)
+    {
+        images.setMaxCost(64*1024);
+    }
+
+    QImage DecodedTileCache::Decode(const QByteArray &data)
+    {
+        QImage image;
+        if(!image.loadFromData(data))
+            return QImage();
+        // The formats the raster paint engine draws without converting
+        if(image.hasAlphaChannel())
+            return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        return image.convertToFormat(QImage::Format_RGB32);
+    }
+
+    bool DecodedTileCache::GetTile(const RawTile &tile, QImage *image)
+    {
+        QMutexLocker locker(&lock);
+        QImage *cached=images.object(tile);
+        if(cached==0)
+        {
+            ++misses;
+            return false;
+        }
+        ++hits;
+        *image=*cached;
+        return true;
+    }
+    void DecodedTileCache::AddTile(const RawTile &tile, const QImage &image)
+    {
+        if(image.isNull())
+            return;
+        int cost=qMax(1,image.byteCount()/1024);
+        QMutexLocker locker(&lock);
+        // QCache evicts the least recently used tiles to make room
+        int before=images.count();
+        bool replacing=images.contains(tile);
+        if(images.insert(tile,new QImage(image),cost))
+            evictions+=before-images.count()+(replacing?0:1);
+#ifdef DEBUG_DECODEDTILECACHE
+        qDebug()<<"DecodedTileCache: now"<<images.count()<<"tiles,"<<images.totalCost()<<"Kb";
+#endif //DEBUG_DECODEDTILECACHE
+    }
+    void DecodedTileCache::Clear()
+    {
+        QMutexLocker locker(&lock);
+        images.clear();
+    }
+
+    void DecodedTileCache::setCapacity(const int &value)
+    {
+        QMutexLocker locker(&lock);
+        int before=images.count();
+        images.setMaxCost(qMax(0,value)*1024);
+        evictions+=before-images.count();
+    }
+    int DecodedTileCache::Capacity()
+    {
+        QMutexLocker locker(&lock);
+        return images.maxCost()/1024;
+    }
+    double DecodedTileCache::Size()
+    {
+        QMutexLocker locker(&lock);
+        return images.totalCost()/1024.0;
+    }
+    int DecodedTileCache::Count()
+    {
+        QMutexLocker locker(&lock);
+        return images.count();
+    }
+    int DecodedTileCache::Hits()
+    {
+        QMutexLocker locker(&lock);
+        return hits;
+    }
+    int DecodedTileCache::Misses()
+    {
+        QMutexLocker locker(&lock);
+        return misses;
+    }
+    int DecodedTileCache::Evictions()
+    {
+        QMutexLocker locker(&lock);
+        return evictions;
+    }
+}
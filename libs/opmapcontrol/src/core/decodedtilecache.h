@@ -0,0 +1,75 @@
+/**
+******************************************************************************
+*
+* @file       decodedtilecache.h
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      Memory cache of decoded tiles, ready to be drawn
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#ifndef DECODEDTILECACHE_H
+#define DECODEDTILECACHE_H
+
+#include "rawtile.h"
+#include <QCache>
+#include <QImage>
+#include <QByteArray>
+#include <QMutex>
+namespace core {
+    /**
+    * Least recently used cache of decoded tiles, keyed by type, position and zoom.
+    *
+    * Tiles are decoded once by the tile loader threads, in a format that can
+    * be drawn without conversion, so panning back over a tile does not decode
+    * it again. The size is bounded by the bytes the images take, not their
+    * number. Thread safe.
+    */
+    class DecodedTileCache
+    {
+    public:
+        DecodedTileCache();
+        /** Decode a PNG/JPEG tile, a null image if it can't be decoded */
+        static QImage Decode(const QByteArray &data);
+
+        /** @return false on a miss, image is left untouched */
+        bool GetTile(const RawTile &tile, QImage *image);
+        void AddTile(const RawTile &tile, const QImage &image);
+        void Clear();
+
+        /** Size in Mb the images may take */
+        void setCapacity(const int &value);
+        int Capacity();
+        /** Size in Mb the images take */
+        double Size();
+        int Count();
+        int Hits();
+        int Misses();
+        int Evictions();
+    private:
+        // Costs are in Kb so large budgets still fit QCache's int
+        QCache<RawTile,QImage> images;
+        QMutex lock;
+        int hits;
+        int misses;
+        int evictions;
+    };
+
+}
+#endif // DECODEDTILECACHE_H
@@ -26,6 +26,6 @@
 */
 #include "diagnostics.h"
 
-diagnostics::diagnostics():networkerrors(0),emptytiles(0),timeouts(0),runningThreads(0),tilesFromMem(0),tilesFromNet(0),tilesFromDB(0)
+diagnostics::diagnostics():networkerrors(0),emptytiles(0),timeouts(0),runningThreads(0),tilesFromMem(0),tilesFromNet(0),tilesFromDB(0),tilesFromPack(0),decodedHits(0),decodedMisses(0),decodedEvictions(0),tilesCancelled(0),loadLatencyAverage(0),loadLatencyMax(0),viewLoadTime(0)
 {
 }
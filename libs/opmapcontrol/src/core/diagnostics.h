@@ -37,9 +37,17 @@ struct diagnostics
     int tilesFromMem;
     int tilesFromNet;
     int tilesFromDB;
+    int tilesFromPack;
+    int decodedHits;
+    int decodedMisses;
+    int decodedEvictions;
+    int tilesCancelled;
+    int loadLatencyAverage; // milliseconds from queued to drawn, per tile
+    int loadLatencyMax;
+    int viewLoadTime; // milliseconds until the last view had no tiles still to load
     QString toString()
     {
-        return QString("Network errors:%1\nEmpty Tiles:%2\nTimeOuts:%3\nRunningThreads:%4\nTilesFromMem:%5\nTilesFromNet:%6\nTilesFromDB:%7").arg(networkerrors).arg(emptytiles).arg(timeouts).arg(runningThreads).arg(tilesFromMem).arg(tilesFromNet).arg(tilesFromDB);
+        return QString("Network errors:%1\nEmpty Tiles:%2\nTimeOuts:%3\nRunningThreads:%4\nTilesFromMem:%5\nTilesFromNet:%6\nTilesFromDB:%7\nTilesFromPack:%8\nDecodedHits:%9\nDecodedMisses:%10\nDecodedEvictions:%11\nTilesCancelled:%12\nLoadLatencyAverage:%13ms\nLoadLatencyMax:%14ms\nViewLoadTime:%15ms").arg(networkerrors).arg(emptytiles).arg(timeouts).arg(runningThreads).arg(tilesFromMem).arg(tilesFromNet).arg(tilesFromDB).arg(tilesFromPack).arg(decodedHits).arg(decodedMisses).arg(decodedEvictions).arg(tilesCancelled).arg(loadLatencyAverage).arg(loadLatencyMax).arg(viewLoadTime);
        ;
     }
 };
@@ -25,6 +25,8 @@
 * 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 */
 #include "opmaps.h"
+#include <QBuffer>
+#include <QImageReader>
 
 
 namespace core {
@@ -36,7 +38,7 @@ namespace core {
             m_pInstance=new OPMaps;
         return m_pInstance;
     }
-    OPMaps::OPMaps():RetryLoadTile(2),useMemoryCache(true)
+    OPMaps::OPMaps():RetryLoadTile(2),useMemoryCache(true),networkConcurrency(4),networkActive(0)
     {
         accessmode=AccessMode::ServerAndCache;
         Language=LanguageType::English;
@@ -85,6 +87,21 @@ namespace core {
 #endif //DEBUG_GMAPS
             if(accessmode != (AccessMode::ServerOnly))
             {
+#ifdef DEBUG_GMAPS
+                qDebug()<<"Try tile from tile pack";
+#endif //DEBUG_GMAPS
+                ret=Cache::Instance()->ImagePack.GetImageFromPack(type,pos,zoom);
+                if(!ret.isEmpty())
+                {
+                    errorvars.lock();
+                    ++diag.tilesFromPack;
+                    errorvars.unlock();
+                    if(useMemoryCache)
+                    {
+                        AddTileToMemoryCache(RawTile(type,pos,zoom),ret);
+                    }
+                    return ret;
+                }
 #ifdef DEBUG_GMAPS
                 qDebug()<<"Try tile from DataBase";
 #endif //DEBUG_GMAPS
@@ -207,9 +224,20 @@ namespace core {
                 default:
                     break;
                 }
+                // Only a few tiles are fetched at once, so loaders of cached tiles
+                // and the tile servers are not held up by a burst of requests
+                networkLock.lock();
+                while(networkActive>=networkConcurrency)
+                    networkFree.wait(&networkLock);
+                ++networkActive;
+                networkLock.unlock();
                 reply=network.get(qheader);
                 tT.start(Timeout);
                 q.exec();
+                networkLock.lock();
+                --networkActive;
+                networkFree.wakeOne();
+                networkLock.unlock();
 
                 if(!tT.isActive()){
                     errorvars.lock();
@@ -241,6 +269,21 @@ namespace core {
                     errorvars.unlock();
                     return ret;
                 }
+                {
+                    // Error pages are sometimes served as tiles, don't cache those
+                    QBuffer buffer(&ret);
+                    buffer.open(QIODevice::ReadOnly);
+                    if(!QImageReader(&buffer).canRead())
+                    {
+#ifdef DEBUG_GMAPS
+                        qDebug()<<"Tile is not an image";
+#endif //DEBUG_GMAPS
+                        errorvars.lock();
+                        ++diag.emptytiles;
+                        errorvars.unlock();
+                        return QByteArray();
+                    }
+                }
 #ifdef DEBUG_GMAPS
                 qDebug()<<"Received Tile from the Internet";
 #endif //DEBUG_GMAPS
@@ -281,12 +324,39 @@ namespace core {
         return Cache::Instance()->ImageCache.ExportMapDataToDB(file,Cache::Instance()->ImageCache.GtileCache()+QDir::separator()+"Data.qmdb");
     }
 
+    bool OPMaps::ExportToTilePack(const QString &file)
+    {
+        // Tiles still queued for the database are part of the export
+        Cache::Instance()->ImageCache.FlushCache();
+        return TilePack::ExportDBToPack(Cache::Instance()->ImageCache.GtileCache()+QDir::separator()+"Data.qmdb",file);
+    }
+    bool OPMaps::ImportFromTilePack(const QString &file)
+    {
+        return TilePack::ImportPackToDB(file,Cache::Instance()->ImageCache.GtileCache()+QDir::separator()+"Data.qmdb");
+    }
+
+    void OPMaps::setNetworkConcurrency(const int &value)
+    {
+        networkLock.lock();
+        networkConcurrency=qMax(1,value);
+        networkFree.wakeAll();
+        networkLock.unlock();
+    }
+    int OPMaps::NetworkConcurrency()
+    {
+        QMutexLocker locker(&networkLock);
+        return networkConcurrency;
+    }
+
     diagnostics OPMaps::GetDiagnostics()
     {
         diagnostics i;
         errorvars.lock();
         i=diag;
         errorvars.unlock();
+        i.decodedHits=DecodedTiles.Hits();
+        i.decodedMisses=DecodedTiles.Misses();
+        i.decodedEvictions=DecodedTiles.Evictions();
         return i;
     }
 }
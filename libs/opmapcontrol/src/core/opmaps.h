@@ -40,6 +40,9 @@
 #include "alllayersoftype.h"
 #include "urlfactory.h"
 #include "diagnostics.h"
+#include <QMutex>
+#include <QWaitCondition>
+#include "decodedtilecache.h"
 
 //#include "point.h"
 
@@ -56,6 +59,8 @@ namespace core {
         static OPMaps* Instance();
         bool ImportFromGMDB(const QString &file);
         bool ExportToGMDB(const QString &file);
+        bool ImportFromTilePack(const QString &file);
+        bool ExportToTilePack(const QString &file);
         /// <summary>
         /// timeout for map connections
         /// </summary>
@@ -68,8 +73,17 @@ namespace core {
         LanguageType::Types GetLanguage(){return Language;}//TODO
         AccessMode::Types GetAccessMode()const{return accessmode;}
         void setAccessMode(const AccessMode::Types& mode){accessmode=mode;}
+        /// <summary>
+        /// tiles fetched from the network at the same time
+        /// </summary>
+        void setNetworkConcurrency(const int& value);
+        int NetworkConcurrency();
         int RetryLoadTile;
         diagnostics GetDiagnostics();
+        /// <summary>
+        /// decoded tiles, filled by the tile loaders and drawn by the map
+        /// </summary>
+        DecodedTileCache DecodedTiles;
 
     private:
         bool useMemoryCache;
@@ -83,6 +97,10 @@ namespace core {
         static OPMaps* m_pInstance;
         diagnostics diag;
         QMutex errorvars;
+        int networkConcurrency;
+        int networkActive;
+        QMutex networkLock;
+        QWaitCondition networkFree;
     protected:
         // MemoryCache TilesInMemory;
 
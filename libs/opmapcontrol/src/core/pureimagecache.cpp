@@ -27,6 +27,7 @@
 #include "pureimagecache.h"
 #include <QDateTime>
 #include <QSettings>
+#include <QMutexLocker>
 //#define DEBUG_PUREIMAGECACHE
 namespace core {
     qlonglong PureImageCache::ConnCounter=0;
@@ -36,8 +37,78 @@ namespace core {
 
     }
 
+    PureImageCache::Connection::Connection(const QString &name,const QString &file):
+        name(name),file(file),valid(false),selectTile(0),findTile(0),insertTile(0),insertTileData(0)
+    {
+        QSqlDatabase cn;
+        cn = QSqlDatabase::addDatabase("QSQLITE",name);
+        cn.setDatabaseName(file);
+        // Wait for the writer rather than fail, instead of sharing one cache between connections
+        cn.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+        if(!cn.open())
+        {
+#ifdef DEBUG_PUREIMAGECACHE
+            qDebug()<<"Connection: Unable to open database"<<cn.lastError().driverText();
+#endif //DEBUG_PUREIMAGECACHE
+            return;
+        }
+        {
+            QSqlQuery query(cn);
+            // Readers don't block the writer, and a commit is no longer a full sync
+            query.exec("PRAGMA journal_mode=WAL");
+            query.exec("PRAGMA synchronous=NORMAL");
+            // Caches created before the index existed
+            query.exec("CREATE INDEX IF NOT EXISTS IndexOfTiles ON Tiles (X, Y, Zoom, Type)");
+        }
+        selectTile=new QSqlQuery(cn);
+        selectTile->setForwardOnly(true);
+        findTile=new QSqlQuery(cn);
+        findTile->setForwardOnly(true);
+        insertTile=new QSqlQuery(cn);
+        insertTileData=new QSqlQuery(cn);
+        valid=selectTile->prepare("SELECT Tile FROM TilesData WHERE id = (SELECT id FROM Tiles WHERE X=? AND Y=? AND Zoom=? AND Type=?)") &&
+              findTile->prepare("SELECT id FROM Tiles WHERE X=? AND Y=? AND Zoom=? AND Type=? LIMIT 1") &&
+              insertTile->prepare("INSERT INTO Tiles(X, Y, Zoom, Type,Date) VALUES(?, ?, ?, ?,?)") &&
+              insertTileData->prepare("INSERT INTO TilesData(id, Tile) VALUES((SELECT last_insert_rowid()), ?)");
+#ifdef DEBUG_PUREIMAGECACHE
+        if(!valid)
+            qDebug()<<"Connection: Unable to prepare statements";
+#endif //DEBUG_PUREIMAGECACHE
+    }
+
+    PureImageCache::Connection::~Connection()
+    {
+        delete selectTile;
+        delete findTile;
+        delete insertTile;
+        delete insertTileData;
+        {
+            QSqlDatabase cn=QSqlDatabase::database(name,false);
+            cn.close();
+        }
+        QSqlDatabase::removeDatabase(name);
+    }
+
+    PureImageCache::Connection* PureImageCache::GetConnection()
+    {
+        QString db=gtilecache+"Data.qmdb";
+        Connection *cn=connections.localData();
+        if(cn==0 || cn->file!=db)
+        {
+            Mcounter.lock();
+            qlonglong id=++ConnCounter;
+            Mcounter.unlock();
+            // Replaces, and deletes, the connection to the previous cache location
+            cn=new Connection(QString::number(id),db);
+            connections.setLocalData(cn);
+        }
+        return cn->valid?cn:0;
+    }
+
     void PureImageCache::setGtileCache(const QString &value)
     {
+        // Queued tiles belong to the previous location
+        FlushCache();
         lock.lockForWrite();
         gtilecache=value;
         QDir d;
@@ -117,6 +188,15 @@ namespace core {
         {
 #ifdef DEBUG_PUREIMAGECACHE
             qDebug()<<"CreateEmptyDB: "<<query.lastError().driverText();
+#endif //DEBUG_PUREIMAGECACHE
+            db.close();
+            return false;
+        }
+        query.exec("CREATE INDEX IF NOT EXISTS IndexOfTiles ON Tiles (X, Y, Zoom, Type)");
+        if(query.numRowsAffected()==-1)
+        {
+#ifdef DEBUG_PUREIMAGECACHE
+            qDebug()<<"CreateEmptyDB: "<<query.lastError().driverText();
 #endif //DEBUG_PUREIMAGECACHE
             db.close();
             return false;
@@ -173,123 +253,199 @@ namespace core {
     {
         if(gtilecache.isEmpty()|gtilecache.isNull())
             return false;
-        lock.lockForRead();
 #ifdef DEBUG_PUREIMAGECACHE
         qDebug()<<"PutImageToCache Start:";//<<pos;
 #endif //DEBUG_PUREIMAGECACHE
-        Mcounter.lock();
-        qlonglong id=++ConnCounter;
-        Mcounter.unlock();
+        PendingTile t;
+        t.tile=tile;
+        t.type=type;
+        t.pos=pos;
+        t.zoom=zoom;
+        t.failedFlushes=0;
+        pendingLock.lock();
+        pending.append(t);
+        bool full=pending.count()>=BatchSize;
+        pendingLock.unlock();
+        if(full)
+            FlushCache();
+        return true;
+    }
+    void PureImageCache::FlushCache()
+    {
+        // One flush at a time, so the tiles written are still the first queued when removed
+        QMutexLocker flushLocker(&flushLock);
+        pendingLock.lock();
+        QList<PendingTile> tiles=pending;
+        pendingLock.unlock();
+        if(tiles.isEmpty())
+            return;
+#ifdef DEBUG_PUREIMAGECACHE
+        qDebug()<<"FlushCache:"<<tiles.count()<<"tiles";
+#endif //DEBUG_PUREIMAGECACHE
+        lock.lockForRead();
+        if(gtilecache.isEmpty())
         {
-            QSqlDatabase cn;
-            cn = QSqlDatabase::addDatabase("QSQLITE",QString::number(id));
-            QString db=gtilecache+"Data.qmdb";
-            cn.setDatabaseName(db);
-            cn.setConnectOptions("QSQLITE_ENABLE_SHARED_CACHE");
-            if(cn.open())
+            // No cache to write to, nothing to keep the tiles for
+            lock.unlock();
+            pendingLock.lock();
+            pending=pending.mid(tiles.count());
+            pendingLock.unlock();
+            return;
+        }
+        bool committed=false;
+        Connection *cn=GetConnection();
+        if(cn)
+        {
+            QSqlDatabase db=QSqlDatabase::database(cn->name,false);
+            db.transaction();
+            QString date=QDateTime::currentDateTime().toString();
+            foreach(const PendingTile &t,tiles)
             {
+                cn->insertTile->addBindValue(t.pos.X());
+                cn->insertTile->addBindValue(t.pos.Y());
+                cn->insertTile->addBindValue(t.zoom);
+                cn->insertTile->addBindValue((int)t.type);
+                cn->insertTile->addBindValue(date);
+                if(cn->insertTile->exec())
                 {
-                    QSqlQuery query(cn);
-                    query.prepare("INSERT INTO Tiles(X, Y, Zoom, Type,Date) VALUES(?, ?, ?, ?,?)");
-                    query.addBindValue(pos.X());
-                    query.addBindValue(pos.Y());
-                    query.addBindValue(zoom);
-
-                    query.addBindValue((int)type);
-                    query.addBindValue(QDateTime::currentDateTime().toString());
-                    query.exec();
+                    cn->insertTileData->addBindValue(t.tile);
+                    cn->insertTileData->exec();
                 }
+            }
+            committed=db.commit();
+            if(!committed)
+            {
+                qWarning()<<"PureImageCache::FlushCache: commit failed, keeping"<<tiles.count()<<"tiles queued:"<<db.lastError().driverText();
+                db.rollback();
+            }
+        }
+        else
+        {
+            qWarning()<<"PureImageCache::FlushCache: no connection to"<<gtilecache<<", keeping"<<tiles.count()<<"tiles queued";
+        }
+        lock.unlock();
+        pendingLock.lock();
+        if(committed)
+        {
+            pending=pending.mid(tiles.count());
+        }
+        else
+        {
+            // Retried at the next flush, unless they have already failed too often
+            int dropped=0;
+            for(int i=0;i<tiles.count();++i)
+            {
+                if(++pending[i-dropped].failedFlushes>=MaxFlushAttempts)
                 {
-                    QSqlQuery query(cn);
-                    query.prepare("INSERT INTO TilesData(id, Tile) VALUES((SELECT last_insert_rowid()), ?)");
-                    query.addBindValue(tile);
-                    query.exec();
+                    pending.removeAt(i-dropped);
+                    ++dropped;
                 }
-                cn.close();
             }
+            if(dropped>0)
+                qWarning()<<"PureImageCache::FlushCache: dropped"<<dropped<<"tiles after"<<MaxFlushAttempts<<"failed flushes";
         }
-        QSqlDatabase::removeDatabase(QString::number(id));
-        lock.unlock();
-        return true;
+        pendingLock.unlock();
     }
     QByteArray PureImageCache::GetImageFromCache(MapType::Types type, Point pos, int zoom)
     {
-        lock.lockForRead();
         QByteArray ar;
+        // Tiles not written yet
+        pendingLock.lock();
+        for(int i=pending.count()-1;i>=0;--i)
+        {
+            const PendingTile &t=pending.at(i);
+            if(t.type==type && t.zoom==zoom && t.pos==pos)
+            {
+                ar=t.tile;
+                break;
+            }
+        }
+        pendingLock.unlock();
+        if(!ar.isNull())
+            return ar;
+        lock.lockForRead();
         if(gtilecache.isEmpty()|gtilecache.isNull())
+        {
+            lock.unlock();
             return ar;
-        QString dir=gtilecache;
-        Mcounter.lock();
-        qlonglong id=++ConnCounter;
-        Mcounter.unlock();
+        }
 #ifdef DEBUG_PUREIMAGECACHE
-        qDebug()<<"Cache dir="<<dir<<" Try to GET:"<<pos.X()+","+pos.Y();
+        qDebug()<<"Cache dir="<<gtilecache<<" Try to GET:"<<pos.X()+","+pos.Y();
 #endif //DEBUG_PUREIMAGECACHE
-
-            QString db=dir+"Data.qmdb";
-			{
-				QSqlDatabase cn;
-			
-				cn = QSqlDatabase::addDatabase("QSQLITE",QString::number(id));
-
-	            cn.setDatabaseName(db);
-		        cn.setConnectOptions("QSQLITE_ENABLE_SHARED_CACHE");
-			    if(cn.open())
-				{
-					QSqlQuery query(cn);
-					query.exec(QString("SELECT Tile FROM TilesData WHERE id = (SELECT id FROM Tiles WHERE X=%1 AND Y=%2 AND Zoom=%3 AND Type=%4)").arg(pos.X()).arg(pos.Y()).arg(zoom).arg((int) type));
-					query.next();
-					if(query.isValid())
-					{
-						ar=query.value(0).toByteArray();
-					}
-					cn.close();
-				}
-			}
-			QSqlDatabase::removeDatabase(QString::number(id));
+        Connection *cn=GetConnection();
+        if(cn)
+        {
+            cn->selectTile->addBindValue(pos.X());
+            cn->selectTile->addBindValue(pos.Y());
+            cn->selectTile->addBindValue(zoom);
+            cn->selectTile->addBindValue((int)type);
+            if(cn->selectTile->exec() && cn->selectTile->next())
+            {
+                ar=cn->selectTile->value(0).toByteArray();
+            }
+            // Ends the read transaction, the statement stays prepared
+            cn->selectTile->finish();
+        }
         lock.unlock();
         return ar;
     }
+    bool PureImageCache::ContainsTile(MapType::Types type, Point pos, int zoom)
+    {
+        bool ret=false;
+        pendingLock.lock();
+        for(int i=0;i<pending.count() && !ret;++i)
+        {
+            const PendingTile &t=pending.at(i);
+            ret=(t.type==type && t.zoom==zoom && t.pos==pos);
+        }
+        pendingLock.unlock();
+        if(ret)
+            return true;
+        lock.lockForRead();
+        Connection *cn=gtilecache.isEmpty()?0:GetConnection();
+        if(cn)
+        {
+            cn->findTile->addBindValue(pos.X());
+            cn->findTile->addBindValue(pos.Y());
+            cn->findTile->addBindValue(zoom);
+            cn->findTile->addBindValue((int)type);
+            ret=cn->findTile->exec() && cn->findTile->next();
+            cn->findTile->finish();
+        }
+        lock.unlock();
+        return ret;
+    }
     void PureImageCache::deleteOlderTiles(int const& days)
     {
         if(gtilecache.isEmpty()|gtilecache.isNull())
             return;
+        FlushCache();
         QList<long> add;
-        bool ret=true;
-        QString dir=gtilecache;
+        lock.lockForRead();
+        QString db=gtilecache+"Data.qmdb";
+        Connection *cn=QFileInfo(db).exists()?GetConnection():0;
+        if(cn)
         {
-            QString db=dir+"Data.qmdb";
-            ret=QFileInfo(db).exists();
-            if(ret)
+            QSqlDatabase cndb=QSqlDatabase::database(cn->name,false);
+            QSqlQuery query(cndb);
+            query.setForwardOnly(true);
+            query.exec(QString("SELECT id, Date FROM Tiles"));
+            while(query.next())
             {
-                QSqlDatabase cn;
-                Mcounter.lock();
-                qlonglong id=++ConnCounter;
-                Mcounter.unlock();
-                cn = QSqlDatabase::addDatabase("QSQLITE",QString::number(id));
-                cn.setDatabaseName(db);
-                cn.setConnectOptions("QSQLITE_ENABLE_SHARED_CACHE");
-                if(cn.open())
-                {
-                    {
-                        QSqlQuery query(cn);
-                        query.exec(QString("SELECT id, X, Y, Zoom, Type, Date FROM Tiles"));
-                        while(query.next())
-                        {
-                            if(QDateTime::fromString(query.value(5).toString()).daysTo(QDateTime::currentDateTime())>days)
-                                add.append(query.value(0).toLongLong());
-                        }
-                        foreach(long i,add)
-                        {
-                            query.exec(QString("DELETE FROM Tiles WHERE id = %1;").arg(i));
-                        }
-                    }
-
-                    cn.close();
-                }
-                QSqlDatabase::removeDatabase(QString::number(id));
+                if(QDateTime::fromString(query.value(1).toString()).daysTo(QDateTime::currentDateTime())>days)
+                    add.append(query.value(0).toLongLong());
             }
+            query.finish();
+            cndb.transaction();
+            query.prepare("DELETE FROM Tiles WHERE id = ?");
+            foreach(long i,add)
+            {
+                query.addBindValue((qlonglong)i);
+                query.exec();
+            }
+            cndb.commit();
         }
+        lock.unlock();
     }
     // PureImageCache::ExportMapDataToDB("C:/Users/Xapo/Documents/mapcontrol/debug/mapscache/data.qmdb","C:/Users/Xapo/Documents/mapcontrol/debug/mapscache/data2.qmdb");
     bool PureImageCache::ExportMapDataToDB(QString sourceFile, QString destFile)
@@ -42,7 +42,14 @@
 #include <QList>
 #include <QMutex>
 #include <QReadWriteLock>
+#include <QThreadStorage>
 namespace core {
+    /**
+    * Tile database. Each thread keeps its own connection open, with its
+    * statements prepared, until it exits. Tiles put to the cache are queued
+    * and written in one transaction by FlushCache(), they are found by
+    * GetImageFromCache meanwhile.
+    */
     class PureImageCache
     {
 
@@ -51,15 +58,53 @@ namespace core {
         static bool CreateEmptyDB(const QString &file);
         bool PutImageToCache(const QByteArray &tile,const MapType::Types &type,const core::Point &pos, const int &zoom);
         QByteArray GetImageFromCache(MapType::Types type, core::Point pos, int zoom);
+        /** Whether the tile is cached, without reading it */
+        bool ContainsTile(MapType::Types type, core::Point pos, int zoom);
+        /**
+        * Write the queued tiles to the database, in one transaction.
+        * Done on its own once BatchSize tiles are queued.
+        */
+        void FlushCache();
         QString GtileCache();
         void setGtileCache(const QString &value);
         static bool ExportMapDataToDB(QString sourceFile, QString destFile);
         void deleteOlderTiles(int const& days);
     private:
+        class Connection
+        {
+        public:
+            Connection(const QString &name,const QString &file);
+            ~Connection();
+            QString name;
+            QString file;
+            bool valid;
+            QSqlQuery *selectTile;
+            QSqlQuery *findTile;
+            QSqlQuery *insertTile;
+            QSqlQuery *insertTileData;
+        };
+        class PendingTile
+        {
+        public:
+            QByteArray tile;
+            MapType::Types type;
+            core::Point pos;
+            int zoom;
+            int failedFlushes;
+        };
+        static const int BatchSize=64;
+        /** A tile is dropped once this many flushes of it fail to commit */
+        static const int MaxFlushAttempts=3;
+        /** The calling thread's connection to the current database, lock must be held */
+        Connection* GetConnection();
         QString gtilecache;
         QMutex Mcounter;
         QReadWriteLock lock;
         static qlonglong ConnCounter;
+        QThreadStorage<Connection*> connections;
+        QMutex pendingLock;
+        QList<PendingTile> pending;
+        QMutex flushLock;
 
     };
 
@@ -98,6 +98,8 @@ void TileCacheQueue::run()
 
         else
         {
+            // Write what was queued in one transaction, before going idle
+            Cache::Instance()->ImageCache.FlushCache();
             #ifdef DEBUG_TILECACHEQUEUE
             qDebug()<<"Cache engine BEGIN WAIT";
             #endif //DEBUG_TILECACHEQUEUE
@@ -0,0 +1,331 @@
+/**
+******************************************************************************
+*
+* @file       tilepack.cpp
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      Read only, memory mapped tile pack for offline use
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#include "tilepack.h"
+#include "pureimagecache.h"
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QVector>
+#include <QDebug>
+#include <QtEndian>
+#include <string.h>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+//#define DEBUG_TILEPACK
+namespace core {
+    static const char TilePackMagic[4]={'O','P','T','P'};
+
+    TilePack::TilePack():data(0),dataSize(0),count(0)
+    {
+
+    }
+    TilePack::~TilePack()
+    {
+        Close();
+    }
+
+    bool TilePack::Open(const QString &fileName)
+    {
+        Close();
+        QWriteLocker locker(&lock);
+        file.setFileName(fileName);
+        if(!file.open(QIODevice::ReadOnly))
+        {
+#ifdef DEBUG_TILEPACK
+            qDebug()<<"TilePack: Unable to open"<<fileName;
+#endif //DEBUG_TILEPACK
+            return false;
+        }
+        dataSize=file.size();
+        if(dataSize>=HeaderSize)
+            data=file.map(0,dataSize);
+        if(data==0 || memcmp(data,TilePackMagic,4)!=0 || qFromLittleEndian<quint32>(data+4)!=Version)
+        {
+#ifdef DEBUG_TILEPACK
+            qDebug()<<"TilePack: Not a tile pack"<<fileName;
+#endif //DEBUG_TILEPACK
+            if(data)
+                file.unmap(data);
+            data=0;
+            file.close();
+            return false;
+        }
+        count=qFromLittleEndian<quint32>(data+8);
+        if(HeaderSize+(qint64)count*EntrySize>dataSize)
+        {
+#ifdef DEBUG_TILEPACK
+            qDebug()<<"TilePack: Index is truncated"<<fileName;
+#endif //DEBUG_TILEPACK
+            file.unmap(data);
+            data=0;
+            count=0;
+            file.close();
+            return false;
+        }
+#ifdef DEBUG_TILEPACK
+        qDebug()<<"TilePack: Opened"<<fileName<<"with"<<count<<"tiles";
+#endif //DEBUG_TILEPACK
+        return true;
+    }
+    void TilePack::Close()
+    {
+        QWriteLocker locker(&lock);
+        if(data)
+            file.unmap(data);
+        data=0;
+        dataSize=0;
+        count=0;
+        file.close();
+    }
+    bool TilePack::IsOpen()
+    {
+        QReadLocker locker(&lock);
+        return data!=0;
+    }
+    QString TilePack::FileName()
+    {
+        QReadLocker locker(&lock);
+        return data?file.fileName():QString();
+    }
+    int TilePack::TileCount()
+    {
+        QReadLocker locker(&lock);
+        return count;
+    }
+
+    TilePack::Entry TilePack::ReadEntry(const uchar *data)
+    {
+        Entry entry;
+        entry.type=qFromLittleEndian<qint32>(data);
+        entry.zoom=qFromLittleEndian<qint32>(data+4);
+        entry.x=qFromLittleEndian<qint32>(data+8);
+        entry.y=qFromLittleEndian<qint32>(data+12);
+        entry.offset=qFromLittleEndian<quint64>(data+20);
+        entry.size=qFromLittleEndian<quint32>(data+28);
+        return entry;
+    }
+    void TilePack::WriteEntry(const Entry &entry, uchar *data)
+    {
+        qToLittleEndian<qint32>(entry.type,data);
+        qToLittleEndian<qint32>(entry.zoom,data+4);
+        qToLittleEndian<qint32>(entry.x,data+8);
+        qToLittleEndian<qint32>(entry.y,data+12);
+        qToLittleEndian<quint32>(0,data+16);
+        qToLittleEndian<quint64>(entry.offset,data+20);
+        qToLittleEndian<quint32>(entry.size,data+28);
+    }
+    bool TilePack::LessThan(const Entry &entry, qint32 type, qint32 zoom, qint32 x, qint32 y)
+    {
+        if(entry.type!=type)
+            return entry.type<type;
+        if(entry.zoom!=zoom)
+            return entry.zoom<zoom;
+        if(entry.x!=x)
+            return entry.x<x;
+        return entry.y<y;
+    }
+    bool TilePack::Find(qint32 type, qint32 zoom, qint32 x, qint32 y, Entry *entry)
+    {
+        if(data==0)
+            return false;
+        const uchar *index=data+HeaderSize;
+        quint32 first=0;
+        quint32 last=count;
+        while(first<last)
+        {
+            quint32 middle=first+(last-first)/2;
+            if(LessThan(ReadEntry(index+(qint64)middle*EntrySize),type,zoom,x,y))
+                first=middle+1;
+            else
+                last=middle;
+        }
+        if(first==count)
+            return false;
+        *entry=ReadEntry(index+(qint64)first*EntrySize);
+        if(entry->type!=type || entry->zoom!=zoom || entry->x!=x || entry->y!=y)
+            return false;
+        return entry->offset+entry->size<=(quint64)dataSize;
+    }
+    QByteArray TilePack::GetImageFromPack(MapType::Types type, Point pos, int zoom)
+    {
+        QReadLocker locker(&lock);
+        Entry entry;
+        if(!Find((int)type,zoom,pos.X(),pos.Y(),&entry))
+            return QByteArray();
+        // A copy, the tile outlives the mapping in the memory cache
+        return QByteArray((const char*)data+entry.offset,entry.size);
+    }
+    bool TilePack::ContainsTile(MapType::Types type, Point pos, int zoom)
+    {
+        QReadLocker locker(&lock);
+        Entry entry;
+        return Find((int)type,zoom,pos.X(),pos.Y(),&entry);
+    }
+
+    bool TilePack::ExportDBToPack(const QString &sourceDB, const QString &destPack)
+    {
+        if(!QFileInfo(sourceDB).exists())
+            return false;
+        bool ret=false;
+        {
+            QSqlDatabase cn=QSqlDatabase::addDatabase("QSQLITE",QLatin1String("TilePackExport"));
+            cn.setDatabaseName(sourceDB);
+            if(cn.open())
+            {
+                // Only the index is kept in memory, tiles are copied one at a time
+                QVector<Entry> entries;
+                QVector<qlonglong> ids;
+                {
+                    QSqlQuery query(cn);
+                    query.setForwardOnly(true);
+                    query.exec("SELECT Tiles.Type, Tiles.Zoom, Tiles.X, Tiles.Y, Tiles.id, length(TilesData.Tile) FROM Tiles JOIN TilesData ON Tiles.id = TilesData.id ORDER BY Tiles.Type, Tiles.Zoom, Tiles.X, Tiles.Y, Tiles.id");
+                    quint64 offset=0;
+                    while(query.next())
+                    {
+                        Entry entry;
+                        entry.type=query.value(0).toInt();
+                        entry.zoom=query.value(1).toInt();
+                        entry.x=query.value(2).toInt();
+                        entry.y=query.value(3).toInt();
+                        entry.size=query.value(5).toUInt();
+                        if(!entries.isEmpty())
+                        {
+                            Entry &previous=entries.last();
+                            if(previous.type==entry.type && previous.zoom==entry.zoom && previous.x==entry.x && previous.y==entry.y)
+                            {
+                                // The same tile cached again later, keep the newest
+                                offset-=previous.size;
+                                entries.remove(entries.count()-1);
+                                ids.remove(ids.count()-1);
+                            }
+                        }
+                        entry.offset=offset;
+                        offset+=entry.size;
+                        entries.append(entry);
+                        ids.append(query.value(4).toLongLong());
+                    }
+                }
+                quint64 dataStart=HeaderSize+(quint64)entries.count()*EntrySize;
+                QByteArray head((int)dataStart,0);
+                uchar *p=(uchar*)head.data();
+                memcpy(p,TilePackMagic,4);
+                qToLittleEndian<quint32>(Version,p+4);
+                qToLittleEndian<quint32>(entries.count(),p+8);
+                for(int i=0;i<entries.count();++i)
+                {
+                    entries[i].offset+=dataStart;
+                    WriteEntry(entries.at(i),p+HeaderSize+i*EntrySize);
+                }
+                QSaveFile out(destPack);
+                if(out.open(QIODevice::WriteOnly) && out.write(head)==head.size())
+                {
+                    ret=true;
+                    QSqlQuery query(cn);
+                    query.setForwardOnly(true);
+                    query.prepare("SELECT Tile FROM TilesData WHERE id = ?");
+                    for(int i=0;i<ids.count() && ret;++i)
+                    {
+                        query.addBindValue(ids.at(i));
+                        ret=query.exec() && query.next();
+                        if(ret)
+                        {
+                            QByteArray tile=query.value(0).toByteArray();
+                            ret=(quint32)tile.size()==entries.at(i).size && out.write(tile)==tile.size();
+                        }
+                        query.finish();
+                    }
+                    ret=ret && out.commit();
+                }
+#ifdef DEBUG_TILEPACK
+                qDebug()<<"ExportDBToPack:"<<entries.count()<<"tiles"<<(ret?"written":"failed");
+#endif //DEBUG_TILEPACK
+                cn.close();
+            }
+        }
+        QSqlDatabase::removeDatabase(QLatin1String("TilePackExport"));
+        return ret;
+    }
+    bool TilePack::ImportPackToDB(const QString &sourcePack, const QString &destDB)
+    {
+        TilePack pack;
+        if(!pack.Open(sourcePack))
+            return false;
+        if(!QFileInfo(destDB).exists() && !PureImageCache::CreateEmptyDB(destDB))
+            return false;
+        bool ret=false;
+        {
+            QSqlDatabase cn=QSqlDatabase::addDatabase("QSQLITE",QLatin1String("TilePackImport"));
+            cn.setDatabaseName(destDB);
+            if(cn.open())
+            {
+                QSqlQuery find(cn);
+                find.setForwardOnly(true);
+                find.prepare("SELECT id FROM Tiles WHERE X=? AND Y=? AND Zoom=? AND Type=?");
+                QSqlQuery insertTile(cn);
+                insertTile.prepare("INSERT INTO Tiles(X, Y, Zoom, Type,Date) VALUES(?, ?, ?, ?,?)");
+                QSqlQuery insertTileData(cn);
+                insertTileData.prepare("INSERT INTO TilesData(id, Tile) VALUES((SELECT last_insert_rowid()), ?)");
+                QString date=QDateTime::currentDateTime().toString();
+                cn.transaction();
+                const uchar *index=pack.data+HeaderSize;
+                for(quint32 i=0;i<pack.count;++i)
+                {
+                    Entry entry=ReadEntry(index+(qint64)i*EntrySize);
+                    if(entry.offset+entry.size>(quint64)pack.dataSize)
+                        continue;
+                    find.addBindValue(entry.x);
+                    find.addBindValue(entry.y);
+                    find.addBindValue(entry.zoom);
+                    find.addBindValue(entry.type);
+                    bool exists=find.exec() && find.next();
+                    find.finish();
+                    if(exists)
+                        continue;
+                    insertTile.addBindValue(entry.x);
+                    insertTile.addBindValue(entry.y);
+                    insertTile.addBindValue(entry.zoom);
+                    insertTile.addBindValue(entry.type);
+                    insertTile.addBindValue(date);
+                    if(insertTile.exec())
+                    {
+                        insertTileData.addBindValue(QByteArray((const char*)pack.data+entry.offset,entry.size));
+                        insertTileData.exec();
+                    }
+                }
+                ret=cn.commit();
+#ifdef DEBUG_TILEPACK
+                qDebug()<<"ImportPackToDB:"<<pack.count<<"tiles"<<(ret?"imported":"failed");
+#endif //DEBUG_TILEPACK
+                cn.close();
+            }
+        }
+        QSqlDatabase::removeDatabase(QLatin1String("TilePackImport"));
+        return ret;
+    }
+
+}
@@ -0,0 +1,101 @@
+/**
+******************************************************************************
+*
+* @file       tilepack.h
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      Read only, memory mapped tile pack for offline use
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#ifndef TILEPACK_H
+#define TILEPACK_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QReadWriteLock>
+#include "maptype.h"
+#include "point.h"
+
+namespace core {
+    /**
+    * A file of tiles for offline use, written once from a tile database and
+    * then only read.
+    *
+    * The file starts with a header, then an index of every tile sorted by
+    * type, zoom, x and y, then the tiles themselves one after the other. It
+    * is memory mapped while open, so a lookup is a binary search of the index
+    * and a copy of the tile, without any file or SQL access.
+    *
+    * All numbers are little endian:
+    *   header: "OPTP", version, tile count, reserved (4 x 4 bytes)
+    *   index entry: type, zoom, x, y, reserved (5 x 4 bytes), offset (8 bytes), size (4 bytes)
+    */
+    class TilePack
+    {
+    public:
+        TilePack();
+        ~TilePack();
+        /**
+        * Map a pack file, replacing the one open
+        *
+        * @return false if it could not be opened or is not a valid pack
+        */
+        bool Open(const QString &file);
+        void Close();
+        bool IsOpen();
+        QString FileName();
+        int TileCount();
+        /** The tile, or an empty array if it is not in the pack */
+        QByteArray GetImageFromPack(MapType::Types type, core::Point pos, int zoom);
+        bool ContainsTile(MapType::Types type, core::Point pos, int zoom);
+
+        /** Write every tile of a tile database into a new pack file, the newest where there are several */
+        static bool ExportDBToPack(const QString &sourceDB, const QString &destPack);
+        /** Add the tiles of a pack to a tile database, which is created if needed. Only new tiles are added. */
+        static bool ImportPackToDB(const QString &sourcePack, const QString &destDB);
+    private:
+        static const quint32 Version=1;
+        static const int HeaderSize=16;
+        static const int EntrySize=32;
+        class Entry
+        {
+        public:
+            qint32 type;
+            qint32 zoom;
+            qint32 x;
+            qint32 y;
+            quint64 offset;
+            quint32 size;
+        };
+        static Entry ReadEntry(const uchar *data);
+        static void WriteEntry(const Entry &entry, uchar *data);
+        static bool LessThan(const Entry &entry, qint32 type, qint32 zoom, qint32 x, qint32 y);
+        /** Find a tile, lock must be held */
+        bool Find(qint32 type, qint32 zoom, qint32 x, qint32 y, Entry *entry);
+        QFile file;
+        uchar *data;
+        qint64 dataSize;
+        quint32 count;
+        QReadWriteLock lock;
+    };
+
+}
+#endif // TILEPACK_H
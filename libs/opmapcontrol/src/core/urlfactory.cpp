@@ -44,6 +44,7 @@ namespace core {
         UserAgent = QString("Mozilla/5.0 (Windows NT 6.1; WOW64; rv:%1.0) Gecko/%2%3%4 Firefox/%5.0.%6").arg(QString::number(Random(3,14)), QString::number(Random(QDate().currentDate().year() - 4, QDate().currentDate().year())), QString::number(Random(11,12)), QString::number(Random(10,30)), QString::number(Random(3,14)), QString::number(Random(1,10))).toLatin1();
 
         Timeout = 5 * 1000;
+        TileServerOverride = QString::fromLocal8Bit(qgetenv("OPMAP_TILE_SERVER"));
         CorrectGoogleVersions=true;
         isCorrectedGoogleVersions = false;
         UseGeocoderCache=true;
@@ -179,6 +180,11 @@ namespace core {
 #ifdef DEBUG_URLFACTORY
         qDebug()<<"Entered MakeImageUrl";
 #endif //DEBUG_URLFACTORY
+        if(!TileServerOverride.isEmpty())
+        {
+            QString url=TileServerOverride;
+            return url.replace("{type}",QString::number((int)type)).replace("{zoom}",QString::number(zoom)).replace("{x}",QString::number(pos.X())).replace("{y}",QString::number(pos.Y()));
+        }
         switch(type)
         {
         case MapType::GoogleMap:
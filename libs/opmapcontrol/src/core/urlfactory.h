@@ -59,6 +59,12 @@ namespace core {
         internals::PointLatLng GetLatLngFromGeodecoder(const QString &keywords,GeoCoderStatusCode::Types &status);
         Placemark GetPlacemarkFromGeocoder(internals::PointLatLng location);
         int Timeout;
+        /// <summary>
+        /// Tile server used instead of the map providers, for testing against a local server.
+        /// {type}, {zoom}, {x} and {y} are replaced, e.g. "http://localhost:8080/{type}/{zoom}/{x}/{y}.png".
+        /// Empty for the providers. Set from the OPMAP_TILE_SERVER environment variable.
+        /// </summary>
+        QString TileServerOverride;
     private:
         int Random(int low, int high);
         void GetSecGoogleWords(const core::Point &pos,  QString &sec1, QString &sec2);
@@ -44,15 +44,24 @@ namespace internals {
     zoom(0),
     isDragging(false),
     TooltipTextPadding(10,10),
-    loaderLimit(5),
+    loaderLimit(10),
     maxzoom(21),
     runningThreads(0),
+    tilesCancelled(0),
+    tilesLoaded(0),
+    loadLatencyTotal(0),
+    loadLatencyMax(0),
+    viewLoadStart(-1),
+    viewLoadTime(0),
     started(false)
     {
         mousewheelzoomtype=MouseWheelZoomType::MousePositionAndCenter;
         SetProjection(new MercatorProjection());
         this->setAutoDelete(false);
+        // Tiles found in a cache load as fast as there are threads, network
+        // fetches are limited separately by OPMaps::NetworkConcurrency
         ProcessLoadTaskCallback.setMaxThreadCount(10);
+        loadClock.start();
         renderOffset=Point(0,0);
         dragPoint=Point(0,0);
         CanDragMap=true;
@@ -84,7 +93,7 @@ namespace internals {
         {
             if(tileLoadQueue.count() > 0)
             {
-                task = tileLoadQueue.dequeue();
+                task = TakeNextLoadTask();
                 {
 
                     last = (tileLoadQueue.count() == 0);
@@ -96,8 +105,7 @@ namespace internals {
         }
         MtileLoadQueue.unlock();
 
-        if(task.HasValue())
-            if(loaderLimit.tryAcquire(1,OPMaps::Instance()->Timeout))
+        if(task.HasValue() && loaderLimit.tryAcquire(1,OPMaps::Instance()->Timeout))
             {
             MtileToload.lock();
             --tilesToload;
@@ -125,6 +133,15 @@ namespace internals {
 
                         foreach(MapType::Types tl,layers)
                         {
+                            // decoded before, no need to fetch it again
+                            QImage decoded;
+                            if(OPMaps::Instance()->DecodedTiles.GetTile(RawTile(tl, task.Pos, task.Zoom), &decoded))
+                            {
+                                Moverlays.lock();
+                                t->Overlays.append(decoded);
+                                Moverlays.unlock();
+                                continue;
+                            }
                             int retry = 0;
                             do
                             {
@@ -146,11 +163,15 @@ namespace internals {
 #endif //DEBUG_CORE
                                 }
 
+                                // decode here rather than when painting
                                 if(img.length()!=0)
+                                    decoded = DecodedTileCache::Decode(img);
+                                if(!decoded.isNull())
                                 {
+                                    OPMaps::Instance()->DecodedTiles.AddTile(RawTile(tl, task.Pos, task.Zoom), decoded);
                                     Moverlays.lock();
                                     {
-                                        t->Overlays.append(img);
+                                        t->Overlays.append(decoded);
 #ifdef DEBUG_CORE
                                         qDebug()<<"Core::run append img:"<<img.length()<<" to tile:"<<t->GetPos().ToString()<<" now has "<<t->Overlays.count()<<" overlays"<<" ID="<<debug;
 #endif //DEBUG_CORE
@@ -181,6 +202,14 @@ namespace internals {
                             Matrix.SetTileAt(task.Pos,t);
                             emit OnNeedInvalidation();
 
+                            int latency = (int)(loadClock.elapsed() - task.Queued);
+                            MloadStats.lock();
+                            ++tilesLoaded;
+                            loadLatencyTotal += latency;
+                            if(latency > loadLatencyMax)
+                                loadLatencyMax = latency;
+                            MloadStats.unlock();
+
 #ifdef DEBUG_CORE
                             qDebug()<<"Core::run add tile "<<t->GetPos().ToString()<<" to matrix index "<<task.Pos.ToString()<<" ID="<<debug;
                             qDebug()<<"Core::run matrix index "<<task.Pos.ToString()<<" as tile with "<<Matrix.TileAt(task.Pos)->Overlays.count()<<" ID="<<debug;
@@ -200,31 +229,6 @@ namespace internals {
                 }
 
 
-                {
-                    // last buddy cleans stuff ;}
-                    if(last)
-                    {
-                        OPMaps::Instance()->kiberCacheLock.lockForWrite();
-                        OPMaps::Instance()->TilesInMemory.RemoveMemoryOverload();
-                        OPMaps::Instance()->kiberCacheLock.unlock();
-
-                        MtileDrawingList.lock();
-                        {
-                            Matrix.ClearPointsNotIn(tileDrawingList);
-                        }
-                        MtileDrawingList.unlock();
-
-
-                        emit OnTileLoadComplete();
-
-
-                        emit OnNeedInvalidation();
-
-                    }
-                }
-
-
-
             }
 #ifdef DEBUG_CORE
             qDebug()<<"loaderLimit release:"+loaderLimit.available()<<" ID="<<debug;
@@ -232,6 +236,38 @@ namespace internals {
             emit OnTilesStillToLoad(tilesToload<0? 0:tilesToload);
             loaderLimit.release();
         }
+        else if(last)
+        {
+            // nothing loaded, but the stale tasks TakeNextLoadTask dropped still changed the count
+            emit OnTilesStillToLoad(tilesToload<0? 0:tilesToload);
+        }
+
+        // last buddy cleans stuff ;}
+        // also when the queue only held stale tasks and there was nothing left to load
+        if(last)
+        {
+            OPMaps::Instance()->kiberCacheLock.lockForWrite();
+            OPMaps::Instance()->TilesInMemory.RemoveMemoryOverload();
+            OPMaps::Instance()->kiberCacheLock.unlock();
+
+            MtileDrawingList.lock();
+            {
+                Matrix.ClearPointsNotIn(tileDrawingList);
+            }
+            MtileDrawingList.unlock();
+
+            MloadStats.lock();
+            if(viewLoadStart >= 0)
+            {
+                viewLoadTime = (int)(loadClock.elapsed() - viewLoadStart);
+                viewLoadStart = -1;
+            }
+            MloadStats.unlock();
+
+            emit OnTileLoadComplete();
+
+            emit OnNeedInvalidation();
+        }
         MrunningThreads.lock();
         --runningThreads;
         MrunningThreads.unlock();
@@ -242,6 +278,12 @@ namespace internals {
         diag=OPMaps::Instance()->GetDiagnostics();
         diag.runningThreads=runningThreads;
         MrunningThreads.unlock();
+        MloadStats.lock();
+        diag.tilesCancelled=tilesCancelled;
+        diag.loadLatencyAverage=tilesLoaded>0? (int)(loadLatencyTotal/tilesLoaded):0;
+        diag.loadLatencyMax=loadLatencyMax;
+        diag.viewLoadTime=viewLoadTime;
+        MloadStats.unlock();
         return diag;
     }
 
@@ -256,6 +298,10 @@ namespace internals {
             if(started)
             {
                 MtileLoadQueue.lock();
+                MloadStats.lock();
+                tilesCancelled += tileLoadQueue.count();
+                viewLoadStart = -1;
+                MloadStats.unlock();
                 tileLoadQueue.clear();
                 MtileLoadQueue.unlock();
                 MtileToload.lock();
@@ -635,10 +681,36 @@ namespace internals {
 
             emit OnTileLoadStart();
 
+            // tiles that went out of view before they were loaded are not needed anymore
+            MtileLoadQueue.lock();
+            {
+                int cancelled = 0;
+                for(int i = tileLoadQueue.count() - 1; i >= 0; --i)
+                {
+                    if(tileLoadQueue.at(i).Zoom != Zoom() || !tileDrawingList.contains(tileLoadQueue.at(i).Pos))
+                    {
+                        tileLoadQueue.removeAt(i);
+                        ++cancelled;
+                    }
+                }
+                if(cancelled > 0)
+                {
+                    MtileToload.lock();
+                    tilesToload -= cancelled;
+                    MtileToload.unlock();
+                    MloadStats.lock();
+                    tilesCancelled += cancelled;
+                    MloadStats.unlock();
+#ifdef DEBUG_CORE
+                    qDebug()<<"Core::UpdateBounds cancelled"<<cancelled<<"tasks out of view";
+#endif //DEBUG_CORE
+                }
+            }
+            MtileLoadQueue.unlock();
 
             foreach(Point p,tileDrawingList)
             {
-                LoadTask task = LoadTask(p, Zoom());
+                LoadTask task = LoadTask(p, Zoom(), loadClock.elapsed());
                 {
                     MtileLoadQueue.lock();
                     {
@@ -647,6 +719,10 @@ namespace internals {
                             MtileToload.lock();
                             ++tilesToload;
                             MtileToload.unlock();
+                            MloadStats.lock();
+                            if(viewLoadStart < 0)
+                                viewLoadStart = task.Queued;
+                            MloadStats.unlock();
                             tileLoadQueue.enqueue(task);
 #ifdef DEBUG_CORE
                             qDebug()<<"Core::UpdateBounds new Task"<<task.Pos.ToString();
@@ -694,6 +770,46 @@ namespace internals {
         }
 
 
+    }
+    LoadTask Core::TakeNextLoadTask()
+    {
+        Point center = centerTileXYLocation;
+        int best = -1;
+        qint64 bestDistance = 0;
+        int dropped = 0;
+        for(int i = tileLoadQueue.count() - 1; i >= 0; --i)
+        {
+            const LoadTask &task = tileLoadQueue.at(i);
+            if(task.Zoom != zoom)
+            {
+                tileLoadQueue.removeAt(i);
+                ++dropped;
+                if(best > i)
+                    --best;
+                continue;
+            }
+            qint64 dx = task.Pos.X() - center.X();
+            qint64 dy = task.Pos.Y() - center.Y();
+            qint64 distance = dx * dx + dy * dy;
+            // ties go to the oldest task
+            if(best < 0 || distance <= bestDistance)
+            {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        if(dropped > 0)
+        {
+            MtileToload.lock();
+            tilesToload -= dropped;
+            MtileToload.unlock();
+            MloadStats.lock();
+            tilesCancelled += dropped;
+            MloadStats.unlock();
+        }
+        if(best < 0)
+            return LoadTask();
+        return tileLoadQueue.takeAt(best);
     }
     void Core::UpdateGroundResolution()
     {
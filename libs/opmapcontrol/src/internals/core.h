@@ -54,6 +54,7 @@
 #include <QSemaphore>
 #include <QThread>
 #include <QDateTime>
+#include <QElapsedTimer>
 
 #include <QObject>
 
@@ -185,6 +186,11 @@ namespace internals {
         void CancelAsyncTasks();
 
         void FindTilesAround(QList<core::Point> &list);
+        /**
+        * Take the queued task closest to the center of the view. Tasks for
+        * another zoom are dropped. MtileLoadQueue must be held.
+        */
+        LoadTask TakeNextLoadTask();
 
         void UpdateGroundResolution();
 
@@ -263,6 +269,15 @@ namespace internals {
         int runningThreads;
         diagnostics diag;
 
+        QElapsedTimer loadClock;
+        QMutex MloadStats;
+        int tilesCancelled;
+        int tilesLoaded;
+        qint64 loadLatencyTotal;
+        int loadLatencyMax;
+        qint64 viewLoadStart; // -1 while no tiles are waiting
+        int viewLoadTime;
+
     protected:
         bool started;
 
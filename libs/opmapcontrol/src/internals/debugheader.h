@@ -4,5 +4,6 @@
 //#define DEBUG_CORE
 //#define DEBUG_TILE
 //#define DEBUG_TILEMATRIX
+//#define DEBUG_MAPRIPPER
 
 #endif // DEBUGHEADER_H
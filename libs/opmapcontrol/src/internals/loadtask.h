@@ -39,17 +39,20 @@ struct LoadTask
   public:
     core::Point Pos;
     int Zoom;
+    qint64 Queued; // time it was queued, in milliseconds of the core's load clock
 
 
-    LoadTask(Point pos, int zoom)
+    LoadTask(Point pos, int zoom, qint64 queued=0)
      {
         Pos = pos;
         Zoom = zoom;
+        Queued = queued;
     }
     LoadTask()
     {
         Pos=core::Point(-1,-1);
         Zoom=-1;
+        Queued=0;
     }
     bool HasValue()
     {
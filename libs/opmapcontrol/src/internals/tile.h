@@ -53,7 +53,8 @@ public:
         this->pos=cSource.pos;
     }
     bool HasValue(){return !(zoom==0);}
-    QList<QByteArray> Overlays;
+    /** Decoded images of the tile, one per layer */
+    QList<QImage> Overlays;
 protected:
 
     QMutex mutex;
@@ -27,6 +27,7 @@
 
 #include "mapripform.h"
 #include "ui_mapripform.h"
+#include <QTime>
 
 MapRipForm::MapRipForm(QWidget *parent) :
     QWidget(parent),
@@ -64,6 +65,19 @@ void MapRipForm::SetNumberOfTiles(const int &total, const int &actual)
     ui->statuslabel->setText(QString("Downloading tile: %1 of %2").arg(actual).arg(total));
 }
 
+void MapRipForm::SetRate(const double &tilesPerSecond, const int &secondsLeft)
+{
+    QString eta=QTime(0,0).addSecs(secondsLeft).toString("hh:mm:ss");
+    if(secondsLeft>=24*3600)
+        eta=QString("%1d %2").arg(secondsLeft/(24*3600)).arg(eta);
+    ui->lblRate->setText(QString("%1 tiles/s, %2 left").arg(tilesPerSecond,0,'f',1).arg(eta));
+}
+
+void MapRipForm::SetFailedTiles(const int &failed)
+{
+    ui->lblFailed->setText(QString("Failed tiles: %1").arg(failed));
+}
+
 void MapRipForm::on_rdoBtn_singleLayer_clicked()
 {
     emit shouldAutoRip(false);
@@ -46,6 +46,8 @@ public slots:
     void SetPercentage(int const& perc);
     void SetProvider(QString const& prov,int const& zoom);
     void SetNumberOfTiles(int const& total,int const& actual);    
+    void SetRate(double const& tilesPerSecond,int const& secondsLeft);
+    void SetFailedTiles(int const& failed);
 
 signals:
     void beginRip();
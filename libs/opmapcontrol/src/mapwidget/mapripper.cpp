@@ -31,19 +31,56 @@
 #include <QScreen>
 #include <QCursor>
 #include <QDebug>
+#include <QFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutexLocker>
 
 namespace mapcontrol
 {
 
-MapRipper::MapRipper(internals::Core * core, const internals::RectLatLng & rect):sleep(100),cancel(false),progressForm(0),core(core)
+class MapRipper::RipTask:public QRunnable
 {
-    if(!rect.IsEmpty())
+public:
+    RipTask(MapRipper *ripper,int index,bool retry):ripper(ripper),index(index),retry(retry){}
+    void run()
+    {
+        ripper->RipTile(index,retry);
+        ripper->taskSlots.release();
+    }
+private:
+    MapRipper *ripper;
+    int index;
+    bool retry;
+};
+
+MapRipper::MapRipper(internals::Core * core, const internals::RectLatLng & rect):sleep(100),cancel(false),progressForm(0),core(core),shouldAutoRip(false),
+    taskSlots(Concurrency*2),startIndex(0),doneCount(0),runStartCount(0),skippedCount(0),failedCount(0),failedZoom(-1),failedIndex(0)
+{
+    type=core->GetMapType();
+    maxzoom=core->MaxZoom();
+    bool resume=rect.IsEmpty() && HasSavedJob(type);
+    if(resume)
+    {
+        QSettings job(JobFile(),QSettings::IniFormat);
+        job.beginGroup("MapRipper");
+        area=internals::RectLatLng(job.value("Lat").toDouble(),job.value("Lng").toDouble(),job.value("WidthLng").toDouble(),job.value("HeightLat").toDouble());
+        zoom=job.value("Zoom").toInt();
+        startIndex=job.value("Index").toInt();
+        shouldAutoRip=job.value("AutoRip").toBool();
+        job.endGroup();
+#ifdef DEBUG_MAPRIPPER
+        qDebug()<<"MapRipper: resuming zoom level"<<zoom<<"from tile"<<startIndex;
+#endif //DEBUG_MAPRIPPER
+    }
+    if(!rect.IsEmpty() || resume)
     {
-        type=core->GetMapType();
         progressForm=new MapRipForm;
-        area=rect;
-        zoom=core->Zoom();
-        maxzoom=core->MaxZoom();
+        if(!resume)
+        {
+            area=rect;
+            zoom=core->Zoom();
+        }
         points=core->Projection()->GetAreaTileList(area,zoom,0);
         progressForm->show();
 
@@ -53,6 +90,8 @@ MapRipper::MapRipper(internals::Core * core, const internals::RectLatLng & rect)
         connect(this,SIGNAL(percentageChanged(int)),progressForm,SLOT(SetPercentage(int)));
         connect(this,SIGNAL(numberOfTilesChanged(int,int)),progressForm,SLOT(SetNumberOfTiles(int,int)));
         connect(this,SIGNAL(providerChanged(QString,int)),progressForm,SLOT(SetProvider(QString,int)));
+        connect(this,SIGNAL(rateChanged(double,int)),progressForm,SLOT(SetRate(double,int)));
+        connect(this,SIGNAL(failedTilesChanged(int)),progressForm,SLOT(SetFailedTiles(int)));
         connect(this,SIGNAL(finished()),this,SLOT(finish()));
         emit numberOfTilesChanged(0,0);
 
@@ -93,6 +132,7 @@ void MapRipper::finish()
     if(zoom<maxzoom && cancel==false)
     {
         ++zoom;
+        startIndex=0;
 
         if (shouldAutoRip == true && (zoom <= progressForm->maxAutoRipZoom))
         {
@@ -103,60 +143,219 @@ void MapRipper::finish()
             {
                 this->doRip();
             }else{
+                if(failedZoom<0)
+                    this->RemoveJob();
                 this->stopRipping();
             }
         }
     }
     else
     {
+        // A cancelled job, or one that left tiles missing, is kept to be resumed
+        if(!cancel && failedZoom<0)
+            this->RemoveJob();
         this->stopRipping();
     }
 }
 
 void MapRipper::run()
 {
-    int countOk = 0;
-    bool goodtile=false;
-    //  Stuff.Shuffle<Point>(ref list);
-    QVector<core::MapType::Types> types = OPMaps::Instance()->GetAllLayersOfType(type);
+    types = OPMaps::Instance()->GetAllLayersOfType(type);
     int all=points.count();
-    for(int i = 0; i < all; i++)
+    progressLock.lock();
+    startIndex=qBound(0,startIndex,all);
+    done.fill(false,all);
+    done.fill(true,0,startIndex);
+    doneCount=startIndex;
+    runStartCount=startIndex;
+    skippedCount=0;
+    failedCount=0;
+    progressLock.unlock();
+
+    QStringList providers;
+    foreach(core::MapType::Types t,types)
+        providers.append(core::MapType::StrByType(t));
+    emit providerChanged(providers.join(", "),zoom);
+    ReportProgress();
+
+    // A bounded number of tiles is queued, so the pool never holds the whole area
+    QThreadPool pool;
+    pool.setMaxThreadCount(Concurrency);
+    rateTimer.start();
+    QElapsedTimer reportTimer;
+    reportTimer.start();
+    for(int i = runStartCount; i < all && !cancel; i++)
     {
-        emit numberOfTilesChanged(all,i+1);
-        if(cancel)
-            break;
+        taskSlots.acquire();
+        pool.start(new RipTask(this,i,false));
+        if(reportTimer.elapsed()>=1000)
+        {
+            ReportProgress();
+            SaveJob();
+            reportTimer.restart();
+        }
+    }
+    pool.waitForDone();
 
-        core::Point p = points[i];
+    // Failed tiles get another go once the rest of the level is done, before the zoom advances
+    for(int pass=0;pass<RetryPasses && !cancel;pass++)
+    {
+        QList<int> failed;
+        progressLock.lock();
+        for(int i=runStartCount;i<all;i++)
         {
-            //qDebug()<<"offline fetching:"<<p.ToString();
-            foreach(core::MapType::Types type,types)
-            {
-                emit providerChanged(core::MapType::StrByType(type),zoom);
-                QByteArray img = OPMaps::Instance()->GetImageFrom(type, p, zoom);
-                if(img.length()!=0)
-                {
-                    goodtile=true;
-                    img=NULL;
-                }
-                else
-                    goodtile=false;
-            }
-            if(goodtile)
-            {
-                countOk++;
-            }
-            else
-            {
-                i--;
-                QThread::msleep(1000);
-                continue;
-            }
+            if(!done.testBit(i))
+                failed.append(i);
         }
-        emit percentageChanged((int) ((i+1)*100/all));//, i+1);
-        // worker.ReportProgress((int) ((i+1)*100/all), i+1);
+        progressLock.unlock();
+        if(failed.isEmpty())
+            break;
+        ReportProgress();
+        foreach(int i,failed)
+        {
+            if(cancel)
+                break;
+            taskSlots.acquire();
+            pool.start(new RipTask(this,i,true));
+        }
+        pool.waitForDone();
+    }
+    ReportProgress();
 
+    progressLock.lock();
+    if(failedCount>0 && !cancel && failedZoom<0)
+    {
+        // The job stays at this level, so resuming fetches the missing tiles first
+        failedZoom=zoom;
+        failedIndex=startIndex;
+    }
+    progressLock.unlock();
+    SaveJob();
+#ifdef DEBUG_MAPRIPPER
+    if(failedCount>0)
+        qDebug()<<"MapRipper:"<<failedCount<<"tiles could not be fetched at zoom level"<<zoom;
+#endif //DEBUG_MAPRIPPER
+}
+
+void MapRipper::RipTile(int index,bool retry)
+{
+    core::Point p = points.at(index);
+    bool goodtile=true;
+    bool fetched=false;
+    foreach(core::MapType::Types t,types)
+    {
+        if(IsCached(t,p))
+            continue;
+        QByteArray img;
+        for(int attempt=0;attempt<Retries && img.isEmpty() && !cancel;attempt++)
+        {
+            if(attempt>0)
+                QThread::msleep(1000*attempt);
+            img = OPMaps::Instance()->GetImageFrom(t, p, zoom);
+        }
+        if(img.isEmpty())
+            goodtile=false;
+        else
+            fetched=true;
+    }
+    if(fetched)
         QThread::msleep(sleep);
+
+    QMutexLocker locker(&progressLock);
+    if(!goodtile)
+    {
+        // Left out of the job's progress, so it is tried again on resume
+        if(!retry)
+            failedCount++;
+        return;
+    }
+    if(retry)
+        failedCount--;
+    done.setBit(index);
+    doneCount++;
+    if(!fetched)
+        skippedCount++;
+    while(startIndex<done.size() && done.testBit(startIndex))
+        startIndex++;
+}
+
+bool MapRipper::IsCached(core::MapType::Types type,const core::Point &pos)
+{
+    return core::Cache::Instance()->ImagePack.ContainsTile(type,pos,zoom) ||
+           core::Cache::Instance()->ImageCache.ContainsTile(type,pos,zoom);
+}
+
+void MapRipper::ReportProgress()
+{
+    progressLock.lock();
+    int all=done.size();
+    int actual=doneCount;
+    int processed=doneCount-runStartCount;
+    int failed=failedCount;
+    progressLock.unlock();
+
+    emit numberOfTilesChanged(all,actual);
+    emit percentageChanged(all>0 ? (int)((qint64)actual*100/all) : 100);
+    double seconds=rateTimer.isValid() ? rateTimer.elapsed()/1000.0 : 0;
+    double rate=seconds>0 ? processed/seconds : 0;
+    emit rateChanged(rate,rate>0 ? (int)((all-actual)/rate) : 0);
+    emit failedTilesChanged(failed);
+}
+
+QString MapRipper::JobFile()
+{
+    return core::Cache::Instance()->CacheLocation()+"MapRipJob.ini";
+}
+
+bool MapRipper::HasSavedJob(core::MapType::Types type)
+{
+    if(!QFile::exists(JobFile()))
+        return false;
+    QSettings job(JobFile(),QSettings::IniFormat);
+    return job.value("MapRipper/Type",-1).toInt()==(int)type;
+}
+
+int MapRipper::SavedJobTilesLeft(internals::Core *core,int *zoom)
+{
+    if(!HasSavedJob(core->GetMapType()))
+        return -1;
+    QSettings job(JobFile(),QSettings::IniFormat);
+    job.beginGroup("MapRipper");
+    internals::RectLatLng jobarea(job.value("Lat").toDouble(),job.value("Lng").toDouble(),job.value("WidthLng").toDouble(),job.value("HeightLat").toDouble());
+    *zoom=job.value("Zoom").toInt();
+    int index=job.value("Index").toInt();
+    job.endGroup();
+    // the same tile list a resumed rip walks
+    return qMax(0,core->Projection()->GetAreaTileList(jobarea,*zoom,0).count()-index);
+}
+
+void MapRipper::SaveJob()
+{
+    progressLock.lock();
+    int savedzoom=zoom;
+    int index=startIndex;
+    if(failedZoom>=0)
+    {
+        savedzoom=failedZoom;
+        index=failedIndex;
     }
+    progressLock.unlock();
+    QSettings job(JobFile(),QSettings::IniFormat);
+    job.beginGroup("MapRipper");
+    job.setValue("Type",(int)type);
+    job.setValue("Lat",area.Lat());
+    job.setValue("Lng",area.Lng());
+    job.setValue("WidthLng",area.WidthLng());
+    job.setValue("HeightLat",area.HeightLat());
+    job.setValue("Zoom",savedzoom);
+    job.setValue("Index",index);
+    job.setValue("AutoRip",shouldAutoRip);
+    job.endGroup();
+}
+
+void MapRipper::RemoveJob()
+{
+    QFile::remove(JobFile());
 }
 
 void MapRipper::doRip()
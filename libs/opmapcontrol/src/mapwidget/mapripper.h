@@ -28,23 +28,53 @@
 #define MAPRIPPER_H
 
 #include <QThread>
+#include <QMutex>
+#include <QBitArray>
+#include <QSemaphore>
+#include <QElapsedTimer>
 #include "../internals/core.h"
 #include "mapripform.h"
 #include <QObject>
 #include <QMessageBox>
 namespace mapcontrol
 {
+    /**
+    * Downloads every tile of an area to the cache, one zoom level after the other.
+    *
+    * A few tiles are fetched at once, and tiles already in the cache or the tile
+    * pack are skipped. Fetched tiles are checked to be images before they are
+    * queued for the cache, which writes them in batches. Tiles that still fail are
+    * tried again once the rest of the level is done. Progress is saved to a job
+    * file in the cache location, so ripping that was cancelled, interrupted or
+    * left tiles missing can be resumed where it stopped.
+    */
     class MapRipper:public QThread
     {
         Q_OBJECT
     public:
+        /** Rip an area. With an empty area the saved job is resumed. */
         MapRipper(internals::Core *,internals::RectLatLng const&);
         void run();
         void moveFormToCenter();
         void doRip();
+        /** Whether a job of this map type was saved, to be resumed */
+        static bool HasSavedJob(core::MapType::Types type);
+        /** Tiles the saved job of the core's map type has left at the zoom level it stopped on, or -1 without one */
+        static int SavedJobTilesLeft(internals::Core *core,int *zoom);
 
     private:
+        class RipTask;
+        static const int Concurrency=4;
+        static const int Retries=3;
+        static const int RetryPasses=2;
+        static QString JobFile();
+        void RipTile(int index,bool retry);
+        bool IsCached(core::MapType::Types type,core::Point const& pos);
+        void ReportProgress();
+        void SaveJob();
+        void RemoveJob();
         QList<core::Point> points;
+        QVector<core::MapType::Types> types;
         int zoom;
         core::MapType::Types type;
         int sleep;
@@ -55,11 +85,24 @@ namespace mapcontrol
         internals::Core * core;
         bool shouldAutoRip;
         int openMessageBox();
+        QSemaphore taskSlots;
+        QMutex progressLock;
+        QBitArray done;
+        int startIndex;     ///< Tiles before this one are all done
+        int doneCount;
+        int runStartCount;
+        int skippedCount;
+        int failedCount;
+        int failedZoom;     ///< Lowest zoom level left with failed tiles, or -1
+        int failedIndex;    ///< First failed tile of failedZoom
+        QElapsedTimer rateTimer;
 
     signals:
         void percentageChanged(int const& perc);
         void numberOfTilesChanged(int const& total,int const& actual);
         void providerChanged(QString const& prov,int const& zoom);
+        void rateChanged(double const& tilesPerSecond,int const& secondsLeft);
+        void failedTilesChanged(int const& failed);
 
     public slots:
         void finish();
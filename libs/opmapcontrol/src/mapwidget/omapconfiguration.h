@@ -146,6 +146,29 @@ public:
     */
     void SetTileMemorySize(int const& value){core::OPMaps::Instance()->TilesInMemory.setMemoryCacheCapacity(value);}
 
+    /**
+    * @brief  Returns the currently used memory for decoded tiles
+    *
+    * @return
+    */
+    double DecodedTileMemoryUsed()const{return core::OPMaps::Instance()->DecodedTiles.Size();}
+
+    /**
+    * @brief  Sets the size of the memory for decoded tiles, least recently drawn tiles are dropped first
+    *
+    * @param  value size in Mb to use for decoded tiles
+    * @return
+    */
+    void SetDecodedTileMemorySize(int const& value){core::OPMaps::Instance()->DecodedTiles.setCapacity(value);}
+
+    /**
+    * @brief  Sets how many tiles are downloaded at the same time, tiles found in a cache are not limited by this
+    *
+    * @param  value number of downloads
+    * @return
+    */
+    void SetNetworkConcurrency(int const& value){core::OPMaps::Instance()->setNetworkConcurrency(value);}
+
     /**
     * @brief Sets the location for the SQLite Database used for caching and the geocoding cache files
     *
@@ -173,6 +196,44 @@ public:
     * @return
     */
     void ExportMapDataToDB(QString const& sourceDB, QString const& destDB)const{core::PureImageCache::ExportMapDataToDB(sourceDB,destDB);}
+    /**
+    * @brief Opens a tile pack, tiles are read from it ahead of the cache database
+    *
+    * @param file the tile pack, an empty string closes the one open
+    * @return false if the file could not be opened or is not a tile pack
+    */
+    bool SetTilePack(QString const& file)
+    {
+        if(file.isEmpty())
+        {
+            core::Cache::Instance()->ImagePack.Close();
+            return true;
+        }
+        return core::Cache::Instance()->ImagePack.Open(file);
+    }
+    /**
+    * @brief Returns the tile pack open, empty if there is none
+    *
+    * @return
+    */
+    QString TilePackFile(){return core::Cache::Instance()->ImagePack.FileName();}
+
+    /**
+    * @brief  Writes the tiles of the cache database to a new tile pack
+    *
+    * @param file the tile pack to create
+    * @return
+    */
+    bool ExportCacheToTilePack(QString const& file){return core::OPMaps::Instance()->ExportToTilePack(file);}
+
+    /**
+    * @brief  Adds the tiles of a tile pack to the cache database. Only new tiles are added.
+    *
+    * @param file the tile pack
+    * @return
+    */
+    bool ImportTilePackToCache(QString const& file){return core::OPMaps::Instance()->ImportFromTilePack(file);}
+
     /**
     * @brief Returns the location for the SQLite Database used for caching and the geocoding cache files
     *
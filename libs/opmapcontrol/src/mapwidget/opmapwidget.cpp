@@ -458,6 +458,17 @@ namespace mapcontrol
     {
         new MapRipper(core,map->SelectedArea());
     }
+    bool OPMapWidget::ResumeRipMap()
+    {
+        if(!MapRipper::HasSavedJob(core->GetMapType()))
+            return false;
+        new MapRipper(core,internals::RectLatLng::Empty);
+        return true;
+    }
+    int OPMapWidget::SavedRipTilesLeft(int *zoom)
+    {
+        return MapRipper::SavedJobTilesLeft(core,zoom);
+    }
 
 
 #define deg_to_rad          ((double)M_PI / 180.0)
@@ -511,6 +511,21 @@ namespace mapcontrol
         */
         void RipMap();
 
+        /**
+        * @brief Resumes ripping where a cancelled rip of the current map type stopped
+        *
+        * @return false if there is no such rip to resume
+        */
+        bool ResumeRipMap();
+
+        /**
+        * @brief Tiles a cancelled rip of the current map type has left at the zoom level it stopped on
+        *
+        * @param zoom set to that zoom level
+        * @return -1 if there is no such rip to resume
+        */
+        int SavedRipTilesLeft(int *zoom);
+
         /**
         * @brief Sets the map zoom level
         */
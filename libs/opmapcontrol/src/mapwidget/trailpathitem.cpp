@@ -0,0 +1,215 @@
+/**
+******************************************************************************
+*
+* @file       trailpathitem.cpp
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      A graphicsItem representing the trail of a UAV
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#include "trailpathitem.h"
+#include "mapgraphicitem.h"
+#include <QStack>
+#include <QPair>
+#include <qmath.h>
+namespace mapcontrol
+{
+    const double TrailPathItem::BaseTolerance=1.0;
+
+    TrailPathItem::TrailPathItem(MapGraphicItem* map):QGraphicsItem(map),map(map),tailStart(0),tolerance(BaseTolerance),color(Qt::red),showline(true),showdots(true)
+    {
+    }
+
+    void TrailPathItem::AddPoint(const internals::PointLatLng &coord, const QColor &color)
+    {
+        if(this->color!=color)
+        {
+            this->color=color;
+            update();
+        }
+        points.append(coord);
+        if(points.count()-tailStart<TailPoints)
+        {
+            AppendToPath(coord,false);
+            return;
+        }
+        Simplify(tailStart,points.count()-1,tolerance);
+        while(points.count()>MaxPoints)
+        {
+            tolerance*=2;
+            Simplify(0,points.count()-1,tolerance);
+        }
+        // the newest point is the start of the next run
+        tailStart=points.count()-1;
+        RebuildPath();
+    }
+    void TrailPathItem::Clear()
+    {
+        prepareGeometryChange();
+        points.clear();
+        tailStart=0;
+        tolerance=BaseTolerance;
+        path=QPainterPath();
+        dots.clear();
+        bounds=QRectF();
+    }
+    void TrailPathItem::RefreshPos()
+    {
+        RebuildPath();
+    }
+    void TrailPathItem::SetShowLine(const bool &value)
+    {
+        showline=value;
+        setVisible(showline||showdots);
+        update();
+    }
+    void TrailPathItem::SetShowDots(const bool &value)
+    {
+        showdots=value;
+        setVisible(showline||showdots);
+        update();
+    }
+
+    void TrailPathItem::Simplify(int first, int last, double tolerance)
+    {
+        if(last-first<2)
+            return;
+        // A flat projection around the first point is good enough for a trail
+        double scale=111319.49;
+        double lngscale=scale*qCos(points.at(first).Lat()*M_PI/180.0);
+        QVector<QPointF> xy;
+        xy.reserve(last-first+1);
+        for(int i=first;i<=last;++i)
+            xy.append(QPointF(points.at(i).Lng()*lngscale,points.at(i).Lat()*scale));
+        QVector<bool> keep(xy.count(),false);
+        keep[0]=true;
+        keep[xy.count()-1]=true;
+        QStack<QPair<int,int> > ranges;
+        ranges.push(qMakePair(0,xy.count()-1));
+        while(!ranges.isEmpty())
+        {
+            QPair<int,int> range=ranges.pop();
+            QPointF a=xy.at(range.first);
+            QPointF ab=xy.at(range.second)-a;
+            double length=qSqrt(ab.x()*ab.x()+ab.y()*ab.y());
+            int farthest=-1;
+            double distance=tolerance;
+            for(int i=range.first+1;i<range.second;++i)
+            {
+                QPointF ap=xy.at(i)-a;
+                double d;
+                if(length<1e-9)
+                    d=qSqrt(ap.x()*ap.x()+ap.y()*ap.y());
+                else
+                    d=qAbs(ab.x()*ap.y()-ab.y()*ap.x())/length;
+                if(d>distance)
+                {
+                    distance=d;
+                    farthest=i;
+                }
+            }
+            if(farthest>=0)
+            {
+                keep[farthest]=true;
+                ranges.push(qMakePair(range.first,farthest));
+                ranges.push(qMakePair(farthest,range.second));
+            }
+        }
+        QVector<internals::PointLatLng> simplified;
+        simplified.reserve(points.count());
+        for(int i=0;i<first;++i)
+            simplified.append(points.at(i));
+        for(int i=first;i<=last;++i)
+        {
+            if(keep.at(i-first))
+                simplified.append(points.at(i));
+        }
+        for(int i=last+1;i<points.count();++i)
+            simplified.append(points.at(i));
+        points=simplified;
+    }
+    void TrailPathItem::AppendToPath(const internals::PointLatLng &coord, bool force)
+    {
+        core::Point local=map->FromLatLngToLocal(coord);
+        QPointF p(local.X(),local.Y());
+        bool changed=false;
+        if(path.elementCount()==0)
+        {
+            path.moveTo(p);
+            lastLine=p;
+            changed=true;
+        }
+        else if(force || qAbs(p.x()-lastLine.x())+qAbs(p.y()-lastLine.y())>=LineStep)
+        {
+            path.lineTo(p);
+            lastLine=p;
+            changed=true;
+        }
+        if(dots.isEmpty() || qAbs(p.x()-lastDot.x())+qAbs(p.y()-lastDot.y())>=DotStep)
+        {
+            dots.append(p);
+            lastDot=p;
+            changed=true;
+        }
+        if(changed)
+        {
+            prepareGeometryChange();
+            bounds=bounds.united(QRectF(p.x()-3,p.y()-3,6,6));
+        }
+    }
+    void TrailPathItem::RebuildPath()
+    {
+        prepareGeometryChange();
+        path=QPainterPath();
+        dots.clear();
+        bounds=QRectF();
+        for(int i=0;i<points.count();++i)
+            AppendToPath(points.at(i),i==points.count()-1);
+    }
+
+    void TrailPathItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+    {
+        Q_UNUSED(option);
+        Q_UNUSED(widget);
+        if(showline && path.elementCount()>1)
+        {
+            QPen pen(color);
+            pen.setWidth(1);
+            painter->setPen(pen);
+            painter->setBrush(Qt::NoBrush);
+            painter->drawPath(path);
+        }
+        if(showdots)
+        {
+            painter->setPen(QPen(Qt::black));
+            painter->setBrush(color);
+            foreach(QPointF p,dots)
+                painter->drawEllipse(p,2,2);
+        }
+    }
+    QRectF TrailPathItem::boundingRect()const
+    {
+        return bounds;
+    }
+    int TrailPathItem::type()const
+    {
+        return Type;
+    }
+}
@@ -0,0 +1,103 @@
+/**
+******************************************************************************
+*
+* @file       trailpathitem.h
+* @author     The OpenPilot Team, http://www.openpilot.org Copyright (C) 2010.
+* @brief      A graphicsItem representing the trail of a UAV
+* @see        The GNU Public License (GPL) Version 3
+* @defgroup   OPMapWidget
+* @{
+*
+*****************************************************************************/
+/*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+* or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+* for more details.
+*
+* You should have received a copy of the GNU General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+#ifndef TRAILPATHITEM_H
+#define TRAILPATHITEM_H
+
+#include <QGraphicsItem>
+#include <QPainter>
+#include <QPainterPath>
+#include <QVector>
+#include "../internals/pointlatlng.h"
+
+namespace mapcontrol
+{
+    class MapGraphicItem;
+    /**
+    * @brief The whole trail of a UAV in one item, drawn as a line, dots or both
+    *
+    * Trail points are kept in a bounded buffer. Every TailPoints new points
+    * are simplified with Douglas-Peucker, and when the buffer is full all of
+    * it is simplified again with twice the tolerance, so a long flight costs
+    * no more than a short one. When drawn, points closer together than a
+    * couple of pixels at the current zoom are skipped.
+    *
+    * @class TrailPathItem trailpathitem.h "mapwidget/trailpathitem.h"
+    */
+    class TrailPathItem:public QGraphicsItem
+    {
+    public:
+                enum { Type = UserType + 8 };
+        TrailPathItem(MapGraphicItem* map);
+        /**
+        * @brief Adds a point at the end of the trail
+        *
+        * @param coord LatLng point
+        * @param color color of the trail, for all of it
+        */
+        void AddPoint(internals::PointLatLng const& coord, QColor const& color);
+        /**
+        * @brief Deletes all the trail points
+        */
+        void Clear();
+        /**
+        * @brief Places the trail again after the map was moved or zoomed
+        */
+        void RefreshPos();
+        void SetShowLine(bool const& value);
+        void SetShowDots(bool const& value);
+        int PointCount()const{return points.count();}
+        void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+                    QWidget *widget);
+        QRectF boundingRect() const;
+        int type() const;
+    private:
+        static const int MaxPoints=2000;
+        static const int TailPoints=64;
+        static const double BaseTolerance; // meters
+        static const int LineStep=2; // pixels
+        static const int DotStep=6; // pixels
+
+        /** Douglas-Peucker of points first to last, which are both kept */
+        void Simplify(int first, int last, double tolerance);
+        void AppendToPath(internals::PointLatLng const& coord, bool force);
+        void RebuildPath();
+
+        MapGraphicItem* map;
+        QVector<internals::PointLatLng> points;
+        int tailStart; // first point not simplified yet
+        double tolerance;
+        QPainterPath path;
+        QVector<QPointF> dots;
+        QPointF lastLine;
+        QPointF lastDot;
+        QRectF bounds;
+        QColor color;
+        bool showline;
+        bool showdots;
+    };
+}
+#endif // TRAILPATHITEM_H
@@ -38,8 +38,7 @@
 #include "uavtrailtype.h"
 #include <QtSvg/QSvgRenderer>
 #include "opmapwidget.h"
-#include "trailitem.h"
-#include "traillineitem.h"
+#include "trailpathitem.h"
 namespace mapcontrol
 {
     class WayPointItem;
@@ -103,6 +102,9 @@ namespace mapcontrol
 
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
                     QWidget *widget);
+        /**
+        * @brief Places the UAV and its trail again after the map was moved or zoomed
+        */
         void RefreshPos();
         QRectF boundingRect() const;
         /**
@@ -207,9 +209,7 @@ namespace mapcontrol
         internals::PointLatLng lastcoord;
         core::Point localposition;
         OPMapWidget* mapwidget;
-        QGraphicsItemGroup* trail;
-        QGraphicsItemGroup * trailLine;
-        internals::PointLatLng lasttrailline;
+        TrailPathItem* trail;
         QTime timer;
         bool showtrail;
         bool showtrailline;
@@ -621,6 +621,17 @@ HEADERS += \
     src/output/logdata.h \
     src/ui/AP2DataPlot2D.h \
     src/ui/AP2DataPlotThread.h \
+    src/ui/AP2DataPlotExportThread.h \
+    src/ui/AP2DataPlotDecimator.h \
+    src/ui/AP2DataPlotOnlineChannel.h \
+    src/ui/AP2DataPlotLazyLog.h \
+    src/ui/AP2DataPlotStatistics.h \
+    src/ui/AP2DataPlotStatisticsDialog.h \
+    src/ui/AP2DataPlotQuery.h \
+    src/ui/AP2DataPlotSession.h \
+    src/ui/AP2DataPlotRenderer.h \
+    src/ui/FrameScheduler.h \
+    src/ui/HUDFramePipeline.h \
     src/ui/dataselectionscreen.h \
     src/ui/qcustomplot.h \
     src/globalobject.h \
@@ -652,6 +663,7 @@ HEADERS += \
     src/comm/AbsPositionOverview.h \
     src/comm/MissionOverview.h \
     src/ui/AP2DataPlot2DModel.h \
+    src/ui/AP2DataPlot2DRowCache.h \
     src/ui/uas/PreFlightCalibrationDialog.h \
     src/ui/configuration/RadioFlashWizard.h \
     src/ui/GraphTreeWidgetItem.h \
@@ -845,6 +857,17 @@ SOURCES += src/main.cc \
     src/output/logdata.cc \
     src/ui/AP2DataPlot2D.cpp \
     src/ui/AP2DataPlotThread.cc \
+    src/ui/AP2DataPlotExportThread.cc \
+    src/ui/AP2DataPlotDecimator.cc \
+    src/ui/AP2DataPlotOnlineChannel.cc \
+    src/ui/AP2DataPlotLazyLog.cc \
+    src/ui/AP2DataPlotStatistics.cc \
+    src/ui/AP2DataPlotStatisticsDialog.cc \
+    src/ui/AP2DataPlotQuery.cc \
+    src/ui/AP2DataPlotSession.cc \
+    src/ui/AP2DataPlotRenderer.cc \
+    src/ui/FrameScheduler.cc \
+    src/ui/HUDFramePipeline.cc \
     src/ui/dataselectionscreen.cpp \
     src/ui/qcustomplot.cpp \
     src/globalobject.cc \
@@ -876,6 +899,7 @@ SOURCES += src/main.cc \
     src/comm/AbsPositionOverview.cc \
     src/comm/MissionOverview.cc \
     src/ui/AP2DataPlot2DModel.cc \
+    src/ui/AP2DataPlot2DRowCache.cc \
     src/ui/uas/PreFlightCalibrationDialog.cpp \
     src/ui/configuration/RadioFlashWizard.cpp \
     src/ui/GraphTreeWidgetItem.cc \
@@ -2113,6 +2113,31 @@ QImage UAS::getImage()
 
 }
 
+QByteArray UAS::getImageData(bool *raw, int *width, int *height)
+{
+#ifdef MAVLINK_ENABLED_PIXHAWK
+    *raw = (imageType == MAVLINK_DATA_STREAM_IMG_RAW8U);
+    *width = imageWidth;
+    *height = imageHeight;
+    // Restart statemachine
+    imagePacketsArrived = 0;
+    if (*raw ||
+        imageType == MAVLINK_DATA_STREAM_IMG_BMP ||
+        imageType == MAVLINK_DATA_STREAM_IMG_JPEG ||
+        imageType == MAVLINK_DATA_STREAM_IMG_PGM ||
+        imageType == MAVLINK_DATA_STREAM_IMG_PNG)
+    {
+        return imageRecBuffer;
+    }
+    return QByteArray();
+#else
+    *raw = false;
+    *width = 0;
+    *height = 0;
+    return QByteArray();
+#endif
+}
+
 void UAS::requestImage()
 {
 #ifdef MAVLINK_ENABLED_PIXHAWK
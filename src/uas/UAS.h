@@ -712,6 +712,8 @@ public:
     }
 
     QImage getImage();
+    /** @brief Data of the last received image, undecoded. Raw is set for 8 bit greyscale pixels of width x height. */
+    QByteArray getImageData(bool *raw, int *width, int *height);
     void requestImage();
     int getAutopilotType(){
         return autopilot;
@@ -39,6 +39,9 @@ This file is part of the APM_PLANNER project
 #include "UAS.h"
 #include "UASManager.h"
 #include <QToolTip>
+#include <QSettings>
+#include <QHBoxLayout>
+#include <QInputDialog>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlRecord>
@@ -48,24 +51,45 @@ This file is part of the APM_PLANNER project
 #include "MainWindow.h"
 #include "AP2DataPlot2DModel.h"
 #include "ArduPilotMegaMAV.h"
+#include "FrameScheduler.h"
 
 #define ROW_HEIGHT_PADDING 3 //Number of additional pixels over font height for each row for the table/excel view.
+#define ONLINE_REBUILD_MSECS 10000 //How often a live graph is swapped over to its channel's folded data
 
 AP2DataPlot2D::AP2DataPlot2D(QWidget *parent,bool isIndependant) : QWidget(parent),
-    m_updateTimer(NULL),
+    m_tableModel(NULL),
+    m_tableFilterProxyModel(NULL),
     m_showOnlyActive(false),
     m_graphCount(0),
     m_plot(NULL),
     m_wideAxisRect(NULL),
     m_logLoaderThread(NULL),
+    m_exportThread(NULL),
+    m_exportProgressDialog(NULL),
     m_model(NULL),
     m_logLoaded(false),
+    m_logLoading(false),
+    m_inSnapshot(false),
+    m_pendingQuery(false),
+    m_pendingStatistics(false),
     m_currentIndex(0),
     m_startIndex(0),
     m_addGraphAction(NULL),
     m_uas(NULL),
     m_progressDialog(NULL),
     m_axisGroupingDialog(NULL),
+    m_statistics(NULL),
+    m_statisticsDialog(NULL),
+    m_statisticsTimer(NULL),
+    m_queryWidget(NULL),
+    m_queryLineEdit(NULL),
+    m_queryLabel(NULL),
+    m_queryAxis(NULL),
+    m_queryCurrent(-1),
+    m_session(NULL),
+    m_asyncRender(false),
+    m_renderer(NULL),
+    m_asyncFrameItem(NULL),
     m_tlogReplayEnabled(false),
     m_logDownloadDialog(NULL),
     m_droneshareUploadDialog(NULL),
@@ -83,17 +107,23 @@ AP2DataPlot2D::AP2DataPlot2D(QWidget *parent,bool isIndependant) : QWidget(paren
     ui.tableSortGroupBox->setVisible(false);
     ui.sortShowPushButton->setVisible(false);
     ui.exportPushButton->setVisible(false);
+    ui.statisticsPushButton->setVisible(false);
+    ui.derivedPushButton->setVisible(false);
+    ui.overlayPushButton->setVisible(false);
 
     QDateTime utc = QDateTime::currentDateTimeUtc();
     utc.setTimeSpec(Qt::LocalTime);
     //m_timeDiff = QDateTime::currentDateTime().msecsTo(utc);
     m_plot = new QCustomPlot(ui.widget);
+    //Live data replots at most every 500ms, and only while the plot is visible
+    FrameScheduler::instance()->registerWidget(m_plot,FrameScheduler::OnDemand,SLOT(replot()),500);
     m_plot->setInteraction(QCP::iRangeDrag, true);
     m_plot->setInteraction(QCP::iRangeZoom, true);
 
     connect(m_plot,SIGNAL(axisDoubleClick(QCPAxis*,QCPAxis::SelectablePart,QMouseEvent*)),this,SLOT(axisDoubleClick(QCPAxis*,QCPAxis::SelectablePart,QMouseEvent*)));
 
     connect(m_plot,SIGNAL(mouseMove(QMouseEvent*)),this,SLOT(plotMouseMove(QMouseEvent*)));
+    connect(m_plot,SIGNAL(mouseDoubleClick(QMouseEvent*)),this,SLOT(plotMouseDoubleClick(QMouseEvent*)));
 
     connect(ui.modeDisplayCheckBox,SIGNAL(clicked(bool)),this,SLOT(modeCheckBoxClicked(bool)));
     connect(ui.errDisplayCheckBox,SIGNAL(clicked(bool)),this,SLOT(errCheckBoxClicked(bool)));
@@ -121,6 +151,47 @@ AP2DataPlot2D::AP2DataPlot2D(QWidget *parent,bool isIndependant) : QWidget(paren
     QCPMarginGroup *marginGroup = new QCPMarginGroup(m_plot);
     m_wideAxisRect->setMarginGroup(QCP::msLeft | QCP::msRight, marginGroup);
 
+    m_queryAxis = m_wideAxisRect->addAxis(QCPAxis::atRight);
+    m_queryAxis->setVisible(false);
+    m_queryAxis->setRange(0,1);
+
+    //Frames rendered off the GUI thread, placed by key so a stale frame still pans with the view
+    m_renderer = new AP2DataPlotRenderer(this);
+    connect(m_renderer,SIGNAL(frameReady(QImage,double,double)),this,SLOT(asyncFrameReady(QImage,double,double)));
+    m_asyncFrameItem = new QCPItemPixmap(m_plot);
+    m_plot->addItem(m_asyncFrameItem);
+    m_asyncFrameItem->setClipAxisRect(m_wideAxisRect);
+    m_asyncFrameItem->topLeft->setAxes(m_wideAxisRect->axis(QCPAxis::atBottom),m_queryAxis);
+    m_asyncFrameItem->bottomRight->setAxes(m_wideAxisRect->axis(QCPAxis::atBottom),m_queryAxis);
+    m_asyncFrameItem->setScaled(true,Qt::IgnoreAspectRatio);
+    m_asyncFrameItem->setPen(Qt::NoPen);
+    m_asyncFrameItem->setSelectable(false);
+    m_asyncFrameItem->setVisible(false);
+    connect(m_plot,SIGNAL(beforeReplot()),this,SLOT(plotBeforeReplot()));
+
+    //Query bar, for finding where a condition holds in an offline log
+    m_queryWidget = new QWidget(this);
+    m_queryLineEdit = new QLineEdit(m_queryWidget);
+    m_queryLineEdit->setPlaceholderText("Find, e.g. GPS.NSats < 6 && MODE == AUTO");
+    m_queryLineEdit->setToolTip("Fields are TYPE.Field, MODE is the flight mode.\n"
+                                "Supports + - * / abs(), < <= > >= == !=, && || !");
+    QPushButton *queryPreviousButton = new QPushButton("<",m_queryWidget);
+    QPushButton *queryNextButton = new QPushButton(">",m_queryWidget);
+    queryPreviousButton->setMaximumWidth(30);
+    queryNextButton->setMaximumWidth(30);
+    m_queryLabel = new QLabel(m_queryWidget);
+    QHBoxLayout *queryLayout = new QHBoxLayout(m_queryWidget);
+    queryLayout->setContentsMargins(0,0,0,0);
+    queryLayout->addWidget(m_queryLineEdit,1);
+    queryLayout->addWidget(queryPreviousButton);
+    queryLayout->addWidget(queryNextButton);
+    queryLayout->addWidget(m_queryLabel);
+    ui.horizontalLayout_4->insertWidget(0,m_queryWidget,1);
+    m_queryWidget->setVisible(false);
+    connect(m_queryLineEdit,SIGNAL(returnPressed()),this,SLOT(queryEntered()));
+    connect(queryNextButton,SIGNAL(clicked()),this,SLOT(queryNextClicked()));
+    connect(queryPreviousButton,SIGNAL(clicked()),this,SLOT(queryPreviousClicked()));
+
     //m_dataSelectionScreen = new DataSelectionScreen(this);
     connect(ui.dataSelectionScreen,SIGNAL(itemEnabled(QString)),this,SLOT(itemEnabled(QString)));
     connect( ui.dataSelectionScreen,SIGNAL(itemDisabled(QString)),this,SLOT(itemDisabled(QString)));
@@ -152,6 +223,16 @@ AP2DataPlot2D::AP2DataPlot2D(QWidget *parent,bool isIndependant) : QWidget(paren
     connect(ui.tableWidget,SIGNAL(currentCellChanged(int,int,int,int)),this,SLOT(tableCellChanged(int,int,int,int)));
 
     connect(ui.graphControlsPushButton,SIGNAL(clicked()),this,SLOT(graphControlsButtonClicked()));
+    connect(ui.statisticsPushButton,SIGNAL(clicked()),this,SLOT(statisticsButtonClicked()));
+    connect(ui.derivedPushButton,SIGNAL(clicked()),this,SLOT(derivedButtonClicked()));
+    connect(ui.overlayPushButton,SIGNAL(clicked()),this,SLOT(overlayButtonClicked()));
+    m_statisticsTimer = new QTimer(this);
+    m_statisticsTimer->setSingleShot(true);
+    m_statisticsTimer->setInterval(150);
+    connect(m_statisticsTimer,SIGNAL(timeout()),this,SLOT(updateStatistics()));
+    m_session = new AP2DataPlotSession(this);
+    connect(m_session,SIGNAL(logLoaded(QString)),this,SLOT(overlayLoaded(QString)));
+    connect(m_session,SIGNAL(logError(QString,QString)),this,SLOT(overlayError(QString,QString)));
     m_model = new QStandardItemModel();
     connect(ui.toKMLPushButton, SIGNAL(clicked()), this, SLOT(logToKmlClicked()));
     connect(ui.horizontalScrollBar,SIGNAL(sliderMoved(int)),this,SLOT(horizontalScrollMoved(int)));
@@ -273,8 +354,126 @@ void AP2DataPlot2D::replyTLogButtonClicked()
 
 }
 
+bool AP2DataPlot2D::getGraphPoints(const QString& name,const Graph &graph,const QCPRange &range,int pixelWidth,QVector<double> *keys,QVector<double> *values)
+{
+    if (!graph.isLogSeries)
+    {
+        return false;
+    }
+    if (!graph.decimator.isNull())
+    {
+        graph.decimator->getPoints(range.lower,range.upper,pixelWidth,*keys,*values);
+        return true;
+    }
+    if (!canReadLog())
+    {
+        //The points the graph already has do until refreshLogGraphs at the next snapshot
+        return false;
+    }
+    //A point per pixel edge is enough to draw the min/max envelope
+    return m_tableModel->getValues(name.section('.',0,0),name.section('.',1),range.lower,range.upper,pixelWidth * 2,keys,values);
+}
+
+void AP2DataPlot2D::updateGraphDetail(const QString& name,const Graph &graph,const QCPRange &range)
+{
+    QVector<double> xlist;
+    QVector<double> ylist;
+    if (getGraphPoints(name,graph,range,m_wideAxisRect->width(),&xlist,&ylist))
+    {
+        graph.graph->setData(xlist,ylist);
+    }
+}
+
+void AP2DataPlot2D::plotBeforeReplot()
+{
+    if (!m_asyncRender)
+    {
+        return;
+    }
+    QCPRange range = m_wideAxisRect->axis(QCPAxis::atBottom)->range();
+    QRect rect = m_wideAxisRect->rect();
+    QVector<double> signature;
+    signature << range.lower << range.upper << rect.width() << rect.height();
+    QStringList graphs;
+    for (QMap<QString,Graph>::const_iterator i = m_graphClassMap.constBegin();i!=m_graphClassMap.constEnd();i++)
+    {
+        const Graph &graph = i.value();
+        if (!graph.isLogSeries || !graph.graph->visible())
+        {
+            continue;
+        }
+        graphs.append(i.key());
+        QCPRange valuerange = graph.graph->valueAxis()->range();
+        signature << static_cast<double>(reinterpret_cast<quintptr>(graph.graph)) << valuerange.lower << valuerange.upper
+                  << graph.graph->data()->size() << graph.graph->pen().color().rgba();
+    }
+    if (signature == m_asyncFrameSignature)
+    {
+        //Only the axes or items changed, the current frame still holds
+        return;
+    }
+    m_asyncFrameSignature = signature;
+    if (graphs.isEmpty())
+    {
+        m_renderer->cancel();
+        m_asyncFrameItem->setVisible(false);
+        return;
+    }
+
+    //A snapshot of just the visible points, the worker never touches the plot
+    AP2DataPlotRenderer::Frame frame;
+    frame.size = rect.size();
+    frame.keyLower = range.lower;
+    frame.keyUpper = range.upper;
+    for (int i=0;i<graphs.size();i++)
+    {
+        const Graph &graph = m_graphClassMap[graphs.at(i)];
+        AP2DataPlotRenderer::Series series;
+        if (!getGraphPoints(graphs.at(i),graph,range,rect.width(),&series.keys,&series.values))
+        {
+            //Still loading, draw what the graph was last given
+            const QCPDataMap *data = graph.graph->data();
+            for (QCPDataMap::const_iterator point = data->constBegin();point!=data->constEnd();point++)
+            {
+                series.keys.append(point.key());
+                series.values.append(point.value().value);
+            }
+        }
+        series.pen = graph.graph->pen();
+        series.valueLower = graph.graph->valueAxis()->range().lower;
+        series.valueUpper = graph.graph->valueAxis()->range().upper;
+        frame.series.append(series);
+    }
+    m_renderer->render(frame);
+}
+
+void AP2DataPlot2D::asyncFrameReady(QImage image,double keyLower,double keyUpper)
+{
+    if (!m_asyncRender)
+    {
+        return;
+    }
+    m_asyncFrameItem->setPixmap(QPixmap::fromImage(image));
+    m_asyncFrameItem->topLeft->setCoords(keyLower,1);
+    m_asyncFrameItem->bottomRight->setCoords(keyUpper,0);
+    m_asyncFrameItem->setVisible(true);
+    m_plot->replot();
+}
+
 void AP2DataPlot2D::xAxisChanged(QCPRange range)
 {
+    //Pick the level of detail for the new range before the replot happens
+    for (QMap<QString,Graph>::const_iterator i = m_graphClassMap.constBegin();i!=m_graphClassMap.constEnd();i++)
+    {
+        updateGraphDetail(i.key(),i.value(),range);
+    }
+
+    if (m_statisticsDialog && m_statisticsDialog->isVisible() && m_statisticsDialog->isVisibleRangeOnly() && !m_logLoaderThread)
+    {
+        //Every pan or zoom step lands here, only the range it settles on is computed
+        m_statisticsTimer->start();
+    }
+
     ui.horizontalScrollBar->setValue(qRound(range.center())); // adjust position of scroll bar slider
     ui.horizontalScrollBar->setPageStep(qRound(range.size())); // adjust size of scroll bar slider
     double totalrange = m_scrollEndIndex - m_scrollStartIndex;
@@ -285,40 +484,41 @@ void AP2DataPlot2D::xAxisChanged(QCPRange range)
     connect(ui.verticalScrollBar, SIGNAL(valueChanged(int)), this, SLOT(verticalScrollMoved(int)));
 }
 
-void AP2DataPlot2D::horizontalScrollMoved(int value)
+void AP2DataPlot2D::plotMouseDoubleClick(QMouseEvent *evt)
 {
-    if (qAbs(m_wideAxisRect->axis(QCPAxis::atBottom)->range().center()-value) > 0.01) // if user is dragging plot, we don't want to replot twice
+    if (!m_logLoaded || m_logLoaderThread || !m_tableFilterProxyModel)
     {
-      m_wideAxisRect->axis(QCPAxis::atBottom)->setRange(value,m_wideAxisRect->axis(QCPAxis::atBottom)->range().size(), Qt::AlignCenter);
-      m_plot->replot();
+        return;
     }
-    return;
-}
-void AP2DataPlot2D::showEvent(QShowEvent *evt)
-{
-    if (m_updateTimer)
+    if (!m_wideAxisRect->rect().contains(evt->pos()))
     {
-        m_updateTimer->stop();
-        m_updateTimer->deleteLater();
-        m_updateTimer = 0;
+        //Axis double clicks are handled by axisDoubleClick
+        return;
+    }
+    //Jump the table to the message at the clicked log index
+    double key = m_wideAxisRect->axis(QCPAxis::atBottom)->pixelToCoord(evt->x());
+    int row = m_tableModel->getRowForIndex(static_cast<quint64>(qMax(0.0,key)));
+    if (row == -1)
+    {
+        return;
     }
-    m_updateTimer = new QTimer(this);
-    connect(m_updateTimer,SIGNAL(timeout()),m_plot,SLOT(replot()));
-    m_updateTimer->start(500);
-    QWidget::showEvent(evt);
+    QModelIndex index = m_tableFilterProxyModel->mapFromSource(m_tableModel->index(row,0));
+    if (!index.isValid())
+    {
+        return;
+    }
+    ui.tableWidget->scrollTo(index,QAbstractItemView::PositionAtCenter);
+    ui.tableWidget->selectRow(index.row());
 }
-
-void AP2DataPlot2D::hideEvent(QHideEvent *evt)
+void AP2DataPlot2D::horizontalScrollMoved(int value)
 {
-    if (m_updateTimer)
+    if (qAbs(m_wideAxisRect->axis(QCPAxis::atBottom)->range().center()-value) > 0.01) // if user is dragging plot, we don't want to replot twice
     {
-        m_updateTimer->stop();
-        m_updateTimer->deleteLater();
-        m_updateTimer = 0;
+      m_wideAxisRect->axis(QCPAxis::atBottom)->setRange(value,m_wideAxisRect->axis(QCPAxis::atBottom)->range().size(), Qt::AlignCenter);
+      m_plot->replot();
     }
-    QWidget::hideEvent(evt);
+    return;
 }
-
 void AP2DataPlot2D::verticalScrollMoved(int value)
 {
     double percent = value / 100.0;
@@ -336,14 +536,17 @@ void AP2DataPlot2D::plotMouseMove(QMouseEvent *evt)
         return;
     }
     QString newresult = "";
-    for (int i=0;i<m_graphClassMap.keys().size();i++)
+    for (QMap<QString,Graph>::const_iterator i = m_graphClassMap.constBegin();i!=m_graphClassMap.constEnd();i++)
     {
 
         double key=0;
         double val=0;
-        QCPGraph *graph = m_graphClassMap.value(m_graphClassMap.keys()[i]).graph;
+        const QString &name = i.key();
+        const Graph &graphclass = i.value();
+        QString separator = ((i + 1) == m_graphClassMap.constEnd()) ? "" : "\n";
+        QCPGraph *graph = graphclass.graph;
         graph->pixelsToCoords(evt->x(),evt->y(),key,val);
-        if (i == 0)
+        if (i == m_graphClassMap.constBegin())
         {
             if (m_logLoaded)
             {
@@ -354,54 +557,61 @@ void AP2DataPlot2D::plotMouseMove(QMouseEvent *evt)
                 newresult.append("Time: " + QDateTime::fromMSecsSinceEpoch(key * 1000.0).toString("hh:mm:ss") + "\n");
             }
         }
-        if (m_graphClassMap.keys()[i] == "MODE")
+        if (name == "MODE")
         {
-            if (m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.keys().size() > 1)
+            if (graphclass.modeMap.size() > 1)
             {
-                for (QMap<double,QString>::const_iterator modemapiterator = m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.constBegin();modemapiterator!=m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.constEnd();modemapiterator++)
+                for (QMap<double,QString>::const_iterator modemapiterator = graphclass.modeMap.constBegin();modemapiterator!=graphclass.modeMap.constEnd();modemapiterator++)
                 {
                     if (modemapiterator.key() < key)
                     {
-                        if (modemapiterator==m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.constEnd()-1)
+                        if (modemapiterator==graphclass.modeMap.constEnd()-1)
                         {
                             //We're at the end, use the end
-                            newresult.append(m_graphClassMap.keys()[i] + ": " + modemapiterator.value() + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+                            newresult.append(name + ": " + modemapiterator.value() + separator);
                         }
                         else if ((modemapiterator+1).key() > key)
                         {
                             //This only gets hit if we're not at the end, and we have the proper value
-                            newresult.append(m_graphClassMap.keys()[i] + ": " + modemapiterator.value() + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+                            newresult.append(name + ": " + modemapiterator.value() + separator);
                             break;
                         }
                     }
                 }
             }
-            else if (m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.keys().size() == 1)
+            else if (graphclass.modeMap.size() == 1)
             {
-                newresult.append(m_graphClassMap.keys()[i] + ": " + m_graphClassMap.value(m_graphClassMap.keys()[i]).modeMap.begin().value() + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+                newresult.append(name + ": " + graphclass.modeMap.begin().value() + separator);
             }
             else
             {
-                newresult.append(m_graphClassMap.keys()[i] + ": " + "Unknown" + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+                newresult.append(name + ": " + "Unknown" + separator);
             }
         }
-        else if (m_graphClassMap.keys()[i] == "ERR")
+        else if (name == "ERR")
         {
             //Ignore ERR
         }
+        else if (graphclass.isLogSeries && graphclass.decimator.isNull() && !m_logLoaderThread
+                 && m_tableModel->getValueAt(name.section('.',0,0),name.section('.',1),key,&val))
+        {
+            //The graph only holds the decimated points, so read the sample under the cursor from the model
+            QString str = QString().sprintf( "%.4g", val);
+            newresult.append(name + ": " + str + separator);
+        }
         else if (graph->data()->contains(key))
         {
             QString str = QString().sprintf( "%.4g", graph->data()->value(key).value);
-            newresult.append(m_graphClassMap.keys()[i] + ": " + str + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+            newresult.append(name + ": " + str + separator);
         }
         else if (graph->data()->lowerBound(key) != graph->data()->constEnd())
         {
         	QString str = QString().sprintf( "%.4g", graph->data()->lowerBound(key).value().value);
-            newresult.append(m_graphClassMap.keys()[i] + ": " + str + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+            newresult.append(name + ": " + str + separator);
         }
         else
         {
-            newresult.append(m_graphClassMap.keys()[i] + ": " + "ERR" + ((i == m_graphClassMap.keys().size()-1) ? "" : "\n"));
+            newresult.append(name + ": " + "ERR" + separator);
         }
     }
     QToolTip::showText(QPoint(evt->globalPos().x() + m_plot->x(),evt->globalPos().y()+m_plot->y()),newresult);
@@ -448,7 +658,345 @@ void AP2DataPlot2D::graphControlsButtonClicked()
     QApplication::postEvent(m_axisGroupingDialog, new QEvent(QEvent::WindowActivate));
 }
 
+void AP2DataPlot2D::statisticsButtonClicked()
+{
+    if (!m_statisticsDialog)
+    {
+        m_statisticsDialog = new AP2DataPlotStatisticsDialog(this);
+        connect(m_statisticsDialog,SIGNAL(statisticsRequested()),this,SLOT(updateStatistics()));
+        if (m_statistics)
+        {
+            m_statisticsDialog->setModeNames(m_statistics->getModeNames());
+        }
+    }
+    m_statisticsDialog->show();
+    m_statisticsDialog->activateWindow();
+    m_statisticsDialog->raise();
+    updateStatistics();
+}
+
+void AP2DataPlot2D::updateStatistics()
+{
+    if (!m_statisticsDialog || !m_statistics || !m_logLoaded)
+    {
+        return;
+    }
+    if (!canReadLog())
+    {
+        //Recomputed at the next snapshot
+        m_pendingStatistics = true;
+        return;
+    }
+    QCPRange range = m_wideAxisRect->axis(QCPAxis::atBottom)->range();
+    AP2DataPlotStatistics::Filter filter = m_statisticsDialog->getFilter(range.lower,range.upper);
+    m_statisticsDialog->clear();
+    for (int i=0;i<m_graphNameList.size();i++)
+    {
+        QString name = m_graphNameList.at(i);
+        if (!m_graphClassMap.value(name).isLogSeries || !AP2DataPlotSession::logNameForType(name).isEmpty())
+        {
+            //MODE and text fields have nothing to summarise, overlay logs aren't in m_statistics' model
+            continue;
+        }
+        m_statisticsDialog->setResult(name,m_statistics->getStatistics(name.section('.',0,0),name.section('.',1),filter));
+    }
+}
+
+void AP2DataPlot2D::addDerivedChannels()
+{
+    QString type = AP2DataPlot2DModel::derivedType();
+    if (m_logTypeNames.contains(type))
+    {
+        return;
+    }
+    m_logTypeNames.insert(type);
+    QSettings settings;
+    QVariantMap channels = settings.value("DATAPLOT_DERIVED_CHANNELS").toMap();
+    for (QVariantMap::const_iterator i = channels.constBegin();i!=channels.constEnd();i++)
+    {
+        m_tableModel->setDerivedChannel(i.key(),i.value().toString());
+        ui.dataSelectionScreen->addItem(type + "." + i.key());
+    }
+}
 
+void AP2DataPlot2D::derivedButtonClicked()
+{
+    if (!m_logLoaded || !m_tableModel)
+    {
+        return;
+    }
+    bool ok = false;
+    QString text = QInputDialog::getText(this,"Derived Channel",
+                                         "Name = expression, for example\n"
+                                         "    Power = CURR.Volt * CURR.Curr\n"
+                                         "    ClimbRate = lowpass(deriv(BARO.Alt),2)\n"
+                                         "Functions: abs sqrt sin cos atan2 min max deg rad avg(x,n) deriv(x) lowpass(x,hz) interp(field)\n"
+                                         "Leave the expression empty to remove a channel.",
+                                         QLineEdit::Normal,"",&ok);
+    if (!ok || text.trimmed().isEmpty())
+    {
+        return;
+    }
+    QRegExp definition("^\\s*([A-Za-z_][A-Za-z0-9_]*)\\s*=(?!=)(.*)$");
+    if (!definition.exactMatch(text))
+    {
+        QMessageBox::information(this,"Error","Derived channels are entered as Name = expression");
+        return;
+    }
+    QString name = definition.cap(1);
+    QString expression = definition.cap(2).trimmed();
+
+    QSettings settings;
+    QVariantMap channels = settings.value("DATAPLOT_DERIVED_CHANNELS").toMap();
+    if (!expression.isEmpty())
+    {
+        AP2DataPlotQuery query;
+        if (!query.parse(expression))
+        {
+            QMessageBox::information(this,"Error","Invalid expression: " + query.getError());
+            return;
+        }
+        channels[name] = expression;
+    }
+    else
+    {
+        channels.remove(name);
+    }
+    settings.setValue("DATAPLOT_DERIVED_CHANNELS",channels);
+
+    if (!canReadLog())
+    {
+        //The model can't be touched until the loader pauses at the next snapshot
+        m_pendingDerived.append(QPair<QString,QString>(name,expression));
+        return;
+    }
+    applyDerivedChannel(name,expression);
+}
+
+void AP2DataPlot2D::applyDerivedChannel(const QString& name,const QString& expression)
+{
+    QString item = AP2DataPlot2DModel::derivedType() + "." + name;
+    //The model holds exactly the channels that are in the selection tree
+    bool existed = m_tableModel->getDerivedChannels().contains(name);
+
+    //Removed and changed channels come off the graph, changed ones are then graphed again
+    if (existed && m_graphClassMap.contains(item))
+    {
+        ui.dataSelectionScreen->disableItem(item);
+    }
+    if (expression.isEmpty())
+    {
+        m_tableModel->removeDerivedChannel(name);
+        if (existed)
+        {
+            ui.dataSelectionScreen->removeItem(item);
+        }
+    }
+    else
+    {
+        m_tableModel->setDerivedChannel(name,expression);
+        if (!existed)
+        {
+            ui.dataSelectionScreen->addItem(item);
+        }
+        ui.dataSelectionScreen->enableItem(item);
+    }
+    m_plot->replot();
+}
+
+void AP2DataPlot2D::clearQuery()
+{
+    for (int i=0;i<m_queryItems.size();i++)
+    {
+        m_plot->removeItem(m_queryItems.at(i));
+    }
+    m_queryItems.clear();
+    m_queryIntervals.clear();
+    m_queryCurrent = -1;
+    m_queryLabel->clear();
+}
+
+void AP2DataPlot2D::queryEntered()
+{
+    clearQuery();
+    if (!m_logLoaded || !m_tableModel || m_queryLineEdit->text().trimmed().isEmpty())
+    {
+        m_plot->replot();
+        return;
+    }
+    AP2DataPlotQuery query;
+    if (!query.parse(m_queryLineEdit->text()))
+    {
+        m_queryLabel->setText("Error: " + query.getError());
+        m_plot->replot();
+        return;
+    }
+    if (!canReadLog())
+    {
+        //Evaluated over what has loaded by the next snapshot
+        m_pendingQuery = true;
+        m_queryLabel->setText("Waiting for the log");
+        m_plot->replot();
+        return;
+    }
+    qint64 msecs = QDateTime::currentMSecsSinceEpoch();
+    bool ok = query.evaluate(m_tableModel,m_modeChanges,&m_queryIntervals);
+    QLOG_DEBUG() << "AP2DataPlot2D::queryEntered:" << m_queryLineEdit->text() << "took" << (QDateTime::currentMSecsSinceEpoch() - msecs) << "ms," << m_queryIntervals.size() << "matches";
+    if (!ok)
+    {
+        m_queryLabel->setText("Error: " + query.getError());
+        m_plot->replot();
+        return;
+    }
+    if (m_queryIntervals.isEmpty())
+    {
+        m_queryLabel->setText("No matches");
+        m_plot->replot();
+        return;
+    }
+
+    //Past this many the highlights are just noise, stepping through still reaches every match
+    static const int maxhighlights = 1000;
+    QCPAxis *xAxis = m_wideAxisRect->axis(QCPAxis::atBottom);
+    QColor color(255,200,0,80);
+    for (int i=0;i<m_queryIntervals.size() && i<maxhighlights;i++)
+    {
+        QCPItemRect *rect = new QCPItemRect(m_plot);
+        rect->setClipAxisRect(m_wideAxisRect);
+        rect->topLeft->setAxes(xAxis,m_queryAxis);
+        rect->bottomRight->setAxes(xAxis,m_queryAxis);
+        rect->topLeft->setCoords(m_queryIntervals.at(i).first,1);
+        rect->bottomRight->setCoords(m_queryIntervals.at(i).second,0);
+        //The pen keeps single sample matches visible
+        rect->setPen(QPen(color));
+        rect->setBrush(QBrush(color));
+        m_plot->addItem(rect);
+        m_queryItems.append(rect);
+    }
+    showQueryInterval(0);
+}
+
+void AP2DataPlot2D::queryNextClicked()
+{
+    showQueryInterval(m_queryCurrent + 1);
+}
+
+void AP2DataPlot2D::queryPreviousClicked()
+{
+    showQueryInterval(m_queryCurrent - 1);
+}
+
+void AP2DataPlot2D::showQueryInterval(int index)
+{
+    if (m_queryIntervals.isEmpty())
+    {
+        return;
+    }
+    int count = m_queryIntervals.size();
+    m_queryCurrent = (index + count) % count;
+    const QPair<double,double> &interval = m_queryIntervals.at(m_queryCurrent);
+
+    //Keep the zoom level unless the match doesn't fit in it
+    QCPAxis *xAxis = m_wideAxisRect->axis(QCPAxis::atBottom);
+    double size = xAxis->range().size();
+    double width = interval.second - interval.first;
+    if (width * 1.2 > size)
+    {
+        size = width * 1.2;
+    }
+    double center = (interval.first + interval.second) / 2.0;
+    xAxis->setRange(center - (size / 2.0),center + (size / 2.0));
+    m_queryLabel->setText(QString("%1 of %2").arg(m_queryCurrent + 1).arg(count));
+    m_plot->replot();
+}
+
+void AP2DataPlot2D::overlayButtonClicked()
+{
+    if (!m_logLoaded || !m_tableModel)
+    {
+        return;
+    }
+    if (m_logLoaderThread)
+    {
+        //Overlays are aligned to this log's time fields and events, which aren't all there yet
+        QMessageBox::information(this,"Error","Wait for the log to finish loading before overlaying another one");
+        return;
+    }
+    QStringList actions;
+    actions << "Add a log" << "Align on log start" << "Align on arming" << "Align on takeoff" << "Align on a condition";
+    bool ok = false;
+    QString action = QInputDialog::getItem(this,"Overlay Log","Overlay another log, or choose how overlaid logs line up with this one.\n"
+                                           "Overlay fields are listed as L2:TYPE.Field, L3:TYPE.Field...",actions,0,false,&ok);
+    if (!ok)
+    {
+        return;
+    }
+    int choice = actions.indexOf(action);
+    if (choice == 0)
+    {
+        QString filename = QFileDialog::getOpenFileName(this,"Overlay Log",QGC::logDirectory(),"Dataflash Log Files (*.log *.bin *.tlog);;All Files (*.*)");
+        if (filename.isEmpty())
+        {
+            return;
+        }
+        QString name = m_session->addLog(filename);
+        QLOG_DEBUG() << "AP2DataPlot2D: overlaying" << filename << "as" << name;
+        return;
+    }
+
+    QString condition;
+    if (choice == 4)
+    {
+        condition = QInputDialog::getText(this,"Overlay Log","Align on the first place this holds in each log, for example\n"
+                                          "    MODE == AUTO\n"
+                                          "    BARO.Alt > 10",
+                                          QLineEdit::Normal,m_session->getCondition(),&ok);
+        if (!ok || condition.trimmed().isEmpty())
+        {
+            return;
+        }
+        AP2DataPlotQuery query;
+        if (!query.parse(condition))
+        {
+            QMessageBox::information(this,"Error","Invalid condition: " + query.getError());
+            return;
+        }
+    }
+    m_session->setAlignment(static_cast<AP2DataPlotSession::Alignment>(choice - 1),condition);
+    //Overlay graphs move to the new alignment, the open log's stay put
+    refreshLogGraphs();
+    m_plot->replot();
+}
+
+void AP2DataPlot2D::overlayLoaded(QString name)
+{
+    if (!m_logLoaded)
+    {
+        return;
+    }
+    QMap<QString,QList<QString> > fmtlist = m_session->getFmtValues(name);
+    for (QMap<QString,QList<QString> >::const_iterator i=fmtlist.constBegin();i!=fmtlist.constEnd();i++)
+    {
+        QString type = name + ":" + i.key();
+        if (m_logTypeNames.contains(type))
+        {
+            continue;
+        }
+        m_logTypeNames.insert(type);
+        for (int j=0;j<i.value().size();j++)
+        {
+            ui.dataSelectionScreen->addItem(type + "." + i.value().at(j));
+        }
+    }
+    QString shortfilename = m_session->getFileName(name);
+    shortfilename = shortfilename.mid(shortfilename.lastIndexOf("/")+1);
+    QMessageBox::information(this,"Overlay Log",shortfilename + " loaded, its fields are listed as " + name + ":TYPE.Field");
+}
+
+void AP2DataPlot2D::overlayError(QString name,QString errorstr)
+{
+    QMessageBox::information(this,"Error","Unable to overlay " + m_session->getFileName(name) + ": " + errorstr);
+}
 
 void AP2DataPlot2D::addGraphLeft()
 {
@@ -660,6 +1208,7 @@ void AP2DataPlot2D::navModeChanged(int uasid, int mode, const QString& text)
         graph.graph=  mainGraph1;
         graph.isInGroup = false;
         graph.isManualRange = false;
+        graph.isLogSeries = false;
         m_graphClassMap["MODE"] = graph;
 
         mainGraph1->rescaleValueAxis();
@@ -689,8 +1238,14 @@ void AP2DataPlot2D::updateValue(const int uasId, const QString& name, const QStr
         return;
     }
     QString propername  = name.mid(name.indexOf(":")+1);
-    if (!m_onlineValueMap.contains(propername))
-    {
+    OnlineChannel *channel = m_onlineChannels.value(propername,NULL);
+    if (!channel)
+    {
+        channel = new OnlineChannel();
+        channel->graph = NULL;
+        channel->axis = NULL;
+        channel->lastRebuild = 0;
+        m_onlineChannels.insert(propername,channel);
         ui.dataSelectionScreen->addItem(propername);
     }
 
@@ -705,65 +1260,73 @@ void AP2DataPlot2D::updateValue(const int uasId, const QString& name, const QStr
         m_wideAxisRect->axis(QCPAxis::atBottom,0)->setRangeUpper((newmsec / 1000.0));
     }
 
-    if (m_graphClassMap.contains(propername))
-    {
-        m_graphClassMap[propername].axisIndex = newmsec / 1000.0;// + 18000000;
-        m_graphClassMap.value(propername).graph->addData(m_graphClassMap.value(propername).axisIndex,value);
-        m_scrollEndIndex = newmsec /  1000.0;
-        //ui.horizontalScrollBar->setMinimum(m_startIndex);
-        ui.horizontalScrollBar->setMaximum(m_scrollEndIndex);
-        //Set a timeout for 30 minutes from now, 1800 seconds.
-        qint64 current = QDateTime::currentMSecsSinceEpoch();
-        //This is 30 minutes
-        m_onlineValueTimeoutList.append(QPair<qint64,double>(current + 1800000,msec));
-        //This is 1 minute
-        //m_onlineValueTimeoutList.append(QPair<qint64,double>(current + 60000,m_currentIndex));
-        if (m_onlineValueTimeoutList[0].first <= current)
-        {
-            for (QMap<QString,Graph>::const_iterator i = m_graphClassMap.constBegin();i!=m_graphClassMap.constEnd();i++)
-            {
-                i.value().graph->removeData(0,m_onlineValueTimeoutList[0].second);
-            }
-            m_onlineValueTimeoutList.removeAt(0);
-        }
-        if (m_graphClassMap.value(propername).groupName != "" && m_graphClassMap.value(propername).groupName != "MANUAL")
+    double key = newmsec / 1000.0;
+    bool folded = channel->data.append(key,value);
+    if (!channel->graph)
+    {
+        return;
+    }
+    if (folded && msec_current - channel->lastRebuild >= ONLINE_REBUILD_MSECS)
+    {
+        //Older samples have gone into min/max buckets, so the graph is trimmed to match
+        QVector<double> xlist;
+        QVector<double> ylist;
+        channel->data.getData(xlist,ylist);
+        channel->graph->setData(xlist,ylist);
+        channel->lastRebuild = msec_current;
+    }
+    else
+    {
+        channel->graph->addData(key,value);
+    }
+    FrameScheduler::instance()->markDirty(m_plot);
+    m_scrollEndIndex = key;
+    //ui.horizontalScrollBar->setMinimum(m_startIndex);
+    ui.horizontalScrollBar->setMaximum(m_scrollEndIndex);
+
+    if (!channel->axis->range().contains(value))
+    {
+        //Out of range values are rare, only then is the graph's grouping looked up
+        QMap<QString,Graph>::iterator graph = m_graphClassMap.find(propername);
+        if (graph != m_graphClassMap.end())
         {
-            //Current graph is in a group
-            if (!m_graphGroupRanges[m_graphClassMap.value(propername).groupName].contains(value))
+            QString groupname = graph.value().groupName;
+            if (groupname != "" && groupname != "MANUAL")
             {
-                //It's out of scale for the group, expand it.
-                if (m_graphGroupRanges[m_graphClassMap.value(propername).groupName].lower > value)
+                //Current graph is in a group, expand the group's scale
+                QCPRange &grouprange = m_graphGroupRanges[groupname];
+                if (grouprange.lower > value)
                 {
-                    m_graphGroupRanges[m_graphClassMap.value(propername).groupName].lower = value;
+                    grouprange.lower = value;
                 }
-                else if (m_graphGroupRanges[m_graphClassMap.value(propername).groupName].upper < value)
+                else if (grouprange.upper < value)
                 {
-                    m_graphGroupRanges[m_graphClassMap.value(propername).groupName].upper = value;
+                    grouprange.upper = value;
                 }
-                for (int i=0;i<m_graphGrouping[m_graphClassMap.value(propername).groupName].size();i++)
+                const QList<QString> &groupgraphs = m_graphGrouping[groupname];
+                for (int i=0;i<groupgraphs.size();i++)
                 {
-                    m_graphClassMap.value(m_graphGrouping[m_graphClassMap.value(propername).groupName][i]).axis->setRange(m_graphGroupRanges[m_graphClassMap.value(propername).groupName]);
+                    m_graphClassMap.value(groupgraphs[i]).axis->setRange(grouprange);
                 }
                 if (m_axisGroupingDialog)
                 {
-                    m_axisGroupingDialog->updateAxis(propername,m_graphClassMap.value(propername).axis->range().lower,m_graphClassMap.value(propername).axis->range().upper);
+                    m_axisGroupingDialog->updateAxis(propername,channel->axis->range().lower,channel->axis->range().upper);
                 }
             }
-        }
-        else if (!m_graphClassMap.value(propername).graph->keyAxis()->range().contains(value) && !m_graphClassMap.value(propername).isManualRange)
-        {
-            m_graphClassMap.value(propername).graph->rescaleValueAxis();
-            if (m_axisGroupingDialog)
+            else if (!graph.value().isManualRange)
             {
-                m_axisGroupingDialog->updateAxis(propername,m_graphClassMap.value(propername).axis->range().lower,m_graphClassMap.value(propername).axis->range().upper);
+                channel->graph->rescaleValueAxis();
+                if (m_axisGroupingDialog)
+                {
+                    m_axisGroupingDialog->updateAxis(propername,channel->axis->range().lower,channel->axis->range().upper);
+                }
             }
         }
-        if (integer)
-        {
-            m_graphClassMap.value(propername).axis->setNumberPrecision(0);
-        }
     }
-    m_onlineValueMap[propername].append(QPair<double,double>(newmsec / 1000.0,value));
+    if (integer)
+    {
+        channel->axis->setNumberPrecision(0);
+    }
 }
 
 void AP2DataPlot2D::valueChanged(const int uasId, const QString& name, const QString& unit, const QVariant& value,const quint64 msec)
@@ -830,13 +1393,28 @@ void AP2DataPlot2D::loadLog(QString filename)
     }
     m_plot->replot();
     m_graphClassMap.clear();
+    for (QHash<QString,OnlineChannel*>::iterator i = m_onlineChannels.begin();i!=m_onlineChannels.end();i++)
+    {
+        //Their graphs are gone. updateValue ignores live data while a log is loaded,
+        //so the channels only keep what was stored before it.
+        i.value()->graph = NULL;
+        i.value()->axis = NULL;
+    }
     m_graphCount=0;
     m_dataList.clear();
+    m_logTypeNames.clear();
 
     QString shortfilename =filename.mid(filename.lastIndexOf("/")+1);
     setWindowTitle(tr("Graph: %1").arg(shortfilename));
     ui.toKMLPushButton->setDisabled(true);
     ui.exportPushButton->setVisible(true);
+    ui.statisticsPushButton->setVisible(true);
+    ui.derivedPushButton->setVisible(true);
+    ui.overlayPushButton->setVisible(true);
+    m_queryWidget->setVisible(true);
+    clearQuery();
+    m_modeChanges.clear();
+    m_session->clear();
 
     m_wideAxisRect->axis(QCPAxis::atBottom, 0)->setTickLabelType(QCPAxis::ltNumber);
     m_wideAxisRect->axis(QCPAxis::atBottom, 0)->setRange(0,100);
@@ -847,9 +1425,21 @@ void AP2DataPlot2D::loadLog(QString filename)
     ui.autoScrollCheckBox->setVisible(false);
 
     m_tableModel = new AP2DataPlot2DModel(this);
+    m_logLoading = true;
+    m_pendingItems.clear();
+    m_pendingDerived.clear();
+    m_pendingQuery = false;
+    m_pendingStatistics = false;
+    delete m_statistics;
+    m_statistics = new AP2DataPlotStatistics(m_tableModel);
     m_logLoaderThread = new AP2DataPlotThread(m_tableModel);
+    QSettings settings;
+    m_asyncRender = settings.value("DATAPLOT_ASYNC_RENDER",true).toBool();
+    m_logLoaderThread->setLazyLoading(settings.value("DATAPLOT_LAZY_BINARY_LOAD",true).toBool());
+    m_logLoaderThread->setProgressive(settings.value("DATAPLOT_PROGRESSIVE_LOAD",true).toBool());
     connect(m_logLoaderThread,SIGNAL(startLoad()),this,SLOT(loadStarted()));
     connect(m_logLoaderThread,SIGNAL(loadProgress(qint64,qint64)),this,SLOT(loadProgress(qint64,qint64)));
+    connect(m_logLoaderThread,SIGNAL(snapshotReady(qint64,qint64)),this,SLOT(loadSnapshot(qint64,qint64)));
     connect(m_logLoaderThread,SIGNAL(error(QString)),this,SLOT(threadError(QString)));
     connect(m_logLoaderThread,SIGNAL(done(int,MAV_TYPE)),this,SLOT(threadDone(int,MAV_TYPE)));
     connect(m_logLoaderThread,SIGNAL(finished()),this,SLOT(threadTerminated()));
@@ -872,12 +1462,30 @@ AP2DataPlot2D::~AP2DataPlot2D()
         m_logLoaderThread->deleteLater();
         m_logLoaderThread = NULL;
     }
+    //Overlay loads hold their own models, stop them before anything else goes
+    m_session->clear();
+    if (m_exportThread)
+    {
+        //The export thread reads from m_tableModel, it has to be finished before the model goes away
+        m_exportThread->stopExport();
+        m_exportThread->wait();
+        delete m_exportThread;
+        m_exportThread = NULL;
+    }
     if (m_axisGroupingDialog)
     {
         m_axisGroupingDialog->close();
         delete m_axisGroupingDialog;
         m_axisGroupingDialog = NULL;
     }
+    if (m_statisticsDialog)
+    {
+        m_statisticsDialog->close();
+        delete m_statisticsDialog;
+        m_statisticsDialog = NULL;
+    }
+    delete m_statistics;
+    m_statistics = NULL;
 
     for (int i=0;i<m_childGraphList.size();i++)
     {
@@ -886,9 +1494,20 @@ AP2DataPlot2D::~AP2DataPlot2D()
 
     delete m_model;
     m_model = NULL;
+    qDeleteAll(m_onlineChannels);
+    m_onlineChannels.clear();
 }
 void AP2DataPlot2D::itemEnabled(QString name)
 {
+    if (m_logLoaded && !canReadLog())
+    {
+        //Graphed once the loader pauses at the next snapshot
+        if (!m_pendingItems.contains(name))
+        {
+            m_pendingItems.append(name);
+        }
+        return;
+    }
     if (m_logLoaded)
     {
         QString parent = name.split(".")[0];
@@ -904,32 +1523,50 @@ void AP2DataPlot2D::itemEnabled(QString name)
         }*/
 
         bool isstr = false;
+        bool isoverlay = !AP2DataPlotSession::logNameForType(parent).isEmpty();
+        bool isnumeric = false;
         QList<QPair<double,QString> > strlist;
         QVector<double> xlist;
         QVector<double> ylist;
-        QMap<quint64,QVariant> values = m_tableModel->getValues(parent,child);
-        if (values.size() == 0)
+        if (isoverlay)
         {
-            //No values!
-            m_graphCount++; //Prevent crash when it tries to disable
-            ui.dataSelectionScreen->disableItem(name);
-            return;
+            //Overlay logs only offer their numeric fields, aligned in full to the open log
+            isnumeric = m_session->getAlignedColumn(parent,child,&xlist,&ylist);
         }
-        for (QMap<quint64,QVariant>::const_iterator i = values.constBegin();i!=values.constEnd();i++)
+        else
         {
-            if (i.value().type() == QVariant::String)
-            {
-                QString graphvaluestr = i.value().toString();
-                strlist.append(QPair<double,QString>(i.key(),graphvaluestr));
-                isstr = true;
-            }
-            else
+            //Numeric fields come decimated from the model's column cache, decoding them on first use.
+            //The whole log is read first so the axes rescale to the full data.
+            isnumeric = m_tableModel->getValues(parent,child,m_tableModel->getFirstIndex(),m_tableModel->getLastIndex(),
+                                                m_wideAxisRect->width() * 2,&xlist,&ylist);
+        }
+        if (!isnumeric && !isoverlay)
+        {
+            //Text fields are drawn as one annotation per message, so they need every value
+            QMap<quint64,QVariant> values = m_tableModel->getValues(parent,child);
+            for (QMap<quint64,QVariant>::const_iterator i = values.constBegin();i!=values.constEnd();i++)
             {
-                double graphvalue = i.value().toDouble();
-                ylist.append(graphvalue);
-            }
-            xlist.append(i.key());
+                if (i.value().type() == QVariant::String)
+                {
+                    QString graphvaluestr = i.value().toString();
+                    strlist.append(QPair<double,QString>(i.key(),graphvaluestr));
+                    isstr = true;
+                }
+                else
+                {
+                    double graphvalue = i.value().toDouble();
+                    ylist.append(graphvalue);
+                }
+                xlist.append(i.key());
 
+            }
+        }
+        if (xlist.size() == 0)
+        {
+            //No values!
+            m_graphCount++; //Prevent crash when it tries to disable
+            ui.dataSelectionScreen->disableItem(name);
+            return;
         }
         QCPAxis *axis = m_wideAxisRect->addAxis(QCPAxis::atLeft);
         axis->setLabel(name);
@@ -961,6 +1598,7 @@ void AP2DataPlot2D::itemEnabled(QString name)
         graph.graph=  mainGraph1;
         graph.isInGroup = false;
         graph.isManualRange = false;
+        graph.isLogSeries = false;
         m_graphClassMap[name] = graph;
         if (isstr)
         {
@@ -988,7 +1626,25 @@ void AP2DataPlot2D::itemEnabled(QString name)
         }
         else
         {
-            mainGraph1->setData(xlist, ylist);
+            //Large logs have millions of samples per field, so the graph is only ever
+            //given the decimated points for the visible range. Start with the whole series
+            //so the axes rescale to the full data.
+            m_graphClassMap[name].isLogSeries = true;
+            if (m_asyncRender)
+            {
+                //The renderer draws the line, QCustomPlot keeps the data for scaling
+                mainGraph1->setLineStyle(QCPGraph::lsNone);
+            }
+            if (isoverlay)
+            {
+                m_graphClassMap[name].decimator = QSharedPointer<AP2DataPlotDecimator>(new AP2DataPlotDecimator());
+                m_graphClassMap[name].decimator->setData(xlist,ylist);
+                updateGraphDetail(name,m_graphClassMap.value(name),QCPRange(xlist.first(),xlist.last()));
+            }
+            else
+            {
+                mainGraph1->setData(xlist,ylist);
+            }
         }
         mainGraph1->rescaleValueAxis();
         if (m_graphCount <= 2)
@@ -996,32 +1652,18 @@ void AP2DataPlot2D::itemEnabled(QString name)
             mainGraph1->rescaleKeyAxis();
             m_wideAxisRect->axis(QCPAxis::atBottom)->setRangeLower(xlist.at(0));
         }
+        updateGraphDetail(name,m_graphClassMap.value(name),xAxis->range());
 
         return;
     } //if (m_logLoaded)
     else
     {
-        if (m_onlineValueMap.contains(name))
+        OnlineChannel *channel = m_onlineChannels.value(name,NULL);
+        if (channel && !channel->data.isEmpty())
         {
             QVector<double> xlist;
             QVector<double> ylist;
-
-            float min = m_onlineValueMap[name][0].second;
-            float max = m_onlineValueMap[name][0].second;
-            for (int j=0;j<m_onlineValueMap[name].size();j++)
-            {
-                xlist.append(m_onlineValueMap[name][j].first);
-                double val = m_onlineValueMap[name][j].second;
-                if (val > max)
-                {
-                    max = val;
-                }
-                if (val < min)
-                {
-                    min = val;
-                }
-                ylist.append(val);
-            }
+            channel->data.getData(xlist,ylist);
             QCPAxis *axis = m_wideAxisRect->addAxis(QCPAxis::atLeft);
             axis->setLabel(name);
             QColor color = QColor::fromRgb(rand()%255,rand()%255,rand()%255);
@@ -1051,7 +1693,11 @@ void AP2DataPlot2D::itemEnabled(QString name)
             graph.graph=  mainGraph1;
             graph.isInGroup = false;
             graph.isManualRange = false;
+            graph.isLogSeries = false;
             m_graphClassMap[name] = graph;
+            channel->graph = mainGraph1;
+            channel->axis = axis;
+            channel->lastRebuild = QDateTime::currentMSecsSinceEpoch();
 
             mainGraph1->setPen(QPen(color, 1));
         }
@@ -1060,7 +1706,13 @@ void AP2DataPlot2D::itemEnabled(QString name)
 
 void AP2DataPlot2D::itemDisabled(QString name)
 {
-    if (m_logLoaded)
+    if (m_pendingItems.removeOne(name))
+    {
+        //Never graphed
+        return;
+    }
+    //Overlay log fields keep their L2: prefix, it is part of the graph name
+    if (m_logLoaded && AP2DataPlotSession::logNameForType(name.section('.',0,0)).isEmpty())
     {
         name = name.mid(name.indexOf(":")+1);
     }
@@ -1072,6 +1724,12 @@ void AP2DataPlot2D::itemDisabled(QString name)
     m_plot->removeGraph(m_graphClassMap.value(name).graph);
     m_plot->replot();
     m_graphClassMap.remove(name);
+    OnlineChannel *channel = m_onlineChannels.value(name,NULL);
+    if (channel)
+    {
+        channel->graph = NULL;
+        channel->axis = NULL;
+    }
     m_graphNameList.removeOne(name);
     m_graphCount--;
     if (m_axisGroupingDialog)
@@ -1099,14 +1757,29 @@ void AP2DataPlot2D::clearGraph()
         m_axisGroupingDialog->clear();
         m_axisGroupingDialog->hide();
     }
+    if (m_statisticsDialog)
+    {
+        m_statisticsDialog->clear();
+    }
+    clearQuery();
     m_graphClassMap.clear();
     m_graphCount=0;
     m_dataList.clear();
+    m_logTypeNames.clear();
 
     if (m_logLoaded)
     {
         //Unload the log.
         m_logLoaded = false;
+        m_queryWidget->setVisible(false);
+        ui.derivedPushButton->setVisible(false);
+        ui.overlayPushButton->setVisible(false);
+        m_modeChanges.clear();
+        m_session->clear();
+        m_asyncRender = false;
+        m_renderer->cancel();
+        m_asyncFrameItem->setVisible(false);
+        m_asyncFrameSignature.clear();
         ui.loadOfflineLogButton->setText("Open Log");
         ui.hideExcelView->setVisible(false);
         ui.hideExcelView->setChecked(false);
@@ -1118,14 +1791,23 @@ void AP2DataPlot2D::clearGraph()
     }
     m_currentIndex = QDateTime::currentMSecsSinceEpoch();
     m_startIndex = m_currentIndex;
-    m_onlineValueMap.clear();
+    qDeleteAll(m_onlineChannels);
+    m_onlineChannels.clear();
     m_plot->replot();
 }
 
 void AP2DataPlot2D::loadStarted()
 {
     m_progressDialog = new QProgressDialog("Loading File","Cancel",0,100,this);
-    m_progressDialog->setWindowModality(Qt::WindowModal);
+    if (m_logLoaderThread && m_logLoaderThread->isProgressive())
+    {
+        //Graphs fill in as the log loads, so leave the window usable
+        m_progressDialog->setWindowModality(Qt::NonModal);
+    }
+    else
+    {
+        m_progressDialog->setWindowModality(Qt::WindowModal);
+    }
     connect(m_progressDialog,SIGNAL(canceled()),this,SLOT(progressDialogCanceled()));
     m_progressDialog->show();
     QApplication::processEvents();
@@ -1138,6 +1820,114 @@ void AP2DataPlot2D::loadProgress(qint64 pos,qint64 size)
     m_progressDialog->setValue(((double)pos / (double)size) * 100.0);
 }
 
+void AP2DataPlot2D::loadSnapshot(qint64 pos,qint64 size)
+{
+    if (!m_logLoaderThread)
+    {
+        return;
+    }
+    QLOG_DEBUG() << "AP2DataPlot2D::loadSnapshot:" << pos << "of" << size << "bytes";
+    //The loader is waiting for snapshotConsumed(), so nothing is writing to the model
+    m_inSnapshot = true;
+    m_tableModel->publishRows();
+    addLogFields();
+    refreshLogGraphs();
+    if (m_statisticsDialog && m_statisticsDialog->isVisible())
+    {
+        m_pendingStatistics = true;
+    }
+    servePendingRequests();
+    m_inSnapshot = false;
+    m_plot->replot();
+    m_logLoaderThread->snapshotConsumed();
+}
+
+void AP2DataPlot2D::servePendingRequests()
+{
+    QList<QPair<QString,QString> > derived = m_pendingDerived;
+    m_pendingDerived.clear();
+    for (int i=0;i<derived.size();i++)
+    {
+        applyDerivedChannel(derived.at(i).first,derived.at(i).second);
+    }
+    QStringList items = m_pendingItems;
+    m_pendingItems.clear();
+    for (int i=0;i<items.size();i++)
+    {
+        itemEnabled(items.at(i));
+    }
+    if (m_pendingQuery)
+    {
+        m_pendingQuery = false;
+        queryEntered();
+    }
+    if (m_pendingStatistics)
+    {
+        m_pendingStatistics = false;
+        updateStatistics();
+    }
+}
+
+void AP2DataPlot2D::addLogFields()
+{
+    addDerivedChannels();
+    QMap<QString,QList<QString> > fmtlist = m_tableModel->getFmtValues();
+    for (QMap<QString,QList<QString> >::const_iterator i=fmtlist.constBegin();i!=fmtlist.constEnd();i++)
+    {
+        QString name = i.key();
+        if (m_logTypeNames.contains(name))
+        {
+            continue;
+        }
+        m_logTypeNames.insert(name);
+        for (int j=0;j<i.value().size();j++)
+        {
+            ui.dataSelectionScreen->addItem(name + "." + i.value().at(j));
+        }
+        QTreeWidgetItem *child = new QTreeWidgetItem(QStringList() << name);
+        child->setFlags(child->flags() | Qt::ItemIsUserCheckable);
+        child->setCheckState(0,Qt::Checked); // Set it checked, since all items are enabled by default
+        ui.sortSelectTreeWidget->addTopLevelItem(child);
+    }
+}
+
+void AP2DataPlot2D::refreshLogGraphs()
+{
+    if (m_statistics)
+    {
+        m_statistics->clear();
+    }
+    m_scrollStartIndex = m_tableModel->getFirstIndex();
+    m_scrollEndIndex = m_tableModel->getLastIndex();
+    ui.horizontalScrollBar->setMinimum(m_scrollStartIndex);
+    ui.horizontalScrollBar->setMaximum(m_scrollEndIndex);
+
+    QCPAxis *xAxis = m_wideAxisRect->axis(QCPAxis::atBottom);
+    for (QMap<QString,Graph>::iterator i = m_graphClassMap.begin();i!=m_graphClassMap.end();i++)
+    {
+        if (!i.value().isLogSeries)
+        {
+            //MODE and text fields are added once the load is done
+            continue;
+        }
+        if (!i.value().decimator.isNull())
+        {
+            QVector<double> xlist;
+            QVector<double> ylist;
+            if (!m_session->getAlignedColumn(i.key().section('.',0,0),i.key().section('.',1),&xlist,&ylist))
+            {
+                continue;
+            }
+            i.value().decimator->setData(xlist,ylist);
+        }
+        updateGraphDetail(i.key(),i.value(),xAxis->range());
+        if (!i.value().isManualRange && !i.value().isInGroup)
+        {
+            i.value().graph->rescaleValueAxis();
+        }
+    }
+}
+
 int AP2DataPlot2D::getStatusTextPos()
 {
     static const int numberOfPositions = 4;
@@ -1184,6 +1974,7 @@ void AP2DataPlot2D::plotTextArrow(int index, const QString &text, const QString&
 void AP2DataPlot2D::threadDone(int errors,MAV_TYPE type)
 {
     m_loadedLogMavType = type;
+    m_logLoading = false;
 
     if (errors != 0)
     {
@@ -1191,26 +1982,14 @@ void AP2DataPlot2D::threadDone(int errors,MAV_TYPE type)
     }
 
 
-    m_scrollStartIndex = m_tableModel->getFirstIndex();
-    m_scrollEndIndex = m_tableModel->getLastIndex();
-    ui.horizontalScrollBar->setMinimum(m_scrollStartIndex);
-    ui.horizontalScrollBar->setMaximum(m_scrollEndIndex);
+    //Anything loaded since the last snapshot
+    m_tableModel->publishRows();
+    addLogFields();
+    refreshLogGraphs();
 
-    QMap<QString,QList<QString> > fmtlist = m_tableModel->getFmtValues();
-    for (QMap<QString,QList<QString> >::const_iterator i=fmtlist.constBegin();i!=fmtlist.constEnd();i++)
-    {
-        QString name = i.key();
-        for (int j=0;j<i.value().size();j++)
-        {
-            ui.dataSelectionScreen->addItem(name + "." + i.value().at(j));
-        }
-        QTreeWidgetItem *child = new QTreeWidgetItem(QStringList() << name);
-        child->setFlags(child->flags() | Qt::ItemIsUserCheckable);
-        child->setCheckState(0,Qt::Checked); // Set it checked, since all items are enabled by default
-        ui.sortSelectTreeWidget->addTopLevelItem(child);
-    }
-
-    QMap<quint64,QString> modes = m_tableModel->getModeValues();
+    QMap<quint64,QString> modes = AP2DataPlotSession::getModeChanges(m_tableModel,type);
+    //Mode names by change index, for restricting statistics to a flight mode
+    QMap<quint64,QString> modechanges;
     if (modes.size() == 0)
     {
         QLOG_DEBUG() << "Graph loaded with no mode table. Running anyway, but text modes will not be available";
@@ -1241,6 +2020,7 @@ void AP2DataPlot2D::threadDone(int errors,MAV_TYPE type)
             graph.graph=  mainGraph1;
             graph.isInGroup = false;
             graph.isManualRange = false;
+            graph.isLogSeries = false;
             m_graphClassMap["MODE"] = graph;
 
             mainGraph1->rescaleValueAxis();
@@ -1253,45 +2033,24 @@ void AP2DataPlot2D::threadDone(int errors,MAV_TYPE type)
         {
             quint64 index = i.key();
             QString mode = i.value();
-            bool ok = false;
-            int modeint = mode.toInt(&ok);
-            if (!ok)
-            {
-                QLOG_DEBUG() << "Unable to determine Mode number in log" << mode;
-            }
-            else
-            {
-                //It's an integer!
-                switch (type)
-                {
-                case MAV_TYPE_QUADROTOR:
-                case MAV_TYPE_HEXAROTOR:
-                case MAV_TYPE_OCTOROTOR:
-                case MAV_TYPE_HELICOPTER:
-                case MAV_TYPE_TRICOPTER:
-                    {
-                        mode = ApmCopter::stringForMode(modeint);
-                    }
-                    break;
-                case MAV_TYPE_FIXED_WING:
-                    {
-                        mode = ApmPlane::stringForMode(modeint);
-                    }
-                    break;
-                case MAV_TYPE_GROUND_ROVER:
-                    {
-                        mode = ApmRover::stringForMode(modeint);
-                    }
-                    break;
-                default:
-                    mode = QString().sprintf("Mode (%d)", modeint);
-                }
-            }
             QLOG_DEBUG() << "Mode change at index" << index << "to" << mode;
             plotTextArrow(index, mode, "MODE",ui.modeDisplayCheckBox);
             m_graphClassMap["MODE"].modeMap[index] = mode;
+            modechanges.insert(index,mode);
         }
     }
+    m_statistics->setModeChanges(modechanges);
+    m_modeChanges = modechanges;
+    m_session->setPrimary(m_tableModel,m_modeChanges);
+    if (m_statisticsDialog)
+    {
+        m_statisticsDialog->setModeNames(m_statistics->getModeNames());
+        if (m_statisticsDialog->isVisible())
+        {
+            m_pendingStatistics = true;
+        }
+    }
+    servePendingRequests();
     ui.verticalScrollBar->setValue(ui.verticalScrollBar->maximum());
 
     //m_tableModel = new AP2DataPlot2DModel(&m_sharedDb,this);
@@ -1314,6 +2073,11 @@ void AP2DataPlot2D::threadDone(int errors,MAV_TYPE type)
 
 void AP2DataPlot2D::threadError(QString errorstr)
 {
+    m_logLoading = false;
+    m_pendingItems.clear();
+    m_pendingDerived.clear();
+    m_pendingQuery = false;
+    m_pendingStatistics = false;
     QMessageBox::information(0,"Error",errorstr);
     m_progressDialog->hide();
     delete m_progressDialog;
@@ -1383,11 +2147,22 @@ void AP2DataPlot2D::exportButtonClicked()
         }
     }*/
 
+    if (m_exportThread)
+    {
+        QMessageBox::information(this,"Error","An export is already in progress");
+        return;
+    }
+    if (m_logLoaderThread)
+    {
+        QMessageBox::information(this,"Error","Wait for the log to finish loading before exporting it");
+        return;
+    }
+
     //remove current extension
     QString exportFilename = m_filename.replace(".bin",".log", Qt::CaseInsensitive); // remove extension
     QFileDialog *dialog = new QFileDialog(this,"Save Log File",QGC::logDirectory());
     dialog->setAcceptMode(QFileDialog::AcceptSave);
-    dialog->setNameFilter("*.log");
+    dialog->setNameFilters(QStringList() << "DataFlash Log (*.log)" << "CSV, one file per message type (*.csv)" << "CSV of graphed fields (*.csv)");
     dialog->selectFile(exportFilename);
     QLOG_DEBUG() << " Suggested Export Filename: " << exportFilename;
     dialog->open(this,SLOT(exportDialogAccepted()));
@@ -1404,66 +2179,97 @@ void AP2DataPlot2D::exportDialogAccepted()
         return;
     }
     QString outputFileName = dialog->selectedFiles().at(0);
+    QString filter = dialog->selectedNameFilter();
     dialog->close();
 
-    QFile outputfile(outputFileName);
-    if (!outputfile.open(QIODevice::ReadWrite | QIODevice::Truncate))
+    AP2DataPlotExportThread::ExportFormat format = AP2DataPlotExportThread::DataFlashLog;
+    QStringList columns;
+    if (filter.startsWith("CSV, one file"))
     {
-        QMessageBox::information(this,"Error","Unable to open output file: " + outputfile.errorString());
-        return;
+        format = AP2DataPlotExportThread::CsvPerType;
     }
-    QProgressDialog *progressDialog = new QProgressDialog("Exporting File","Cancel",0,100,this);
-    progressDialog->setWindowModality(Qt::WindowModal);
-    progressDialog->show();
-    QApplication::processEvents();
-
-    QString formatheader = "FMT, 128, 89, FMT, BBnNZ, Type,Length,Name,Format,Columns\r\n";
-    QMap<QString,QList<QString> > fmtlist = m_tableModel->getFmtValues();
-    for (QMap<QString,QList<QString> >::const_iterator i = fmtlist.constBegin();i!=fmtlist.constEnd();i++)
+    else if (filter.startsWith("CSV of graphed"))
     {
-        QString fmtname = i.key();
-        QString line = m_tableModel->getFmtLine(fmtname);
-        if (line != "")
+        format = AP2DataPlotExportThread::FilteredCsv;
+        for (int i=0;i<m_graphNameList.size();i++)
         {
-            formatheader += line + "\r\n";
+            //MODE is an annotation graph, not a log field
+            if (m_graphNameList.at(i) != "MODE")
+            {
+                columns.append(m_graphNameList.at(i));
+            }
         }
+        if (columns.size() == 0)
+        {
+            QMessageBox::information(this,"Error","Graph the fields you want to export first");
+            return;
+        }
+    }
+    if (format != AP2DataPlotExportThread::DataFlashLog && !outputFileName.endsWith(".csv",Qt::CaseInsensitive))
+    {
+        outputFileName += ".csv";
     }
 
-    outputfile.write(formatheader.toLatin1());
+    m_exportProgressDialog = new QProgressDialog("Exporting File","Cancel",0,100,this);
+    m_exportProgressDialog->setWindowModality(Qt::WindowModal);
+    connect(m_exportProgressDialog,SIGNAL(canceled()),this,SLOT(exportProgressDialogCanceled()));
+    m_exportProgressDialog->show();
 
-    for (int i=0;i<m_tableModel->rowCount();i++)
+    m_exportThread = new AP2DataPlotExportThread(m_tableModel);
+    connect(m_exportThread,SIGNAL(exportProgress(qint64,qint64,double)),this,SLOT(exportProgress(qint64,qint64,double)));
+    connect(m_exportThread,SIGNAL(done(qint64,qint64)),this,SLOT(exportDone(qint64,qint64)));
+    connect(m_exportThread,SIGNAL(error(QString)),this,SLOT(exportError(QString)));
+    connect(m_exportThread,SIGNAL(finished()),this,SLOT(exportThreadTerminated()));
+    m_exportThread->exportFile(outputFileName,format,columns);
+}
+
+void AP2DataPlot2D::exportProgress(qint64 rows,qint64 total,double rowsPerSecond)
+{
+    if (!m_exportProgressDialog)
     {
-        int j=1;
-        QVariant val = m_tableModel->data(m_tableModel->index(i,j++));
-        QString line = val.toString();
-        val = m_tableModel->data(m_tableModel->index(i,j++));
-        while (!val.isNull())
-        {
-            line += ", " + val.toString();
-            val = m_tableModel->data(m_tableModel->index(i,j++));
-        }
-        outputfile.write(line.append("\r\n").toLatin1());
-        if (i % 5)
-        {
-            progressDialog->setValue(100.0 * ((double)i / (double)m_tableModel->rowCount()));
-        }
-        QApplication::processEvents();
-        if (progressDialog->wasCanceled())
-        {
-            outputfile.close();
-            progressDialog->hide();
-            progressDialog->deleteLater();
-            progressDialog=NULL;
-            QMessageBox::information(0,"Warning","Export was canceled");
-            return;
-        }
+        return;
     }
+    if (total > 0)
+    {
+        m_exportProgressDialog->setValue(qMin(99.0,100.0 * ((double)rows / (double)total)));
+    }
+    m_exportProgressDialog->setLabelText(QString("Exporting File - %1 rows/s").arg(rowsPerSecond,0,'f',0));
+}
 
-    outputfile.close();
-    progressDialog->hide();
-    progressDialog->deleteLater();
-    progressDialog=NULL;
+void AP2DataPlot2D::exportDone(qint64 rows,qint64 msecs)
+{
+    if (m_exportProgressDialog)
+    {
+        m_exportProgressDialog->hide();
+        m_exportProgressDialog->deleteLater();
+        m_exportProgressDialog = NULL;
+    }
+    QLOG_INFO() << "Exported" << rows << "rows in" << msecs << "ms";
+}
+
+void AP2DataPlot2D::exportError(QString errorstr)
+{
+    if (m_exportProgressDialog)
+    {
+        m_exportProgressDialog->hide();
+        m_exportProgressDialog->deleteLater();
+        m_exportProgressDialog = NULL;
+    }
+    QMessageBox::information(0,"Warning",errorstr);
+}
 
+void AP2DataPlot2D::exportProgressDialogCanceled()
+{
+    if (m_exportThread)
+    {
+        m_exportThread->stopExport();
+    }
+}
+
+void AP2DataPlot2D::exportThreadTerminated()
+{
+    m_exportThread->deleteLater();
+    m_exportThread = NULL;
 }
 
 void AP2DataPlot2D::modeCheckBoxClicked(bool checked)
@@ -37,9 +37,17 @@ This file is part of the APM_PLANNER project
 #include "DroneshareUploadDialog.h"
 
 #include "AP2DataPlotThread.h"
+#include "AP2DataPlotExportThread.h"
 #include "dataselectionscreen.h"
 #include "AP2DataPlotAxisDialog.h"
 #include "AP2DataPlot2DModel.h"
+#include "AP2DataPlotDecimator.h"
+#include "AP2DataPlotOnlineChannel.h"
+#include "AP2DataPlotStatistics.h"
+#include "AP2DataPlotStatisticsDialog.h"
+#include "AP2DataPlotQuery.h"
+#include "AP2DataPlotSession.h"
+#include "AP2DataPlotRenderer.h"
 #include "ui_AP2DataPlot2D.h"
 
 #include <QWidget>
@@ -48,6 +56,13 @@ This file is part of the APM_PLANNER project
 #include <QTextBrowser>
 #include <QSqlDatabase>
 #include <QStandardItemModel>
+#include <QSharedPointer>
+#include <QSet>
+#include <QHash>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QLabel>
+#include <QTimer>
 
 class LogDownloadDialog;
 
@@ -82,6 +97,8 @@ private slots:
     void loadStarted();
     //Progress of graph loading thread
     void loadProgress(qint64 pos,qint64 size);
+    //Graph loading thread has committed part of the log and is waiting for us to read it
+    void loadSnapshot(qint64 pos,qint64 size);
     //Cancel clicked on the graph loading thread progress dialog
     void progressDialogCanceled();
     //Graph loading thread finished
@@ -113,7 +130,25 @@ private slots:
     void showOnlyClicked();
     void showAllClicked();
     void graphControlsButtonClicked();
+    void statisticsButtonClicked();
+    //Recompute the statistics panel for the graphed fields
+    void updateStatistics();
+    //Add, change or remove a derived channel
+    void derivedButtonClicked();
+    //Load another log to overlay on this one, and choose how the logs are aligned
+    void overlayButtonClicked();
+    void overlayLoaded(QString name);
+    void overlayError(QString name,QString errorstr);
+    //Hand the visible graph lines to the renderer if the view has changed since the last frame
+    void plotBeforeReplot();
+    void asyncFrameReady(QImage image,double keyLower,double keyUpper);
+    //Evaluate the query bar expression and highlight where it holds
+    void queryEntered();
+    void queryNextClicked();
+    void queryPreviousClicked();
     void plotMouseMove(QMouseEvent *evt);
+    //Double click on the plot jumps the table to that point of the log
+    void plotMouseDoubleClick(QMouseEvent *evt);
     void horizontalScrollMoved(int value);
     void verticalScrollMoved(int value);
     void xAxisChanged(QCPRange range);
@@ -123,6 +158,13 @@ private slots:
 
     void exportButtonClicked();
     void exportDialogAccepted();
+    //Progress of the export thread
+    void exportProgress(qint64 rows,qint64 total,double rowsPerSecond);
+    void exportDone(qint64 rows,qint64 msecs);
+    void exportError(QString errorstr);
+    void exportProgressDialogCanceled();
+    //Export thread actually exited
+    void exportThreadTerminated();
 
     void graphGroupingChanged(QList<AP2DataPlotAxisDialog::GraphRange> graphRangeList);
     void graphColorsChanged(QMap<QString,QColor> colormap);
@@ -143,8 +185,6 @@ private slots:
     void setExcelViewHidden(bool hidden);
 
 private:
-    void showEvent(QShowEvent *evt);
-    void hideEvent(QHideEvent *evt);
     AP2DataPlot2DModel *m_tableModel;
     QSortFilterProxyModel *m_tableFilterProxyModel;
     QList<QString> m_tableFilterList;
@@ -154,19 +194,42 @@ private:
 private:
     Ui::AP2DataPlot2D ui;
 
-    QTimer *m_updateTimer;
     class Graph
     {
     public:
         bool isManualRange;
         QString groupName;
         bool isInGroup;
-        double axisIndex;
         QCPAxis *axis;
         QCPGraph *graph;
         QList<QCPAbstractItem*> itemList;
         QMap<double,QString> modeMap;
+        //Numeric offline log graph, which only ever holds the decimated points for the visible range
+        bool isLogSeries;
+        //Level of detail for overlay log graphs, NULL for the main log's which are read from the model
+        QSharedPointer<AP2DataPlotDecimator> decimator;
     };
+    //Points of an offline log graph for a key range at a pixel width. Returns false for other graphs,
+    //and for main log graphs while the loader has the model.
+    bool getGraphPoints(const QString& name,const Graph &graph,const QCPRange &range,int pixelWidth,QVector<double> *keys,QVector<double> *values);
+    //Feed a decimated graph just the points it needs to draw the given key range
+    void updateGraphDetail(const QString& name,const Graph &graph,const QCPRange &range);
+    //Add message types that have gained rows to the selection trees
+    void addLogFields();
+    //Reload the enabled offline graphs and scroll range from the model, as more of the log comes in
+    void refreshLogGraphs();
+    //Add the saved derived channels to the model and the selection tree
+    void addDerivedChannels();
+    //Add or change a derived channel in the model and the selection tree, an empty expression removes it
+    void applyDerivedChannel(const QString& name,const QString& expression);
+    //The loader writes to m_tableModel until threadDone, except while loadSnapshot has it paused
+    bool canReadLog() const { return !m_logLoading || m_inSnapshot; }
+    //Serve the graph, query, derived channel and statistics requests made while the model couldn't be read
+    void servePendingRequests();
+    //Remove the query highlights and results
+    void clearQuery();
+    //Scroll the graph to a query result
+    void showQueryInterval(int index);
 
     QMap<QString,Graph> m_graphClassMap;
 
@@ -177,8 +240,17 @@ private:
     QMap<QString,QCPRange> m_graphGroupRanges;
     //Map from the spreadsheet view row name (ATT,GPS,etc), to the header names (roll,pitch,yaw or long,lat,alt)
     QMap<QString,QString> m_tableHeaderNameMap;
-    //Graph name to list of values for "online" mode
-    QMap<QString,QList<QPair<double,double> > > m_onlineValueMap;
+    //Live data of one channel in "online" mode, and its graph while that is enabled
+    class OnlineChannel
+    {
+    public:
+        AP2DataPlotOnlineChannel data;
+        QCPGraph *graph;
+        QCPAxis *axis;
+        qint64 lastRebuild; //msecs since epoch the graph was last given the folded data
+    };
+    //Channel name to its live data, resolved once per sample
+    QHash<QString,OnlineChannel*> m_onlineChannels;
     //Map from graph name to list of values for "offline" mode
     QMap<QString,QList<QPair<int,QVariantMap> > > m_dataList;
     QList<QString> loglines;
@@ -187,17 +259,28 @@ private:
 
     QList<QWidget*> m_childGraphList;
 
-    QList<QPair<qint64,double> > m_onlineValueTimeoutList;
-
     //List of graph names, used in m_axisList, m_graphMap,m_graphToGroupMap and the like as the graph name
     QList<QString> m_graphNameList;
     int m_graphCount;
     QCustomPlot *m_plot;
     QCPAxisRect *m_wideAxisRect;
     AP2DataPlotThread *m_logLoaderThread;
+    AP2DataPlotExportThread *m_exportThread;
+    QProgressDialog *m_exportProgressDialog;
     //DataSelectionScreen *m_dataSelectionScreen;
     QStandardItemModel *m_model;
     bool m_logLoaded;
+    //Set from loadLog until the loader is done or fails
+    bool m_logLoading;
+    //Set while loadSnapshot has the loader paused
+    bool m_inSnapshot;
+    //Requests made while the log is loading, see servePendingRequests
+    QStringList m_pendingItems;
+    QList<QPair<QString,QString> > m_pendingDerived;
+    bool m_pendingQuery;
+    bool m_pendingStatistics;
+    //Message types already in the data selection and sort trees
+    QSet<QString> m_logTypeNames;
     //Current "index", X axis on graph. Used to keep all the graphs lined up.
     qint64 m_currentIndex;
     qint64 m_startIndex; //epoch msecs since graphing started
@@ -205,6 +288,30 @@ private:
     UASInterface *m_uas;
     QProgressDialog *m_progressDialog;
     AP2DataPlotAxisDialog *m_axisGroupingDialog;
+    AP2DataPlotStatistics *m_statistics;
+    AP2DataPlotStatisticsDialog *m_statisticsDialog;
+    //Visible range statistics are recomputed once panning and zooming settle
+    QTimer *m_statisticsTimer;
+    //Mode names by change index, as shown on the MODE graph
+    QMap<quint64,QString> m_modeChanges;
+
+    QWidget *m_queryWidget;
+    QLineEdit *m_queryLineEdit;
+    QLabel *m_queryLabel;
+    //Hidden 0-1 axis the query highlights and rendered frames span
+    QCPAxis *m_queryAxis;
+    QList<QCPAbstractItem*> m_queryItems;
+    QList<QPair<double,double> > m_queryIntervals;
+    int m_queryCurrent;
+    //Logs overlaid on the open one
+    AP2DataPlotSession *m_session;
+    //Offline graph lines are rendered on a worker thread and blitted from m_asyncFrameItem,
+    //QCustomPlot itself only draws the axes and items
+    bool m_asyncRender;
+    AP2DataPlotRenderer *m_renderer;
+    QCPItemPixmap *m_asyncFrameItem;
+    //What the last requested frame showed, to tell whether a replot needs a new one
+    QVector<double> m_asyncFrameSignature;
     //qint64 m_timeDiff;
     bool m_tlogReplayEnabled;
 
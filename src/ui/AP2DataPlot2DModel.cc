@@ -28,12 +28,17 @@ This file is part of the APM_PLANNER project
 
 
 #include "AP2DataPlot2DModel.h"
+#include "AP2DataPlot2DRowCache.h"
+#include "AP2DataPlotDecimator.h"
+#include "AP2DataPlotLazyLog.h"
+#include "AP2DataPlotQuery.h"
 #include <QSqlQuery>
 #include <QDebug>
 #include <QSqlRecord>
 #include <QSqlField>
 #include <QSqlError>
 #include <QUuid>
+#include <QtAlgorithms>
 #include <QsLog.h>
 #include <ArduPilotMegaMAV.h>
 /*
@@ -59,6 +64,14 @@ This file is part of the APM_PLANNER project
  * ATUN (idx integer PRIMARY KEY, Axis integer, TuneStep integer, RateMin real, RateMax real, RPGain real, RDGain real, SPGain real);
  *  The types are defined by the format (in this case, BBfffff)
  *  inside AP2DataPlot2DModel::makeCreateTableString.
+ *
+ * The database is a named shared-cache in-memory database, so worker threads
+ * (such as the table row prefetcher) can open their own connection to it.
+ * Table cells are served from AP2DataPlot2DRowCache rather than queried one by one.
+ *
+ * When a binary log is lazy loaded, most message tables stay empty. Their rows
+ * live in AP2DataPlotLazyLog as file offsets and are decoded from the log file
+ * on demand; getColumn() caches what has been decoded.
  */
 AP2DataPlot2DModel::AP2DataPlot2DModel(QObject *parent) :
     QAbstractTableModel(parent)
@@ -66,9 +79,14 @@ AP2DataPlot2DModel::AP2DataPlot2DModel(QObject *parent) :
     m_firstIndex = 0;
     m_lastIndex = 0;
     m_columnCount = 0;
+    m_rowCount = 0;
+    m_currentRow = -1;
+    m_lazyLog = NULL;
     m_databaseName = QUuid::createUuid().toString();
     m_sharedDb = QSqlDatabase::addDatabase("QSQLITE",m_databaseName);
-    m_sharedDb.setDatabaseName(":memory:");
+    m_sharedDb.setConnectOptions("QSQLITE_OPEN_URI");
+    m_sharedDb.setDatabaseName(getDatabaseUri());
+    m_rowCache = new AP2DataPlot2DRowCache(this);
     if (!m_sharedDb.open())
     {
      //   QMessageBox::information(0,"error","Error opening shared database " + m_sharedDb.lastError().text());
@@ -136,6 +154,7 @@ AP2DataPlot2DModel::AP2DataPlot2DModel(QObject *parent) :
         quint64 idx = query.value("idx").toLongLong();
 
         m_rowToTableMap.insert(m_rowCount,QPair<quint64,QString>(idx,name));
+        m_rowIndexes.append(idx);
         QSqlQuery fmtquery(m_sharedDb);
         if (!m_headerStringList.contains(name))
         {
@@ -170,8 +189,112 @@ AP2DataPlot2DModel::AP2DataPlot2DModel(QObject *parent) :
 }
 AP2DataPlot2DModel::~AP2DataPlot2DModel()
 {
+    //The row cache has its own connection to the database, it must go first.
+    delete m_rowCache;
+    m_rowCache = NULL;
+    delete m_lazyLog;
+    m_lazyLog = NULL;
+    qDeleteAll(m_insertQueries);
+    m_insertQueries.clear();
     QSqlDatabase::removeDatabase(m_databaseName);
 }
+void AP2DataPlot2DModel::setLazyLog(AP2DataPlotLazyLog *log)
+{
+    QWriteLocker locker(&m_rowLock);
+    delete m_lazyLog;
+    m_lazyLog = log;
+}
+bool AP2DataPlot2DModel::addLazyType(const QString& name,const QString& format,const QStringList& labels,int length)
+{
+    QWriteLocker locker(&m_rowLock);
+    return m_lazyLog && m_lazyLog->addType(name,format,labels,length);
+}
+bool AP2DataPlot2DModel::isLazyType(const QString& name) const
+{
+    QReadLocker locker(&m_rowLock);
+    return m_lazyLog && m_lazyLog->hasType(name);
+}
+bool AP2DataPlot2DModel::addLazyRow(const QString& name,qint64 offset,quint64 index,int fieldcount)
+{
+    QWriteLocker locker(&m_rowLock);
+    if (!m_lazyLog->addRecord(name,offset,index))
+    {
+        return false;
+    }
+    if (m_firstIndex == 0)
+    {
+        m_firstIndex = index;
+    }
+    m_lastIndex = index;
+    if (fieldcount > m_columnCount)
+    {
+        m_columnCount = fieldcount;
+    }
+    m_pendingRows.append(QPair<quint64,QString>(index,name));
+    return true;
+}
+QVector<QVariant> AP2DataPlot2DModel::getLazyRow(const QString& name,quint64 index) const
+{
+    QReadLocker locker(&m_rowLock);
+    if (!m_lazyLog)
+    {
+        return QVector<QVariant>();
+    }
+    return m_lazyLog->decodeRecord(name,index);
+}
+QVector<quint64> AP2DataPlot2DModel::getLazyIndexes(const QString& name) const
+{
+    QReadLocker locker(&m_rowLock);
+    if (!m_lazyLog)
+    {
+        return QVector<quint64>();
+    }
+    return m_lazyLog->getRecordIndexes(name);
+}
+QString AP2DataPlot2DModel::getDatabaseUri() const
+{
+    //Strip the braces off the uuid so it is a valid uri path
+    QString name = m_databaseName;
+    name.remove('{').remove('}');
+    return "file:" + name + "?mode=memory&cache=shared";
+}
+QList<QPair<quint64,QString> > AP2DataPlot2DModel::getRowKeys(int first,int count) const
+{
+    QList<QPair<quint64,QString> > retval;
+    QReadLocker locker(&m_rowLock);
+    QMap<int,QPair<quint64,QString> >::const_iterator i = m_rowToTableMap.constFind(first);
+    while (i != m_rowToTableMap.constEnd() && retval.size() < count)
+    {
+        retval.append(i.value());
+        i++;
+    }
+    return retval;
+}
+
+void AP2DataPlot2DModel::publishRows()
+{
+    QVector<QPair<quint64,QString> > rows;
+    {
+        QWriteLocker locker(&m_rowLock);
+        rows.swap(m_pendingRows);
+    }
+    if (rows.isEmpty())
+    {
+        return;
+    }
+    //Views call back into rowCount() and data() from endInsertRows(), so the lock can't be held across it
+    beginInsertRows(QModelIndex(),m_rowCount,m_rowCount + rows.size() - 1);
+    {
+        QWriteLocker locker(&m_rowLock);
+        m_rowIndexes.reserve(m_rowIndexes.size() + rows.size());
+        for (int i=0;i<rows.size();i++)
+        {
+            m_rowToTableMap.insert(m_rowCount++,rows.at(i));
+            m_rowIndexes.append(rows.at(i).first);
+        }
+    }
+    endInsertRows();
+}
 
 QMap<QString,QList<QString> > AP2DataPlot2DModel::getFmtValues()
 {
@@ -183,18 +306,17 @@ QMap<QString,QList<QString> > AP2DataPlot2DModel::getFmtValues()
     {
         QSqlRecord record = fmtquery.record();
         QString name = record.value(3).toString();
-        QSqlQuery indexquery(m_sharedDb);
-        if (!indexquery.prepare("SELECT * FROM 'INDEX' WHERE value = '" + name + "';"))
-        {
-            continue;
-        }
-        if (!indexquery.exec())
+        if (isLazyType(name))
         {
-            continue;
+            if (!m_lazyLog->hasRecords(name))
+            {
+                //No records
+                continue;
+            }
         }
-        if (!indexquery.next())
+        else if (!m_typeRowCount.value(name))
         {
-            //No records
+            //No records. Counted as rows are added, since this is called on every loader snapshot.
             continue;
         }
         if (!m_headerStringList.contains(name))
@@ -255,6 +377,10 @@ QString AP2DataPlot2DModel::getFmtLine(const QString& name)
             {
                 size += 1;
             }
+            else if ((format.at(i).toLatin1() == 'q') || (format.at(i).toLatin1() == 'Q'))
+            {
+                size += 8;
+            }
         }
         QString formatline = "FMT, " + QString::number(record.value(1).toInt()) + ", " + QString::number(size+3) + ", " + name + ", " + format + ", " + vars;
         return formatline;
@@ -378,11 +504,6 @@ int AP2DataPlot2DModel::columnCount ( const QModelIndex & parent) const
 }
 QVariant AP2DataPlot2DModel::data ( const QModelIndex & index, int role) const
 {
-    quint64 tableindex = index.row();
-    if (m_rowToTableMap.contains(index.row()))
-    {
-        tableindex = m_rowToTableMap.value(index.row()).first;
-    }
     if (role != Qt::DisplayRole)
     {
         return QVariant();
@@ -391,50 +512,17 @@ QVariant AP2DataPlot2DModel::data ( const QModelIndex & index, int role) const
     {
         return QVariant();
     }
-    if (index.column() == 0)
+    if (index.row() < m_fmtStringList.size())
     {
-        if (index.row() < m_fmtStringList.size())
+        if (index.column() == 0)
         {
             //Index is a FMT msg
             return QString::number(index.row());
         }
-        else
-        {
-            //Index is a normal table message, get the index from m_rowToTableMap
-            return QString::number(tableindex);
-        }
-    }
-    if (index.row() < m_fmtStringList.size())
-    {
         return m_fmtStringList.at(index.row()).value(index.column()-1);
     }
-
-    QString tablename = m_rowToTableMap.value(index.row()).second;
-    QSqlQuery tablequery(m_sharedDb);
-    QString val = QString::number(tableindex);
-    tablequery.prepare("SELECT * FROM " + tablename + " WHERE idx = " + val);
-    if (!tablequery.exec())
-    {
-        qDebug() << "Unable to exec table query:" << tablequery.lastError().text();
-        return QVariant();
-    }
-    if (!tablequery.next())
-    {
-        return QVariant();
-    }
-    if ((index.column()-1) >= tablequery.record().count())
-    {
-        return QVariant();
-    }
-    if (index.column() == 0)
-    {
-        return tablequery.value(0);
-    }
-    if (index.column() == 1)
-    {
-        return tablename;
-    }
-    return tablequery.value((index.column()-1));
+    //Normal table message, served from the paged row cache
+    return m_rowCache->value(index.row(),index.column());
 }
 void AP2DataPlot2DModel::selectedRowChanged(QModelIndex current,QModelIndex previous)
 {
@@ -533,6 +621,20 @@ bool AP2DataPlot2DModel::addType(QString name,int type,int length,QString types,
 }
 QMap<quint64,QVariant> AP2DataPlot2DModel::getValues(const QString& parent,const QString& child)
 {
+    if (isLazyType(parent))
+    {
+        QVector<quint64> indexes;
+        QVector<QVariant> values;
+        QMap<quint64,QVariant> retval;
+        if (m_lazyLog->decodeVariantColumn(parent,child,&indexes,&values))
+        {
+            for (int i=0;i<indexes.size();i++)
+            {
+                retval.insert(indexes.at(i),values.at(i));
+            }
+        }
+        return retval;
+    }
     int index = getChildIndex(parent,child);
     QSqlQuery itemquery(m_sharedDb);
     itemquery.prepare("SELECT * FROM '" + parent + "';");
@@ -548,43 +650,186 @@ QMap<quint64,QVariant> AP2DataPlot2DModel::getValues(const QString& parent,const
     return retval;
 }
 
-int AP2DataPlot2DModel::getChildIndex(const QString& parent,const QString& child)
+bool AP2DataPlot2DModel::getColumn(const QString& parent,const QString& child,QVector<double> *index,QVector<double> *values)
 {
+    QString key = parent + "." + child;
+    QHash<QString,AP2DataPlotColumn>::const_iterator cached = m_columnCache.constFind(key);
+    if (cached != m_columnCache.constEnd())
+    {
+        if (index && values)
+        {
+            *index = cached.value().index;
+            *values = cached.value().values;
+        }
+        return true;
+    }
 
-    QSqlQuery tablequery(m_sharedDb);
-    //tablequery.prepare("SELECT * FROM '" + parent + "';");
-    if (!tablequery.prepare("SELECT * FROM 'FMT' WHERE name = '" + parent + "';"))
+    AP2DataPlotColumn column;
+    if (parent == derivedType())
     {
-        QLOG_DEBUG() << "Error preparing select:" + tablequery.lastError().text();
-        return -1;
+        if (!getDerivedColumn(child,&column))
+        {
+            return false;
+        }
     }
-    if (!tablequery.exec())
+    else if (isLazyType(parent))
     {
-        QLOG_DEBUG() << "Error execing select:" + tablequery.lastError().text();
-        return -1;
+        if (!m_lazyLog->decodeColumn(parent,child,&column.index,&column.values))
+        {
+            return false;
+        }
     }
-    if (!tablequery.next())
+    else
     {
-        return -1;
+        if (getChildIndex(parent,child) == -1)
+        {
+            return false;
+        }
+        QSqlQuery itemquery(m_sharedDb);
+        itemquery.setForwardOnly(true);
+        if (!itemquery.prepare("SELECT idx," + child + " FROM '" + parent + "' ORDER BY idx;") || !itemquery.exec())
+        {
+            QLOG_DEBUG() << "Error selecting column" << key << itemquery.lastError().text();
+            return false;
+        }
+        while (itemquery.next())
+        {
+            QVariant value = itemquery.value(1);
+            if (value.type() == QVariant::String)
+            {
+                //Text fields are annotations, not graphable numbers
+                return false;
+            }
+            column.index.append(itemquery.value(0).toDouble());
+            column.values.append(value.toDouble());
+        }
+    }
+    m_columnCache.insert(key,column);
+    if (index && values)
+    {
+        *index = column.index;
+        *values = column.values;
+    }
+    return true;
+}
+
+bool AP2DataPlot2DModel::getDerivedColumn(const QString& name,AP2DataPlotColumn *column)
+{
+    if (!m_derivedChannels.contains(name) || m_derivedInProgress.contains(name))
+    {
+        return false;
     }
-    QSqlRecord record = tablequery.record();
-    QStringList valuessplit = record.value(5).toString().split(","); //comma delimited list of names
-    bool found = false;
-    int index = 0;
-    for (int i=0;i<valuessplit.size();i++)
+    AP2DataPlotQuery query;
+    if (!query.parse(m_derivedChannels.value(name)))
+    {
+        QLOG_DEBUG() << "Invalid derived channel" << name << query.getError();
+        return false;
+    }
+    m_derivedInProgress.insert(name);
+    bool ok = query.evaluateSeries(this,&column->index,&column->values);
+    m_derivedInProgress.remove(name);
+    if (!ok)
+    {
+        QLOG_DEBUG() << "Unable to compute derived channel" << name << query.getError();
+    }
+    return ok;
+}
+
+void AP2DataPlot2DModel::clearDerivedColumns()
+{
+    //Channels can use each other, so they all go
+    QString prefix = derivedType() + ".";
+    for (QHash<QString,AP2DataPlotColumn>::iterator i = m_columnCache.begin();i!=m_columnCache.end();)
     {
-        if (valuessplit.at(i) == child)
+        if (i.key().startsWith(prefix))
         {
-            found = true;
-            index = i;
-            i = valuessplit.size();
+            i = m_columnCache.erase(i);
         }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void AP2DataPlot2DModel::setDerivedChannel(const QString& name,const QString& expression)
+{
+    m_derivedChannels.insert(name,expression);
+    clearDerivedColumns();
+}
+
+void AP2DataPlot2DModel::removeDerivedChannel(const QString& name)
+{
+    m_derivedChannels.remove(name);
+    clearDerivedColumns();
+}
+
+bool AP2DataPlot2DModel::getValues(const QString& type,const QString& field,double tStart,double tEnd,int maxPoints,QVector<double> *index,QVector<double> *values)
+{
+    index->clear();
+    values->clear();
+    if (!getColumn(type,field,NULL,NULL))
+    {
+        return false;
+    }
+    AP2DataPlotColumn &column = m_columnCache[type + "." + field];
+    int count = column.index.size();
+    if (count == 0)
+    {
+        return true;
+    }
+    int first = qLowerBound(column.index.constBegin(),column.index.constEnd(),tStart) - column.index.constBegin();
+    int last = qUpperBound(column.index.constBegin(),column.index.constEnd(),tEnd) - column.index.constBegin();
+    if (maxPoints <= 0 || last - first <= maxPoints)
+    {
+        first = qMax(0,first - 1);
+        last = qMin(count,last + 1);
+        *index = column.index.mid(first,last - first);
+        *values = column.values.mid(first,last - first);
+        return true;
+    }
+    if (column.detail.isNull())
+    {
+        column.detail = QSharedPointer<AP2DataPlotDecimator>(new AP2DataPlotDecimator());
+        column.detail->setData(column.index,column.values);
+    }
+    column.detail->getPoints(tStart,tEnd,qMax(1,maxPoints / 2),*index,*values);
+    return true;
+}
+
+bool AP2DataPlot2DModel::getValueAt(const QString& type,const QString& field,double index,double *value)
+{
+    QVector<double> keys;
+    QVector<double> values;
+    if (!getValues(type,field,index,index,0,&keys,&values) || keys.isEmpty())
+    {
+        return false;
     }
-    if (!found)
+    //At most the sample before index, any at it, and the one after
+    int pos = qUpperBound(keys.constBegin(),keys.constEnd(),index) - keys.constBegin();
+    *value = values.at(qMax(0,pos - 1));
+    return true;
+}
+
+int AP2DataPlot2DModel::getRowForIndex(quint64 index) const
+{
+    if (m_rowIndexes.isEmpty())
+    {
+        return -1;
+    }
+    int row = qLowerBound(m_rowIndexes.constBegin(),m_rowIndexes.constEnd(),index) - m_rowIndexes.constBegin();
+    return qMin(row,m_rowIndexes.size() - 1);
+}
+
+int AP2DataPlot2DModel::getChildIndex(const QString& parent,const QString& child)
+{
+    //Field names are kept per type as types are added, no need to go back to the FMT table
+    QMap<QString,QList<QString> >::const_iterator fields = m_headerStringList.constFind(parent);
+    if (fields == m_headerStringList.constEnd())
     {
         return -1;
     }
-    return index;
+    return fields.value().indexOf(child);
 }
 bool AP2DataPlot2DModel::startTransaction()
 {
@@ -597,6 +842,9 @@ bool AP2DataPlot2DModel::startTransaction()
 }
 bool AP2DataPlot2DModel::endTransaction()
 {
+    //Rows may have changed under any cached pages or columns
+    m_rowCache->clear();
+    m_columnCache.clear();
     if (!m_sharedDb.commit())
     {
         setError("Unable to commit to database: " + m_sharedDb.lastError().text());
@@ -605,31 +853,33 @@ bool AP2DataPlot2DModel::endTransaction()
     return true;
 }
 
-bool AP2DataPlot2DModel::addRow(QString name,QList<QPair<QString,QVariant> >  values,quint64 index)
+QSqlQuery *AP2DataPlot2DModel::getInsertQuery(const QString& name)
 {
-    if (m_firstIndex == 0)
+    //Insert statements are prepared once per type and reused for every row
+    QSqlQuery *query = m_insertQueries.value(name);
+    if (!query)
     {
-        m_firstIndex = index;
-    }
-    m_lastIndex = index;
-    //Add a row to a previously defined message type, NAME.Jy   Th
-    QSqlQuery query(m_sharedDb);
-    if (m_msgNameToInsertQuery.contains(name))
-    {
-        if (!query.prepare(m_msgNameToInsertQuery.value(name)))
+        query = new QSqlQuery(m_sharedDb);
+        if (!query->prepare(m_msgNameToInsertQuery.value(name)))
         {
-           setError("Unable to prepare query: " + query.lastError().text());
-           return false;
+           setError("Unable to prepare query: " + query->lastError().text());
+           delete query;
+           return NULL;
         }
+        m_insertQueries.insert(name,query);
     }
-    query.bindValue(QString(":idx"),index);
-    for (int i=0;i<values.size();i++)
+    return query;
+}
+bool AP2DataPlot2DModel::insertRow(QSqlQuery *query,const QString& name,int fieldcount,quint64 index)
+{
+    if (m_firstIndex == 0)
     {
-        query.bindValue(QString(":") + values.at(i).first,values.at(i).second);
+        m_firstIndex = index;
     }
-    if (!query.exec())
+    m_lastIndex = index;
+    if (!query->exec())
     {
-        setError("Error execing insert query: " + query.lastError().text());
+        setError("Error execing insert query: " + query->lastError().text());
         return false;
     }
     else
@@ -642,18 +892,54 @@ bool AP2DataPlot2DModel::addRow(QString name,QList<QPair<QString,QVariant> >  va
             return false;
         }
     }
-    if (values.size() > m_columnCount)
+    if (fieldcount > m_columnCount)
     {
-        m_columnCount = values.size();
+        m_columnCount = fieldcount;
     }
-    m_rowToTableMap.insert(m_rowCount++,QPair<quint64,QString>(index,name));
-   // if (!m_sharedDb.commit())
-   // {
-   //     setError("Error commiting to database " + m_sharedDb.lastError().text());
-   //     return false;
-   // }
+    QWriteLocker locker(&m_rowLock);
+    m_pendingRows.append(QPair<quint64,QString>(index,name));
+    m_typeRowCount[name]++;
     return true;
-
+}
+bool AP2DataPlot2DModel::addRow(QString name,QList<QPair<QString,QVariant> >  values,quint64 index)
+{
+    //Add a row to a previously defined message type, NAME.Jy   Th
+    QSqlQuery *query = getInsertQuery(name);
+    if (!query)
+    {
+        return false;
+    }
+    if (values.size() < m_headerStringList.value(name).size())
+    {
+        //Bindings stay set between rows, fields missing from this row have to be cleared
+        const QList<QString> &fields = m_headerStringList[name];
+        for (int i=0;i<fields.size();i++)
+        {
+            query->bindValue(QString(":") + fields.at(i).trimmed(),QVariant());
+        }
+    }
+    query->bindValue(QString(":idx"),index);
+    for (int i=0;i<values.size();i++)
+    {
+        query->bindValue(QString(":") + values.at(i).first,values.at(i).second);
+    }
+    return insertRow(query,name,values.size(),index);
+}
+bool AP2DataPlot2DModel::addRow(const QString& name,const QVariant *values,int count,quint64 index)
+{
+    QSqlQuery *query = getInsertQuery(name);
+    if (!query)
+    {
+        return false;
+    }
+    //Placeholder 0 is the index, the fields follow in FMT order
+    int fieldcount = m_headerStringList.value(name).size();
+    query->bindValue(0,index);
+    for (int i=0;i<fieldcount;i++)
+    {
+        query->bindValue(i + 1,(i < count) ? values[i] : QVariant());
+    }
+    return insertRow(query,name,qMin(count,fieldcount),index);
 }
 QString AP2DataPlot2DModel::makeCreateTableString(QString tablename, QString formatstr,QStringList variablestr)
 {
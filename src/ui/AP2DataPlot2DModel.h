@@ -32,6 +32,26 @@ This file is part of the APM_PLANNER project
 
 #include <QAbstractTableModel>
 #include <QSqlDatabase>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+
+class AP2DataPlot2DRowCache;
+class AP2DataPlotDecimator;
+class QSqlQuery;
+class AP2DataPlotLazyLog;
+
+//One numeric field of a message type, ordered by log index
+class AP2DataPlotColumn
+{
+public:
+    QVector<double> index;
+    QVector<double> values;
+    //Min/max pyramid for ranged reads, built the first time one has to be decimated
+    QSharedPointer<AP2DataPlotDecimator> detail;
+};
 
 class AP2DataPlot2DModel : public QAbstractTableModel
 {
@@ -46,17 +66,55 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
     bool addType(QString name,int type,int length,QString types,QStringList names);
     bool addRow(QString name,QList<QPair<QString,QVariant> >  values,quint64 index);
+    //Same as above with count values in FMT field order, which avoids binding by name
+    bool addRow(const QString& name,const QVariant *values,int count,quint64 index);
     QMap<QString,QList<QString> > getFmtValues();
     QString getFmtLine(const QString& name);
     QMap<quint64,QString> getModeValues();
     bool hasType(const QString& name);
     QMap<quint64,QVariant> getValues(const QString& parent,const QString& child);
+    //Numeric field as index/value vectors, decoded once and then cached. Returns false for text fields.
+    bool getColumn(const QString& parent,const QString& child,QVector<double> *index,QVector<double> *values);
+    //Samples of a numeric field with log index in [tStart,tEnd], plus the sample either side so lines
+    //drawn from them reach the range edges. Found by binary search on the cached column. If maxPoints
+    //is above zero and the range holds more samples than that, they are reduced to the min and max of
+    //each bucket of the column's AP2DataPlotDecimator, at least maxPoints/2 buckets, so spikes are kept.
+    bool getValues(const QString& type,const QString& field,double tStart,double tEnd,int maxPoints,QVector<double> *index,QVector<double> *values);
+    //Value of the last sample at or before index, or the first sample if there is none before it
+    bool getValueAt(const QString& type,const QString& field,double index,double *value);
+    //Table row of the first message at or after a log index
+    int getRowForIndex(quint64 index) const;
     int getChildIndex(const QString& parent,const QString& child);
     QString getError() { return m_error; }
     bool endTransaction();
     bool startTransaction();
     quint64 getLastIndex();
     quint64 getFirstIndex();
+    //Log index and message name for count table rows starting at first
+    QList<QPair<quint64,QString> > getRowKeys(int first,int count) const;
+    //Rows the loader adds are held back until this is called on the GUI thread, with the
+    //loader paused or done. Only then do rowCount(), the row map and the views see them.
+    void publishRows();
+    QSqlDatabase getDatabase() const { return m_sharedDb; }
+    QString getDatabaseName() const { return m_databaseName; }
+    //URI other threads use to open their own connection to this database
+    QString getDatabaseUri() const;
+
+    //Lazy loading of binary logs, see AP2DataPlotLazyLog. The model takes ownership of the log.
+    void setLazyLog(AP2DataPlotLazyLog *log);
+    bool addLazyType(const QString& name,const QString& format,const QStringList& labels,int length);
+    bool isLazyType(const QString& name) const;
+    bool addLazyRow(const QString& name,qint64 offset,quint64 index,int fieldcount);
+    //Decode a lazy row in the table view layout, safe to call from the row cache thread
+    QVector<QVariant> getLazyRow(const QString& name,quint64 index) const;
+    QVector<quint64> getLazyIndexes(const QString& name) const;
+
+    //Derived channels are expressions over other fields (see AP2DataPlotQuery), read with
+    //getColumn(derivedType(),name) and computed the first time they are read.
+    static QString derivedType() { return "DERIVED"; }
+    void setDerivedChannel(const QString& name,const QString& expression);
+    void removeDerivedChannel(const QString& name);
+    QMap<QString,QString> getDerivedChannels() const { return m_derivedChannels; }
 
 public slots:
     void selectedRowChanged(QModelIndex current,QModelIndex previous);
@@ -71,18 +129,33 @@ private: //helpers
     bool createIndexTable();
     bool createIndexInsert(QSqlQuery *query);
     void setError(QString error);
+    QSqlQuery *getInsertQuery(const QString& name);
+    bool insertRow(QSqlQuery *query,const QString& name,int fieldcount,quint64 index);
     QString makeCreateTableString(QString tablename, QString formatstr,QStringList variablestr);
     QString makeInsertTableString(QString tablename, QStringList variablestr);
+    bool getDerivedColumn(const QString& name,AP2DataPlotColumn *column);
+    void clearDerivedColumns();
 
 private:
     QString m_error;
     QString m_databaseName;
     QSqlDatabase m_sharedDb;
+    //Guards the row maps and the lazy log's records. The loader thread writes m_pendingRows
+    //and the lazy log, publishRows() moves the pending rows over on the GUI thread, and the
+    //row cache thread reads through getRowKeys() and getLazyRow().
+    mutable QReadWriteLock m_rowLock;
+    //Rows added since the last publishRows(), log index and message name
+    QVector<QPair<quint64,QString> > m_pendingRows;
     QMap<int,QPair<quint64,QString> > m_rowToTableMap;
+    //Log index of each row, in row order, for getRowForIndex
+    QVector<quint64> m_rowIndexes;
     QMap<QString,QList<QString> > m_headerStringList;
     QList<QString> m_currentHeaderItems;
     QList<QList<QString> > m_fmtStringList;
     QMap<QString,QString> m_msgNameToInsertQuery;
+    QHash<QString,int> m_typeRowCount;
+    //Prepared insert per message type, see addRow
+    QHash<QString,QSqlQuery*> m_insertQueries;
 
     int m_rowCount;
     int m_columnCount;
@@ -95,6 +168,14 @@ private:
     QSqlQuery *m_indexinsertquery;
     QSqlQuery *m_fmtInsertQuery;
 
+    AP2DataPlot2DRowCache *m_rowCache;
+    AP2DataPlotLazyLog *m_lazyLog;
+    //"TYPE.Field" to decoded column
+    QHash<QString,AP2DataPlotColumn> m_columnCache;
+    //Derived channel name to expression
+    QMap<QString,QString> m_derivedChannels;
+    //Channels being computed, so one defined in terms of itself fails instead of recursing
+    QSet<QString> m_derivedInProgress;
 
 };
 
@@ -0,0 +1,286 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot paged row cache for the table view
+ */
+
+
+#include "AP2DataPlot2DRowCache.h"
+#include "AP2DataPlot2DModel.h"
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QsLog.h>
+
+AP2DataPlot2DRowCache::AP2DataPlot2DRowCache(AP2DataPlot2DModel *model,QObject *parent) :
+    QThread(parent),
+    m_model(model),
+    m_pages(MaxPages),
+    m_stop(false),
+    m_generation(0),
+    m_lastPage(-1)
+{
+    m_guiDb = m_model->getDatabase();
+}
+
+AP2DataPlot2DRowCache::~AP2DataPlot2DRowCache()
+{
+    stopPrefetch();
+}
+
+void AP2DataPlot2DRowCache::stopPrefetch()
+{
+    m_mutex.lock();
+    m_stop = true;
+    m_prefetchQueue.clear();
+    m_waitCondition.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+void AP2DataPlot2DRowCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pages.clear();
+    m_prefetchQueue.clear();
+    m_lastPage = -1;
+    //Any page the prefetch thread is loading right now belongs to the old rows
+    m_generation++;
+}
+
+QVariant AP2DataPlot2DRowCache::value(int row,int column)
+{
+    int page = row / PageSize;
+    QMutexLocker locker(&m_mutex);
+    Page *cached = m_pages.object(page);
+    if (!cached)
+    {
+        //Page miss, load it here. This is one ranged select per message type in the page.
+        locker.unlock();
+        Page *loaded = new Page();
+        if (!fetchPage(m_guiDb,page,loaded))
+        {
+            delete loaded;
+            return QVariant();
+        }
+        locker.relock();
+        if (!m_pages.contains(page))
+        {
+            m_pages.insert(page,loaded);
+        }
+        else
+        {
+            //The prefetch thread beat us to it
+            delete loaded;
+        }
+        cached = m_pages.object(page);
+    }
+    QVariant retval;
+    int offset = row - (page * PageSize);
+    if (cached && offset < cached->size() && column < cached->at(offset).size())
+    {
+        retval = cached->at(offset).at(column);
+    }
+    if (page != m_lastPage)
+    {
+        requestPrefetch(page,(page > m_lastPage) ? 1 : -1);
+        m_lastPage = page;
+    }
+    return retval;
+}
+
+void AP2DataPlot2DRowCache::requestPrefetch(int page,int direction)
+{
+    //Must be called with m_mutex locked. Anything still queued from an older
+    //viewport position is stale, so the queue is replaced rather than appended to.
+    m_prefetchQueue.clear();
+    for (int i=1;i<=PrefetchPages;i++)
+    {
+        int next = page + (i * direction);
+        if (next < 0 || (next * PageSize) >= m_model->rowCount())
+        {
+            break;
+        }
+        if (!m_pages.contains(next))
+        {
+            m_prefetchQueue.append(next);
+        }
+    }
+    if (m_prefetchQueue.size() == 0 || m_stop)
+    {
+        //Once stopped the prefetcher stays stopped, pages are then only loaded on demand
+        return;
+    }
+    if (!isRunning())
+    {
+        start(QThread::LowPriority);
+    }
+    m_waitCondition.wakeAll();
+}
+
+bool AP2DataPlot2DRowCache::fetchPage(QSqlDatabase &db,int page,Page *result)
+{
+    QList<QPair<quint64,QString> > keys = m_model->getRowKeys(page * PageSize,PageSize);
+    if (keys.size() == 0)
+    {
+        return false;
+    }
+
+    //Group the rows by message type, so each type needs a single ranged select
+    QMap<QString,QPair<quint64,quint64> > tableRanges;
+    for (int i=0;i<keys.size();i++)
+    {
+        const QString &table = keys.at(i).second;
+        quint64 idx = keys.at(i).first;
+        if (!tableRanges.contains(table))
+        {
+            tableRanges.insert(table,QPair<quint64,quint64>(idx,idx));
+        }
+        else
+        {
+            QPair<quint64,quint64> &range = tableRanges[table];
+            range.first = qMin(range.first,idx);
+            range.second = qMax(range.second,idx);
+        }
+    }
+
+    QHash<quint64,QVector<QVariant> > rowsByIndex;
+    for (QMap<QString,QPair<quint64,quint64> >::const_iterator i = tableRanges.constBegin();i!=tableRanges.constEnd();i++)
+    {
+        if (m_model->isLazyType(i.key()))
+        {
+            //Lazy loaded rows are decoded straight from the log file instead
+            for (int j=0;j<keys.size();j++)
+            {
+                if (keys.at(j).second == i.key())
+                {
+                    rowsByIndex.insert(keys.at(j).first,m_model->getLazyRow(i.key(),keys.at(j).first));
+                }
+            }
+            continue;
+        }
+        QSqlQuery tablequery(db);
+        tablequery.setForwardOnly(true);
+        if (!tablequery.prepare("SELECT * FROM '" + i.key() + "' WHERE idx >= :first AND idx <= :last;"))
+        {
+            //Not cached, so the page is tried again the next time it is shown
+            QLOG_DEBUG() << "AP2DataPlot2DRowCache: Unable to prepare page query:" << tablequery.lastError().text();
+            return false;
+        }
+        tablequery.bindValue(":first",i.value().first);
+        tablequery.bindValue(":last",i.value().second);
+        if (!tablequery.exec())
+        {
+            QLOG_DEBUG() << "AP2DataPlot2DRowCache: Unable to exec page query:" << tablequery.lastError().text();
+            return false;
+        }
+        while (tablequery.next())
+        {
+            //Decode into the same column layout AP2DataPlot2DModel::data() presents:
+            //0 is the index, 1 the message name, and the message fields from 2 onward.
+            QSqlRecord record = tablequery.record();
+            quint64 idx = record.value(0).toLongLong();
+            QVector<QVariant> row(record.count() + 1);
+            row[0] = QString::number(idx);
+            row[1] = i.key();
+            for (int j=1;j<record.count();j++)
+            {
+                row[j+1] = record.value(j);
+            }
+            rowsByIndex.insert(idx,row);
+        }
+    }
+
+    result->resize(keys.size());
+    for (int i=0;i<keys.size();i++)
+    {
+        (*result)[i] = rowsByIndex.value(keys.at(i).first);
+    }
+    return true;
+}
+
+void AP2DataPlot2DRowCache::run()
+{
+    if (QThread::currentThread() == QCoreApplication::instance()->thread())
+    {
+        //This loop waits for prefetch requests, on the GUI thread it would never return
+        QLOG_ERROR() << "AP2DataPlot2DRowCache::run() called on the GUI thread, use start() instead";
+        return;
+    }
+    QString connectionName = m_model->getDatabaseName() + "_rowcache";
+    {
+        //A QSqlDatabase connection may only be used from the thread that created it,
+        //so the prefetcher opens its own connection to the shared in-memory database.
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE",connectionName);
+        db.setConnectOptions("QSQLITE_OPEN_URI");
+        db.setDatabaseName(m_model->getDatabaseUri());
+        if (!db.open())
+        {
+            QLOG_ERROR() << "AP2DataPlot2DRowCache: Unable to open prefetch connection:" << db.lastError().text();
+        }
+        else
+        {
+            forever
+            {
+                m_mutex.lock();
+                while (!m_stop && m_prefetchQueue.isEmpty())
+                {
+                    m_waitCondition.wait(&m_mutex);
+                }
+                if (m_stop)
+                {
+                    m_mutex.unlock();
+                    break;
+                }
+                int page = m_prefetchQueue.takeFirst();
+                int generation = m_generation;
+                bool cached = m_pages.contains(page);
+                m_mutex.unlock();
+                if (cached)
+                {
+                    continue;
+                }
+
+                Page *loaded = new Page();
+                if (!fetchPage(db,page,loaded))
+                {
+                    delete loaded;
+                    continue;
+                }
+                QMutexLocker locker(&m_mutex);
+                if (m_stop || generation != m_generation || m_pages.contains(page))
+                {
+                    delete loaded;
+                }
+                else
+                {
+                    m_pages.insert(page,loaded);
+                }
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+}
@@ -0,0 +1,89 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot paged row cache for the table view
+ */
+
+
+#ifndef AP2DATAPLOT2DROWCACHE_H
+#define AP2DATAPLOT2DROWCACHE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCache>
+#include <QVector>
+#include <QVariant>
+#include <QSqlDatabase>
+
+class AP2DataPlot2DModel;
+
+/*
+ * Holds decoded table rows in fixed size pages so AP2DataPlot2DModel::data()
+ * can be answered from memory. A page is loaded with one ranged SELECT per
+ * message type contained in it, rather than one SELECT per cell.
+ *
+ * Pages ahead of the viewport in the scroll direction are loaded on a
+ * background thread using its own connection to the shared in-memory database.
+ */
+class AP2DataPlot2DRowCache : public QThread
+{
+    Q_OBJECT
+public:
+    //Rows per page, and number of pages kept in memory
+    static const int PageSize = 256;
+    static const int MaxPages = 128;
+    //Number of pages to load ahead of the viewport in the scroll direction
+    static const int PrefetchPages = 4;
+
+    explicit AP2DataPlot2DRowCache(AP2DataPlot2DModel *model,QObject *parent = 0);
+    ~AP2DataPlot2DRowCache();
+
+    //Returns the table value for a row/column, as the model would display it
+    QVariant value(int row,int column);
+    //Drop every cached page, used when the underlying rows change
+    void clear();
+    void stopPrefetch();
+
+private:
+    typedef QVector<QVector<QVariant> > Page;
+
+    void run(); // from QThread;
+    bool fetchPage(QSqlDatabase &db,int page,Page *result);
+    void requestPrefetch(int page,int direction);
+
+private:
+    AP2DataPlot2DModel *m_model;
+    QSqlDatabase m_guiDb;
+
+    QMutex m_mutex;
+    QWaitCondition m_waitCondition;
+    QCache<int,Page> m_pages;
+    QList<int> m_prefetchQueue;
+    bool m_stop;
+    int m_generation;
+
+    int m_lastPage;
+};
+
+#endif // AP2DATAPLOT2DROWCACHE_H
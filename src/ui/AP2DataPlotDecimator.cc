@@ -0,0 +1,202 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot level of detail for large graph series
+ */
+
+
+#include "AP2DataPlotDecimator.h"
+#include <QtAlgorithms>
+
+AP2DataPlotDecimator::AP2DataPlotDecimator()
+{
+}
+
+void AP2DataPlotDecimator::clear()
+{
+    m_keys.clear();
+    m_values.clear();
+    m_levels.clear();
+}
+
+void AP2DataPlotDecimator::appendBucket(Level &level,double minkey,double minvalue,double maxkey,double maxvalue)
+{
+    level.minKey.append(minkey);
+    level.minValue.append(minvalue);
+    level.maxKey.append(maxkey);
+    level.maxValue.append(maxvalue);
+}
+
+void AP2DataPlotDecimator::setData(const QVector<double> &keys,const QVector<double> &values)
+{
+    clear();
+    m_keys = keys;
+    m_values = values;
+    int count = qMin(m_keys.size(),m_values.size());
+    if (count < BucketFactor * 2)
+    {
+        //Nothing to gain, always draw raw
+        return;
+    }
+
+    //First level is built from the raw samples
+    Level first;
+    first.bucketSize = BucketFactor;
+    int bucketcount = (count + BucketFactor - 1) / BucketFactor;
+    first.minKey.reserve(bucketcount);
+    first.minValue.reserve(bucketcount);
+    first.maxKey.reserve(bucketcount);
+    first.maxValue.reserve(bucketcount);
+    for (int i=0;i<count;i+=BucketFactor)
+    {
+        int end = qMin(i + BucketFactor,count);
+        int minindex = i;
+        int maxindex = i;
+        for (int j=i+1;j<end;j++)
+        {
+            if (m_values.at(j) < m_values.at(minindex))
+            {
+                minindex = j;
+            }
+            if (m_values.at(j) > m_values.at(maxindex))
+            {
+                maxindex = j;
+            }
+        }
+        appendBucket(first,m_keys.at(minindex),m_values.at(minindex),m_keys.at(maxindex),m_values.at(maxindex));
+    }
+    m_levels.append(first);
+
+    //Each further level merges BucketFactor buckets of the level below, until there are only a handful left
+    while (m_levels.last().minKey.size() > BucketFactor * 2)
+    {
+        const Level &below = m_levels.last();
+        Level level;
+        level.bucketSize = below.bucketSize * BucketFactor;
+        int belowcount = below.minKey.size();
+        for (int i=0;i<belowcount;i+=BucketFactor)
+        {
+            int end = qMin(i + BucketFactor,belowcount);
+            int minindex = i;
+            int maxindex = i;
+            for (int j=i+1;j<end;j++)
+            {
+                if (below.minValue.at(j) < below.minValue.at(minindex))
+                {
+                    minindex = j;
+                }
+                if (below.maxValue.at(j) > below.maxValue.at(maxindex))
+                {
+                    maxindex = j;
+                }
+            }
+            appendBucket(level,below.minKey.at(minindex),below.minValue.at(minindex),below.maxKey.at(maxindex),below.maxValue.at(maxindex));
+        }
+        m_levels.append(level);
+    }
+}
+
+void AP2DataPlotDecimator::getPoints(double lower,double upper,int pixelWidth,QVector<double> &keys,QVector<double> &values) const
+{
+    keys.clear();
+    values.clear();
+    int count = qMin(m_keys.size(),m_values.size());
+    if (count == 0)
+    {
+        return;
+    }
+    //Raw sample range, widened by one sample either side
+    int first = qLowerBound(m_keys.constBegin(),m_keys.constBegin() + count,lower) - m_keys.constBegin();
+    int last = qUpperBound(m_keys.constBegin(),m_keys.constBegin() + count,upper) - m_keys.constBegin();
+    first = qMax(0,first - 1);
+    last = qMin(count - 1,last);
+
+    int visible = last - first + 1;
+    pixelWidth = qMax(1,pixelWidth);
+
+    //Pick the coarsest level which still has at least one bucket per pixel
+    int levelindex = -1;
+    for (int i=0;i<m_levels.size();i++)
+    {
+        if (visible / m_levels.at(i).bucketSize >= pixelWidth)
+        {
+            levelindex = i;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (levelindex == -1)
+    {
+        //Zoomed in far enough to draw the raw samples
+        keys = m_keys.mid(first,visible);
+        values = m_values.mid(first,visible);
+        return;
+    }
+
+    const Level &level = m_levels.at(levelindex);
+    int firstbucket = first / level.bucketSize;
+    int lastbucket = qMin(level.minKey.size() - 1,last / level.bucketSize);
+    keys.reserve(((lastbucket - firstbucket + 1) * 2) + 2);
+    values.reserve(((lastbucket - firstbucket + 1) * 2) + 2);
+
+    //Edge samples keep the line continuous to the border of the plot
+    keys.append(m_keys.at(first));
+    values.append(m_values.at(first));
+    for (int i=firstbucket;i<=lastbucket;i++)
+    {
+        //Emit the extremes in key order so the polyline doesn't double back
+        if (level.minKey.at(i) <= level.maxKey.at(i))
+        {
+            keys.append(level.minKey.at(i));
+            values.append(level.minValue.at(i));
+            keys.append(level.maxKey.at(i));
+            values.append(level.maxValue.at(i));
+        }
+        else
+        {
+            keys.append(level.maxKey.at(i));
+            values.append(level.maxValue.at(i));
+            keys.append(level.minKey.at(i));
+            values.append(level.minValue.at(i));
+        }
+    }
+    keys.append(m_keys.at(last));
+    values.append(m_values.at(last));
+
+    //QCPGraph::setData keys on x, drop duplicate keys that the edge samples may have introduced
+    int out = 1;
+    for (int i=1;i<keys.size();i++)
+    {
+        if (keys.at(i) > keys.at(out-1))
+        {
+            keys[out] = keys.at(i);
+            values[out] = values.at(i);
+            out++;
+        }
+    }
+    keys.resize(out);
+    values.resize(out);
+}
@@ -0,0 +1,78 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot level of detail for large graph series
+ */
+
+
+#ifndef AP2DATAPLOTDECIMATOR_H
+#define AP2DATAPLOTDECIMATOR_H
+
+#include <QVector>
+
+/*
+ * Min/max envelope pyramid for one graph series.
+ *
+ * Level n splits the series into buckets of BucketFactor^n samples and keeps the
+ * minimum and maximum sample (with their keys) of each bucket. A replot asks for
+ * the points covering the visible key range at the plot's pixel width, and gets
+ * the raw samples when zoomed in far enough, otherwise the coarsest level that
+ * still has at least one bucket per pixel. Spikes are never lost, since every
+ * bucket contributes both its extremes.
+ */
+class AP2DataPlotDecimator
+{
+public:
+    AP2DataPlotDecimator();
+
+    //Keys must be sorted ascending
+    void setData(const QVector<double> &keys,const QVector<double> &values);
+    void clear();
+    int size() const { return m_keys.size(); }
+
+    //Points to draw for keys in [lower,upper] across pixelWidth pixels.
+    //The samples either side of the range are included so lines reach the plot edges.
+    void getPoints(double lower,double upper,int pixelWidth,QVector<double> &keys,QVector<double> &values) const;
+
+private:
+    //Each level's buckets are this many buckets (or raw samples) of the level below
+    static const int BucketFactor = 4;
+
+    class Level
+    {
+    public:
+        int bucketSize; //Raw samples per bucket
+        QVector<double> minKey;
+        QVector<double> minValue;
+        QVector<double> maxKey;
+        QVector<double> maxValue;
+    };
+
+    void appendBucket(Level &level,double minkey,double minvalue,double maxkey,double maxvalue);
+
+    QVector<double> m_keys;
+    QVector<double> m_values;
+    QVector<Level> m_levels;
+};
+
+#endif // AP2DATAPLOTDECIMATOR_H
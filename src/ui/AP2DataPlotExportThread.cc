@@ -0,0 +1,501 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot log export thread
+ */
+
+
+#include "AP2DataPlotExportThread.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include "QsLog.h"
+
+//Output is collected in memory and written out in blocks of this size
+#define EXPORT_BUFFER_SIZE (1024 * 1024)
+//Minimum time between exportProgress signals
+#define EXPORT_PROGRESS_INTERVAL_MSECS 250
+
+static QByteArray csvField(const QVariant &value)
+{
+    QByteArray field = value.toString().toLatin1();
+    if (field.contains(',') || field.contains('"'))
+    {
+        field.replace("\"","\"\"");
+        field.prepend('"');
+        field.append('"');
+    }
+    return field;
+}
+
+namespace
+{
+//Walks the rows of one message type in idx order, from its SQL table or,
+//for lazy loaded types, from the log file. Column 0 is idx, fields start at 1.
+class ExportCursor
+{
+public:
+    ExportCursor(QSqlDatabase &db,AP2DataPlot2DModel *model,const QString& name) :
+        m_model(model),
+        m_name(name),
+        m_query(NULL),
+        m_lazyPos(-1),
+        m_columns(0),
+        m_valid(false)
+    {
+        if (m_model->isLazyType(name))
+        {
+            m_lazyIndexes = m_model->getLazyIndexes(name);
+            m_valid = true;
+            return;
+        }
+        m_query = new QSqlQuery(db);
+        m_query->setForwardOnly(true);
+        if (!m_query->prepare("SELECT * FROM '" + name + "' ORDER BY idx;") || !m_query->exec())
+        {
+            QLOG_DEBUG() << "Export unable to select from" << name << m_query->lastError().text();
+            return;
+        }
+        m_columns = m_query->record().count();
+        m_valid = true;
+    }
+    ~ExportCursor()
+    {
+        delete m_query;
+    }
+    bool isValid() const { return m_valid; }
+    QString name() const { return m_name; }
+    bool next()
+    {
+        if (m_query)
+        {
+            return m_query->next();
+        }
+        if (++m_lazyPos >= m_lazyIndexes.size())
+        {
+            return false;
+        }
+        //Lazy rows come back as the table view shows them: idx, name, fields...
+        m_lazyRow = m_model->getLazyRow(m_name,m_lazyIndexes.at(m_lazyPos));
+        m_columns = m_lazyRow.size() - 1;
+        return true;
+    }
+    quint64 index() const
+    {
+        if (m_query)
+        {
+            return m_query->value(0).toULongLong();
+        }
+        return m_lazyIndexes.at(m_lazyPos);
+    }
+    int columnCount() const { return m_columns; }
+    QVariant value(int column) const
+    {
+        if (m_query)
+        {
+            return m_query->value(column);
+        }
+        if (column == 0)
+        {
+            return index();
+        }
+        return m_lazyRow.value(column + 1);
+    }
+private:
+    AP2DataPlot2DModel *m_model;
+    QString m_name;
+    QSqlQuery *m_query;
+    QVector<quint64> m_lazyIndexes;
+    int m_lazyPos;
+    QVector<QVariant> m_lazyRow;
+    int m_columns;
+    bool m_valid;
+};
+}
+
+AP2DataPlotExportThread::AP2DataPlotExportThread(AP2DataPlot2DModel *model,QObject *parent) :
+    QThread(parent),
+    m_dataModel(model),
+    m_format(DataFlashLog),
+    m_totalRows(0),
+    m_stop(false),
+    m_rowsWritten(0),
+    m_startMsecs(0),
+    m_lastProgressMsecs(0)
+{
+    QLOG_DEBUG() << "Created AP2DataPlotExportThread:" << this;
+}
+
+AP2DataPlotExportThread::~AP2DataPlotExportThread()
+{
+    QLOG_DEBUG() << "Destroyed AP2DataPlotExportThread:" << this;
+}
+
+bool AP2DataPlotExportThread::isMainThread()
+{
+    return QThread::currentThread() == QCoreApplication::instance()->thread();
+}
+
+void AP2DataPlotExportThread::exportFile(const QString& filename,ExportFormat format,const QStringList& columns)
+{
+    Q_ASSERT(isMainThread());
+    m_fileName = filename;
+    m_format = format;
+    m_columns = columns;
+    m_totalRows = m_dataModel->rowCount();
+
+    //These go through the model's own connection, so are read here rather than on the export thread
+    m_fmtValues = m_dataModel->getFmtValues();
+    m_fmtLines.clear();
+    for (QMap<QString,QList<QString> >::const_iterator i = m_fmtValues.constBegin();i!=m_fmtValues.constEnd();i++)
+    {
+        QString line = m_dataModel->getFmtLine(i.key());
+        if (line != "")
+        {
+            m_fmtLines.append(line);
+        }
+    }
+    //Reset here rather than in run(), a stopExport() before the thread gets going still counts
+    m_stop = false;
+    start();
+}
+
+void AP2DataPlotExportThread::run()
+{
+    Q_ASSERT(!isMainThread());
+    emit startExport();
+    m_rowsWritten = 0;
+    m_startMsecs = QDateTime::currentMSecsSinceEpoch();
+    m_lastProgressMsecs = m_startMsecs;
+    m_buffer.clear();
+    m_buffer.reserve(EXPORT_BUFFER_SIZE + 4096);
+
+    bool success = false;
+    QString connectionName = m_dataModel->getDatabaseName() + "_export";
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE",connectionName);
+        db.setConnectOptions("QSQLITE_OPEN_URI");
+        db.setDatabaseName(m_dataModel->getDatabaseUri());
+        if (!db.open())
+        {
+            emit error("Unable to open log database for export: " + db.lastError().text());
+        }
+        else
+        {
+            switch (m_format)
+            {
+            case DataFlashLog:
+                success = exportDataFlashLog(db);
+                break;
+            case CsvPerType:
+                success = exportCsvPerType(db);
+                break;
+            case FilteredCsv:
+                success = exportFilteredCsv(db);
+                break;
+            }
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    qint64 msecs = QDateTime::currentMSecsSinceEpoch() - m_startMsecs;
+    if (m_stop)
+    {
+        QLOG_ERROR() << "Log export was canceled after" << msecs / 1000.0 << "seconds -" << m_rowsWritten << "rows";
+        emit error("Export was canceled");
+    }
+    else if (success)
+    {
+        QLOG_INFO() << "Log export took" << msecs / 1000.0 << "seconds -" << m_rowsWritten << "rows";
+        emit done(m_rowsWritten,msecs);
+    }
+}
+
+bool AP2DataPlotExportThread::exportDataFlashLog(QSqlDatabase &db)
+{
+    QFile outputfile;
+    if (!openOutput(outputfile,m_fileName))
+    {
+        return false;
+    }
+    QString formatheader = "FMT, 128, 89, FMT, BBnNZ, Type,Length,Name,Format,Columns\r\n";
+    for (int i=0;i<m_fmtLines.size();i++)
+    {
+        formatheader += m_fmtLines.at(i) + "\r\n";
+    }
+    if (!write(outputfile,formatheader.toLatin1()))
+    {
+        return false;
+    }
+
+    //One forward only cursor per message type, merged on idx to restore log order.
+    //Each cursor has exactly one pending row in the map at a time.
+    QList<ExportCursor*> cursors;
+    QList<QByteArray> cursorNames;
+    QMap<quint64,int> pending;
+    for (QMap<QString,QList<QString> >::const_iterator i = m_fmtValues.constBegin();i!=m_fmtValues.constEnd();i++)
+    {
+        ExportCursor *cursor = new ExportCursor(db,m_dataModel,i.key());
+        if (!cursor->isValid())
+        {
+            delete cursor;
+            continue;
+        }
+        cursors.append(cursor);
+        cursorNames.append(i.key().toLatin1());
+        if (cursor->next())
+        {
+            pending.insert(cursor->index(),cursors.size()-1);
+        }
+    }
+
+    bool success = true;
+    while (!pending.isEmpty() && !m_stop && success)
+    {
+        QMap<quint64,int>::iterator first = pending.begin();
+        int current = first.value();
+        pending.erase(first);
+
+        ExportCursor *cursor = cursors.at(current);
+        QByteArray line = cursorNames.at(current);
+        for (int j=1;j<cursor->columnCount();j++)
+        {
+            line += ", " + cursor->value(j).toString().toLatin1();
+        }
+        line += "\r\n";
+        success = write(outputfile,line);
+        rowWritten();
+
+        if (cursor->next())
+        {
+            pending.insert(cursor->index(),current);
+        }
+    }
+    qDeleteAll(cursors);
+    return flush(outputfile) && success;
+}
+
+bool AP2DataPlotExportThread::exportCsvPerType(QSqlDatabase &db)
+{
+    QString basename = m_fileName;
+    if (basename.endsWith(".csv",Qt::CaseInsensitive))
+    {
+        basename.chop(4);
+    }
+    for (QMap<QString,QList<QString> >::const_iterator i = m_fmtValues.constBegin();i!=m_fmtValues.constEnd() && !m_stop;i++)
+    {
+        QFile outputfile;
+        if (!openOutput(outputfile,basename + "_" + i.key() + ".csv"))
+        {
+            return false;
+        }
+        QByteArray header = "idx";
+        for (int j=0;j<i.value().size();j++)
+        {
+            header += "," + i.value().at(j).toLatin1();
+        }
+        if (!write(outputfile,header + "\r\n"))
+        {
+            return false;
+        }
+
+        ExportCursor cursor(db,m_dataModel,i.key());
+        if (!cursor.isValid())
+        {
+            emit error("Unable to read " + i.key() + " for export");
+            return false;
+        }
+        while (cursor.next() && !m_stop)
+        {
+            QByteArray line = QByteArray::number(cursor.index());
+            for (int j=1;j<cursor.columnCount();j++)
+            {
+                line += "," + csvField(cursor.value(j));
+            }
+            line += "\r\n";
+            if (!write(outputfile,line))
+            {
+                return false;
+            }
+            rowWritten();
+        }
+        if (!flush(outputfile))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AP2DataPlotExportThread::exportFilteredCsv(QSqlDatabase &db)
+{
+    //Resolve TYPE.Field into which record column feeds which output column
+    QMap<QString,QList<QPair<int,int> > > typeToColumns;
+    for (int i=0;i<m_columns.size();i++)
+    {
+        QString type = m_columns.at(i).section('.',0,0);
+        QString field = m_columns.at(i).section('.',1);
+        int fieldindex = m_fmtValues.value(type).indexOf(field);
+        if (fieldindex == -1)
+        {
+            QLOG_DEBUG() << "Export ignoring unknown column" << m_columns.at(i);
+            continue;
+        }
+        //Record column 0 is idx, fields start at 1
+        typeToColumns[type].append(QPair<int,int>(fieldindex + 1,i));
+    }
+    if (typeToColumns.isEmpty())
+    {
+        emit error("None of the selected fields are in the log");
+        return false;
+    }
+
+    QFile outputfile;
+    if (!openOutput(outputfile,m_fileName))
+    {
+        return false;
+    }
+    if (!write(outputfile,"idx," + m_columns.join(",").toLatin1() + "\r\n"))
+    {
+        return false;
+    }
+
+    QList<ExportCursor*> cursors;
+    QList<QList<QPair<int,int> > > cursorColumns;
+    QMap<quint64,int> pending;
+    m_totalRows = 0;
+    for (QMap<QString,QList<QPair<int,int> > >::const_iterator i = typeToColumns.constBegin();i!=typeToColumns.constEnd();i++)
+    {
+        if (m_dataModel->isLazyType(i.key()))
+        {
+            m_totalRows += m_dataModel->getLazyIndexes(i.key()).size();
+        }
+        else
+        {
+            QSqlQuery count(db);
+            if (count.exec("SELECT COUNT(*) FROM '" + i.key() + "';") && count.next())
+            {
+                m_totalRows += count.value(0).toLongLong();
+            }
+        }
+        ExportCursor *cursor = new ExportCursor(db,m_dataModel,i.key());
+        if (!cursor->isValid())
+        {
+            delete cursor;
+            continue;
+        }
+        cursors.append(cursor);
+        cursorColumns.append(i.value());
+        if (cursor->next())
+        {
+            pending.insert(cursor->index(),cursors.size()-1);
+        }
+    }
+
+    QVector<QByteArray> current(m_columns.size());
+    bool success = true;
+    while (!pending.isEmpty() && !m_stop && success)
+    {
+        QMap<quint64,int>::iterator first = pending.begin();
+        quint64 idx = first.key();
+        int currentcursor = first.value();
+        pending.erase(first);
+
+        ExportCursor *cursor = cursors.at(currentcursor);
+        const QList<QPair<int,int> > &columns = cursorColumns.at(currentcursor);
+        for (int j=0;j<columns.size();j++)
+        {
+            current[columns.at(j).second] = csvField(cursor->value(columns.at(j).first));
+        }
+        QByteArray line = QByteArray::number(idx);
+        for (int j=0;j<current.size();j++)
+        {
+            line += "," + current.at(j);
+        }
+        line += "\r\n";
+        success = write(outputfile,line);
+        rowWritten();
+
+        if (cursor->next())
+        {
+            pending.insert(cursor->index(),currentcursor);
+        }
+    }
+    qDeleteAll(cursors);
+    return flush(outputfile) && success;
+}
+
+bool AP2DataPlotExportThread::openOutput(QFile &file,const QString& filename)
+{
+    file.setFileName(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        emit error("Unable to open output file: " + file.errorString());
+        return false;
+    }
+    m_buffer.clear();
+    return true;
+}
+
+bool AP2DataPlotExportThread::write(QFile &file,const QByteArray& data)
+{
+    m_buffer.append(data);
+    if (m_buffer.size() >= EXPORT_BUFFER_SIZE)
+    {
+        return flush(file);
+    }
+    return true;
+}
+
+bool AP2DataPlotExportThread::flush(QFile &file)
+{
+    //QFile buffers too, so a full disk may only show once that buffer is flushed
+    if ((m_buffer.size() > 0 && file.write(m_buffer) != m_buffer.size()) || !file.flush())
+    {
+        emit error("Error writing output file: " + file.errorString());
+        m_buffer.clear();
+        return false;
+    }
+    m_buffer.clear();
+    return true;
+}
+
+void AP2DataPlotExportThread::rowWritten()
+{
+    m_rowsWritten++;
+    if (m_rowsWritten % 4096 != 0)
+    {
+        return;
+    }
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - m_lastProgressMsecs < EXPORT_PROGRESS_INTERVAL_MSECS)
+    {
+        return;
+    }
+    m_lastProgressMsecs = now;
+    double rowspersecond = (m_rowsWritten * 1000.0) / qMax(qint64(1),now - m_startMsecs);
+    emit exportProgress(m_rowsWritten,m_totalRows,rowspersecond);
+}
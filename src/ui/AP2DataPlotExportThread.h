@@ -0,0 +1,100 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot log export thread
+ */
+
+
+#ifndef AP2DATAPLOTEXPORTTHREAD_H
+#define AP2DATAPLOTEXPORTTHREAD_H
+
+#include <QThread>
+#include <QFile>
+#include <QStringList>
+#include <QSqlDatabase>
+#include "AP2DataPlot2DModel.h"
+
+/*
+ * Streams a loaded log out of the model's database into a file, on its own
+ * thread and with its own database connection.
+ *
+ * DataFlashLog: text .log, every message merged back into log order.
+ * CsvPerType: one CSV file per message type, written type by type.
+ * FilteredCsv: a single CSV of the requested TYPE.Field columns, merged in
+ *  log order. Columns not present in a row hold their last known value.
+ */
+class AP2DataPlotExportThread : public QThread
+{
+    Q_OBJECT
+public:
+    enum ExportFormat
+    {
+        DataFlashLog,
+        CsvPerType,
+        FilteredCsv
+    };
+
+    explicit AP2DataPlotExportThread(AP2DataPlot2DModel *model,QObject *parent = 0);
+    ~AP2DataPlotExportThread();
+
+    //Must be called from the main thread, the FMT header is read from the model here.
+    void exportFile(const QString& filename,ExportFormat format,const QStringList& columns = QStringList());
+    void stopExport() { m_stop = true; }
+
+signals:
+    void startExport();
+    void exportProgress(qint64 rows,qint64 total,double rowsPerSecond);
+    void done(qint64 rows,qint64 msecs);
+    void error(QString errorstr);
+
+private:
+    void run(); // from QThread;
+    bool isMainThread();
+
+    bool exportDataFlashLog(QSqlDatabase &db);
+    bool exportCsvPerType(QSqlDatabase &db);
+    bool exportFilteredCsv(QSqlDatabase &db);
+
+    bool openOutput(QFile &file,const QString& filename);
+    bool write(QFile &file,const QByteArray& data);
+    bool flush(QFile &file);
+    void rowWritten();
+
+private:
+    AP2DataPlot2DModel *m_dataModel;
+    QString m_fileName;
+    ExportFormat m_format;
+    QStringList m_columns;
+    //Message type to field names, and the FMT header lines, captured on the main thread
+    QMap<QString,QList<QString> > m_fmtValues;
+    QStringList m_fmtLines;
+    qint64 m_totalRows;
+
+    volatile bool m_stop;
+    QByteArray m_buffer;
+    qint64 m_rowsWritten;
+    qint64 m_startMsecs;
+    qint64 m_lastProgressMsecs;
+};
+
+#endif // AP2DATAPLOTEXPORTTHREAD_H
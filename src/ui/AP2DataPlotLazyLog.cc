@@ -0,0 +1,407 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot on demand field decoding for binary logs
+ */
+
+
+#include "AP2DataPlotLazyLog.h"
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <string.h>
+#include "QsLog.h"
+
+//Columns smaller than this are decoded on the calling thread
+#define PARALLEL_DECODE_MIN_RECORDS 65536
+
+namespace
+{
+//Decodes the records [first,last) of one field into preallocated output vectors
+class ColumnDecodeTask : public QRunnable
+{
+public:
+    ColumnDecodeTask(const uchar *data,const QVector<qint64> &offsets,const QVector<quint64> &indexes,int fieldoffset,char typecode,
+                     int first,int last,double *indexout,double *valueout) :
+        m_data(data),
+        m_offsets(offsets),
+        m_indexes(indexes),
+        m_fieldOffset(fieldoffset),
+        m_typeCode(typecode),
+        m_first(first),
+        m_last(last),
+        m_indexOut(indexout),
+        m_valueOut(valueout)
+    {
+    }
+    void run()
+    {
+        for (int i=m_first;i<m_last;i++)
+        {
+            m_indexOut[i] = m_indexes.at(i);
+            m_valueOut[i] = AP2DataPlotLazyLog::decodeNumber(m_data + m_offsets.at(i) + m_fieldOffset,m_typeCode);
+        }
+    }
+private:
+    const uchar *m_data;
+    const QVector<qint64> &m_offsets;
+    const QVector<quint64> &m_indexes;
+    int m_fieldOffset;
+    char m_typeCode;
+    int m_first;
+    int m_last;
+    double *m_indexOut;
+    double *m_valueOut;
+};
+}
+
+AP2DataPlotLazyLog::AP2DataPlotLazyLog() :
+    m_data(NULL),
+    m_size(0)
+{
+}
+
+AP2DataPlotLazyLog::~AP2DataPlotLazyLog()
+{
+    if (m_data)
+    {
+        m_file.unmap(const_cast<uchar*>(m_data));
+        m_data = NULL;
+    }
+    m_file.close();
+}
+
+bool AP2DataPlotLazyLog::open(const QString& filename)
+{
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        m_error = "Unable to open log file: " + m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0,m_size);
+    if (!m_data)
+    {
+        m_error = "Unable to map log file: " + m_file.errorString();
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+int AP2DataPlotLazyLog::valueSize(char typeCode)
+{
+    switch (typeCode)
+    {
+    case 'b':
+    case 'B':
+    case 'M':
+        return 1;
+    case 'h':
+    case 'H':
+    case 'c':
+    case 'C':
+        return 2;
+    case 'i':
+    case 'I':
+    case 'e':
+    case 'E':
+    case 'L':
+    case 'f':
+    case 'n':
+        return 4;
+    case 'q':
+    case 'Q':
+        return 8;
+    case 'N':
+        return 16;
+    case 'Z':
+        return 64;
+    default:
+        return -1;
+    }
+}
+
+double AP2DataPlotLazyLog::decodeNumber(const uchar *data,char typeCode)
+{
+    switch (typeCode)
+    {
+    case 'b':
+    case 'M':
+        return static_cast<qint8>(data[0]);
+    case 'B':
+        return static_cast<quint8>(data[0]);
+    case 'h':
+        return qFromLittleEndian<qint16>(data);
+    case 'H':
+        return qFromLittleEndian<quint16>(data);
+    case 'i':
+        return qFromLittleEndian<qint32>(data);
+    case 'I':
+        return qFromLittleEndian<quint32>(data);
+    case 'f':
+    {
+        quint32 bits = qFromLittleEndian<quint32>(data);
+        float f;
+        memcpy(&f,&bits,sizeof(f));
+        return f;
+    }
+    case 'c':
+        return qFromLittleEndian<qint16>(data) / 100.0;
+    case 'C':
+        return qFromLittleEndian<quint16>(data) / 100.0;
+    case 'e':
+        return qFromLittleEndian<qint32>(data) / 100.0;
+    case 'E':
+        return qFromLittleEndian<quint32>(data) / 100.0;
+    case 'L':
+        return qFromLittleEndian<qint32>(data) / 10000000.0;
+    case 'q':
+        return qFromLittleEndian<qint64>(data);
+    case 'Q':
+        return qFromLittleEndian<quint64>(data);
+    default:
+        return 0;
+    }
+}
+
+QVariant AP2DataPlotLazyLog::decodeValue(const uchar *data,char typeCode)
+{
+    switch (typeCode)
+    {
+    case 'b':
+    case 'M':
+        return static_cast<qint8>(data[0]);
+    case 'B':
+        return static_cast<quint8>(data[0]);
+    case 'h':
+        return qFromLittleEndian<qint16>(data);
+    case 'H':
+        return qFromLittleEndian<quint16>(data);
+    case 'i':
+        return qFromLittleEndian<qint32>(data);
+    case 'I':
+        return qFromLittleEndian<quint32>(data);
+    case 'q':
+        return qFromLittleEndian<qint64>(data);
+    case 'Q':
+        return qFromLittleEndian<quint64>(data);
+    case 'f':
+        return static_cast<float>(decodeNumber(data,typeCode));
+    case 'c':
+    case 'C':
+    case 'e':
+    case 'E':
+    case 'L':
+        return decodeNumber(data,typeCode);
+    case 'n':
+    case 'N':
+    case 'Z':
+    {
+        //Fixed size, nul padded
+        int size = valueSize(typeCode);
+        int len = 0;
+        while (len < size && data[len])
+        {
+            len++;
+        }
+        return QString::fromLatin1(reinterpret_cast<const char*>(data),len);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+int AP2DataPlotLazyLog::formatSize(const QByteArray& format)
+{
+    int total = 0;
+    for (int i=0;i<format.size();i++)
+    {
+        int size = valueSize(format.at(i));
+        if (size < 0)
+        {
+            return -1;
+        }
+        total += size;
+    }
+    return total;
+}
+
+bool AP2DataPlotLazyLog::addType(const QString& name,const QString& format,const QStringList& labels,int length)
+{
+    Type type;
+    type.format = format.toLatin1();
+    type.labels = labels;
+    type.payloadLength = length - 3;
+    if (formatSize(type.format) != type.payloadLength)
+    {
+        m_error = "Format " + format + " of type " + name + " does not match its message length " + QString::number(length);
+        QLOG_DEBUG() << "AP2DataPlotLazyLog::addType():" << m_error;
+        return false;
+    }
+    int offset = 0;
+    for (int i=0;i<type.format.size();i++)
+    {
+        type.fieldOffsets.append(offset);
+        offset += valueSize(type.format.at(i));
+    }
+    m_types.insert(name,type);
+    return true;
+}
+
+bool AP2DataPlotLazyLog::addRecord(const QString& name,qint64 offset,quint64 index)
+{
+    QMap<QString,Type>::iterator type = m_types.find(name);
+    if (type == m_types.end())
+    {
+        return false;
+    }
+    if (offset < 0 || offset + type.value().payloadLength > m_size)
+    {
+        QLOG_DEBUG() << "AP2DataPlotLazyLog::addRecord(): record" << index << "of" << name << "runs past the end of the file";
+        return false;
+    }
+    type.value().recordOffsets.append(offset);
+    type.value().recordIndexes.append(index);
+    return true;
+}
+
+bool AP2DataPlotLazyLog::hasType(const QString& name) const
+{
+    return m_types.contains(name);
+}
+
+bool AP2DataPlotLazyLog::hasRecords(const QString& name) const
+{
+    return m_types.value(name).recordOffsets.size() > 0;
+}
+
+QVector<quint64> AP2DataPlotLazyLog::getRecordIndexes(const QString& name) const
+{
+    return m_types.value(name).recordIndexes;
+}
+
+int AP2DataPlotLazyLog::fieldIndex(const QString& name,const QString& field) const
+{
+    return m_types.value(name).labels.indexOf(field);
+}
+
+bool AP2DataPlotLazyLog::isNumericField(const QString& name,const QString& field) const
+{
+    int index = fieldIndex(name,field);
+    if (index == -1)
+    {
+        return false;
+    }
+    char typecode = m_types.value(name).format.at(index);
+    return typecode != 'n' && typecode != 'N' && typecode != 'Z';
+}
+
+bool AP2DataPlotLazyLog::decodeColumn(const QString& name,const QString& field,QVector<double> *index,QVector<double> *values) const
+{
+    QMap<QString,Type>::const_iterator typeiterator = m_types.constFind(name);
+    if (typeiterator == m_types.constEnd() || !isNumericField(name,field))
+    {
+        return false;
+    }
+    const Type &type = typeiterator.value();
+    int fieldindex = type.labels.indexOf(field);
+    int fieldoffset = type.fieldOffsets.at(fieldindex);
+    char typecode = type.format.at(fieldindex);
+    int count = type.recordOffsets.size();
+    index->resize(count);
+    values->resize(count);
+
+    int threads = QThread::idealThreadCount();
+    if (count < PARALLEL_DECODE_MIN_RECORDS || threads <= 1)
+    {
+        ColumnDecodeTask task(m_data,type.recordOffsets,type.recordIndexes,fieldoffset,typecode,0,count,index->data(),values->data());
+        task.run();
+        return true;
+    }
+
+    //Each task writes its own slice of the output, so no locking is needed
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    int chunk = (count + threads - 1) / threads;
+    for (int first=0;first<count;first+=chunk)
+    {
+        pool.start(new ColumnDecodeTask(m_data,type.recordOffsets,type.recordIndexes,fieldoffset,typecode,
+                                        first,qMin(first + chunk,count),index->data(),values->data()));
+    }
+    pool.waitForDone();
+    return true;
+}
+
+bool AP2DataPlotLazyLog::decodeVariantColumn(const QString& name,const QString& field,QVector<quint64> *index,QVector<QVariant> *values) const
+{
+    QMap<QString,Type>::const_iterator typeiterator = m_types.constFind(name);
+    if (typeiterator == m_types.constEnd())
+    {
+        return false;
+    }
+    const Type &type = typeiterator.value();
+    int fieldindex = type.labels.indexOf(field);
+    if (fieldindex == -1)
+    {
+        return false;
+    }
+    int fieldoffset = type.fieldOffsets.at(fieldindex);
+    char typecode = type.format.at(fieldindex);
+    *index = type.recordIndexes;
+    values->resize(type.recordOffsets.size());
+    for (int i=0;i<type.recordOffsets.size();i++)
+    {
+        (*values)[i] = decodeValue(m_data + type.recordOffsets.at(i) + fieldoffset,typecode);
+    }
+    return true;
+}
+
+QVector<QVariant> AP2DataPlotLazyLog::decodeRecord(const QString& name,quint64 index) const
+{
+    QVector<QVariant> retval;
+    QMap<QString,Type>::const_iterator typeiterator = m_types.constFind(name);
+    if (typeiterator == m_types.constEnd())
+    {
+        return retval;
+    }
+    const Type &type = typeiterator.value();
+    //Indexes are assigned in file order, so they are sorted
+    QVector<quint64>::const_iterator found = qBinaryFind(type.recordIndexes.constBegin(),type.recordIndexes.constEnd(),index);
+    if (found == type.recordIndexes.constEnd())
+    {
+        return retval;
+    }
+    const uchar *record = m_data + type.recordOffsets.at(found - type.recordIndexes.constBegin());
+    retval.reserve(type.format.size() + 2);
+    retval.append(QString::number(index));
+    retval.append(name);
+    for (int i=0;i<type.format.size();i++)
+    {
+        retval.append(decodeValue(record + type.fieldOffsets.at(i),type.format.at(i)));
+    }
+    return retval;
+}
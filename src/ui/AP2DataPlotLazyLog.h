@@ -0,0 +1,104 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot on demand field decoding for binary logs
+ */
+
+
+#ifndef AP2DATAPLOTLAZYLOG_H
+#define AP2DATAPLOTLAZYLOG_H
+
+#include <QFile>
+#include <QMap>
+#include <QVector>
+#include <QVariant>
+#include <QStringList>
+
+/*
+ * Index of a memory mapped binary (.bin) dataflash log.
+ *
+ * The loader records only where each message of a type starts in the file and
+ * what log index it has. Fields are decoded straight out of the mapped file when
+ * something asks for them: a whole column at a time for graphing (split across
+ * threads), or a single record for the table view.
+ */
+class AP2DataPlotLazyLog
+{
+public:
+    AP2DataPlotLazyLog();
+    ~AP2DataPlotLazyLog();
+
+    bool open(const QString& filename);
+    QString getError() const { return m_error; }
+    const uchar *data() const { return m_data; }
+    qint64 size() const { return m_size; }
+
+    //length is the full message length from the FMT packet, including the 3 byte header.
+    //Types whose fields don't add up to it are rejected, their offsets can't be trusted
+    bool addType(const QString& name,const QString& format,const QStringList& labels,int length);
+    //offset is the file position of the message payload, after the 3 byte header.
+    //Returns false if the record runs past the end of the mapped file
+    bool addRecord(const QString& name,qint64 offset,quint64 index);
+
+    bool hasType(const QString& name) const;
+    bool hasRecords(const QString& name) const;
+    int fieldIndex(const QString& name,const QString& field) const;
+    bool isNumericField(const QString& name,const QString& field) const;
+    QVector<quint64> getRecordIndexes(const QString& name) const;
+
+    //Decode one numeric field of every record of a type
+    bool decodeColumn(const QString& name,const QString& field,QVector<double> *index,QVector<double> *values) const;
+    //Decode one field of every record of a type, for text fields
+    bool decodeVariantColumn(const QString& name,const QString& field,QVector<quint64> *index,QVector<QVariant> *values) const;
+    //Decode a whole record, laid out as the table view shows it: index, name, fields...
+    QVector<QVariant> decodeRecord(const QString& name,quint64 index) const;
+
+    //Decode a single value of the given dataflash type code, as AP2DataPlotThread does
+    static QVariant decodeValue(const uchar *data,char typeCode);
+    static double decodeNumber(const uchar *data,char typeCode);
+    //Size in bytes of a value of the given type code, or -1 if unknown
+    static int valueSize(char typeCode);
+    //Summed size in bytes of every field of a format string, or -1 if it has an unknown type code
+    static int formatSize(const QByteArray& format);
+
+private:
+    class Type
+    {
+    public:
+        Type() : payloadLength(0) {}
+        QByteArray format;
+        QStringList labels;
+        int payloadLength;
+        QVector<int> fieldOffsets;
+        QVector<qint64> recordOffsets;
+        QVector<quint64> recordIndexes;
+    };
+
+    QString m_error;
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    QMap<QString,Type> m_types;
+};
+
+#endif // AP2DATAPLOTLAZYLOG_H
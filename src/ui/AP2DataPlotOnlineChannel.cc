@@ -0,0 +1,166 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot bounded storage for live data
+ */
+
+
+#include "AP2DataPlotOnlineChannel.h"
+#include <cmath>
+
+AP2DataPlotOnlineChannel::AP2DataPlotOnlineChannel()
+{
+    Tier seconds;
+    seconds.bucketSeconds = 1.0;
+    seconds.maxAge = 3600.0;
+    m_tiers.append(seconds);
+    Tier tens;
+    tens.bucketSeconds = 10.0;
+    tens.maxAge = 43200.0;
+    m_tiers.append(tens);
+}
+
+void AP2DataPlotOnlineChannel::clear()
+{
+    m_samples.clear();
+    for (int i=0;i<m_tiers.size();i++)
+    {
+        m_tiers[i].buckets.clear();
+    }
+}
+
+bool AP2DataPlotOnlineChannel::append(double key,double value)
+{
+    Sample sample;
+    sample.key = key;
+    sample.value = value;
+    m_samples.append(sample);
+
+    bool folded = false;
+    while (m_samples.size() > 1 && (m_samples.first().key < key - FullRateSeconds || m_samples.size() > MaxFullRateSamples))
+    {
+        const Sample &oldest = m_samples.first();
+        Bucket bucket;
+        bucket.start = oldest.key;
+        bucket.minKey = oldest.key;
+        bucket.minValue = oldest.value;
+        bucket.maxKey = oldest.key;
+        bucket.maxValue = oldest.value;
+        m_samples.removeFirst();
+        if (addToTier(0,bucket,key))
+        {
+            folded = true;
+        }
+    }
+    return folded;
+}
+
+bool AP2DataPlotOnlineChannel::addToTier(int tier,const Bucket &bucket,double now)
+{
+    if (tier >= m_tiers.size())
+    {
+        //Older than anything kept
+        return false;
+    }
+    Tier &target = m_tiers[tier];
+    double start = floor(bucket.start / target.bucketSeconds) * target.bucketSeconds;
+    bool added = false;
+    if (target.buckets.size() > 0 && target.buckets.last().start == start)
+    {
+        Bucket &current = target.buckets.last();
+        if (bucket.minValue < current.minValue)
+        {
+            current.minKey = bucket.minKey;
+            current.minValue = bucket.minValue;
+        }
+        if (bucket.maxValue > current.maxValue)
+        {
+            current.maxKey = bucket.maxKey;
+            current.maxValue = bucket.maxValue;
+        }
+    }
+    else
+    {
+        Bucket merged = bucket;
+        merged.start = start;
+        target.buckets.append(merged);
+        added = true;
+    }
+
+    //Buckets that have aged out of this tier go down to the next, coarser one
+    while (target.buckets.size() > 1 && target.buckets.first().start + target.bucketSeconds < now - target.maxAge)
+    {
+        Bucket oldest = target.buckets.first();
+        target.buckets.removeFirst();
+        addToTier(tier + 1,oldest,now);
+    }
+    return added;
+}
+
+void AP2DataPlotOnlineChannel::getData(QVector<double> &keys,QVector<double> &values) const
+{
+    keys.clear();
+    values.clear();
+    int total = m_samples.size();
+    for (int i=0;i<m_tiers.size();i++)
+    {
+        total += m_tiers.at(i).buckets.size() * 2;
+    }
+    keys.reserve(total);
+    values.reserve(total);
+
+    //Coarsest, so oldest, first
+    for (int i=m_tiers.size()-1;i>=0;i--)
+    {
+        const Ring<Bucket> &buckets = m_tiers.at(i).buckets;
+        for (int j=0;j<buckets.size();j++)
+        {
+            const Bucket &bucket = buckets.at(j);
+            //Extremes in key order so the polyline doesn't double back
+            bool minfirst = bucket.minKey <= bucket.maxKey;
+            double firstkey = minfirst ? bucket.minKey : bucket.maxKey;
+            double firstvalue = minfirst ? bucket.minValue : bucket.maxValue;
+            double secondkey = minfirst ? bucket.maxKey : bucket.minKey;
+            double secondvalue = minfirst ? bucket.maxValue : bucket.minValue;
+            if (keys.isEmpty() || firstkey > keys.last())
+            {
+                keys.append(firstkey);
+                values.append(firstvalue);
+            }
+            if (secondkey > keys.last())
+            {
+                keys.append(secondkey);
+                values.append(secondvalue);
+            }
+        }
+    }
+    for (int i=0;i<m_samples.size();i++)
+    {
+        const Sample &sample = m_samples.at(i);
+        if (keys.isEmpty() || sample.key > keys.last())
+        {
+            keys.append(sample.key);
+            values.append(sample.value);
+        }
+    }
+}
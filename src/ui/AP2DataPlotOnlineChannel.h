@@ -0,0 +1,127 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot bounded storage for live data
+ */
+
+
+#ifndef AP2DATAPLOTONLINECHANNEL_H
+#define AP2DATAPLOTONLINECHANNEL_H
+
+#include <QVector>
+
+/*
+ * Live values of one channel, kept in bounded memory however long the vehicle
+ * is connected.
+ *
+ * The last FullRateSeconds are kept at full rate. Older samples are folded into
+ * min/max buckets, one second wide up to an hour back, then ten seconds wide up
+ * to twelve hours back, and dropped after that. Every store is a ring, so an
+ * append is O(1) amortized and memory is bounded by the tier sizes.
+ */
+class AP2DataPlotOnlineChannel
+{
+public:
+    AP2DataPlotOnlineChannel();
+
+    //Keys are in seconds and must not go backwards. Returns true when samples were
+    //folded into a new bucket, so a graph of getData() has gone stale.
+    bool append(double key,double value);
+    void clear();
+    bool isEmpty() const { return m_samples.size() == 0; }
+
+    //Everything stored in key order, the buckets' extremes followed by the full rate samples
+    void getData(QVector<double> &keys,QVector<double> &values) const;
+
+private:
+    static const int FullRateSeconds = 300;
+    //Past this the oldest samples are folded early, whatever the rate
+    static const int MaxFullRateSamples = 65536;
+
+    template <class T> class Ring
+    {
+    public:
+        Ring() : m_head(0), m_count(0) {}
+        int size() const { return m_count; }
+        const T &at(int i) const { return m_data.at((m_head + i) & (m_data.size() - 1)); }
+        const T &first() const { return at(0); }
+        T &last() { return m_data[(m_head + m_count - 1) & (m_data.size() - 1)]; }
+        void clear() { m_data.clear(); m_head = 0; m_count = 0; }
+        void removeFirst()
+        {
+            m_head = (m_head + 1) & (m_data.size() - 1);
+            m_count--;
+        }
+        void append(const T &item)
+        {
+            if (m_count == m_data.size())
+            {
+                //Double the capacity, unwrapping into the new storage
+                QVector<T> data(m_data.isEmpty() ? 16 : m_data.size() * 2);
+                for (int i=0;i<m_count;i++)
+                {
+                    data[i] = at(i);
+                }
+                m_data = data;
+                m_head = 0;
+            }
+            m_data[(m_head + m_count) & (m_data.size() - 1)] = item;
+            m_count++;
+        }
+    private:
+        QVector<T> m_data; //Capacity is a power of two
+        int m_head;
+        int m_count;
+    };
+
+    class Sample
+    {
+    public:
+        double key;
+        double value;
+    };
+    class Bucket
+    {
+    public:
+        double start;
+        double minKey;
+        double minValue;
+        double maxKey;
+        double maxValue;
+    };
+    class Tier
+    {
+    public:
+        double bucketSeconds;
+        double maxAge;
+        Ring<Bucket> buckets;
+    };
+
+    //Merge a sample or finer bucket into a tier, pushing that tier's expired buckets on down
+    bool addToTier(int tier,const Bucket &bucket,double now);
+
+    Ring<Sample> m_samples;
+    QVector<Tier> m_tiers;
+};
+
+#endif // AP2DATAPLOTONLINECHANNEL_H
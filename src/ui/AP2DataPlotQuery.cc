@@ -0,0 +1,1096 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot log query expressions
+ */
+
+
+#include "AP2DataPlotQuery.h"
+#include "AP2DataPlot2DModel.h"
+#include "AP2DataPlotStatistics.h"
+#include <qnumeric.h>
+#include <qmath.h>
+#include <algorithm>
+
+//NaN, a field before its first sample, counts as false
+static inline bool isTrue(double value)
+{
+    return value == value && value != 0;
+}
+
+AP2DataPlotQuery::AP2DataPlotQuery() :
+    m_position(0),
+    m_root(0),
+    m_usesMode(false),
+    m_usesTime(false),
+    m_size(0)
+{
+}
+
+AP2DataPlotQuery::~AP2DataPlotQuery()
+{
+    clear();
+}
+
+void AP2DataPlotQuery::clear()
+{
+    qDeleteAll(m_nodes);
+    m_nodes.clear();
+    m_root = 0;
+    m_tokens.clear();
+    m_position = 0;
+    m_fields.clear();
+    m_usesMode = false;
+    m_usesTime = false;
+    finishEvaluation();
+    m_modeNames.clear();
+    m_size = 0;
+}
+
+bool AP2DataPlotQuery::tokenize(const QString& expression)
+{
+    int i = 0;
+    while (i < expression.size())
+    {
+        QChar c = expression.at(i);
+        //Units are up to the reader, "> 10°" is the same as "> 10"
+        if (c.isSpace() || c == QChar(0x00B0))
+        {
+            i++;
+            continue;
+        }
+        Token token;
+        token.number = 0;
+        if (c.isDigit() || (c == '.' && i + 1 < expression.size() && expression.at(i + 1).isDigit()))
+        {
+            int start = i;
+            while (i < expression.size() && (expression.at(i).isDigit() || expression.at(i) == '.'))
+            {
+                i++;
+            }
+            if (i < expression.size() && (expression.at(i) == 'e' || expression.at(i) == 'E'))
+            {
+                i++;
+                if (i < expression.size() && (expression.at(i) == '-' || expression.at(i) == '+'))
+                {
+                    i++;
+                }
+                while (i < expression.size() && expression.at(i).isDigit())
+                {
+                    i++;
+                }
+            }
+            bool ok = false;
+            token.type = NumberToken;
+            token.text = expression.mid(start,i - start);
+            token.number = token.text.toDouble(&ok);
+            if (!ok)
+            {
+                m_error = "Invalid number: " + token.text;
+                return false;
+            }
+        }
+        else if (c.isLetter() || c == '_')
+        {
+            int start = i;
+            while (i < expression.size() && (expression.at(i).isLetterOrNumber() || expression.at(i) == '_' || expression.at(i) == '.'))
+            {
+                i++;
+            }
+            token.type = WordToken;
+            token.text = expression.mid(start,i - start);
+            QString lower = token.text.toLower();
+            if (lower == "and" || lower == "or" || lower == "not")
+            {
+                token.type = OperatorToken;
+                token.text = (lower == "and") ? "&&" : ((lower == "or") ? "||" : "!");
+            }
+        }
+        else if (c == '\'' || c == '"')
+        {
+            int end = expression.indexOf(c,i + 1);
+            if (end == -1)
+            {
+                m_error = "Missing closing quote";
+                return false;
+            }
+            token.type = StringToken;
+            token.text = expression.mid(i + 1,end - i - 1);
+            i = end + 1;
+        }
+        else
+        {
+            static const char *twochar[] = { "<=", ">=", "==", "!=", "&&", "||", 0 };
+            token.type = OperatorToken;
+            for (int j=0;twochar[j];j++)
+            {
+                if (expression.mid(i,2) == twochar[j])
+                {
+                    token.text = twochar[j];
+                    break;
+                }
+            }
+            if (!token.text.isEmpty())
+            {
+                i += 2;
+            }
+            else if (QString("<>=!+-*/(),").contains(c))
+            {
+                token.text = (c == '=') ? QString("==") : QString(c);
+                i++;
+            }
+            else
+            {
+                m_error = QString("Unexpected character '%1'").arg(c);
+                return false;
+            }
+        }
+        m_tokens.append(token);
+    }
+    Token end;
+    end.type = EndToken;
+    end.number = 0;
+    m_tokens.append(end);
+    return true;
+}
+
+bool AP2DataPlotQuery::parse(const QString& expression)
+{
+    clear();
+    m_error = "";
+    if (!tokenize(expression))
+    {
+        return false;
+    }
+    m_root = parseOr();
+    if (!m_root)
+    {
+        return false;
+    }
+    if (m_tokens.at(m_position).type != EndToken)
+    {
+        m_error = "Unexpected '" + m_tokens.at(m_position).text + "'";
+        m_root = 0;
+        return false;
+    }
+    if (!isNumeric(m_root))
+    {
+        m_error = "MODE can only be compared to a mode name with == or !=";
+        m_root = 0;
+        return false;
+    }
+    return true;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::newNode(NodeType type,Node *left,Node *right)
+{
+    Node *node = new Node();
+    node->type = type;
+    node->number = 0;
+    node->field = -1;
+    node->left = left;
+    node->right = right;
+    m_nodes.append(node);
+    return node;
+}
+
+bool AP2DataPlotQuery::isOperator(const QString& op) const
+{
+    const Token &token = m_tokens.at(m_position);
+    return token.type == OperatorToken && token.text == op;
+}
+
+bool AP2DataPlotQuery::isNumeric(const Node *node) const
+{
+    return node->type != ModeNode && node->type != StringNode;
+}
+
+bool AP2DataPlotQuery::isCondition(const Node *node)
+{
+    if (node && !isNumeric(node))
+    {
+        m_error = "MODE can only be compared to a mode name with == or !=";
+        return false;
+    }
+    return node != 0;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseOr()
+{
+    Node *left = parseAnd();
+    while (left && isOperator("||"))
+    {
+        m_position++;
+        Node *right = parseAnd();
+        left = isCondition(left) && isCondition(right) ? newNode(OrNode,left,right) : 0;
+    }
+    return left;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseAnd()
+{
+    Node *left = parseNot();
+    while (left && isOperator("&&"))
+    {
+        m_position++;
+        Node *right = parseNot();
+        left = isCondition(left) && isCondition(right) ? newNode(AndNode,left,right) : 0;
+    }
+    return left;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseNot()
+{
+    if (isOperator("!"))
+    {
+        m_position++;
+        Node *operand = parseNot();
+        return isCondition(operand) ? newNode(NotNode,operand) : 0;
+    }
+    return parseComparison();
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseComparison()
+{
+    static const char *operators[] = { "<", "<=", ">", ">=", "==", "!=", 0 };
+    static const NodeType types[] = { LessNode, LessEqualNode, GreaterNode, GreaterEqualNode, EqualNode, NotEqualNode };
+    Node *left = parseSum();
+    if (!left)
+    {
+        return 0;
+    }
+    for (int i=0;operators[i];i++)
+    {
+        if (!isOperator(operators[i]))
+        {
+            continue;
+        }
+        m_position++;
+        Node *right = parseSum();
+        if (!right)
+        {
+            return 0;
+        }
+        if (isNumeric(left) && isNumeric(right))
+        {
+            return newNode(types[i],left,right);
+        }
+        //MODE == AUTO, either way around
+        Node *mode = (left->type == ModeNode) ? left : right;
+        Node *name = (left->type == ModeNode) ? right : left;
+        if (mode->type != ModeNode || name->type != StringNode || (types[i] != EqualNode && types[i] != NotEqualNode))
+        {
+            m_error = "MODE can only be compared to a mode name with == or !=";
+            return 0;
+        }
+        Node *node = newNode((types[i] == EqualNode) ? ModeEqualNode : ModeNotEqualNode);
+        node->text = name->text;
+        return node;
+    }
+    return left;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseSum()
+{
+    Node *left = parseProduct();
+    while (left && (isOperator("+") || isOperator("-")))
+    {
+        NodeType type = isOperator("+") ? AddNode : SubtractNode;
+        m_position++;
+        Node *right = parseProduct();
+        if (!right)
+        {
+            return 0;
+        }
+        if (!isNumeric(left) || !isNumeric(right))
+        {
+            m_error = "Arithmetic needs numbers or fields";
+            return 0;
+        }
+        left = newNode(type,left,right);
+    }
+    return left;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseProduct()
+{
+    Node *left = parseUnary();
+    while (left && (isOperator("*") || isOperator("/")))
+    {
+        NodeType type = isOperator("*") ? MultiplyNode : DivideNode;
+        m_position++;
+        Node *right = parseUnary();
+        if (!right)
+        {
+            return 0;
+        }
+        if (!isNumeric(left) || !isNumeric(right))
+        {
+            m_error = "Arithmetic needs numbers or fields";
+            return 0;
+        }
+        left = newNode(type,left,right);
+    }
+    return left;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseUnary()
+{
+    if (isOperator("+"))
+    {
+        m_position++;
+        return parseUnary();
+    }
+    if (isOperator("-"))
+    {
+        m_position++;
+        Node *operand = parseUnary();
+        if (operand && !isNumeric(operand))
+        {
+            m_error = "Arithmetic needs numbers or fields";
+            return 0;
+        }
+        return operand ? newNode(NegateNode,operand) : 0;
+    }
+    return parsePrimary();
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parsePrimary()
+{
+    const Token token = m_tokens.at(m_position);
+    if (token.type == EndToken)
+    {
+        m_error = "Unexpected end of expression";
+        return 0;
+    }
+    m_position++;
+    if (token.type == NumberToken)
+    {
+        Node *node = newNode(NumberNode);
+        node->number = token.number;
+        return node;
+    }
+    if (token.type == StringToken)
+    {
+        Node *node = newNode(StringNode);
+        node->text = token.text;
+        return node;
+    }
+    if (token.type == OperatorToken && token.text == "(")
+    {
+        Node *node = parseOr();
+        if (!node)
+        {
+            return 0;
+        }
+        if (!isOperator(")"))
+        {
+            m_error = "Missing ')'";
+            return 0;
+        }
+        m_position++;
+        return node;
+    }
+    if (token.type == WordToken)
+    {
+        if (isOperator("("))
+        {
+            m_position++;
+            QList<Node*> args;
+            while (true)
+            {
+                Node *arg = parseOr();
+                if (!arg)
+                {
+                    return 0;
+                }
+                args.append(arg);
+                if (!isOperator(","))
+                {
+                    break;
+                }
+                m_position++;
+            }
+            if (!isOperator(")"))
+            {
+                m_error = "Missing ')'";
+                return 0;
+            }
+            m_position++;
+            return parseFunction(token.text.toLower(),args);
+        }
+        if (token.text.contains("."))
+        {
+            Node *node = newNode(FieldNode);
+            node->text = token.text;
+            node->field = fieldNumber(token.text);
+            return node;
+        }
+        if (token.text.toUpper() == "MODE")
+        {
+            m_usesMode = true;
+            return newNode(ModeNode);
+        }
+        //Anything else is a mode name
+        Node *node = newNode(StringNode);
+        node->text = token.text;
+        return node;
+    }
+    m_error = "Unexpected '" + token.text + "'";
+    return 0;
+}
+
+int AP2DataPlotQuery::fieldNumber(const QString& name)
+{
+    int field = m_fields.indexOf(name);
+    if (field == -1)
+    {
+        field = m_fields.size();
+        m_fields.append(name);
+    }
+    return field;
+}
+
+AP2DataPlotQuery::Node *AP2DataPlotQuery::parseFunction(const QString& name,const QList<Node*>& args)
+{
+    //constant is set for functions whose second argument is a setting rather than a series
+    static const struct
+    {
+        const char *name;
+        NodeType type;
+        int args;
+        bool constant;
+    } functions[] = {
+        { "abs", AbsNode, 1, false },
+        { "sqrt", SqrtNode, 1, false },
+        { "sin", SinNode, 1, false },
+        { "cos", CosNode, 1, false },
+        { "deg", DegreesNode, 1, false },
+        { "rad", RadiansNode, 1, false },
+        { "atan2", Atan2Node, 2, false },
+        { "min", MinNode, 2, false },
+        { "max", MaxNode, 2, false },
+        { "avg", AverageNode, 2, true },
+        { "deriv", DerivativeNode, 1, false },
+        { "lowpass", LowpassNode, 2, true },
+        { "interp", InterpolateNode, 1, false },
+        { 0, NumberNode, 0, false }
+    };
+    int function = 0;
+    while (functions[function].name && name != functions[function].name)
+    {
+        function++;
+    }
+    if (!functions[function].name)
+    {
+        m_error = "Unknown function: " + name;
+        return 0;
+    }
+    if (args.size() != functions[function].args)
+    {
+        m_error = QString("%1() takes %2 argument(s)").arg(name).arg(functions[function].args);
+        return 0;
+    }
+    for (int i=0;i<args.size();i++)
+    {
+        if (!isNumeric(args.at(i)))
+        {
+            m_error = name + "() needs numbers or fields";
+            return 0;
+        }
+    }
+    Node *node = newNode(functions[function].type,args.at(0),(args.size() > 1) ? args.at(1) : 0);
+    if (functions[function].constant)
+    {
+        if (args.at(1)->type != NumberNode || args.at(1)->number <= 0)
+        {
+            m_error = name + "() needs a positive number as its second argument";
+            return 0;
+        }
+        node->number = args.at(1)->number;
+        node->right = 0;
+    }
+    if (node->type == InterpolateNode)
+    {
+        if (args.at(0)->type != FieldNode)
+        {
+            m_error = "interp() needs a field";
+            return 0;
+        }
+        node->field = args.at(0)->field;
+    }
+    if (node->type == DerivativeNode || node->type == LowpassNode)
+    {
+        m_usesTime = true;
+    }
+    return node;
+}
+
+bool AP2DataPlotQuery::prepare(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges)
+{
+    //Merge every index any of the fields was logged at into one timeline
+    m_indexes.resize(m_fields.size());
+    m_values.resize(m_fields.size());
+    m_timeline.clear();
+    for (int i=0;i<m_fields.size();i++)
+    {
+        QString type = m_fields.at(i).section('.',0,0);
+        QString field = m_fields.at(i).section('.',1);
+        if (!model->getColumn(type,field,&m_indexes[i],&m_values[i]))
+        {
+            m_error = "Unknown or non numeric field: " + m_fields.at(i);
+            return false;
+        }
+        m_timeline = mergeIndexes(m_timeline,m_indexes.at(i));
+    }
+    if (m_usesMode)
+    {
+        QVector<double> modeindexes;
+        for (QMap<quint64,QString>::const_iterator i = modeChanges.constBegin();i!=modeChanges.constEnd();i++)
+        {
+            modeindexes.append(i.key());
+        }
+        if (m_fields.isEmpty())
+        {
+            //Nothing else to go by, so the last mode lasts until the end of the log
+            modeindexes.append(model->getLastIndex());
+        }
+        m_timeline = mergeIndexes(m_timeline,modeindexes);
+    }
+    m_size = m_timeline.size();
+    const double *time = m_timeline.constData();
+
+    //Each field holds its last value until it is logged again
+    m_samples.resize(m_fields.size());
+    for (int f=0;f<m_fields.size();f++)
+    {
+        const double *index = m_indexes.at(f).constData();
+        const double *value = m_values.at(f).constData();
+        int count = qMin(m_indexes.at(f).size(),m_values.at(f).size());
+        m_samples[f].resize(m_size);
+        double *out = m_samples[f].data();
+        int j = -1;
+        for (int i=0;i<m_size;i++)
+        {
+            while (j + 1 < count && index[j + 1] <= time[i])
+            {
+                j++;
+            }
+            out[i] = (j < 0) ? qQNaN() : value[j];
+        }
+    }
+    m_modeNames.clear();
+    m_modeIds.clear();
+    if (m_usesMode)
+    {
+        m_modeIds.resize(m_size);
+        int *out = m_modeIds.data();
+        QMap<quint64,QString>::const_iterator mode = modeChanges.constBegin();
+        int current = -1;
+        for (int i=0;i<m_size;i++)
+        {
+            while (mode != modeChanges.constEnd() && mode.key() <= time[i])
+            {
+                current = m_modeNames.indexOf(mode.value());
+                if (current == -1)
+                {
+                    current = m_modeNames.size();
+                    m_modeNames.append(mode.value());
+                }
+                mode++;
+            }
+            out[i] = current;
+        }
+    }
+    m_seconds.clear();
+    if (m_usesTime)
+    {
+        prepareSeconds(model);
+    }
+    return true;
+}
+
+void AP2DataPlotQuery::prepareSeconds(AP2DataPlot2DModel *model)
+{
+    //Known times from the time field of every message type used
+    QStringList types;
+    QVector<QPair<double,double> > known;
+    for (int i=0;i<m_fields.size();i++)
+    {
+        QString type = m_fields.at(i).section('.',0,0);
+        QVector<double> index;
+        QVector<double> times;
+        if (types.contains(type) || !AP2DataPlotStatistics::getTimeColumn(model,type,&index,&times))
+        {
+            continue;
+        }
+        types.append(type);
+        for (int j=0;j<index.size() && j<times.size();j++)
+        {
+            known.append(QPair<double,double>(index.at(j),times.at(j)));
+        }
+    }
+    m_seconds.resize(m_size);
+    double *out = m_seconds.data();
+    const double *time = m_timeline.constData();
+    if (known.isEmpty())
+    {
+        //No time field, rates are per log index
+        for (int i=0;i<m_size;i++)
+        {
+            out[i] = time[i];
+        }
+        return;
+    }
+    std::sort(known.begin(),known.end());
+    //Linear between the known times, held before the first and after the last
+    int j = 0;
+    for (int i=0;i<m_size;i++)
+    {
+        while (j + 1 < known.size() && known.at(j + 1).first <= time[i])
+        {
+            j++;
+        }
+        const QPair<double,double> &before = known.at(j);
+        if (time[i] <= before.first || j + 1 == known.size())
+        {
+            out[i] = before.second;
+            continue;
+        }
+        const QPair<double,double> &after = known.at(j + 1);
+        out[i] = before.second + (after.second - before.second) * (time[i] - before.first) / (after.first - before.first);
+    }
+}
+
+QVector<double> AP2DataPlotQuery::mergeIndexes(const QVector<double>& first,const QVector<double>& second)
+{
+    QVector<double> merged(first.size() + second.size());
+    double *end = std::set_union(first.constBegin(),first.constEnd(),second.constBegin(),second.constEnd(),merged.begin());
+    merged.resize(end - merged.constBegin());
+    return merged;
+}
+
+void AP2DataPlotQuery::finishEvaluation()
+{
+    m_indexes.clear();
+    m_values.clear();
+    m_samples.clear();
+    m_modeIds.clear();
+    m_seconds.clear();
+    m_timeline.clear();
+}
+
+bool AP2DataPlotQuery::evaluate(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges,QList<QPair<double,double> > *intervals)
+{
+    intervals->clear();
+    if (!m_root)
+    {
+        m_error = "No expression to evaluate";
+        return false;
+    }
+    if (!prepare(model,modeChanges))
+    {
+        finishEvaluation();
+        return false;
+    }
+    QVector<double> result = evaluateNode(m_root);
+    const double *match = result.constData();
+    const double *time = m_timeline.constData();
+    int start = -1;
+    for (int i=0;i<m_size;i++)
+    {
+        bool matched = isTrue(match[i]);
+        if (matched && start == -1)
+        {
+            start = i;
+        }
+        else if (!matched && start != -1)
+        {
+            intervals->append(QPair<double,double>(time[start],time[i]));
+            start = -1;
+        }
+    }
+    if (start != -1)
+    {
+        intervals->append(QPair<double,double>(time[start],time[m_size - 1]));
+    }
+    finishEvaluation();
+    m_error = "";
+    return true;
+}
+
+bool AP2DataPlotQuery::evaluateSeries(AP2DataPlot2DModel *model,QVector<double> *index,QVector<double> *values)
+{
+    index->clear();
+    values->clear();
+    if (!m_root)
+    {
+        m_error = "No expression to evaluate";
+        return false;
+    }
+    if (m_usesMode)
+    {
+        m_error = "MODE can only be used to find where a condition holds";
+        return false;
+    }
+    if (m_fields.isEmpty())
+    {
+        m_error = "The expression doesn't use any fields";
+        return false;
+    }
+    if (!prepare(model,QMap<quint64,QString>()))
+    {
+        finishEvaluation();
+        return false;
+    }
+    QVector<double> result = evaluateNode(m_root);
+    const double *value = result.constData();
+    const double *time = m_timeline.constData();
+    index->reserve(m_size);
+    values->reserve(m_size);
+    for (int i=0;i<m_size;i++)
+    {
+        //Before all the fields have been logged there is nothing to show
+        if (!qIsNaN(value[i]) && !qIsInf(value[i]))
+        {
+            index->append(time[i]);
+            values->append(value[i]);
+        }
+    }
+    finishEvaluation();
+    m_error = "";
+    return true;
+}
+
+QVector<double> AP2DataPlotQuery::evaluateNode(const Node *node) const
+{
+    switch (node->type)
+    {
+    case NumberNode:
+        return QVector<double>(m_size,node->number);
+    case FieldNode:
+        return m_samples.at(node->field);
+    case InterpolateNode:
+    {
+        //Linear between the field's own samples instead of holding the last one
+        QVector<double> result(m_size);
+        double *out = result.data();
+        const double *time = m_timeline.constData();
+        const double *index = m_indexes.at(node->field).constData();
+        const double *value = m_values.at(node->field).constData();
+        int count = qMin(m_indexes.at(node->field).size(),m_values.at(node->field).size());
+        int j = -1;
+        for (int i=0;i<m_size;i++)
+        {
+            while (j + 1 < count && index[j + 1] <= time[i])
+            {
+                j++;
+            }
+            if (j < 0)
+            {
+                out[i] = qQNaN();
+            }
+            else if (j + 1 == count || index[j] == time[i])
+            {
+                out[i] = value[j];
+            }
+            else
+            {
+                out[i] = value[j] + (value[j + 1] - value[j]) * (time[i] - index[j]) / (index[j + 1] - index[j]);
+            }
+        }
+        return result;
+    }
+    case ModeEqualNode:
+    case ModeNotEqualNode:
+    {
+        int id = -1;
+        for (int i=0;i<m_modeNames.size();i++)
+        {
+            if (m_modeNames.at(i).compare(node->text,Qt::CaseInsensitive) == 0)
+            {
+                id = i;
+            }
+        }
+        QVector<double> result(m_size);
+        double *out = result.data();
+        const int *mode = m_modeIds.constData();
+        bool equal = (node->type == ModeEqualNode);
+        for (int i=0;i<m_size;i++)
+        {
+            //Before the first mode change the mode is unknown, and matches neither
+            out[i] = (mode[i] >= 0 && (mode[i] == id) == equal) ? 1.0 : 0.0;
+        }
+        return result;
+    }
+    case AverageNode:
+    {
+        //Trailing average of the finite samples among the last n, fewer at the start.
+        //A NaN or inf would otherwise stay in the running sum for the rest of the log.
+        QVector<double> input = evaluateNode(node->left);
+        QVector<double> result(m_size,qQNaN());
+        double *out = result.data();
+        const double *in = input.constData();
+        int window = qMax(1,qRound(node->number));
+        double sum = 0;
+        int count = 0;
+        for (int i=0;i<m_size;i++)
+        {
+            if (qIsFinite(in[i]))
+            {
+                sum += in[i];
+                count++;
+            }
+            if (i >= window && qIsFinite(in[i - window]))
+            {
+                sum -= in[i - window];
+                count--;
+            }
+            if (count > 0)
+            {
+                out[i] = sum / count;
+            }
+        }
+        return result;
+    }
+    case DerivativeNode:
+    {
+        //Per second, from the log's time fields
+        QVector<double> input = evaluateNode(node->left);
+        QVector<double> result(m_size,qQNaN());
+        const double *in = input.constData();
+        const double *seconds = m_seconds.constData();
+        double *out = result.data();
+        double last = qQNaN();
+        for (int i=1;i<m_size;i++)
+        {
+            double dt = seconds[i] - seconds[i - 1];
+            if (dt > 0)
+            {
+                last = (in[i] - in[i - 1]) / dt;
+            }
+            //Samples logged at the same time keep the previous rate
+            out[i] = last;
+        }
+        return result;
+    }
+    case LowpassNode:
+    {
+        //First order, cutoff in Hz
+        QVector<double> result = evaluateNode(node->left);
+        double *out = result.data();
+        const double *seconds = m_seconds.constData();
+        double rc = 1.0 / (2.0 * M_PI * node->number);
+        int last = -1; //Last finite sample, which holds the filter state
+        for (int i=0;i<m_size;i++)
+        {
+            if (!qIsFinite(out[i]))
+            {
+                //Gaps carry the output forward rather than poisoning every later sample
+                if (last >= 0)
+                {
+                    out[i] = out[last];
+                }
+                continue;
+            }
+            if (last >= 0)
+            {
+                double dt = qMax(0.0,seconds[i] - seconds[last]);
+                double alpha = dt / (rc + dt);
+                out[i] = out[last] + alpha * (out[i] - out[last]);
+            }
+            last = i;
+        }
+        return result;
+    }
+    case NegateNode:
+    case AbsNode:
+    case SqrtNode:
+    case SinNode:
+    case CosNode:
+    case DegreesNode:
+    case RadiansNode:
+    case NotNode:
+    {
+        QVector<double> result = evaluateNode(node->left);
+        double *out = result.data();
+        switch (node->type)
+        {
+        case NegateNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = -out[i];
+            }
+            break;
+        case AbsNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = qAbs(out[i]);
+            }
+            break;
+        case SqrtNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = qSqrt(out[i]);
+            }
+            break;
+        case SinNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = qSin(out[i]);
+            }
+            break;
+        case CosNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = qCos(out[i]);
+            }
+            break;
+        case DegreesNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = out[i] * (180.0 / M_PI);
+            }
+            break;
+        case RadiansNode:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = out[i] * (M_PI / 180.0);
+            }
+            break;
+        default:
+            for (int i=0;i<m_size;i++)
+            {
+                out[i] = isTrue(out[i]) ? 0.0 : 1.0;
+            }
+            break;
+        }
+        return result;
+    }
+    default:
+        break;
+    }
+
+    //Binary operators, the result is written over the left operand
+    QVector<double> result = evaluateNode(node->left);
+    QVector<double> rightresult = evaluateNode(node->right);
+    double *a = result.data();
+    const double *b = rightresult.constData();
+    switch (node->type)
+    {
+    case AddNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = a[i] + b[i];
+        }
+        break;
+    case SubtractNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = a[i] - b[i];
+        }
+        break;
+    case MultiplyNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = a[i] * b[i];
+        }
+        break;
+    case DivideNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = a[i] / b[i];
+        }
+        break;
+    case Atan2Node:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = qAtan2(a[i],b[i]);
+        }
+        break;
+    case MinNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (b[i] < a[i]) ? b[i] : a[i];
+        }
+        break;
+    case MaxNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (b[i] > a[i]) ? b[i] : a[i];
+        }
+        break;
+    case LessNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] < b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case LessEqualNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] <= b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case GreaterNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] > b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case GreaterEqualNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] >= b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case EqualNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] == b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case NotEqualNode:
+        //NaN != x would be true, but a field that hasn't been logged yet shouldn't match
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (a[i] == a[i] && b[i] == b[i] && a[i] != b[i]) ? 1.0 : 0.0;
+        }
+        break;
+    case AndNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (isTrue(a[i]) && isTrue(b[i])) ? 1.0 : 0.0;
+        }
+        break;
+    case OrNode:
+        for (int i=0;i<m_size;i++)
+        {
+            a[i] = (isTrue(a[i]) || isTrue(b[i])) ? 1.0 : 0.0;
+        }
+        break;
+    default:
+        break;
+    }
+    return result;
+}
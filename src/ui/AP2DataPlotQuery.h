@@ -0,0 +1,190 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot log query expressions
+ */
+
+
+#ifndef AP2DATAPLOTQUERY_H
+#define AP2DATAPLOTQUERY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QPair>
+#include <QMap>
+
+class AP2DataPlot2DModel;
+
+/*
+ * An expression over the fields of a loaded log. Used as a condition, such as
+ *     GPS.NSats < 6 && MODE == AUTO
+ *     abs(ATT.Roll - ATT.DesRoll) > 10
+ * it finds where the condition holds. Used as a derived channel, such as
+ *     sqrt(GPS.VelN * GPS.VelN + GPS.VelE * GPS.VelE)
+ *     lowpass(deriv(BARO.Alt),2)
+ * it gives a series that can be graphed like a field.
+ *
+ * Fields are written TYPE.Field, MODE is the flight mode and other bare words
+ * are mode names. Supported are + - * /, the comparisons < <= > >= == !=,
+ * && || ! (or "and", "or", "not") and the functions
+ *     abs sqrt sin cos atan2 min max
+ *     deg(x), rad(x)     convert from radians, to radians
+ *     avg(x,n)           average of the last n samples
+ *     deriv(x)           rate of change per second
+ *     lowpass(x,hz)      first order lowpass
+ *     interp(TYPE.Field) the field linearly interpolated instead of held
+ *
+ * Messages are logged at different rates, so the fields used are first merged
+ * onto one timeline of every index any of them was logged at, each field holding
+ * its last value. The expression is then evaluated a whole column at a time.
+ */
+class AP2DataPlotQuery
+{
+public:
+    AP2DataPlotQuery();
+    ~AP2DataPlotQuery();
+
+    //False, with getError() set, if the expression can't be parsed
+    bool parse(const QString& expression);
+    QString getError() const { return m_error; }
+    //TYPE.Field names the expression uses
+    QStringList getFields() const { return m_fields; }
+
+    //Log index intervals where the expression holds, in order. Each lasts from the first
+    //matching index up to the next index where it no longer holds.
+    bool evaluate(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges,QList<QPair<double,double> > *intervals);
+    //Value of the expression at every index of the timeline once all its fields have been logged
+    bool evaluateSeries(AP2DataPlot2DModel *model,QVector<double> *index,QVector<double> *values);
+
+private:
+    enum NodeType
+    {
+        NumberNode,
+        FieldNode,
+        ModeNode,
+        StringNode,
+        NegateNode,
+        AbsNode,
+        SqrtNode,
+        SinNode,
+        CosNode,
+        DegreesNode,
+        RadiansNode,
+        Atan2Node,
+        MinNode,
+        MaxNode,
+        AverageNode,
+        DerivativeNode,
+        LowpassNode,
+        InterpolateNode,
+        AddNode,
+        SubtractNode,
+        MultiplyNode,
+        DivideNode,
+        LessNode,
+        LessEqualNode,
+        GreaterNode,
+        GreaterEqualNode,
+        EqualNode,
+        NotEqualNode,
+        ModeEqualNode,
+        ModeNotEqualNode,
+        AndNode,
+        OrNode,
+        NotNode
+    };
+    class Node
+    {
+    public:
+        NodeType type;
+        double number;
+        QString text;
+        int field;
+        Node *left;
+        Node *right;
+    };
+    enum TokenType
+    {
+        NumberToken,
+        WordToken,
+        StringToken,
+        OperatorToken,
+        EndToken
+    };
+    class Token
+    {
+    public:
+        TokenType type;
+        QString text;
+        double number;
+    };
+
+    void clear();
+    bool tokenize(const QString& expression);
+    Node *newNode(NodeType type,Node *left = 0,Node *right = 0);
+    bool isOperator(const QString& op) const;
+    Node *parseOr();
+    Node *parseAnd();
+    Node *parseNot();
+    Node *parseComparison();
+    Node *parseSum();
+    Node *parseProduct();
+    Node *parseUnary();
+    Node *parsePrimary();
+    Node *parseFunction(const QString& name,const QList<Node*>& args);
+    int fieldNumber(const QString& name);
+    bool isNumeric(const Node *node) const;
+    //Operand of && || !, sets the error if it is MODE or a mode name
+    bool isCondition(const Node *node);
+
+    bool prepare(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges);
+    //Seconds at each timeline index, for deriv and lowpass
+    void prepareSeconds(AP2DataPlot2DModel *model);
+    static QVector<double> mergeIndexes(const QVector<double>& first,const QVector<double>& second);
+    void finishEvaluation();
+    QVector<double> evaluateNode(const Node *node) const;
+
+    QString m_error;
+    QList<Token> m_tokens;
+    int m_position;
+    QList<Node*> m_nodes;
+    Node *m_root;
+    QStringList m_fields;
+    bool m_usesMode;
+    bool m_usesTime;
+
+    //Evaluation state
+    int m_size;
+    QVector<double> m_timeline;
+    QVector<double> m_seconds;
+    //The fields' own columns, and held at every timeline index
+    QVector<QVector<double> > m_indexes;
+    QVector<QVector<double> > m_values;
+    QVector<QVector<double> > m_samples;
+    QVector<int> m_modeIds;
+    QStringList m_modeNames;
+};
+
+#endif // AP2DATAPLOTQUERY_H
@@ -0,0 +1,153 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot graph rendering off the GUI thread
+ */
+
+
+#include "AP2DataPlotRenderer.h"
+#include <QRunnable>
+#include <QPainter>
+#include <QPolygonF>
+#include <QMetaObject>
+
+//Points per polyline call, and between checks for a newer frame
+#define RENDER_CHUNK_POINTS 4096
+
+namespace
+{
+
+class RenderTask : public QRunnable
+{
+public:
+    RenderTask(QObject *renderer,const AP2DataPlotRenderer::Frame &frame,QAtomicInt *generation,int mygeneration) :
+        m_renderer(renderer),
+        m_frame(frame),
+        m_generation(generation),
+        m_myGeneration(mygeneration)
+    {
+    }
+    void run()
+    {
+        if (isStale() || m_frame.size.isEmpty() || m_frame.keyUpper <= m_frame.keyLower)
+        {
+            return;
+        }
+        QImage image(m_frame.size,QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        double width = m_frame.size.width();
+        double height = m_frame.size.height();
+        double xscale = width / (m_frame.keyUpper - m_frame.keyLower);
+        for (int i=0;i<m_frame.series.size();i++)
+        {
+            const AP2DataPlotRenderer::Series &series = m_frame.series.at(i);
+            if (series.valueUpper <= series.valueLower)
+            {
+                continue;
+            }
+            double yscale = height / (series.valueUpper - series.valueLower);
+            painter.setPen(series.pen);
+            int count = qMin(series.keys.size(),series.values.size());
+            QPolygonF line;
+            line.reserve(RENDER_CHUNK_POINTS + 1);
+            for (int j=0;j<count;j++)
+            {
+                line.append(QPointF((series.keys.at(j) - m_frame.keyLower) * xscale,(series.valueUpper - series.values.at(j)) * yscale));
+                if (line.size() > RENDER_CHUNK_POINTS)
+                {
+                    if (isStale())
+                    {
+                        return;
+                    }
+                    painter.drawPolyline(line);
+                    //Start the next chunk from this point so the line stays joined
+                    QPointF last = line.last();
+                    line.clear();
+                    line.append(last);
+                }
+            }
+            if (line.size() > 1)
+            {
+                painter.drawPolyline(line);
+            }
+            if (isStale())
+            {
+                return;
+            }
+        }
+        painter.end();
+        QMetaObject::invokeMethod(m_renderer,"frameDone",Qt::QueuedConnection,Q_ARG(QImage,image),
+                                  Q_ARG(double,m_frame.keyLower),Q_ARG(double,m_frame.keyUpper),Q_ARG(int,m_myGeneration));
+    }
+private:
+    bool isStale() const
+    {
+        return m_generation->load() != m_myGeneration;
+    }
+    QObject *m_renderer;
+    AP2DataPlotRenderer::Frame m_frame;
+    QAtomicInt *m_generation;
+    int m_myGeneration;
+};
+
+}
+
+AP2DataPlotRenderer::AP2DataPlotRenderer(QObject *parent) :
+    QObject(parent),
+    m_generation(0),
+    m_shownGeneration(0),
+    m_cancelledGeneration(0)
+{
+    //One frame at a time, anything queued behind it is stale by the time it would start
+    m_pool.setMaxThreadCount(1);
+}
+
+AP2DataPlotRenderer::~AP2DataPlotRenderer()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void AP2DataPlotRenderer::render(const Frame &frame)
+{
+    int generation = m_generation.fetchAndAddOrdered(1) + 1;
+    m_pool.start(new RenderTask(this,frame,&m_generation,generation));
+}
+
+void AP2DataPlotRenderer::cancel()
+{
+    m_cancelledGeneration = m_generation.fetchAndAddOrdered(1) + 1;
+}
+
+void AP2DataPlotRenderer::frameDone(QImage image,double keyLower,double keyUpper,int generation)
+{
+    //Finished just before a newer frame was asked for is still newer than what is shown,
+    //but not if it was cancelled or a newer one made it first
+    if (generation <= m_cancelledGeneration || generation <= m_shownGeneration)
+    {
+        return;
+    }
+    m_shownGeneration = generation;
+    emit frameReady(image,keyLower,keyUpper);
+}
@@ -0,0 +1,92 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot graph rendering off the GUI thread
+ */
+
+
+#ifndef AP2DATAPLOTRENDERER_H
+#define AP2DATAPLOTRENDERER_H
+
+#include <QObject>
+#include <QImage>
+#include <QPen>
+#include <QVector>
+#include <QList>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+/*
+ * Rasterises graph lines on a worker thread.
+ *
+ * The GUI thread hands over a Frame, a snapshot of the points each graph
+ * draws in the visible range and how they map onto the axis rect. It is
+ * rendered into a transparent QImage, which comes back through frameReady()
+ * for the plot to blit. Starting a new frame abandons the one in progress, so
+ * only the latest view is ever rendered in full.
+ */
+class AP2DataPlotRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    class Series
+    {
+    public:
+        QVector<double> keys;
+        QVector<double> values;
+        QPen pen;
+        double valueLower;
+        double valueUpper;
+    };
+    class Frame
+    {
+    public:
+        QSize size;
+        double keyLower;
+        double keyUpper;
+        QList<Series> series;
+    };
+
+    explicit AP2DataPlotRenderer(QObject *parent = 0);
+    ~AP2DataPlotRenderer();
+
+    //Start rendering a frame, abandoning any render still in progress
+    void render(const Frame &frame);
+    //Abandon any render in progress, no frameReady() follows
+    void cancel();
+
+signals:
+    void frameReady(QImage image,double keyLower,double keyUpper);
+
+private slots:
+    void frameDone(QImage image,double keyLower,double keyUpper,int generation);
+
+private:
+    QThreadPool m_pool;
+    //Bumped for every render and cancel, a render stops once it no longer matches
+    QAtomicInt m_generation;
+    int m_shownGeneration;
+    int m_cancelledGeneration;
+};
+
+#endif // AP2DATAPLOTRENDERER_H
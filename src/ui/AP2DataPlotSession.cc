@@ -0,0 +1,439 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot multi log session
+ */
+
+
+#include "AP2DataPlotSession.h"
+#include "AP2DataPlotStatistics.h"
+#include "AP2DataPlotQuery.h"
+#include "ArduPilotMegaMAV.h"
+#include "QsLog.h"
+#include <algorithm>
+
+//Dataflash EV ids, see the ArduPilot LogEvent list
+#define EV_ARMED 10
+#define EV_TAKEOFF 16
+#define EV_NOT_LANDED 28
+//HEARTBEAT base_mode bit set while armed, for tlogs
+#define TLOG_ARMED_FLAG 128
+
+//Frequently logged types with a time field, tried first when building a clock
+static const char *s_clockTypes[] = { "IMU", "ATT", "CTUN", "NTUN", "GPS", "BARO", "RCIN", "RCOU", "CURR",
+                                      "ATTITUDE", "RAW_IMU", "SCALED_IMU2", "GLOBAL_POSITION_INT", "SYS_STATUS", 0 };
+
+AP2DataPlotSession::AP2DataPlotSession(QObject *parent) :
+    QObject(parent),
+    m_nextLog(2),
+    m_alignment(AlignStart)
+{
+    m_primary.model = NULL;
+    m_primary.thread = NULL;
+    m_primary.type = MAV_TYPE_GENERIC;
+    m_primary.loaded = true;
+    m_primary.aligned = false;
+    m_primary.alignIndex = 0;
+}
+
+AP2DataPlotSession::~AP2DataPlotSession()
+{
+    clear();
+}
+
+void AP2DataPlotSession::setPrimary(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges)
+{
+    m_primary.model = model;
+    m_primary.modeChanges = modeChanges;
+    m_primary.aligned = false;
+    m_primary.clock = Clock();
+}
+
+QString AP2DataPlotSession::addLog(const QString& filename)
+{
+    QString name = "L" + QString::number(m_nextLog++);
+    Log *log = new Log();
+    log->fileName = filename;
+    log->model = new AP2DataPlot2DModel();
+    log->thread = new AP2DataPlotThread(log->model);
+    log->type = MAV_TYPE_GENERIC;
+    log->loaded = false;
+    log->aligned = false;
+    log->alignIndex = 0;
+    //Nothing is graphed until the load is done, and only graphed fields should take memory
+    log->thread->setLazyLoading(true);
+    log->thread->setProgressive(false);
+    connect(log->thread,SIGNAL(done(int,MAV_TYPE)),this,SLOT(threadDone(int,MAV_TYPE)));
+    connect(log->thread,SIGNAL(error(QString)),this,SLOT(threadError(QString)));
+    connect(log->thread,SIGNAL(finished()),this,SLOT(threadTerminated()));
+    m_logs.insert(name,log);
+    QLOG_DEBUG() << "AP2DataPlotSession: loading" << filename << "as" << name;
+    log->thread->loadFile(filename);
+    return name;
+}
+
+void AP2DataPlotSession::clear()
+{
+    for (QMap<QString,Log*>::iterator i = m_logs.begin();i!=m_logs.end();i++)
+    {
+        Log *log = i.value();
+        if (log->thread)
+        {
+            //The thread writes to the model, it has to be finished before the model goes away
+            log->thread->stopLoad();
+            log->thread->wait();
+            delete log->thread;
+        }
+        delete log->model;
+        delete log;
+    }
+    m_logs.clear();
+    m_nextLog = 2;
+}
+
+QStringList AP2DataPlotSession::getLogNames() const
+{
+    return m_logs.keys();
+}
+
+QString AP2DataPlotSession::getFileName(const QString& name) const
+{
+    return m_logs.contains(name) ? m_logs.value(name)->fileName : QString();
+}
+
+bool AP2DataPlotSession::isLoaded(const QString& name) const
+{
+    return m_logs.contains(name) && m_logs.value(name)->loaded;
+}
+
+QMap<QString,QList<QString> > AP2DataPlotSession::getFmtValues(const QString& name) const
+{
+    if (!isLoaded(name))
+    {
+        return QMap<QString,QList<QString> >();
+    }
+    return m_logs.value(name)->model->getFmtValues();
+}
+
+QString AP2DataPlotSession::logNameForThread(QObject *thread) const
+{
+    for (QMap<QString,Log*>::const_iterator i = m_logs.constBegin();i!=m_logs.constEnd();i++)
+    {
+        if (i.value()->thread == thread)
+        {
+            return i.key();
+        }
+    }
+    return QString();
+}
+
+void AP2DataPlotSession::threadDone(int errors,MAV_TYPE type)
+{
+    QString name = logNameForThread(sender());
+    if (name.isEmpty())
+    {
+        return;
+    }
+    Log *log = m_logs.value(name);
+    log->model->publishRows();
+    log->loaded = true;
+    log->type = type;
+    log->modeChanges = getModeChanges(log->model,type);
+    QLOG_DEBUG() << "AP2DataPlotSession:" << name << "loaded with" << errors << "errors";
+    emit logLoaded(name);
+}
+
+void AP2DataPlotSession::threadError(QString errorstr)
+{
+    QString name = logNameForThread(sender());
+    if (!name.isEmpty())
+    {
+        emit logError(name,errorstr);
+    }
+}
+
+void AP2DataPlotSession::threadTerminated()
+{
+    QString name = logNameForThread(sender());
+    if (name.isEmpty())
+    {
+        return;
+    }
+    Log *log = m_logs.value(name);
+    log->thread->deleteLater();
+    log->thread = NULL;
+    if (!log->loaded)
+    {
+        //Failed or canceled, there is nothing to overlay
+        delete log->model;
+        delete log;
+        m_logs.remove(name);
+    }
+}
+
+void AP2DataPlotSession::setAlignment(Alignment alignment,const QString& condition)
+{
+    m_alignment = alignment;
+    m_condition = condition;
+    m_primary.aligned = false;
+    for (QMap<QString,Log*>::iterator i = m_logs.begin();i!=m_logs.end();i++)
+    {
+        i.value()->aligned = false;
+    }
+}
+
+QString AP2DataPlotSession::logNameForType(const QString& type)
+{
+    int colon = type.indexOf(':');
+    return (colon == -1) ? QString() : type.left(colon);
+}
+
+bool AP2DataPlotSession::getAlignedColumn(const QString& type,const QString& field,QVector<double> *index,QVector<double> *values)
+{
+    QString name = logNameForType(type);
+    if (!isLoaded(name) || !m_primary.model)
+    {
+        return false;
+    }
+    Log *log = m_logs.value(name);
+    if (!log->model->getColumn(type.mid(name.size() + 1),field,index,values))
+    {
+        return false;
+    }
+    align(&m_primary);
+    align(log);
+
+    if (log->clock.isValid() && m_primary.clock.isValid())
+    {
+        //Seconds since the overlay's event, then back to the open log's index at that long after its event
+        QVector<double> alignseconds = log->clock.toSeconds(QVector<double>() << log->alignIndex);
+        QVector<double> primaryseconds = m_primary.clock.toSeconds(QVector<double>() << m_primary.alignIndex);
+        double offset = primaryseconds.at(0) - alignseconds.at(0);
+        QVector<double> seconds = log->clock.toSeconds(*index);
+        double *data = seconds.data();
+        for (int i=0;i<seconds.size();i++)
+        {
+            data[i] += offset;
+        }
+        *index = m_primary.clock.toIndex(seconds);
+    }
+    else
+    {
+        //Without time fields the best there is is lining up the indexes
+        double offset = m_primary.alignIndex - log->alignIndex;
+        double *data = index->data();
+        for (int i=0;i<index->size();i++)
+        {
+            data[i] += offset;
+        }
+    }
+    return true;
+}
+
+void AP2DataPlotSession::align(Log *log)
+{
+    if (log->aligned)
+    {
+        return;
+    }
+    if (!log->clock.isValid())
+    {
+        log->clock = makeClock(log->model);
+    }
+    log->alignIndex = findAlignIndex(log->model,log->modeChanges);
+    log->aligned = true;
+}
+
+double AP2DataPlotSession::findAlignIndex(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges) const
+{
+    QVector<double> index;
+    QVector<double> values;
+    switch (m_alignment)
+    {
+    case AlignArming:
+        if (model->getColumn("EV","Id",&index,&values))
+        {
+            for (int i=0;i<index.size();i++)
+            {
+                if (values.at(i) == EV_ARMED)
+                {
+                    return index.at(i);
+                }
+            }
+        }
+        if (model->getColumn("HEARTBEAT","base_mode",&index,&values))
+        {
+            for (int i=0;i<index.size();i++)
+            {
+                if (static_cast<int>(values.at(i)) & TLOG_ARMED_FLAG)
+                {
+                    return index.at(i);
+                }
+            }
+        }
+        break;
+    case AlignTakeoff:
+        if (model->getColumn("EV","Id",&index,&values))
+        {
+            for (int i=0;i<index.size();i++)
+            {
+                if (values.at(i) == EV_TAKEOFF || values.at(i) == EV_NOT_LANDED)
+                {
+                    return index.at(i);
+                }
+            }
+        }
+        break;
+    case AlignCondition:
+    {
+        AP2DataPlotQuery query;
+        QList<QPair<double,double> > intervals;
+        if (query.parse(m_condition) && query.evaluate(model,modeChanges,&intervals) && !intervals.isEmpty())
+        {
+            return intervals.first().first;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    //Not found, or aligning on the start anyway
+    return model->getFirstIndex();
+}
+
+AP2DataPlotSession::Clock AP2DataPlotSession::makeClock(AP2DataPlot2DModel *model)
+{
+    QStringList types;
+    for (int i=0;s_clockTypes[i];i++)
+    {
+        types.append(s_clockTypes[i]);
+    }
+    types.append(model->getFmtValues().keys());
+    Clock clock;
+    for (int i=0;i<types.size();i++)
+    {
+        QVector<double> index;
+        QVector<double> seconds;
+        if (!AP2DataPlotStatistics::getTimeColumn(model,types.at(i),&index,&seconds) || index.size() < 2)
+        {
+            continue;
+        }
+        //Keep only points where time moves forward, so the map can be inverted
+        for (int j=0;j<index.size() && j<seconds.size();j++)
+        {
+            if (clock.seconds.isEmpty() || seconds.at(j) > clock.seconds.last())
+            {
+                clock.index.append(index.at(j));
+                clock.seconds.append(seconds.at(j));
+            }
+        }
+        if (clock.isValid())
+        {
+            break;
+        }
+        clock = Clock();
+    }
+    return clock;
+}
+
+QVector<double> AP2DataPlotSession::Clock::toSeconds(const QVector<double>& indexes) const
+{
+    return map(index,seconds,indexes);
+}
+
+QVector<double> AP2DataPlotSession::Clock::toIndex(const QVector<double>& times) const
+{
+    return map(seconds,index,times);
+}
+
+QVector<double> AP2DataPlotSession::Clock::map(const QVector<double>& from,const QVector<double>& to,const QVector<double>& values)
+{
+    //values is sorted, so one pass through the table does it
+    QVector<double> result(values.size());
+    int count = from.size();
+    double rate = (to.last() - to.first()) / (from.last() - from.first());
+    int j = 0;
+    for (int i=0;i<values.size();i++)
+    {
+        double value = values.at(i);
+        if (value <= from.first())
+        {
+            result[i] = to.first() + (value - from.first()) * rate;
+            continue;
+        }
+        if (value >= from.last())
+        {
+            result[i] = to.last() + (value - from.last()) * rate;
+            continue;
+        }
+        while (j + 1 < count && from.at(j + 1) < value)
+        {
+            j++;
+        }
+        result[i] = to.at(j) + (to.at(j + 1) - to.at(j)) * (value - from.at(j)) / (from.at(j + 1) - from.at(j));
+    }
+    return result;
+}
+
+QMap<quint64,QString> AP2DataPlotSession::getModeChanges(AP2DataPlot2DModel *model,MAV_TYPE type)
+{
+    QMap<quint64,QString> modes = model->getModeValues();
+    for (QMap<quint64,QString>::iterator i = modes.begin(); i != modes.end(); i++)
+    {
+        QString mode = i.value();
+        bool ok = false;
+        int modeint = mode.toInt(&ok);
+        if (!ok)
+        {
+            QLOG_DEBUG() << "Unable to determine Mode number in log" << mode;
+            continue;
+        }
+        //It's an integer!
+        switch (type)
+        {
+        case MAV_TYPE_QUADROTOR:
+        case MAV_TYPE_HEXAROTOR:
+        case MAV_TYPE_OCTOROTOR:
+        case MAV_TYPE_HELICOPTER:
+        case MAV_TYPE_TRICOPTER:
+            {
+                mode = ApmCopter::stringForMode(modeint);
+            }
+            break;
+        case MAV_TYPE_FIXED_WING:
+            {
+                mode = ApmPlane::stringForMode(modeint);
+            }
+            break;
+        case MAV_TYPE_GROUND_ROVER:
+            {
+                mode = ApmRover::stringForMode(modeint);
+            }
+            break;
+        default:
+            mode = QString().sprintf("Mode (%d)", modeint);
+        }
+        i.value() = mode;
+    }
+    return modes;
+}
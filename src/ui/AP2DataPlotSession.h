@@ -0,0 +1,139 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot multi log session
+ */
+
+
+#ifndef AP2DATAPLOTSESSION_H
+#define AP2DATAPLOTSESSION_H
+
+#include <QObject>
+#include <QMap>
+#include <QVector>
+#include <QStringList>
+#include "AP2DataPlotThread.h"
+#include "AP2DataPlot2DModel.h"
+
+/*
+ * Logs overlaid on the log an AP2DataPlot2D has open, for comparing flights.
+ *
+ * Each overlay log is loaded by its own AP2DataPlotThread, so several load at
+ * once, into its own model. Binary logs are loaded lazily, so only the fields
+ * actually graphed are ever decoded. Logs are named L2, L3... and their fields
+ * are addressed as "L2:TYPE.Field".
+ *
+ * Overlay fields are moved onto the open log's index axis. Both logs are
+ * converted to seconds from their time fields, and aligned on an event found
+ * in each: the start of the log, arming, takeoff or the first place an
+ * AP2DataPlotQuery condition holds.
+ */
+class AP2DataPlotSession : public QObject
+{
+    Q_OBJECT
+public:
+    enum Alignment
+    {
+        AlignStart,
+        AlignArming,
+        AlignTakeoff,
+        AlignCondition
+    };
+
+    explicit AP2DataPlotSession(QObject *parent = 0);
+    ~AP2DataPlotSession();
+
+    //The open log everything is aligned to, and its mode changes by name
+    void setPrimary(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges);
+    //Start loading a log, returns the name it will be known by
+    QString addLog(const QString& filename);
+    //Stop loading and forget every overlay log
+    void clear();
+    QStringList getLogNames() const;
+    QString getFileName(const QString& name) const;
+    bool isLoaded(const QString& name) const;
+    //Message types and their fields, once the log has loaded
+    QMap<QString,QList<QString> > getFmtValues(const QString& name) const;
+
+    void setAlignment(Alignment alignment,const QString& condition = QString());
+    Alignment getAlignment() const { return m_alignment; }
+    QString getCondition() const { return m_condition; }
+
+    //Overlay log name of a "L2:TYPE" message type, empty for the open log's own types
+    static QString logNameForType(const QString& type);
+    //A field of an overlay log on the open log's index axis. type is "L2:TYPE".
+    bool getAlignedColumn(const QString& type,const QString& field,QVector<double> *index,QVector<double> *values);
+
+    //Mode changes from a model, with mode numbers replaced by names where the vehicle type is known
+    static QMap<quint64,QString> getModeChanges(AP2DataPlot2DModel *model,MAV_TYPE type);
+
+signals:
+    void logLoaded(QString name);
+    void logError(QString name,QString errorstr);
+
+private slots:
+    void threadDone(int errors,MAV_TYPE type);
+    void threadError(QString errorstr);
+    void threadTerminated();
+
+private:
+    //Piecewise linear map between log index and seconds
+    class Clock
+    {
+    public:
+        QVector<double> index;
+        QVector<double> seconds;
+        bool isValid() const { return index.size() > 1; }
+        //Both expect sorted input, and extrapolate at the average rate past either end
+        QVector<double> toSeconds(const QVector<double>& indexes) const;
+        QVector<double> toIndex(const QVector<double>& times) const;
+        static QVector<double> map(const QVector<double>& from,const QVector<double>& to,const QVector<double>& values);
+    };
+    class Log
+    {
+    public:
+        QString fileName;
+        AP2DataPlot2DModel *model;
+        AP2DataPlotThread *thread;
+        MAV_TYPE type;
+        bool loaded;
+        QMap<quint64,QString> modeChanges;
+        //Recomputed when the alignment changes
+        bool aligned;
+        double alignIndex;
+        Clock clock;
+    };
+
+    QString logNameForThread(QObject *thread) const;
+    static Clock makeClock(AP2DataPlot2DModel *model);
+    double findAlignIndex(AP2DataPlot2DModel *model,const QMap<quint64,QString>& modeChanges) const;
+    void align(Log *log);
+
+    Log m_primary;
+    QMap<QString,Log*> m_logs;
+    int m_nextLog;
+    Alignment m_alignment;
+    QString m_condition;
+};
+
+#endif // AP2DATAPLOTSESSION_H
@@ -0,0 +1,252 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot per field statistics
+ */
+
+
+#include "AP2DataPlotStatistics.h"
+#include "AP2DataPlot2DModel.h"
+#include <QStringList>
+#include <qnumeric.h>
+#include <qmath.h>
+#include <algorithm>
+#include <limits>
+
+AP2DataPlotStatistics::Filter::Filter() :
+    lower(-std::numeric_limits<double>::infinity()),
+    upper(std::numeric_limits<double>::infinity()),
+    threshold(qQNaN())
+{
+}
+
+QString AP2DataPlotStatistics::Filter::key() const
+{
+    return QString::number(lower,'g',17) + "|" + QString::number(upper,'g',17) + "|" + mode + "|" + QString::number(threshold,'g',17);
+}
+
+AP2DataPlotStatistics::Result::Result() :
+    valid(false),
+    count(0),
+    min(0),
+    max(0),
+    mean(0),
+    stddev(0),
+    duration(0),
+    timeAboveThreshold(0)
+{
+}
+
+AP2DataPlotStatistics::AP2DataPlotStatistics(AP2DataPlot2DModel *model) :
+    m_model(model),
+    m_cache(MaxCachedResults)
+{
+}
+
+QList<int> AP2DataPlotStatistics::percentileList()
+{
+    return QList<int>() << 5 << 25 << 50 << 75 << 95 << 99;
+}
+
+void AP2DataPlotStatistics::setModeChanges(const QMap<quint64,QString>& modes)
+{
+    m_modeChanges = modes;
+    m_cache.clear();
+}
+
+QStringList AP2DataPlotStatistics::getModeNames() const
+{
+    QStringList retval;
+    for (QMap<quint64,QString>::const_iterator i = m_modeChanges.constBegin();i!=m_modeChanges.constEnd();i++)
+    {
+        if (!retval.contains(i.value()))
+        {
+            retval.append(i.value());
+        }
+    }
+    return retval;
+}
+
+void AP2DataPlotStatistics::clear()
+{
+    m_cache.clear();
+}
+
+QList<QPair<double,double> > AP2DataPlotStatistics::getRanges(const Filter& filter) const
+{
+    QList<QPair<double,double> > retval;
+    if (filter.mode.isEmpty())
+    {
+        retval.append(QPair<double,double>(filter.lower,filter.upper));
+        return retval;
+    }
+    //A mode lasts from its change index up to just before the next change
+    for (QMap<quint64,QString>::const_iterator i = m_modeChanges.constBegin();i!=m_modeChanges.constEnd();i++)
+    {
+        if (i.value() != filter.mode)
+        {
+            continue;
+        }
+        QMap<quint64,QString>::const_iterator next = i + 1;
+        double first = qMax(static_cast<double>(i.key()),filter.lower);
+        double last = filter.upper;
+        if (next != m_modeChanges.constEnd())
+        {
+            last = qMin(static_cast<double>(next.key()) - 0.5,filter.upper);
+        }
+        if (first <= last)
+        {
+            retval.append(QPair<double,double>(first,last));
+        }
+    }
+    return retval;
+}
+
+bool AP2DataPlotStatistics::getTimeColumn(AP2DataPlot2DModel *model,const QString& type,QVector<double> *index,QVector<double> *times)
+{
+    //Dataflash messages carry TimeUS or TimeMS, tlog messages time_boot_ms
+    static const char *timefields[] = { "TimeUS", "TimeMS", "time_boot_ms", 0 };
+    static const double timescales[] = { 1000000.0, 1000.0, 1000.0 };
+    for (int i=0;timefields[i];i++)
+    {
+        if (model->getColumn(type,timefields[i],index,times))
+        {
+            for (int j=0;j<times->size();j++)
+            {
+                (*times)[j] /= timescales[i];
+            }
+            return true;
+        }
+    }
+    index->clear();
+    times->clear();
+    return false;
+}
+
+AP2DataPlotStatistics::Result AP2DataPlotStatistics::getStatistics(const QString& type,const QString& field,const Filter& filter)
+{
+    QString key = type + "." + field + "|" + filter.key();
+    Result *cached = m_cache.object(key);
+    if (cached)
+    {
+        return *cached;
+    }
+    QVector<double> index;
+    QVector<double> values;
+    if (!m_model->getColumn(type,field,&index,&values))
+    {
+        return Result();
+    }
+    QVector<double> timeindex;
+    QVector<double> times;
+    getTimeColumn(m_model,type,&timeindex,&times);
+    Result result = compute(index,values,times,getRanges(filter),filter.threshold);
+    m_cache.insert(key,new Result(result));
+    return result;
+}
+
+AP2DataPlotStatistics::Result AP2DataPlotStatistics::compute(const QVector<double>& index,const QVector<double>& values,const QVector<double>& times,
+                                                             const QList<QPair<double,double> >& ranges,double threshold)
+{
+    Result result;
+    int count = qMin(index.size(),values.size());
+    bool hastimes = times.size() == count;
+    bool hasthreshold = !qIsNaN(threshold);
+    const double *indexdata = index.constData();
+    const double *valuedata = values.constData();
+    const double *timedata = times.constData();
+
+    QVector<double> selected;
+    selected.reserve(count);
+    double mean = 0;
+    double m2 = 0;
+    int range = 0;
+    for (int i=0;i<count && range<ranges.size();i++)
+    {
+        double key = indexdata[i];
+        while (range < ranges.size() && key > ranges.at(range).second)
+        {
+            range++;
+        }
+        if (range == ranges.size() || key < ranges.at(range).first)
+        {
+            continue;
+        }
+        double value = valuedata[i];
+        if (selected.isEmpty())
+        {
+            result.min = value;
+            result.max = value;
+        }
+        else
+        {
+            result.min = qMin(result.min,value);
+            result.max = qMax(result.max,value);
+        }
+        selected.append(value);
+        //Welford's update, stable for long logs with a large offset
+        double delta = value - mean;
+        mean += delta / selected.size();
+        m2 += delta * (value - mean);
+
+        //Each sample holds until the next one of the same message
+        if (hastimes && i + 1 < count)
+        {
+            double dt = timedata[i+1] - timedata[i];
+            if (dt > 0)
+            {
+                result.duration += dt;
+                if (hasthreshold && value > threshold)
+                {
+                    result.timeAboveThreshold += dt;
+                }
+            }
+        }
+    }
+    result.count = selected.size();
+    if (result.count == 0)
+    {
+        return result;
+    }
+    result.valid = true;
+    result.mean = mean;
+    result.stddev = (result.count > 1) ? qSqrt(m2 / (result.count - 1)) : 0;
+
+    //Ascending percentiles, so each selection only has to look above the previous one
+    QList<int> percentiles = percentileList();
+    double *begin = selected.data();
+    double *end = begin + selected.size();
+    double *from = begin;
+    for (int i=0;i<percentiles.size();i++)
+    {
+        int rank = qBound(0,static_cast<int>((percentiles.at(i) / 100.0) * (result.count - 1) + 0.5),result.count - 1);
+        double *nth = begin + rank;
+        if (nth >= from)
+        {
+            std::nth_element(from,nth,end);
+            from = nth;
+        }
+        result.percentiles.append(*nth);
+    }
+    return result;
+}
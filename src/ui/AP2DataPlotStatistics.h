@@ -0,0 +1,112 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot per field statistics
+ */
+
+
+#ifndef AP2DATAPLOTSTATISTICS_H
+#define AP2DATAPLOTSTATISTICS_H
+
+#include <QVector>
+#include <QList>
+#include <QPair>
+#include <QMap>
+#include <QCache>
+#include <QStringList>
+
+class AP2DataPlot2DModel;
+
+/*
+ * Summary statistics of one log field, optionally restricted to a log index
+ * range and/or the periods spent in one flight mode.
+ *
+ * Everything except the percentiles comes out of a single pass over the
+ * column the model already holds for graphing. Percentiles are selected
+ * from the matching samples with nth_element rather than a full sort.
+ * Results are cached per field and filter until clear() is called. The visible
+ * range filter changes with every pan, so only the most recent MaxCachedResults
+ * results are kept.
+ */
+class AP2DataPlotStatistics
+{
+public:
+    class Filter
+    {
+    public:
+        Filter();
+        //Log index range, inclusive. Unrestricted by default.
+        double lower;
+        double upper;
+        //Only samples logged while in this mode, empty for any mode
+        QString mode;
+        //Time spent above this value is reported when it is set (not NaN)
+        double threshold;
+        QString key() const;
+    };
+
+    class Result
+    {
+    public:
+        Result();
+        bool valid;
+        int count;
+        double min;
+        double max;
+        double mean;
+        double stddev;
+        //Same order as percentileList()
+        QVector<double> percentiles;
+        //Seconds, from the message's own time field. Zero when it has none.
+        double duration;
+        double timeAboveThreshold;
+    };
+
+    static const int MaxCachedResults = 256;
+
+    explicit AP2DataPlotStatistics(AP2DataPlot2DModel *model);
+
+    //Log index of each mode change, with the mode name, as AP2DataPlot2D shows them
+    void setModeChanges(const QMap<quint64,QString>& modes);
+    QStringList getModeNames() const;
+
+    Result getStatistics(const QString& type,const QString& field,const Filter& filter);
+    //Forget cached results, for when the model has gained rows
+    void clear();
+
+    static QList<int> percentileList();
+    //Time field of a message type in seconds, false if it has none
+    static bool getTimeColumn(AP2DataPlot2DModel *model,const QString& type,QVector<double> *index,QVector<double> *times);
+    //ranges must be sorted and not overlap. times may be empty, otherwise it is in seconds and matches index.
+    static Result compute(const QVector<double>& index,const QVector<double>& values,const QVector<double>& times,
+                          const QList<QPair<double,double> >& ranges,double threshold);
+
+private:
+    QList<QPair<double,double> > getRanges(const Filter& filter) const;
+
+    AP2DataPlot2DModel *m_model;
+    QMap<quint64,QString> m_modeChanges;
+    QCache<QString,Result> m_cache;
+};
+
+#endif // AP2DATAPLOTSTATISTICS_H
@@ -0,0 +1,158 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot statistics panel
+ */
+
+
+#include "AP2DataPlotStatisticsDialog.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QHeaderView>
+
+AP2DataPlotStatisticsDialog::AP2DataPlotStatisticsDialog(QWidget *parent) :
+    QWidget(parent,Qt::Tool)
+{
+    setWindowTitle(tr("Log Statistics"));
+
+    m_rangeComboBox = new QComboBox(this);
+    m_rangeComboBox->addItem(tr("Whole log"));
+    m_rangeComboBox->addItem(tr("Visible range"));
+
+    m_modeComboBox = new QComboBox(this);
+    m_modeComboBox->addItem(tr("All modes"));
+
+    m_thresholdCheckBox = new QCheckBox(tr("Time above"),this);
+    m_thresholdSpinBox = new QDoubleSpinBox(this);
+    m_thresholdSpinBox->setRange(-1000000000.0,1000000000.0);
+    m_thresholdSpinBox->setDecimals(3);
+    m_thresholdSpinBox->setEnabled(false);
+
+    QPushButton *refreshButton = new QPushButton(tr("Refresh"),this);
+
+    QHBoxLayout *controlLayout = new QHBoxLayout();
+    controlLayout->addWidget(new QLabel(tr("Range:"),this));
+    controlLayout->addWidget(m_rangeComboBox);
+    controlLayout->addWidget(new QLabel(tr("Mode:"),this));
+    controlLayout->addWidget(m_modeComboBox);
+    controlLayout->addWidget(m_thresholdCheckBox);
+    controlLayout->addWidget(m_thresholdSpinBox);
+    controlLayout->addStretch();
+    controlLayout->addWidget(refreshButton);
+
+    QStringList headers;
+    headers << tr("Field") << tr("Count") << tr("Min") << tr("Max") << tr("Mean") << tr("Std Dev");
+    QList<int> percentiles = AP2DataPlotStatistics::percentileList();
+    for (int i=0;i<percentiles.size();i++)
+    {
+        headers << "P" + QString::number(percentiles.at(i));
+    }
+    headers << tr("Duration (s)") << tr("Time Above (s)");
+    m_tableWidget = new QTableWidget(0,headers.size(),this);
+    m_tableWidget->setHorizontalHeaderLabels(headers);
+    m_tableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tableWidget->verticalHeader()->setVisible(false);
+
+    QVBoxLayout *layout = new QVBoxLayout();
+    layout->addLayout(controlLayout);
+    layout->addWidget(m_tableWidget);
+    setLayout(layout);
+    resize(900,300);
+
+    connect(m_rangeComboBox,SIGNAL(currentIndexChanged(int)),this,SIGNAL(statisticsRequested()));
+    connect(m_modeComboBox,SIGNAL(currentIndexChanged(int)),this,SIGNAL(statisticsRequested()));
+    connect(m_thresholdCheckBox,SIGNAL(toggled(bool)),m_thresholdSpinBox,SLOT(setEnabled(bool)));
+    connect(m_thresholdCheckBox,SIGNAL(toggled(bool)),this,SIGNAL(statisticsRequested()));
+    connect(m_thresholdSpinBox,SIGNAL(editingFinished()),this,SIGNAL(statisticsRequested()));
+    connect(refreshButton,SIGNAL(clicked()),this,SIGNAL(statisticsRequested()));
+}
+
+AP2DataPlotStatisticsDialog::~AP2DataPlotStatisticsDialog()
+{
+}
+
+void AP2DataPlotStatisticsDialog::setModeNames(const QStringList& modes)
+{
+    QString current = m_modeComboBox->currentText();
+    m_modeComboBox->blockSignals(true);
+    m_modeComboBox->clear();
+    m_modeComboBox->addItem(tr("All modes"));
+    m_modeComboBox->addItems(modes);
+    int index = m_modeComboBox->findText(current);
+    m_modeComboBox->setCurrentIndex(index == -1 ? 0 : index);
+    m_modeComboBox->blockSignals(false);
+}
+
+bool AP2DataPlotStatisticsDialog::isVisibleRangeOnly() const
+{
+    return m_rangeComboBox->currentIndex() == 1;
+}
+
+AP2DataPlotStatistics::Filter AP2DataPlotStatisticsDialog::getFilter(double lower,double upper) const
+{
+    AP2DataPlotStatistics::Filter filter;
+    if (isVisibleRangeOnly())
+    {
+        filter.lower = lower;
+        filter.upper = upper;
+    }
+    if (m_modeComboBox->currentIndex() > 0)
+    {
+        filter.mode = m_modeComboBox->currentText();
+    }
+    if (m_thresholdCheckBox->isChecked())
+    {
+        filter.threshold = m_thresholdSpinBox->value();
+    }
+    return filter;
+}
+
+void AP2DataPlotStatisticsDialog::clear()
+{
+    m_tableWidget->setRowCount(0);
+}
+
+void AP2DataPlotStatisticsDialog::setResult(const QString& name,const AP2DataPlotStatistics::Result& result)
+{
+    int row = m_tableWidget->rowCount();
+    m_tableWidget->insertRow(row);
+    QStringList columns;
+    columns << name << QString::number(result.count);
+    if (result.valid)
+    {
+        columns << QString::number(result.min,'g',8) << QString::number(result.max,'g',8);
+        columns << QString::number(result.mean,'g',8) << QString::number(result.stddev,'g',8);
+        for (int i=0;i<result.percentiles.size();i++)
+        {
+            columns << QString::number(result.percentiles.at(i),'g',8);
+        }
+        columns << QString::number(result.duration,'f',2);
+        columns << (m_thresholdCheckBox->isChecked() ? QString::number(result.timeAboveThreshold,'f',2) : QString());
+    }
+    for (int i=0;i<columns.size();i++)
+    {
+        m_tableWidget->setItem(row,i,new QTableWidgetItem(columns.at(i)));
+    }
+}
@@ -0,0 +1,66 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief AP2DataPlot statistics panel
+ */
+
+
+#ifndef AP2DATAPLOTSTATISTICSDIALOG_H
+#define AP2DATAPLOTSTATISTICSDIALOG_H
+
+#include <QWidget>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QDoubleSpinBox>
+#include <QTableWidget>
+#include "AP2DataPlotStatistics.h"
+
+//Table of statistics for the graphed fields. AP2DataPlot2D fills it in
+//whenever statisticsRequested is emitted.
+class AP2DataPlotStatisticsDialog : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit AP2DataPlotStatisticsDialog(QWidget *parent = 0);
+    ~AP2DataPlotStatisticsDialog();
+
+    void setModeNames(const QStringList& modes);
+    //The filter from the controls, using lower/upper when restricted to the visible range
+    AP2DataPlotStatistics::Filter getFilter(double lower,double upper) const;
+    bool isVisibleRangeOnly() const;
+
+    void clear();
+    void setResult(const QString& name,const AP2DataPlotStatistics::Result& result);
+
+signals:
+    void statisticsRequested();
+
+private:
+    QComboBox *m_rangeComboBox;
+    QComboBox *m_modeComboBox;
+    QCheckBox *m_thresholdCheckBox;
+    QDoubleSpinBox *m_thresholdSpinBox;
+    QTableWidget *m_tableWidget;
+};
+
+#endif // AP2DATAPLOTSTATISTICSDIALOG_H
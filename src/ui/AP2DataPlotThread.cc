@@ -37,16 +37,350 @@ This file is part of the APM_PLANNER project
 #include <QSqlQuery>
 #include <QSqlField>
 #include <QSqlError>
-#include "MAVLinkDecoder.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <string.h>
+#include <limits.h>
+#include <qnumeric.h>
+#include "AP2DataPlotLazyLog.h"
 #include "QsLog.h"
 #include "QGC.h"
 
+//Message types which are always decoded in full, even when lazy loading,
+//since AP2DataPlot2D::threadDone and the vehicle type detection need them straight away.
+static const char *s_fullyLoadedTypes[] = { "FMT", "PARM", "MODE", "EV", "ERR", "MSG", 0 };
+
+//Field layout of every mavlink message, for decoding tlog messages straight from their payload
+static const mavlink_message_info_t s_mavlinkMessageInfo[256] = MAVLINK_MESSAGE_INFO;
+
+//With progressive loading on, a snapshot is published each time this much more of the file has been read
+#define SNAPSHOT_INTERVAL_BYTES (4 * 1024 * 1024)
+
+//Text logs are parsed in chunks of about this size, see loadAsciiLog
+#define ASCII_CHUNK_BYTES (1024 * 1024)
+
+namespace
+{
+//A type defined by an FMT line of a text log
+struct AsciiFormat
+{
+    QString name;
+    QByteArray format;
+    //Where the FMT line is, lines of this type before it are unknown
+    qint64 offset;
+};
+
+//A data line parsed into AsciiChunk::values, one value per format character
+struct AsciiRow
+{
+    int format;
+    int firstValue;
+};
+
+//A run of whole lines of a text log and what AsciiChunkTask parsed from them
+struct AsciiChunk
+{
+    AsciiChunk(const char *data,const char *begin,const char *end,const QList<AsciiFormat> &formats,const QHash<quint64,int> &names) :
+        data(data),
+        begin(begin),
+        end(end),
+        formats(formats),
+        names(names),
+        errors(0)
+    {
+    }
+    const char *data;
+    const char *begin;
+    const char *end;
+    const QList<AsciiFormat> &formats;
+    const QHash<quint64,int> &names;
+    QVector<AsciiRow> rows;
+    QVector<QVariant> values;
+    int errors;
+    //Set when the log can't be loaded at all
+    QString fatalError;
+};
+
+//Message names are at most four characters, packed into an integer they can be looked up
+//without building a string for every line. Returns 0 for names too long to pack.
+inline quint64 asciiNameKey(const char *begin,const char *end)
+{
+    if (begin == end || end - begin > 8)
+    {
+        return 0;
+    }
+    quint64 key = 0;
+    for (;begin < end;begin++)
+    {
+        key = (key << 8) | static_cast<uchar>(*begin);
+    }
+    return key;
+}
+
+inline bool isAsciiSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+//Trim [begin,end) in place
+inline void trimAscii(const char *&begin,const char *&end)
+{
+    while (begin < end && isAsciiSpace(*begin))
+    {
+        begin++;
+    }
+    while (end > begin && isAsciiSpace(*(end - 1)))
+    {
+        end--;
+    }
+}
+
+QByteArray asciiToken(const char *begin,const char *end)
+{
+    trimAscii(begin,end);
+    return QByteArray(begin,end - begin);
+}
+
+//Decimal integer, with an optional sign and nothing else
+bool parseAsciiInteger(const char *begin,const char *end,qint64 *value)
+{
+    bool negative = false;
+    if (begin < end && (*begin == '-' || *begin == '+'))
+    {
+        negative = (*begin == '-');
+        begin++;
+    }
+    if (begin == end || end - begin > 18)
+    {
+        return false;
+    }
+    qint64 result = 0;
+    for (;begin < end;begin++)
+    {
+        if (*begin < '0' || *begin > '9')
+        {
+            return false;
+        }
+        result = result * 10 + (*begin - '0');
+    }
+    *value = negative ? -result : result;
+    return true;
+}
+
+bool parseAsciiDouble(const char *begin,const char *end,double *value)
+{
+    //Exactly representable powers of ten. A mantissa below 2^53 scaled by one of
+    //these is correctly rounded, anything else goes through QByteArray::toDouble.
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    quint64 mantissa = 0;
+    int digits = 0;
+    int significant = 0;
+    int exponent = 0;
+    for (;p < end && *p >= '0' && *p <= '9';p++,digits++)
+    {
+        mantissa = mantissa * 10 + (*p - '0');
+        significant += (mantissa != 0);
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++;p < end && *p >= '0' && *p <= '9';p++,digits++)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            significant += (mantissa != 0);
+            exponent--;
+        }
+    }
+    bool fast = (digits > 0 && significant <= 15);
+    if (fast && p < end && (*p == 'e' || *p == 'E'))
+    {
+        qint64 e = 0;
+        fast = parseAsciiInteger(p + 1,end,&e) && e > -1000 && e < 1000;
+        exponent += fast ? static_cast<int>(e) : 0;
+        p = end;
+    }
+    if (fast && p == end && exponent >= -22 && exponent <= 22)
+    {
+        double result = static_cast<double>(mantissa);
+        result = (exponent < 0) ? result / powers[-exponent] : result * powers[exponent];
+        *value = negative ? -result : result;
+        return true;
+    }
+    bool ok = false;
+    double result = QByteArray(begin,end - begin).toDouble(&ok);
+    if (!ok || qIsInf(result) || qIsNaN(result))
+    {
+        return false;
+    }
+    *value = result;
+    return true;
+}
+
+//Tokenizes the lines of an AsciiChunk and parses every field according to its format
+class AsciiChunkTask : public QRunnable
+{
+public:
+    explicit AsciiChunkTask(AsciiChunk *chunk) :
+        m_chunk(chunk)
+    {
+    }
+    void run()
+    {
+        AsciiChunk &chunk = *m_chunk;
+        chunk.values.reserve((chunk.end - chunk.begin) / 6);
+        for (const char *line = chunk.begin;line < chunk.end && chunk.fatalError.isEmpty();)
+        {
+            const char *eol = static_cast<const char*>(memchr(line,'\n',chunk.end - line));
+            if (!eol)
+            {
+                eol = chunk.end;
+            }
+            parseLine(line,eol);
+            line = eol + 1;
+        }
+    }
+private:
+    void parseLine(const char *line,const char *eol)
+    {
+        AsciiChunk &chunk = *m_chunk;
+        const char *nameend = static_cast<const char*>(memchr(line,',',eol - line));
+        if (!nameend || (eol - line >= 3 && memcmp(line,"FMT",3) == 0))
+        {
+            //FMT lines were handled before parsing started, lines without a comma are text
+            return;
+        }
+        const char *namestart = line;
+        const char *nametrimmed = nameend;
+        trimAscii(namestart,nametrimmed);
+        QHash<quint64,int>::const_iterator found = chunk.names.constFind(asciiNameKey(namestart,nametrimmed));
+        if (found == chunk.names.constEnd() || chunk.formats.at(found.value()).offset > line - chunk.data)
+        {
+            QLOG_DEBUG() << "Found line at offset" << (line - chunk.data) << "with unknown command" << QByteArray(namestart,nametrimmed - namestart) << ", skipping...";
+            return;
+        }
+        const AsciiFormat &format = chunk.formats.at(found.value());
+        const char *typecodes = format.format.constData();
+        int fieldcount = format.format.size();
+
+        AsciiRow row;
+        row.format = found.value();
+        row.firstValue = chunk.values.size();
+        bool foundError = false;
+        int field = 0;
+        for (const char *token = nameend + 1;token <= eol;field++)
+        {
+            const char *tokenend = static_cast<const char*>(memchr(token,',',eol - token));
+            if (!tokenend)
+            {
+                tokenend = eol;
+            }
+            const char *valuestart = token;
+            token = tokenend + 1;
+            if (field >= fieldcount || foundError)
+            {
+                //Only counted from here on, the line is rejected either way
+                continue;
+            }
+            trimAscii(valuestart,tokenend);
+            switch (typecodes[field])
+            {
+            case 'b': case 'B': case 'h': case 'H': case 'i': case 'I': case 'q': case 'Q':
+            {
+                qint64 value;
+                if (!parseAsciiInteger(valuestart,tokenend,&value))
+                {
+                    QLOG_DEBUG() << "Failed to convert " << QByteArray(valuestart,tokenend - valuestart) << " to an integer number.";
+                    foundError = true;
+                }
+                else if (value >= INT_MIN && value <= INT_MAX)
+                {
+                    chunk.values.append(QVariant(static_cast<int>(value)));
+                }
+                else
+                {
+                    chunk.values.append(QVariant(value));
+                }
+                break;
+            }
+            case 'c': case 'C': case 'e': case 'E': case 'f': case 'L':
+            {
+                double value;
+                if (!parseAsciiDouble(valuestart,tokenend,&value))
+                {
+                    QLOG_DEBUG() << "Failed to convert " << QByteArray(valuestart,tokenend - valuestart) << " to a floating point number.";
+                    foundError = true;
+                }
+                else
+                {
+                    chunk.values.append(QVariant(value));
+                }
+                break;
+            }
+            case 'n': case 'N': case 'Z': case 'M':
+                chunk.values.append(QVariant(QString::fromUtf8(valuestart,tokenend - valuestart)));
+                break;
+            default:
+                QLOG_DEBUG() << "AP2DataPlotThread::run(): Unknown data value found" << typecodes[field];
+                chunk.fatalError = QString("Unknown data value found: %1").arg(QChar(typecodes[field]));
+                return;
+            }
+        }
+        if (field != fieldcount || foundError)
+        {
+            if (foundError)
+            {
+                QLOG_DEBUG() << "Found an error at offset" << (line - chunk.data) << ", skipping it.";
+            }
+            chunk.values.resize(row.firstValue);
+            chunk.errors++;
+            return;
+        }
+        if (fieldcount > 0)
+        {
+            chunk.rows.append(row);
+        }
+    }
+
+    AsciiChunk *m_chunk;
+};
+}
+
+//Vehicle type from the firmware banner or the parameters only a vehicle type has,
+//MAV_TYPE_GENERIC if the line shows neither.
+static MAV_TYPE asciiVehicleType(const char *line,const char *eol)
+{
+    QByteArray text = QByteArray::fromRawData(line,eol - line);
+    bool parm = text.startsWith("PARM");
+    if (text.contains("ArduRover") || (parm && text.contains("SKID_STEER_OUT")))
+    {
+        return MAV_TYPE_GROUND_ROVER;
+    }
+    if (text.contains("ArduPlane") || (parm && text.contains("PTCH2SRV_P")))
+    {
+        return MAV_TYPE_FIXED_WING;
+    }
+    if (text.contains("ArduCopter") || (parm && (text.contains("RATE_RLL_P") || text.contains("H_SWASH_PLATE"))))
+    {
+        return MAV_TYPE_QUADROTOR;
+    }
+    return MAV_TYPE_GENERIC;
+}
+
 
 AP2DataPlotThread::AP2DataPlotThread(AP2DataPlot2DModel *model,QObject *parent) :
     QThread(parent),
-    m_decoder(NULL),
     m_dataModel(model),
-    m_logStartTime(0)
+    m_logStartTime(0),
+    m_lazyLoading(false),
+    m_progressive(false),
+    m_nextSnapshot(0)
 {
     QLOG_DEBUG() << "Created AP2DataPlotThread:" << this;
     qRegisterMetaType<MAV_TYPE>("MAV_TYPE");
@@ -69,6 +403,26 @@ bool AP2DataPlotThread::isMainThread()
     return QThread::currentThread() == QCoreApplication::instance()->thread();
 }
 
+bool AP2DataPlotThread::checkSnapshot(qint64 pos,qint64 size)
+{
+    if (!m_progressive || pos < m_nextSnapshot)
+    {
+        return true;
+    }
+    m_nextSnapshot = pos + SNAPSHOT_INTERVAL_BYTES;
+    //Commit so the snapshot only ever contains whole messages
+    if (!m_dataModel->endTransaction())
+    {
+        return false;
+    }
+    emit snapshotReady(pos,size);
+    //The model can't be read and written at the same time, so wait for the GUI to be done with it
+    while (!m_stop && !m_snapshotSemaphore.tryAcquire(1,100))
+    {
+    }
+    return m_dataModel->startTransaction();
+}
+
 void AP2DataPlotThread::loadBinaryLog(QFile &logfile)
 {
     QByteArray block;
@@ -91,6 +445,11 @@ void AP2DataPlotThread::loadBinaryLog(QFile &logfile)
     {
         int nonpacketcounter = 0;
         emit loadProgress(logfile.pos(),logfile.size());
+        if (!checkSnapshot(logfile.pos(),logfile.size()))
+        {
+            emit error(m_dataModel->getError());
+            return;
+        }
         block.append(logfile.read(8192));
         for (int i=0;i<block.size();i++)
         {
@@ -392,65 +751,302 @@ void AP2DataPlotThread::loadBinaryLog(QFile &logfile)
         return;
     }
 }
-void AP2DataPlotThread::loadAsciiLog(QFile &logfile)
+void AP2DataPlotThread::loadBinaryLogIndex()
 {
+    AP2DataPlotLazyLog *lazylog = new AP2DataPlotLazyLog();
+    if (!lazylog->open(m_fileName))
+    {
+        emit error(lazylog->getError());
+        delete lazylog;
+        return;
+    }
+    //The model owns the lazy log from here on, and decodes fields out of it on demand
+    m_dataModel->setLazyLog(lazylog);
+    const uchar *data = lazylog->data();
+    qint64 size = lazylog->size();
+
+    QStringList fullyLoadedTypes;
+    for (int i=0;s_fullyLoadedTypes[i];i++)
+    {
+        fullyLoadedTypes.append(s_fullyLoadedTypes[i]);
+    }
+
+    int paramtype = -1;
+    int typeToLength[256];
+    bool typeIsLazy[256];
+    QString typeToName[256];
+    QByteArray typeToFormat[256];
+    QStringList typeToLabels[256];
+    for (int i=0;i<256;i++)
+    {
+        typeToLength[i] = 0;
+        typeIsLazy[i] = false;
+    }
+    QStringList tables;
+
+    int index = 0;
+    qint64 nonpacketcounter = 0;
+    qint64 nextprogress = 0;
     m_loadedLogType = MAV_TYPE_GENERIC;
-    int index = 500;
-    QMap<QString,QString> nameToTypeString;
-    QMap<QString,QStringList> nameToValueList;
 
     if (!m_dataModel->startTransaction())
     {
         emit error(m_dataModel->getError());
         return;
     }
-    while (!logfile.atEnd() && !m_stop)
+    qint64 pos = 0;
+    while (pos + 3 <= size && !m_stop)
     {
-        emit loadProgress(logfile.pos(),logfile.size());
-        QString line = logfile.readLine();
-        emit lineRead(line);
-        if (m_loadedLogType == MAV_TYPE_GENERIC)
+        if (pos >= nextprogress)
         {
-            if ((line.contains("ArduCopter") || (line.contains("PARM") && (line.contains("RATE_RLL_P") || line.contains("H_SWASH_PLATE")))))
+            emit loadProgress(pos,size);
+            nextprogress = pos + (1024 * 1024);
+            if (!checkSnapshot(pos,size))
+            {
+                emit error(m_dataModel->getError());
+                return;
+            }
+        }
+        if (data[pos] != 0xA3 || data[pos+1] != 0x95)
+        {
+            //Non packet
+            nonpacketcounter++;
+            pos++;
+            continue;
+        }
+        unsigned char type = data[pos+2];
+        if (type == 0x80)
+        {
+            //Message format packet
+            if (pos + 89 > size)
+            {
+                break;
+            }
+            const uchar *packet = data + pos + 3;
+            pos += 89;
+            unsigned char msg_type = packet[0]; //Message type defined in the format struct
+            unsigned char msg_length = packet[1];  //Message length
+            QString name = QString(QByteArray(reinterpret_cast<const char*>(packet + 2),4)); //Name of the message
+            QString format = QString(QByteArray(reinterpret_cast<const char*>(packet + 6),16)); //Format of the variables
+            QString labels = QString(QByteArray(reinterpret_cast<const char*>(packet + 22),64)); //comma delimited list of variable names.
+            if (name == "PARM")
+            {
+                paramtype = msg_type;
+            }
+            typeToLength[msg_type] = msg_length;
+            typeToName[msg_type] = name;
+            typeToFormat[msg_type] = format.toLatin1();
+            typeToLabels[msg_type] = labels.split(",");
+
+            if (msg_type == 0x80)
             {
-                m_loadedLogType = MAV_TYPE_QUADROTOR;
+                //Mesage is a format type, we don't want to include it
+                continue;
             }
-            if (line.contains("ArduPlane") || (line.contains("PARM") && line.contains("PTCH2SRV_P")))
+            if (format == "" || labels == "")
             {
-                m_loadedLogType = MAV_TYPE_FIXED_WING;
+                QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): empty format string or labels string for type" << msg_type << name;
+                continue;
             }
-            if (line.contains("ArduRover") || (line.contains("PARM") && line.contains("SKID_STEER_OUT")))
+            if (AP2DataPlotLazyLog::formatSize(typeToFormat[msg_type]) != msg_length - 3)
             {
-                m_loadedLogType = MAV_TYPE_GROUND_ROVER;
+                //Field offsets would run past the message, so none of its packets are read
+                QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): format" << format << "does not match length" << msg_length << "for type" << msg_type << name;
+                continue;
             }
+            if (!tables.contains(name))
+            {
+                //The SQL table is still created for lazy types, the FMT table is used to look them up
+                if (!m_dataModel->addType(name,msg_type,msg_length,format,labels.split(",")))
+                {
+                    QString actualerror = m_dataModel->getError();
+                    m_dataModel->endTransaction(); //endTransaction can re-set the error if it errors, but we should try it anyway.
+                    emit error(actualerror);
+                    return;
+                }
+                if (!fullyLoadedTypes.contains(name) && !m_dataModel->addLazyType(name,format,labels.split(","),msg_length))
+                {
+                    continue;
+                }
+                tables.append(name);
+            }
+            typeIsLazy[msg_type] = !fullyLoadedTypes.contains(name);
+            index++;
+            continue;
+        }
+
+        //Data packet
+        if (typeToLength[type] == 0)
+        {
+            //Not a type we have a format for, treat it as noise and resync
+            nonpacketcounter++;
+            pos++;
+            continue;
+        }
+        if (pos + typeToLength[type] > size)
+        {
+            //Truncated last packet
+            break;
         }
-        QStringList linesplit = line.replace("\r","").replace("\n","").split(",");
-        if (linesplit.size() > 0)
+        const uchar *packet = data + pos + 3;
+        qint64 packetoffset = pos + 3;
+        pos += typeToLength[type];
+
+        const QString &name = typeToName[type];
+        if (!tables.contains(name))
         {
-            if (line.startsWith("FMT"))
+            QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): No query available for param category" << name;
+            continue;
+        }
+        index++;
+        const QByteArray &formatstr = typeToFormat[type];
+        if (typeIsLazy[type])
+        {
+            if (formatstr.size() > 1)
             {
-                //Format line
-                if (linesplit.size() > 4)
+                if (!m_dataModel->addLazyRow(name,packetoffset,index,formatstr.size()))
                 {
-                    QString type = linesplit[3].trimmed();
-                    if (type != "FMT")
+                    QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): Dropped out of range record" << index << "of" << name;
+                }
+            }
+            continue;
+        }
+
+        QList<QPair<QString,QVariant> > valuepairlist;
+        const QStringList &labelstrsplit = typeToLabels[type];
+        int offset = 0;
+        for (int j=0;j<formatstr.size() && j<labelstrsplit.size();j++)
+        {
+            char typeCode = formatstr.at(j);
+            int valuesize = AP2DataPlotLazyLog::valueSize(typeCode);
+            if (valuesize < 0)
+            {
+                QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): ERROR UNKNOWN DATA TYPE" << typeCode;
+                break;
+            }
+            valuepairlist.append(QPair<QString,QVariant>(labelstrsplit.at(j),AP2DataPlotLazyLog::decodeValue(packet + offset,typeCode)));
+            offset += valuesize;
+        }
+        if (valuepairlist.size() > 1)
+        {
+            if (!m_dataModel->addRow(name,valuepairlist,index))
+            {
+                QString actualerror = m_dataModel->getError();
+                m_dataModel->endTransaction(); //endTransaction can re-set the error if it errors, but we should try it anyway.
+                emit error(actualerror);
+                return;
+            }
+        }
+
+        if (type == paramtype && m_loadedLogType == MAV_TYPE_GENERIC)
+        {
+            for (int j=0;j<valuepairlist.size();j++)
+            {
+                QString value = valuepairlist.at(j).second.toString();
+                if (value == "RATE_RLL_P" || value == "H_SWASH_PLATE")
+                {
+                    m_loadedLogType = MAV_TYPE_QUADROTOR;
+                }
+                else if (value == "PTCH2SRV_P")
+                {
+                    m_loadedLogType = MAV_TYPE_FIXED_WING;
+                }
+                else if (value == "SKID_STEER_OUT")
+                {
+                    m_loadedLogType = MAV_TYPE_GROUND_ROVER;
+                }
+            }
+        }
+    }
+    emit loadProgress(pos,size);
+    if (nonpacketcounter > 0)
+    {
+        QLOG_DEBUG() << "AP2DataPlotThread::loadBinaryLogIndex(): Non packet bytes found in log file" << nonpacketcounter << "bytes filtered out. This may be a corrupt log";
+    }
+    if (!m_dataModel->endTransaction())
+    {
+        emit error(m_dataModel->getError());
+        return;
+    }
+}
+void AP2DataPlotThread::loadAsciiLog(QFile &logfile)
+{
+    m_loadedLogType = MAV_TYPE_GENERIC;
+    int index = 500;
+    qint64 size = logfile.size();
+
+    //The whole file is tokenized in place, straight from the mapping where possible
+    QByteArray filedata;
+    const char *data = reinterpret_cast<const char*>(logfile.map(0,size));
+    if (!data)
+    {
+        filedata = logfile.readAll();
+        data = filedata.constData();
+        size = filedata.size();
+    }
+
+    if (!m_dataModel->startTransaction())
+    {
+        emit error(m_dataModel->getError());
+        return;
+    }
+
+    //First pass, only the FMT and PARM lines are looked at. This defines every type
+    //before the data lines are parsed in parallel, and detects the vehicle type once.
+    QList<AsciiFormat> formats;
+    QHash<quint64,int> nameToFormat;
+    const char *fileend = data + size;
+    for (const char *line = data;line < fileend && !m_stop;)
+    {
+        const char *eol = static_cast<const char*>(memchr(line,'\n',fileend - line));
+        if (!eol)
+        {
+            eol = fileend;
+        }
+        if (eol - line >= 3 && memcmp(line,"FMT",3) == 0)
+        {
+            QList<QByteArray> linesplit;
+            for (const char *token = line;token <= eol;)
+            {
+                const char *tokenend = token;
+                while (tokenend < eol && *tokenend != ',')
+                {
+                    tokenend++;
+                }
+                linesplit.append(asciiToken(token,tokenend));
+                token = tokenend + 1;
+            }
+            //Format line
+            if (linesplit.size() > 4)
+            {
+                QString type = QString::fromUtf8(linesplit[3]);
+                quint64 key = asciiNameKey(linesplit[3].constData(),linesplit[3].constData() + linesplit[3].size());
+                if (key == 0)
+                {
+                    QLOG_ERROR() << "Unusable message name in plot log file:" << type;
+                }
+                else if (nameToFormat.contains(key))
+                {
+                    //Logs that were appended to repeat their FMT lines, the first definition is kept
+                }
+                else if (type != "FMT")
+                {
+                    AsciiFormat format;
+                    format.name = type;
+                    format.format = linesplit[4];
+                    format.offset = line - data;
+                    nameToFormat.insert(key,formats.size());
+                    formats.append(format);
+                    if (!format.format.isEmpty())
                     {
-                        QString descstr = linesplit[4].trimmed();
-                        nameToTypeString[type] = descstr;
-                        if (descstr == "")
-                        {
-                            continue;
-                        }
                         QStringList valuestr;
                         for (int i=5;i<linesplit.size();i++)
                         {
-                            QString name = linesplit[i].trimmed();
-                            valuestr += name;
+                            valuestr += QString::fromUtf8(linesplit[i]);
                         }
-                        nameToValueList[type] = valuestr;
-                        int type_id = linesplit[1].trimmed().toInt();
-                        int length = linesplit[2].trimmed().toInt();
-                        if (!m_dataModel->addType(type,type_id,length,descstr,valuestr))
+                        int type_id = linesplit[1].toInt();
+                        int length = linesplit[2].toInt();
+                        if (!m_dataModel->addType(type,type_id,length,QString::fromLatin1(format.format),valuestr))
                         {
                             QString actualerror = m_dataModel->getError();
                             m_dataModel->endTransaction(); //endTransaction can re-set the error if it errors, but we should try it anyway.
@@ -459,121 +1055,168 @@ void AP2DataPlotThread::loadAsciiLog(QFile &logfile)
                         }
                     }
                 }
-                else
-                {
-                    QLOG_ERROR() << "Error with line in plot log file:" << line;
-                }
             }
             else
             {
-                if (linesplit.size() > 1)
-                {
-                    QString name = linesplit[0].trimmed();
-                    if (nameToTypeString.contains(name))
-                    {
-                        QString typestr = nameToTypeString[name];
-                        static QString intdef("bBhHiI");
-                        static QString floatdef("cCeEfL");
-                        static QString chardef("nNZM");
-                        if (typestr.size() != linesplit.size() - 1)
-                        {
-                            //QLOG_DEBUG() << "Bound values for" << name << "count:" << nameToInsertQuery[name]->boundValues().values().size() << "actual" << linesplit.size() << typestr.size();
-                            //QLOG_DEBUG() << "Error in line:" << index << "param" << name << "parameter mismatch";
-                            m_errorCount++;
-                        }
-                        else
-                        {
-                            QList<QPair<QString,QVariant> > valuepairlist;
-                            QStringList valuestrlist = nameToValueList.value(name);
-                            //valuelist.append(QPair<QString,QVariant>("idx",unixtimemsec));
+                QLOG_ERROR() << "Error with line in plot log file:" << QByteArray(line,eol - line);
+            }
+        }
+        else if (m_loadedLogType == MAV_TYPE_GENERIC)
+        {
+            //The firmware banner, messages and the PARM block are all that can identify the vehicle
+            bool parmormsg = (eol - line >= 4) && (memcmp(line,"PARM",4) == 0 || memcmp(line,"MSG",3) == 0);
+            if (parmormsg || !memchr(line,',',eol - line))
+            {
+                m_loadedLogType = asciiVehicleType(line,eol);
+            }
+        }
+        line = eol + 1;
+    }
 
-                            bool foundError = false;
-                            for (int i = 1; i < linesplit.size(); i++)
-                            {
-                                QString subname = "";
-                                if (valuestrlist.size() > i-1)
-                                {
-                                    subname = valuestrlist.at(i-1);
-                                }
-                                else
-                                {
-                                    continue;
-                                }
-                                bool ok;
-                                QChar typeCode = typestr.at(i - 1);
-                                QString valStr = linesplit[i].trimmed();
-                                if (intdef.contains(typeCode))
-                                {
-                                    int val = valStr.toInt(&ok);
-                                    if (ok)
-                                    {
-                                        valuepairlist.append(QPair<QString,QVariant>(subname,val));
-                                    }
-                                    else
-                                    {
-                                        QLOG_DEBUG() << "Failed to convert " << valStr << " to an integer number.";
-                                        foundError = true;
-                                    }
-                                }
-                                else if (chardef.contains(typeCode))
-                                {
-                                    valuepairlist.append(QPair<QString,QVariant>(subname,valStr));
-                                }
-                                else if (floatdef.contains(typeCode))
-                                {
-                                    double val = valStr.toDouble(&ok);
-                                    if (ok && !isinf(val) && !isnan(val))
-                                    {
-                                        valuepairlist.append(QPair<QString,QVariant>(subname,val));
-                                    }
-                                    else
-                                    {
-                                        QLOG_DEBUG() << "Failed to convert " << valStr << " to a floating point number.";
-                                        foundError = true;
-                                    }
-                                }
-                                else
-                                {
-                                    QLOG_DEBUG() << "AP2DataPlotThread::run(): Unknown data value found" << typeCode;
-                                    emit error(QString("Unknown data value found: %1").arg(typeCode));
-                                    return;
-                                }
-                            }
-                            if (foundError)
-                            {
-                                QLOG_DEBUG() << "Found an error on line " << index << ", skipping it.";
-                                ++m_errorCount;
-                            }
-                            else
-                            {
-                                if (valuepairlist.size() > 0)
-                                {
-                                    if (!m_dataModel->addRow(name,valuepairlist,index++))
-                                    {
-                                        QString actualerror = m_dataModel->getError();
-                                        m_dataModel->endTransaction(); //endTransaction can re-set the error if it errors, but we should try it anyway.
-                                        emit error(actualerror);
-                                        return;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        QLOG_DEBUG() << "Found line " << index << " with unknown command " << name << ", skipping...";
-                    }
-                }
+    //Second pass, the data lines. Chunks of the file are parsed on the thread pool a batch
+    //at a time, then added to the model in file order so indexes stay sequential.
+    int threads = qMax(1,QThread::idealThreadCount());
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    const char *batchstart = data;
+    while (batchstart < fileend && !m_stop)
+    {
+        QList<AsciiChunk*> chunks;
+        for (int i=0;i<threads && batchstart < fileend;i++)
+        {
+            const char *chunkend = fileend;
+            if (fileend - batchstart > ASCII_CHUNK_BYTES)
+            {
+                //Chunks end on a line boundary
+                chunkend = static_cast<const char*>(memchr(batchstart + ASCII_CHUNK_BYTES,'\n',fileend - batchstart - ASCII_CHUNK_BYTES));
+                chunkend = chunkend ? chunkend + 1 : fileend;
+            }
+            AsciiChunk *chunk = new AsciiChunk(data,batchstart,chunkend,formats,nameToFormat);
+            chunks.append(chunk);
+            pool.start(new AsciiChunkTask(chunk));
+            batchstart = chunkend;
+        }
+        pool.waitForDone();
 
+        for (int i=0;i<chunks.size();i++)
+        {
+            AsciiChunk *chunk = chunks.at(i);
+            if (!chunk->fatalError.isEmpty())
+            {
+                qDeleteAll(chunks);
+                m_dataModel->endTransaction();
+                emit error(chunk->fatalError);
+                return;
+            }
+            m_errorCount += chunk->errors;
+            const QVariant *values = chunk->values.constData();
+            for (int j=0;j<chunk->rows.size() && !m_stop;j++)
+            {
+                const AsciiRow &row = chunk->rows.at(j);
+                const AsciiFormat &format = formats.at(row.format);
+                if (!m_dataModel->addRow(format.name,values + row.firstValue,format.format.size(),index++))
+                {
+                    QString actualerror = m_dataModel->getError();
+                    qDeleteAll(chunks);
+                    m_dataModel->endTransaction(); //endTransaction can re-set the error if it errors, but we should try it anyway.
+                    emit error(actualerror);
+                    return;
+                }
+            }
+            qint64 pos = chunk->end - data;
+            emit loadProgress(pos,size);
+            if (!checkSnapshot(pos,size))
+            {
+                qDeleteAll(chunks);
+                emit error(m_dataModel->getError());
+                return;
             }
         }
+        qDeleteAll(chunks);
     }
+    logfile.seek(batchstart - data);
     if (!m_dataModel->endTransaction())
     {
         emit error(m_dataModel->getError());
         return;
     }
 }
+//Table column type for a mavlink field, using the dataflash type codes
+//AP2DataPlot2DModel::makeCreateTableString understands. Numeric arrays aren't stored, 0 is returned for them.
+static char tlogTypeChar(const mavlink_field_info_t &field)
+{
+    if (field.type == MAVLINK_TYPE_CHAR)
+    {
+        return (field.array_length > 0) ? 'Z' : 'b';
+    }
+    if (field.array_length > 0)
+    {
+        return 0;
+    }
+    switch (field.type)
+    {
+    case MAVLINK_TYPE_UINT8_T:
+        return 'B';
+    case MAVLINK_TYPE_INT8_T:
+        return 'b';
+    case MAVLINK_TYPE_UINT16_T:
+        return 'H';
+    case MAVLINK_TYPE_INT16_T:
+        return 'h';
+    case MAVLINK_TYPE_UINT32_T:
+        return 'I';
+    case MAVLINK_TYPE_INT32_T:
+        return 'i';
+    case MAVLINK_TYPE_UINT64_T:
+        return 'Q';
+    case MAVLINK_TYPE_INT64_T:
+        return 'q';
+    case MAVLINK_TYPE_FLOAT:
+    case MAVLINK_TYPE_DOUBLE:
+        return 'f';
+    default:
+        QLOG_ERROR() << "Unknown type:" << QString::number(field.type);
+        return 0;
+    }
+}
+
+//A field of a received message, in its own type
+static QVariant decodeTLogField(const mavlink_message_t &message,const mavlink_field_info_t &field)
+{
+    switch (field.type)
+    {
+    case MAVLINK_TYPE_CHAR:
+        if (field.array_length > 0)
+        {
+            const char *str = _MAV_PAYLOAD(&message) + field.wire_offset;
+            return QString::fromLatin1(str,qstrnlen(str,field.array_length));
+        }
+        return static_cast<int>(_MAV_RETURN_char(&message,field.wire_offset));
+    case MAVLINK_TYPE_UINT8_T:
+        return static_cast<uint>(_MAV_RETURN_uint8_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_INT8_T:
+        return static_cast<int>(_MAV_RETURN_int8_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_UINT16_T:
+        return static_cast<uint>(_MAV_RETURN_uint16_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_INT16_T:
+        return static_cast<int>(_MAV_RETURN_int16_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_UINT32_T:
+        return static_cast<uint>(_MAV_RETURN_uint32_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_INT32_T:
+        return static_cast<int>(_MAV_RETURN_int32_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_UINT64_T:
+        return static_cast<qulonglong>(_MAV_RETURN_uint64_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_INT64_T:
+        return static_cast<qlonglong>(_MAV_RETURN_int64_t(&message,field.wire_offset));
+    case MAVLINK_TYPE_FLOAT:
+        return _MAV_RETURN_float(&message,field.wire_offset);
+    case MAVLINK_TYPE_DOUBLE:
+        return _MAV_RETURN_double(&message,field.wire_offset);
+    default:
+        return QVariant();
+    }
+}
+
 void AP2DataPlotThread::loadTLog(QFile &logfile)
 {
     m_loadedLogType = MAV_TYPE_GENERIC;
@@ -584,10 +1227,10 @@ void AP2DataPlotThread::loadTLog(QFile &logfile)
     mavlink_message_t message;
     mavlink_status_t status;
 
-    QList<uint64_t*> mavlinkList;
     m_fieldCount=0;
-    m_decoder = new MAVLinkDecoder();
-    QList<quint64> lastunixtimemseclist;
+    //Indexes handed out so far are all at or below this, see below
+    quint64 lastindex = 0;
+    bool haveindex = false;
 
     if (!m_dataModel->startTransaction())
     {
@@ -597,6 +1240,11 @@ void AP2DataPlotThread::loadTLog(QFile &logfile)
     while (!logfile.atEnd() && !m_stop)
     {
         emit loadProgress(logfile.pos(),logfile.size());
+        if (!checkSnapshot(logfile.pos(),logfile.size()))
+        {
+            emit error(m_dataModel->getError());
+            return;
+        }
         QByteArray bytes = logfile.read(128);
         bytesize+=128;
 
@@ -624,6 +1272,11 @@ void AP2DataPlotThread::loadTLog(QFile &logfile)
             if (decodeState != 1)
             {
                 timebuf.append(bytes[i]);
+                if (timebuf.size() > 4096)
+                {
+                    //Only the last 8 bytes are ever used, don't let junk between messages grow it
+                    timebuf.remove(0,timebuf.size() - 8);
+                }
             }
             else if (decodeState == 1) // This 'else' works as you need one more byte that the timestamp to satisfy. as would just with else removed
             {
@@ -636,82 +1289,24 @@ void AP2DataPlotThread::loadTLog(QFile &logfile)
                 timebuf.clear();
 
                 //Good decode
-                if (message.sysid != 255) // [TODO] GCS packet is not always 255 sysid.
+                const mavlink_message_info_t &info = s_mavlinkMessageInfo[message.msgid];
+                if (message.sysid != 255 && info.num_fields > 0) // [TODO] GCS packet is not always 255 sysid.
                 {
-                    uint64_t *target = (uint64_t*)malloc(message.len * 4);
-                    memcpy(target,message.payload64,message.len * 4);
-                    mavlinkList.append(target);
-                    QList<QPair<QString,QVariant> > retvals = m_decoder->receiveMessage(0,message);
-                    QString name = m_decoder->getMessageName(message.msgid);
+                    QString name = info.name;
 
                     if (!m_dataModel->hasType(name))
                     {
-
-                        QList<QString> fieldnames = m_decoder->getFieldList(name);
                         QStringList variablenames;
                         QString typechars;
-                        for (int i=0;i<fieldnames.size();i++)
+                        for (unsigned int field=0;field<info.num_fields;field++)
                         {
-                            mavlink_field_info_t fieldinfo = m_decoder->getFieldInfo(name,fieldnames.at(i));
-                            variablenames <<  QString(fieldinfo.name);
-                            switch (fieldinfo.type)
+                            char typechar = tlogTypeChar(info.fields[field]);
+                            if (typechar == 0)
                             {
-                                case MAVLINK_TYPE_CHAR:
-                                {
-                                    typechars += "b";
-                                }
-                                break;
-                                case MAVLINK_TYPE_UINT8_T:
-                                {
-                                    typechars += "B";
-                                }
-                                break;
-                                case MAVLINK_TYPE_INT8_T:
-                                {
-                                    typechars += "b";
-                                }
-                                break;
-                                case MAVLINK_TYPE_UINT16_T:
-                                {
-                                    typechars += "H";
-                                }
-                                break;
-                                case MAVLINK_TYPE_INT16_T:
-                                {
-                                    typechars += "h";
-                                }
-                                break;
-                                case MAVLINK_TYPE_UINT32_T:
-                                {
-                                    typechars += "I";
-                                }
-                                break;
-                                case MAVLINK_TYPE_INT32_T:
-                                {
-                                    typechars += "i";
-                                }
-                                break;
-                                case MAVLINK_TYPE_FLOAT:
-                                {
-                                    typechars += "f";
-                                }
-                                break;
-                                case MAVLINK_TYPE_UINT64_T:
-                                {
-                                    typechars += "I";
-                                }
-                                break;
-                                case MAVLINK_TYPE_INT64_T:
-                                {
-                                    typechars += "i";
-                                }
-                                break;
-                                default:
-                                {
-                                    QLOG_ERROR() << "Unknown type:" << QString::number(fieldinfo.type);
-                                }
-                                break;
+                                continue;
                             }
+                            variablenames << QString(info.fields[field].name);
+                            typechars += typechar;
                         }
 
                         if (!m_dataModel->addType(name,0,0,typechars,variablenames))
@@ -723,18 +1318,24 @@ void AP2DataPlotThread::loadTLog(QFile &logfile)
                         }
                     }
 
-                    quint64 unixtimemsec = (lastLogTime - m_logStartTime);
-
-                    while (lastunixtimemseclist.contains(unixtimemsec))
+                    //Indexes have to be unique. Messages logged in the same msec, or with
+                    //a timestamp that went backwards, go just after the previous one.
+                    qint64 logoffset = lastLogTime - static_cast<qint64>(m_logStartTime);
+                    quint64 unixtimemsec = (logoffset > 0) ? logoffset : 0;
+                    if (haveindex && unixtimemsec <= lastindex)
                     {
-                        unixtimemsec += 1;
+                        unixtimemsec = lastindex + 1;
                     }
+                    lastindex = unixtimemsec;
+                    haveindex = true;
 
-                    lastunixtimemseclist.append(unixtimemsec);
                     QList<QPair<QString,QVariant> > valuepairlist;
-                    for (int i=0;i<retvals.size();i++)
+                    for (unsigned int field=0;field<info.num_fields;field++)
                     {
-                        valuepairlist.append(QPair<QString,QVariant>(retvals.at(i).first.split(".")[1],retvals.at(i).second.toLongLong()));
+                        if (tlogTypeChar(info.fields[field]) != 0)
+                        {
+                            valuepairlist.append(QPair<QString,QVariant>(info.fields[field].name,decodeTLogField(message,info.fields[field])));
+                        }
                     }
                     if (valuepairlist.size() > 1)
                     {
@@ -774,7 +1375,14 @@ void AP2DataPlotThread::run()
 
     QLOG_DEBUG() << "AP2DataPlotThread::run(): Log loading start -" << logfile.size() << "bytes";
 
-    if (m_fileName.toLower().endsWith(".bin"))
+    //The first snapshot comes after the first interval, by then there is something to graph
+    m_nextSnapshot = SNAPSHOT_INTERVAL_BYTES;
+    if (m_fileName.toLower().endsWith(".bin") && m_lazyLoading)
+    {
+        //It's a binary file, index it and leave the fields in the file until they're graphed
+        loadBinaryLogIndex();
+    }
+    else if (m_fileName.toLower().endsWith(".bin"))
     {
         //It's a binary file
         loadBinaryLog(logfile);
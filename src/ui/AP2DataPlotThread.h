@@ -31,9 +31,9 @@ This file is part of the APM_PLANNER project
 #define AP2DATAPLOTTHREAD_H
 
 #include <QThread>
+#include <QSemaphore>
 #include <QVariantMap>
 #include <QSqlDatabase>
-#include "MAVLinkDecoder.h"
 #include "AP2DataPlot2DModel.h"
 #include "libs/mavlink/include/mavlink/v1.0/ardupilotmega/mavlink.h"
 
@@ -46,14 +46,25 @@ public:
 
     void loadFile(const QString& file);
     void stopLoad() { m_stop = true; }
+    //Binary logs are only indexed during load, fields are decoded when first graphed
+    void setLazyLoading(bool lazy) { m_lazyLoading = lazy; }
+    //Publish what has been loaded so far every few MB, see snapshotReady
+    void setProgressive(bool progressive) { m_progressive = progressive; }
+    bool isProgressive() const { return m_progressive; }
+
+    //Lets the loader carry on after snapshotReady. The loader writes to the model at any
+    //other time before done(), so the model may only be read in between.
+    void snapshotConsumed() { m_snapshotSemaphore.release(); }
 
 signals:
     void startLoad();
     void loadProgress(qint64 pos,qint64 size);
+    //Everything up to pos is committed to the model, and the loader is paused
+    //until snapshotConsumed() is called.
+    void snapshotReady(qint64 pos,qint64 size);
     void payloadDecoded(int index,QString name,QVariantMap map);
     void done(int errors,MAV_TYPE type);
     void error(QString errorstr);
-    void lineRead(QString line);
 
 private:
     void run(); // from QThread;
@@ -61,8 +72,10 @@ private:
 
     void loadDataFieldsFromValues();
     void loadBinaryLog(QFile &logfile);
+    void loadBinaryLogIndex();
     void loadAsciiLog(QFile &logfile);
     void loadTLog(QFile &logfile);
+    bool checkSnapshot(qint64 pos,qint64 size);
 
 private:
     QString m_fileName;
@@ -70,10 +83,13 @@ private:
     int m_fieldCount;
     int m_errorCount;
     MAV_TYPE m_loadedLogType;
-    MAVLinkDecoder *m_decoder;
     AP2DataPlot2DModel *m_dataModel;
     QMap<QString,QString> m_msgNameToInsertQuery;
     quint64 m_logStartTime;
+    bool m_lazyLoading;
+    bool m_progressive;
+    qint64 m_nextSnapshot;
+    QSemaphore m_snapshotSemaphore;
 };
 
 #endif // AP2DATAPLOTTHREAD_H
@@ -0,0 +1,330 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief Application wide frame clock for instrument widgets
+ */
+
+#include "QsLog.h"
+#include "FrameScheduler.h"
+
+#include <QApplication>
+#include <QWidget>
+#include <QSettings>
+#include <QMetaObject>
+#include <QPointer>
+#include <QEvent>
+
+#define FRAME_SCHEDULER_DEFAULT_RATE 25
+#define FRAME_SCHEDULER_MIN_RATE 1
+#define FRAME_SCHEDULER_MAX_RATE 60
+#define FRAME_SCHEDULER_COST_REPORT_INTERVAL 10000 // ms
+
+FrameScheduler* FrameScheduler::instance()
+{
+    static FrameScheduler* _instance = 0;
+    if(_instance == 0)
+    {
+        _instance = new FrameScheduler();
+        // Set the application as parent to ensure that this object
+        // will be destroyed when the main application exits
+        _instance->setParent(qApp);
+    }
+    return _instance;
+}
+
+FrameScheduler::FrameScheduler(QObject *parent) : QObject(parent),
+    m_targetRate(FRAME_SCHEDULER_DEFAULT_RATE)
+{
+    QSettings settings;
+    settings.beginGroup("FRAME_SCHEDULER");
+    m_targetRate = qBound(FRAME_SCHEDULER_MIN_RATE,
+                          settings.value("TARGET_RATE", FRAME_SCHEDULER_DEFAULT_RATE).toInt(),
+                          FRAME_SCHEDULER_MAX_RATE);
+    settings.endGroup();
+
+    m_frameTimer.setInterval(1000 / m_targetRate);
+    connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(frameTick()));
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    m_frameTimer.stop();
+    qDeleteAll(m_entries);
+    m_entries.clear();
+}
+
+void FrameScheduler::registerWidget(QWidget *widget, Mode mode, const char *member, int minInterval)
+{
+    if (!widget || !member)
+    {
+        return;
+    }
+    Entry *entry = m_entries.value(widget, 0);
+    if (!entry)
+    {
+        entry = new Entry();
+        entry->widget = widget;
+        entry->cost.name = widget->objectName().isEmpty() ? widget->metaObject()->className() : widget->objectName();
+        entry->cost.frames = 0;
+        entry->cost.lastCost = 0;
+        entry->cost.averageCost = 0;
+        entry->cost.maxCost = 0;
+        m_entries.insert(widget, entry);
+        connect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(widgetDestroyed(QObject*)));
+        widget->installEventFilter(this);
+    }
+    // Restoring a minimised window is only seen by the window
+    widget->window()->installEventFilter(this);
+    // member is in SLOT() form, "1name(args)". invokeMethod only wants the name.
+    QByteArray name(member);
+    if (name.size() > 1 && name.at(0) >= '0' && name.at(0) <= '9')
+    {
+        name = name.mid(1);
+    }
+    int paren = name.indexOf('(');
+    entry->member = paren == -1 ? name : name.left(paren);
+    entry->mode = mode;
+    entry->minInterval = minInterval;
+    entry->dirty = true;
+    entry->lastUpdate.invalidate();
+    startClock();
+}
+
+void FrameScheduler::unregisterWidget(QWidget *widget)
+{
+    Entry *entry = m_entries.take(widget);
+    if (entry)
+    {
+        disconnect(widget, SIGNAL(destroyed(QObject*)), this, SLOT(widgetDestroyed(QObject*)));
+        widget->removeEventFilter(this);
+        delete entry;
+    }
+}
+
+void FrameScheduler::widgetDestroyed(QObject *object)
+{
+    delete m_entries.take(object);
+}
+
+bool FrameScheduler::eventFilter(QObject *object, QEvent *event)
+{
+    if (event->type() == QEvent::Show)
+    {
+        Entry *entry = m_entries.value(object, 0);
+        if (entry && (entry->dirty || entry->mode == Continuous))
+        {
+            startClock();
+        }
+    }
+    else if (event->type() == QEvent::WindowStateChange)
+    {
+        // A window was restored or minimised. The next frame stops the clock again if nothing can be seen.
+        QWidget *window = qobject_cast<QWidget*>(object);
+        if (window && !(window->windowState() & Qt::WindowMinimized))
+        {
+            startClock();
+        }
+    }
+    else if (event->type() == QEvent::ParentChange && m_entries.contains(object))
+    {
+        // Docked or undocked, watch the new window
+        static_cast<QWidget*>(object)->window()->installEventFilter(this);
+    }
+    return QObject::eventFilter(object, event);
+}
+
+void FrameScheduler::markDirty(QWidget *widget)
+{
+    Entry *entry = m_entries.value(widget, 0);
+    if (entry)
+    {
+        entry->dirty = true;
+        if (!isSuspended(widget))
+        {
+            startClock();
+        }
+    }
+}
+
+void FrameScheduler::setTargetRate(int rate)
+{
+    rate = qBound(FRAME_SCHEDULER_MIN_RATE, rate, FRAME_SCHEDULER_MAX_RATE);
+    if (rate == m_targetRate)
+    {
+        return;
+    }
+    m_targetRate = rate;
+    m_frameTimer.setInterval(1000 / m_targetRate);
+
+    QSettings settings;
+    settings.beginGroup("FRAME_SCHEDULER");
+    settings.setValue("TARGET_RATE", m_targetRate);
+    settings.endGroup();
+    emit targetRateChanged(m_targetRate);
+}
+
+QList<FrameScheduler::PaintCost> FrameScheduler::getPaintCosts() const
+{
+    QList<PaintCost> costs;
+    for (QMap<QObject*,Entry*>::const_iterator i = m_entries.constBegin(); i != m_entries.constEnd(); ++i)
+    {
+        costs.append(i.value()->cost);
+    }
+    return costs;
+}
+
+void FrameScheduler::logPaintCosts()
+{
+    QList<PaintCost> costs = getPaintCosts();
+    for (int i=0;i<costs.size();i++)
+    {
+        const PaintCost &cost = costs.at(i);
+        if (cost.frames == 0)
+        {
+            continue;
+        }
+        QLOG_DEBUG() << "FrameScheduler:" << cost.name << "frames" << cost.frames << "last" << cost.lastCost
+                     << "ms, average" << cost.averageCost << "ms, max" << cost.maxCost << "ms";
+    }
+}
+
+bool FrameScheduler::isShown(QWidget *widget)
+{
+    // isVisible() is false for widgets in a tab or stack page that is not shown.
+    if (!widget->isVisible())
+    {
+        return false;
+    }
+    QWidget *window = widget->window();
+    if (window && (window->windowState() & Qt::WindowMinimized))
+    {
+        return false;
+    }
+    return !widget->visibleRegion().isEmpty();
+}
+
+bool FrameScheduler::isSuspended(QWidget *widget)
+{
+    if (!widget->isVisible())
+    {
+        return true;
+    }
+    QWidget *window = widget->window();
+    return window && (window->windowState() & Qt::WindowMinimized);
+}
+
+void FrameScheduler::startClock()
+{
+    if (!m_frameTimer.isActive())
+    {
+        m_frameTimer.start();
+    }
+}
+
+void FrameScheduler::frameTick()
+{
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+
+    bool pending = false;
+    bool updated = false;
+    // Copy the list, an update slot may register or destroy widgets.
+    QList<QObject*> widgets = m_entries.keys();
+    for (int i=0;i<widgets.size();i++)
+    {
+        Entry *entry = m_entries.value(widgets.at(i), 0);
+        if (!entry)
+        {
+            continue;
+        }
+        if (entry->mode == OnDemand && !entry->dirty)
+        {
+            continue;
+        }
+        if (!isShown(entry->widget))
+        {
+            // The dirty flag is kept. Hidden and minimised widgets restart the clock when they are
+            // shown or their window is restored.
+            if (!isSuspended(entry->widget))
+            {
+                // Covered, there is no event to wait for
+                pending = true;
+            }
+            continue;
+        }
+        if (entry->mode == Continuous)
+        {
+            pending = true;
+        }
+        if (entry->minInterval > 0 && entry->lastUpdate.isValid() && entry->lastUpdate.elapsed() < entry->minInterval)
+        {
+            pending = true;
+            continue;
+        }
+        entry->dirty = false;
+        entry->lastUpdate.start();
+
+        QElapsedTimer paintTimer;
+        paintTimer.start();
+        QPointer<QWidget> widget(entry->widget);
+        QMetaObject::invokeMethod(entry->widget, entry->member.constData(), Qt::DirectConnection);
+        qreal cost = paintTimer.nsecsElapsed() / 1000000.0;
+        updated = true;
+
+        if (!widget || m_entries.value(widgets.at(i), 0) != entry)
+        {
+            // Destroyed or unregistered by its own update
+            continue;
+        }
+        entry->cost.frames++;
+        entry->cost.lastCost = cost;
+        entry->cost.averageCost = entry->cost.frames == 1 ? cost : entry->cost.averageCost * 0.9 + cost * 0.1;
+        if (cost > entry->cost.maxCost)
+        {
+            entry->cost.maxCost = cost;
+        }
+    }
+
+    if (updated)
+    {
+        qreal frameTime = frameTimer.nsecsElapsed() / 1000000.0;
+        if (frameTime > m_frameTimer.interval())
+        {
+            QLOG_DEBUG() << "FrameScheduler: frame took" << frameTime << "ms, target" << m_frameTimer.interval() << "ms";
+        }
+        if (!m_costReportTimer.isValid())
+        {
+            m_costReportTimer.start();
+        }
+        else if (m_costReportTimer.elapsed() >= FRAME_SCHEDULER_COST_REPORT_INTERVAL)
+        {
+            logPaintCosts();
+            m_costReportTimer.restart();
+        }
+    }
+    if (!pending)
+    {
+        // Nothing left to do until a widget is marked dirty again
+        m_frameTimer.stop();
+    }
+}
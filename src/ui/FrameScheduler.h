@@ -0,0 +1,139 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief Application wide frame clock for instrument widgets
+ */
+
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMap>
+#include <QList>
+#include <QString>
+#include <QElapsedTimer>
+
+class QWidget;
+
+/**
+ * @brief One clock for every widget that redraws from telemetry.
+ *
+ * Instead of running their own refresh timers, widgets register here and mark
+ * themselves dirty when new data arrives. Once per frame, at the target rate,
+ * each dirty widget has its update slot (repaint() unless another is given)
+ * called once, however many times it was marked. Widgets that are hidden, in
+ * a tab that is not shown or in a minimised window are skipped, and keep their
+ * dirty flag until they can be seen again.
+ *
+ * Continuous widgets are updated on every frame they are visible without
+ * being marked, optionally no more often than a minimum interval. This suits
+ * widgets that poll their data.
+ *
+ * The clock only runs while a widget has something to draw. It stops while
+ * every widget with work is hidden or minimised, and starts again when one is
+ * shown or its window restored.
+ *
+ * The time each update slot takes is measured and kept per widget, and
+ * written to the debug log every few seconds while widgets are updating.
+ * This class follows the singleton design pattern.
+ */
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode
+    {
+        OnDemand,
+        Continuous
+    };
+
+    class PaintCost
+    {
+    public:
+        QString name;
+        quint64 frames;
+        qreal lastCost;     ///< Milliseconds
+        qreal averageCost;  ///< Milliseconds, moving average
+        qreal maxCost;      ///< Milliseconds
+    };
+
+    /** @brief Get the singleton instance */
+    static FrameScheduler* instance();
+
+    /**
+     * @brief Start scheduling a widget. It is forgotten when destroyed.
+     * @param member Slot called once per frame, as for QTimer::singleShot
+     * @param minInterval Minimum milliseconds between two updates, 0 for every frame
+     */
+    void registerWidget(QWidget *widget, Mode mode = OnDemand, const char *member = SLOT(repaint()), int minInterval = 0);
+    void unregisterWidget(QWidget *widget);
+
+    int getTargetRate() const { return m_targetRate; }
+    QList<PaintCost> getPaintCosts() const;
+
+public slots:
+    /** @brief Have the widget updated on the next frame it is visible */
+    void markDirty(QWidget *widget);
+    /** @brief Frames per second, stored in the settings */
+    void setTargetRate(int rate);
+
+protected:
+    bool eventFilter(QObject *object, QEvent *event);
+
+signals:
+    void targetRateChanged(int rate);
+
+private slots:
+    void frameTick();
+    void widgetDestroyed(QObject *object);
+
+private:
+    explicit FrameScheduler(QObject *parent = 0);
+    ~FrameScheduler();
+
+    class Entry
+    {
+    public:
+        QWidget *widget;
+        Mode mode;
+        QByteArray member;
+        int minInterval;
+        bool dirty;
+        QElapsedTimer lastUpdate;
+        PaintCost cost;
+    };
+
+    static bool isShown(QWidget *widget);
+    /** Hidden or minimised, a show or window state change event comes before it can be seen */
+    static bool isSuspended(QWidget *widget);
+    void startClock();
+    void logPaintCosts();
+
+    QMap<QObject*,Entry*> m_entries;
+    QTimer m_frameTimer;
+    int m_targetRate;
+    QElapsedTimer m_costReportTimer;
+};
+
+#endif // FRAMESCHEDULER_H
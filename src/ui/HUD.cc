@@ -37,6 +37,7 @@ This file is part of the QGROUNDCONTROL project
 #include "UAS.h"
 #include "HUD.h"
 #include "QGC.h"
+#include "FrameScheduler.h"
 
 #include <QShowEvent>
 #include <QContextMenuEvent>
@@ -70,13 +71,6 @@ HUD::HUD(int width, int height, QWidget* parent)
       vheight(150.0f),
       vGaugeSpacing(65.0f),
       vPitchPerDeg(6.0f), ///< 4 mm y translation per degree)
-      rawBuffer1(NULL),
-      rawBuffer2(NULL),
-      rawImage(NULL),
-      rawLastIndex(0),
-      rawExpectedBytes(0),
-      bytesPerLine(1),
-      imageStarted(false),
       receivedDepth(8),
       receivedChannels(1),
       receivedWidth(640),
@@ -88,7 +82,6 @@ HUD::HUD(int width, int height, QWidget* parent)
       infoColor(QColor(20, 200, 20)),
       fuelColor(criticalColor),
       warningBlinkRate(5),
-      refreshTimer(new QTimer(this)),
       noCamera(true),
       hardwareAcceleration(true),
       strongStrokeWidth(1.5f),
@@ -116,14 +109,12 @@ HUD::HUD(int width, int height, QWidget* parent)
       alt(0.0),
       load(0.0f),
       offlineDirectory(""),
-      nextOfflineImage(""),
       HUDInstrumentsEnabled(false),
       videoEnabled(true),
       xImageFactor(1.0),
       yImageFactor(1.0),
       imageRequested(false),
-      imageLoggingEnabled(false),
-    image(NULL)
+      imageLoggingEnabled(false)
 {
     // Fill with black background
     QImage fill = QImage(width, height, QImage::Format_Indexed8);
@@ -134,6 +125,9 @@ HUD::HUD(int width, int height, QWidget* parent)
     fill.fill(0);
     glImage = fill;
 
+    framePipeline = new HUDFramePipeline(this);
+    connect(framePipeline, SIGNAL(frameReady()), this, SLOT(update()));
+
     // Set auto fill to false
     setAutoFillBackground(false);
 
@@ -143,9 +137,8 @@ HUD::HUD(int width, int height, QWidget* parent)
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     scalingFactor = this->width()/vwidth;
 
-    // Refresh timer
-    refreshTimer->setInterval(updateInterval);
-    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(repaint()));
+    // Repainted by the frame scheduler while visible
+    FrameScheduler::instance()->registerWidget(this, FrameScheduler::Continuous, SLOT(repaint()), updateInterval);
 
     // Resize to correct size and fill with image
     QWidget::resize(this->width(), this->height());
@@ -174,7 +167,6 @@ HUD::HUD(int width, int height, QWidget* parent)
 
 HUD::~HUD()
 {
-    refreshTimer->stop();
 }
 
 QSize HUD::sizeHint() const
@@ -187,7 +179,6 @@ void HUD::showEvent(QShowEvent* event)
     // React only to internal (pre-display)
     // events
     QWidget::showEvent(event);
-    refreshTimer->start(updateInterval);
     emit visibilityChanged(true);
 }
 
@@ -195,7 +186,6 @@ void HUD::hideEvent(QHideEvent* event)
 {
     // React only to internal (pre-display)
     // events
-    refreshTimer->stop();
     QWidget::hideEvent(event);
     emit visibilityChanged(false);
 }
@@ -545,25 +535,15 @@ void HUD::paintHUD()
         double scalingFactorH = this->height()/vheight;
         if (scalingFactorH < scalingFactor) scalingFactor = scalingFactorH;
 
-        // Fill with black background
-        if (videoEnabled) {
-            if (nextOfflineImage != "" && QFileInfo(nextOfflineImage).exists()) {
-                QLOG_DEBUG() << __FILE__ << __LINE__ << "template image:" << nextOfflineImage;
-                QImage fill = QImage(nextOfflineImage);
-
-                glImage = fill;
-
-                // Reset to save load efforts
-                nextOfflineImage = "";
-            }
-
-        }
+        // Camera frames are converted for this size by the frame pipeline
+        framePipeline->setDisplaySize(size());
+        HUDFramePtr videoFrame = framePipeline->currentFrame();
 
         if (dataStreamEnabled || videoEnabled)
         {
-
-            xImageFactor = width() / (float)glImage.width();
-            yImageFactor = height() / (float)glImage.height();
+            QSize imageSize = videoFrame ? framePipeline->sourceSize() : glImage.size();
+            xImageFactor = width() / (float)imageSize.width();
+            yImageFactor = height() / (float)imageSize.height();
             float imageFactor = qMin(xImageFactor, yImageFactor);
             // Resize to correct size and fill with image
             // FIXME
@@ -574,8 +554,20 @@ void HUD::paintHUD()
         painter.begin(this);
         painter.setRenderHint(QPainter::Antialiasing, true);
         painter.setRenderHint(QPainter::HighQualityAntialiasing, true);
-        QPixmap pmap = QPixmap::fromImage(glImage).scaledToWidth(width());
-        painter.drawPixmap(0, (height() - pmap.height()) / 2, pmap);
+        if (videoFrame) {
+            const QImage& frameImage = videoFrame->image;
+            if (frameImage.width() == width()) {
+                // Already scaled and in the paint engine's format, drawn without a copy
+                painter.drawImage(0, (height() - frameImage.height()) / 2, frameImage);
+            } else {
+                // Until the frame pipeline catches up with a resize
+                int frameHeight = (frameImage.height() * width()) / frameImage.width();
+                painter.drawImage(QRect(0, (height() - frameHeight) / 2, width(), frameHeight), frameImage);
+            }
+        } else {
+            QPixmap pmap = QPixmap::fromImage(glImage).scaledToWidth(width());
+            painter.drawPixmap(0, (height() - pmap.height()) / 2, pmap);
+        }
 
         // END OF OPENGL PAINTING
 
@@ -1169,59 +1161,18 @@ void HUD::selectWaypoint(int uasId, int id)
 
 void HUD::setImageSize(int width, int height, int depth, int channels)
 {
-    // Allocate raw image in correct size
-    if (width != receivedWidth || height != receivedHeight || depth != receivedDepth || channels != receivedChannels || image == NULL) {
-        // Set new size
-        if (width > 0) receivedWidth  = width;
-        if (height > 0) receivedHeight = height;
-        if (depth > 1) receivedDepth = depth;
-        if (channels > 1) receivedChannels = channels;
-
-        rawExpectedBytes = (receivedWidth * receivedHeight * receivedDepth * receivedChannels) / 8;
-        bytesPerLine = rawExpectedBytes / receivedHeight;
-        // Delete old buffers if necessary
-        rawImage = NULL;
-        if (rawBuffer1 != NULL) delete rawBuffer1;
-        if (rawBuffer2 != NULL) delete rawBuffer2;
-
-        rawBuffer1 = (unsigned char*)malloc(rawExpectedBytes);
-        rawBuffer2 = (unsigned char*)malloc(rawExpectedBytes);
-        rawImage = rawBuffer1;
-        if (image)
-            delete image;
-
-        // Set image format
-        // 8 BIT GREYSCALE IMAGE
-        if (depth <= 8 && channels == 1) {
-            image = new QImage(receivedWidth, receivedHeight, QImage::Format_Indexed8);
-            // Create matching color table
-            image->setColorCount(256);
-            for (int i = 0; i < 256; i++) {
-                image->setColor(i, qRgb(i, i, i));
-                //QLOG_DEBUG() << __FILE__ << __LINE__ << std::hex << i;
-            }
-
-        }
-        // 32 BIT COLOR IMAGE WITH ALPHA VALUES (#ARGB)
-        else {
-            image = new QImage(receivedWidth, receivedHeight, QImage::Format_ARGB32);
-        }
-
-        // Fill first channel of image with black pixels
-        image->fill(0);
-        glImage = *image;
-
+    // Set new size
+    if (width > 0) receivedWidth  = width;
+    if (height > 0) receivedHeight = height;
+    if (depth > 1) receivedDepth = depth;
+    if (channels > 1) receivedChannels = channels;
+
+    // Set size once, the image buffers are kept by the frame pipeline
+    QSize imageSize(receivedWidth, receivedHeight);
+    if (minimumSize() != imageSize || maximumSize() != imageSize) {
         QLOG_DEBUG() << __FILE__ << __LINE__ << "Setting up image";
-
-        // Set size once
-        setFixedSize(receivedWidth, receivedHeight);
-        setMinimumSize(receivedWidth, receivedHeight);
-        setMaximumSize(receivedWidth, receivedHeight);
-        // Lock down the size
-        //setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
-        //resize(receivedWidth, receivedHeight);
+        setFixedSize(imageSize);
     }
-
 }
 
 void HUD::startImage(int imgid, int width, int height, int depth, int channels)
@@ -1229,55 +1180,20 @@ void HUD::startImage(int imgid, int width, int height, int depth, int channels)
     Q_UNUSED(imgid);
     //QLOG_DEBUG() << "HUD: starting image (" << width << "x" << height << ", " << depth << "bits) with " << channels << "channels";
 
-    // Copy previous image to screen if it hasn't been finished properly
-    finishImage();
-
     // Reset image size if necessary
     setImageSize(width, height, depth, channels);
-    imageStarted = true;
+    // A previous image that hasn't been finished is dropped
+    framePipeline->startRawFrame(receivedWidth, receivedHeight, receivedDepth, receivedChannels);
 }
 
 void HUD::finishImage()
 {
-    if (imageStarted) {
-        commitRawDataToGL();
-        imageStarted = false;
-    }
-}
-
-void HUD::commitRawDataToGL()
-{
-    QLOG_DEBUG() << __FILE__ << __LINE__ << "Copying raw data to GL buffer:" << rawImage << receivedWidth << receivedHeight << image->format();
-    if (image != NULL) {
-        QImage::Format format = image->format();
-        QImage* newImage = new QImage(rawImage, receivedWidth, receivedHeight, format);
-        if (format == QImage::Format_Indexed8) {
-            // Create matching color table
-            newImage->setColorCount(256);
-            for (int i = 0; i < 256; i++) {
-                newImage->setColor(i, qRgb(i, i, i));
-                //QLOG_DEBUG() << __FILE__ << __LINE__ << std::hex << i;
-            }
-        }
-
-        glImage = *newImage;
-        delete image;
-        image = newImage;
-        // Switch buffers
-        if (rawImage == rawBuffer1) {
-            rawImage = rawBuffer2;
-            //QLOG_DEBUG() << "Now buffer 2";
-        } else {
-            rawImage = rawBuffer1;
-            //QLOG_DEBUG() << "Now buffer 1";
-        }
-    }
-    update();
+    framePipeline->finishRawFrame();
 }
 
 void HUD::saveImage(QString fileName)
 {
-    image->save(fileName);
+    framePipeline->saveFrame(fileName);
 }
 
 void HUD::saveImage()
@@ -1291,7 +1207,11 @@ void HUD::startImage(quint64 timestamp)
 {
     if (videoEnabled && offlineDirectory != "") {
         // Load and diplay image file
-        nextOfflineImage = QString(offlineDirectory + "/%1.bmp").arg(timestamp);
+        QString offlineImage = QString(offlineDirectory + "/%1.bmp").arg(timestamp);
+        if (QFileInfo(offlineImage).exists()) {
+            QLOG_DEBUG() << __FILE__ << __LINE__ << "template image:" << offlineImage;
+            framePipeline->loadFrame(offlineImage);
+        }
     }
 }
 
@@ -1316,41 +1236,10 @@ void HUD::enableVideo(bool enabled)
 void HUD::setPixels(int imgid, const unsigned char* imageData, int length, int startIndex)
 {
     Q_UNUSED(imgid);
-    //    QLOG_DEBUG() << "at" << __FILE__ << __LINE__ << ": Received startindex" << startIndex << "and length" << length << "(" << startIndex+length << "of" << rawExpectedBytes << "bytes)";
-
-    if (imageStarted)
-    {
-        //if (rawLastIndex != startIndex) QLOG_DEBUG() << "PACKET LOSS!";
-
-        if (startIndex+length > rawExpectedBytes)
-        {
-            QLOG_DEBUG() << "HUD: OVERFLOW! startIndex:" << startIndex << "length:" << length << "image raw size" << ((receivedWidth * receivedHeight * receivedChannels * receivedDepth) / 8) - 1;
-        }
-        else
-        {
-            memcpy(rawImage+startIndex, imageData, length);
-
-            rawLastIndex = startIndex+length;
+    //    QLOG_DEBUG() << "at" << __FILE__ << __LINE__ << ": Received startindex" << startIndex << "and length" << length;
 
-            // Check if we just reached the end of the image
-            if (startIndex+length == rawExpectedBytes)
-            {
-                //QLOG_DEBUG() << "HUD: END OF IMAGE REACHED!";
-                finishImage();
-                rawLastIndex = 0;
-            }
-        }
-
-        //        for (int i = 0; i < length; i++)
-        //        {
-        //            for (int j = 0; j < receivedChannels; j++)
-        //            {
-        //                unsigned int x = (startIndex+i) % receivedWidth;
-        //                unsigned int y = (unsigned int)((startIndex+i) / receivedWidth);
-        //                QLOG_DEBUG() << "Setting pixel" << x << "," << y << "to" << (unsigned int)*(rawImage+startIndex+i);
-        //            }
-        //        }
-    }
+    // Written straight into the frame, which is sent on once the last byte arrived
+    framePipeline->appendRawData(imageData, length, startIndex);
 }
 
 void HUD::copyImage()
@@ -1358,13 +1247,14 @@ void HUD::copyImage()
     UAS* u = dynamic_cast<UAS*>(this->uas);
     if (u)
     {
-        this->glImage = u->getImage();
-
-        // Save to directory if logging is enabled
-        if (imageLoggingEnabled)
+        // Decoded off the GUI thread, and saved there as well if logging is enabled
+        bool raw = false;
+        int width = 0;
+        int height = 0;
+        QByteArray data = u->getImageData(&raw, &width, &height);
+        if (!data.isEmpty())
         {
-            u->getImage().save(QString("%1/%2.png").arg(imageLogDirectory).arg(imageLogCounter));
-            imageLogCounter++;
+            framePipeline->decodeFrame(data, raw, width, height);
         }
     }
 }
@@ -1383,18 +1273,20 @@ void HUD::saveImages(bool save)
 
         if (imageLogDirectory != "")
         {
-            imageLogCounter = 0;
+            framePipeline->setLogDirectory(imageLogDirectory);
             imageLoggingEnabled = true;
             QLOG_DEBUG() << "Logging on";
         }
         else
         {
+            framePipeline->setLogDirectory("");
             imageLoggingEnabled = false;
             selectSaveDirectoryAction->setChecked(false);
         }
     }
     else
     {
+        framePipeline->setLogDirectory("");
         imageLoggingEnabled = false;
         selectSaveDirectoryAction->setChecked(false);
     }
@@ -40,6 +40,7 @@ This file is part of the QGROUNDCONTROL project
 #include <QTimer>
 #include <QVector3D>
 #include "UASInterface.h"
+#include "HUDFramePipeline.h"
 
 /**
  * @brief Displays a Head Up Display (HUD)
@@ -58,6 +59,11 @@ public:
     void setImageSize(int width, int height, int depth, int channels);
     void resize(int w, int h);
 
+    /** @brief Video frames displayed, dropped and displayed late, since the HUD was created */
+    quint64 getShownFrames() const { return framePipeline->getShownFrames(); }
+    quint64 getDroppedFrames() const { return framePipeline->getDroppedFrames(); }
+    quint64 getLateFrames() const { return framePipeline->getLateFrames(); }
+
 public slots:
 //    void initializeGL();
     //void paintGL();
@@ -122,7 +128,6 @@ signals:
     void visibilityChanged(bool visible);
 
 protected:
-    void commitRawDataToGL();
     /** @brief Convert reference coordinates to screen coordinates */
     float refToScreenX(float x);
     /** @brief Convert reference coordinates to screen coordinates */
@@ -142,8 +147,8 @@ protected:
 
     static const int updateInterval = 100;
 
-    QImage* image; ///< Double buffer image
-    QImage glImage; ///< The background / camera image
+    HUDFramePipeline* framePipeline; ///< Receives and decodes the camera image
+    QImage glImage; ///< The background image, when there is no camera image
     UASInterface* uas; ///< The uas currently monitored
     float yawInt; ///< The yaw integral. Used to damp the yaw indication.
     QString mode; ///< The current vehicle mode
@@ -159,14 +164,7 @@ protected:
     int xCenter; ///< Center of the HUD instrument in pixel coordinates. Allows to off-center the whole instrument in its OpenGL window, e.g. to fit another instrument
     int yCenter; ///< Center of the HUD instrument in pixel coordinates. Allows to off-center the whole instrument in its OpenGL window, e.g. to fit another instrument
 
-    // Image buffers
-    unsigned char* rawBuffer1; ///< Double buffer 1 for the image
-    unsigned char* rawBuffer2; ///< Double buffer 2 for the image
-    unsigned char* rawImage;   ///< Pointer to current complete image
-    int rawLastIndex;          ///< The last byte index received of the image
-    int rawExpectedBytes;      ///< Number of raw image bytes expected. Calculated by: image depth * channels * widht * height / 8
-    int bytesPerLine;          ///< Bytes per image line. Is calculated as: image depth * channels * width / 8
-    bool imageStarted;         ///< If an image is currently in transmission
+    // Image stream
     int receivedDepth;         ///< Image depth in bit for the current image
     int receivedChannels;      ///< Number of color channels
     int receivedWidth;         ///< Width in pixels of the current image
@@ -183,7 +181,6 @@ protected:
     // Blink rates
     int warningBlinkRate;      ///< Blink rate of warning messages, will be rounded to the refresh rate
 
-    QTimer* refreshTimer;      ///< The main timer, controls the update rate
     QPainter* HUDPainter;
     QFont font;                ///< The HUD font, per default the free Bitstream Vera SANS, which is very close to actual HUD fonts
     QFontDatabase fontDatabase;///< Font database, only used to load the TrueType font file (the HUD font is directly loaded from file rather than from the system)
@@ -217,7 +214,6 @@ protected:
     double alt;
     float load;
     QString offlineDirectory;
-    QString nextOfflineImage;
     bool HUDInstrumentsEnabled;
     bool videoEnabled;
     bool dataStreamEnabled;
@@ -232,7 +228,6 @@ protected:
     void paintEvent(QPaintEvent *event);
     bool imageRequested;
     QString imageLogDirectory;
-    unsigned int imageLogCounter;
 };
 
 #endif // HUD_H
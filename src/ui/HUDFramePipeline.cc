@@ -0,0 +1,511 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief Pooled frame buffers for the HUD video stream
+ */
+
+#include "QsLog.h"
+#include "HUDFramePipeline.h"
+
+#include <QRunnable>
+#include <QPainter>
+#include <QBuffer>
+#include <QImageReader>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <string.h>
+
+HUDFramePool::HUDFramePool(int capacity) :
+    d(new Data())
+{
+    d->capacity = capacity;
+    d->allocated = 0;
+}
+
+HUDFramePool::~HUDFramePool()
+{
+}
+
+HUDFramePool::Data::~Data()
+{
+    qDeleteAll(free);
+}
+
+void HUDFramePool::Recycler::operator()(HUDFrame *frame)
+{
+    QMutexLocker locker(&d->lock);
+    d->free.append(frame);
+}
+
+HUDFramePtr HUDFramePool::acquire(const QSize& size, QImage::Format format)
+{
+    if (size.isEmpty() || format == QImage::Format_Invalid)
+    {
+        return HUDFramePtr();
+    }
+    HUDFrame *frame = NULL;
+    {
+        QMutexLocker locker(&d->lock);
+        for (int i = 0; i < d->free.size(); i++)
+        {
+            if (d->free.at(i)->image.size() == size && d->free.at(i)->image.format() == format)
+            {
+                frame = d->free.takeAt(i);
+                break;
+            }
+        }
+        if (!frame)
+        {
+            if (d->allocated < d->capacity)
+            {
+                d->allocated++;
+            }
+            else if (!d->free.isEmpty())
+            {
+                // Replace a free frame of another size or format
+                delete d->free.takeFirst();
+            }
+            else
+            {
+                return HUDFramePtr();
+            }
+            frame = new HUDFrame();
+        }
+    }
+    if (frame->image.size() != size || frame->image.format() != format)
+    {
+        frame->image = QImage(size, format);
+        if (format == QImage::Format_Indexed8)
+        {
+            // Greyscale color table
+            frame->image.setColorCount(256);
+            for (int i = 0; i < 256; i++)
+            {
+                frame->image.setColor(i, qRgb(i, i, i));
+            }
+        }
+    }
+    frame->completed = 0;
+    return HUDFramePtr(frame, Recycler(d));
+}
+
+namespace
+{
+
+/** @brief Gets the source frame, then converts it into a display frame */
+class PrepareTask : public QRunnable
+{
+public:
+    enum Source
+    {
+        RawSource,          ///< Already received into a frame
+        EncodedSource,      ///< Encoded image data
+        PixelSource,        ///< 8 bit greyscale pixels
+        FileSource          ///< Image file
+    };
+
+    PrepareTask(QObject *pipeline, HUDFramePool *receivePool, HUDFramePool *displayPool, QAtomicInt *pending,
+                Source type, QSize displaySize, qint64 completed, bool refresh) :
+        width(0),
+        height(0),
+        pipeline(pipeline),
+        receivePool(receivePool),
+        displayPool(displayPool),
+        pending(pending),
+        type(type),
+        displaySize(displaySize),
+        completed(completed),
+        refresh(refresh)
+    {
+    }
+
+    HUDFramePtr source;
+    QByteArray data;
+    QString fileName;
+    int width;
+    int height;
+
+    void run()
+    {
+        if (type != RawSource)
+        {
+            source = readSource();
+        }
+        HUDFramePtr display;
+        if (source)
+        {
+            source->completed = completed;
+            display = convert();
+        }
+        if (display)
+        {
+            QMetaObject::invokeMethod(pipeline, "frameDone", Qt::QueuedConnection,
+                                      Q_ARG(HUDFramePtr, source), Q_ARG(HUDFramePtr, display), Q_ARG(bool, refresh));
+        }
+        else
+        {
+            QMetaObject::invokeMethod(pipeline, "frameFailed", Qt::QueuedConnection);
+        }
+        // Release the frames before the next task, they go back to the pool
+        source.clear();
+        display.clear();
+        pending->fetchAndAddOrdered(-1);
+    }
+
+private:
+    HUDFramePtr readSource()
+    {
+        if (type == PixelSource)
+        {
+            if (data.size() < width * height)
+            {
+                return HUDFramePtr();
+            }
+            HUDFramePtr frame = receivePool->acquire(QSize(width, height), QImage::Format_Indexed8);
+            if (frame)
+            {
+                for (int y = 0; y < height; y++)
+                {
+                    memcpy(frame->image.scanLine(y), data.constData() + y * width, width);
+                }
+            }
+            return frame;
+        }
+
+        QBuffer buffer;
+        QImageReader reader;
+        if (type == FileSource)
+        {
+            reader.setFileName(fileName);
+        }
+        else
+        {
+            buffer.setData(data);
+            buffer.open(QIODevice::ReadOnly);
+            reader.setDevice(&buffer);
+        }
+        // Readers that know the size up front decode straight into a pooled frame
+        HUDFramePtr frame = receivePool->acquire(reader.size(), reader.imageFormat());
+        if (frame)
+        {
+            if (!reader.read(&frame->image))
+            {
+                QLOG_DEBUG() << "HUD: could not decode image:" << reader.errorString();
+                return HUDFramePtr();
+            }
+            return frame;
+        }
+        QImage image;
+        if (!reader.read(&image))
+        {
+            QLOG_DEBUG() << "HUD: could not decode image:" << reader.errorString();
+            return HUDFramePtr();
+        }
+        frame = receivePool->acquire(image.size(), image.format());
+        if (frame)
+        {
+            frame->image = image;
+        }
+        return frame;
+    }
+
+    HUDFramePtr convert()
+    {
+        QSize size = source->image.size();
+        if (displaySize.width() > 0)
+        {
+            // Scaled to the widget width, as the HUD draws it
+            size = QSize(displaySize.width(), qMax(1, (size.height() * displaySize.width()) / size.width()));
+        }
+        HUDFramePtr display = displayPool->acquire(size, QImage::Format_ARGB32_Premultiplied);
+        if (!display)
+        {
+            return display;
+        }
+        QPainter painter(&display->image);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+        painter.drawImage(QRect(QPoint(0, 0), size), source->image);
+        painter.end();
+        display->completed = completed;
+        return display;
+    }
+
+    QObject *pipeline;
+    HUDFramePool *receivePool;
+    HUDFramePool *displayPool;
+    QAtomicInt *pending;
+    Source type;
+    QSize displaySize;
+    qint64 completed;
+    bool refresh;
+};
+
+class SaveTask : public QRunnable
+{
+public:
+    SaveTask(const HUDFramePtr& frame, const QString& fileName, QAtomicInt *pending) :
+        frame(frame),
+        fileName(fileName),
+        pending(pending)
+    {
+    }
+    void run()
+    {
+        if (!frame->image.save(fileName))
+        {
+            QLOG_WARN() << "HUD: could not save image to" << fileName;
+        }
+        frame.clear();
+        pending->fetchAndAddOrdered(-1);
+    }
+private:
+    HUDFramePtr frame;
+    QString fileName;
+    QAtomicInt *pending;
+};
+
+}
+
+HUDFramePipeline::HUDFramePipeline(QObject *parent) :
+    QObject(parent),
+    receivePool(RECEIVE_FRAMES),
+    displayPool(DISPLAY_FRAMES),
+    pending(0),
+    pendingSaves(0),
+    rawExpectedBytes(0),
+    rawBytesPerLine(0),
+    rawReceivedBytes(0),
+    logCounter(0),
+    shownFrames(0),
+    droppedFrames(0),
+    lateFrames(0)
+{
+    qRegisterMetaType<HUDFramePtr>("HUDFramePtr");
+    workerPool.setMaxThreadCount(1);
+    savePool.setMaxThreadCount(1);
+    clock.start();
+}
+
+HUDFramePipeline::~HUDFramePipeline()
+{
+    workerPool.waitForDone();
+    savePool.waitForDone();
+}
+
+void HUDFramePipeline::startRawFrame(int width, int height, int depth, int channels)
+{
+    if (rawFrame)
+    {
+        // The previous frame never completed
+        rawFrame.clear();
+        dropFrame();
+    }
+    if (width <= 0 || height <= 0)
+    {
+        return;
+    }
+    QImage::Format format = (depth <= 8 && channels == 1) ? QImage::Format_Indexed8 : QImage::Format_ARGB32;
+    rawFrame = receivePool.acquire(QSize(width, height), format);
+    if (!rawFrame)
+    {
+        dropFrame();
+        return;
+    }
+    rawExpectedBytes = (width * height * depth * channels) / 8;
+    rawBytesPerLine = rawExpectedBytes / height;
+    rawReceivedBytes = 0;
+}
+
+void HUDFramePipeline::appendRawData(const unsigned char* data, int length, int startIndex)
+{
+    if (!rawFrame)
+    {
+        return;
+    }
+    if (startIndex < 0 || startIndex + length > rawExpectedBytes)
+    {
+        QLOG_DEBUG() << "HUD: OVERFLOW! startIndex:" << startIndex << "length:" << length << "image raw size" << rawExpectedBytes;
+        return;
+    }
+    QImage& image = rawFrame->image;
+    if (rawBytesPerLine == image.bytesPerLine())
+    {
+        memcpy(image.bits() + startIndex, data, length);
+    }
+    else
+    {
+        // Scan lines are padded to 32 bits, the stream is not
+        int index = startIndex;
+        int remaining = length;
+        while (remaining > 0)
+        {
+            int line = index / rawBytesPerLine;
+            int column = index % rawBytesPerLine;
+            int count = qMin(remaining, rawBytesPerLine - column);
+            if (line < image.height() && column + count <= image.bytesPerLine())
+            {
+                memcpy(image.scanLine(line) + column, data, count);
+            }
+            data += count;
+            index += count;
+            remaining -= count;
+        }
+    }
+    rawReceivedBytes += length;
+    if (startIndex + length == rawExpectedBytes)
+    {
+        finishRawFrame();
+    }
+}
+
+void HUDFramePipeline::finishRawFrame()
+{
+    if (!rawFrame)
+    {
+        return;
+    }
+    HUDFramePtr frame = rawFrame;
+    rawFrame.clear();
+    if (rawReceivedBytes < rawExpectedBytes)
+    {
+        // Packets were lost, the frame is not worth showing
+        dropFrame();
+        return;
+    }
+    if (!startWork())
+    {
+        return;
+    }
+    PrepareTask *task = new PrepareTask(this, &receivePool, &displayPool, &pending, PrepareTask::RawSource,
+                                        displaySize, clock.elapsed(), false);
+    task->source = frame;
+    workerPool.start(task);
+}
+
+void HUDFramePipeline::decodeFrame(const QByteArray& data, bool raw, int width, int height)
+{
+    if (!startWork())
+    {
+        return;
+    }
+    PrepareTask *task = new PrepareTask(this, &receivePool, &displayPool, &pending,
+                                        raw ? PrepareTask::PixelSource : PrepareTask::EncodedSource,
+                                        displaySize, clock.elapsed(), false);
+    task->data = data;
+    task->width = width;
+    task->height = height;
+    workerPool.start(task);
+}
+
+void HUDFramePipeline::loadFrame(const QString& fileName)
+{
+    if (!startWork())
+    {
+        return;
+    }
+    PrepareTask *task = new PrepareTask(this, &receivePool, &displayPool, &pending, PrepareTask::FileSource,
+                                        displaySize, clock.elapsed(), false);
+    task->fileName = fileName;
+    workerPool.start(task);
+}
+
+void HUDFramePipeline::setDisplaySize(const QSize& size)
+{
+    if (size == displaySize)
+    {
+        return;
+    }
+    displaySize = size;
+    if (lastSource && pending.load() == 0)
+    {
+        // Convert the frame shown again, for the new size
+        pending.fetchAndAddOrdered(1);
+        PrepareTask *task = new PrepareTask(this, &receivePool, &displayPool, &pending, PrepareTask::RawSource,
+                                            displaySize, lastSource->completed, true);
+        task->source = lastSource;
+        workerPool.start(task);
+    }
+}
+
+void HUDFramePipeline::setLogDirectory(const QString& directory)
+{
+    logDirectory = directory;
+    logCounter = 0;
+}
+
+void HUDFramePipeline::saveFrame(const QString& fileName)
+{
+    if (!lastSource)
+    {
+        return;
+    }
+    if (pendingSaves.load() >= MAX_PENDING_SAVES)
+    {
+        QLOG_WARN() << "HUD: image saving is behind, skipping" << fileName;
+        return;
+    }
+    pendingSaves.fetchAndAddOrdered(1);
+    savePool.start(new SaveTask(lastSource, fileName, &pendingSaves));
+}
+
+bool HUDFramePipeline::startWork()
+{
+    if (pending.load() >= MAX_PENDING)
+    {
+        dropFrame();
+        return false;
+    }
+    pending.fetchAndAddOrdered(1);
+    return true;
+}
+
+void HUDFramePipeline::dropFrame()
+{
+    droppedFrames++;
+}
+
+void HUDFramePipeline::frameDone(HUDFramePtr source, HUDFramePtr display, bool refresh)
+{
+    lastSource = source;
+    displayFrame = display;
+    if (!refresh)
+    {
+        shownFrames++;
+        if (clock.elapsed() - source->completed > LATE_FRAME_MSECS)
+        {
+            lateFrames++;
+        }
+        if (!logDirectory.isEmpty())
+        {
+            saveFrame(QString("%1/%2.png").arg(logDirectory).arg(logCounter));
+            logCounter++;
+        }
+    }
+    emit frameReady();
+}
+
+void HUDFramePipeline::frameFailed()
+{
+    dropFrame();
+}
@@ -0,0 +1,186 @@
+/*===================================================================
+APM_PLANNER Open Source Ground Control Station
+
+(c) 2015 APM_PLANNER PROJECT <http://www.diydrones.com>
+
+This file is part of the APM_PLANNER project
+
+    APM_PLANNER is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    APM_PLANNER is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with APM_PLANNER. If not, see <http://www.gnu.org/licenses/>.
+
+======================================================================*/
+/**
+ * @file
+ *   @brief Pooled frame buffers for the HUD video stream
+ */
+
+#ifndef HUDFRAMEPIPELINE_H
+#define HUDFRAMEPIPELINE_H
+
+#include <QObject>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QMetaType>
+
+/** @brief One video frame, lent out by a HUDFramePool */
+class HUDFrame
+{
+public:
+    QImage image;
+    qint64 completed;   ///< Pipeline clock time the frame's data was complete, in milliseconds
+};
+
+/** @brief A frame, returned to its pool once the last reference is gone */
+typedef QSharedPointer<HUDFrame> HUDFramePtr;
+Q_DECLARE_METATYPE(HUDFramePtr)
+
+/**
+ * @brief A bounded set of frame buffers that are reused from frame to frame.
+ *
+ * Frames are only allocated until the pool holds its capacity, after that a
+ * frame is only available once a previous one has been released. Frames of a
+ * different size or format replace free ones, so a change of stream
+ * resolution does not grow the pool. Thread safe.
+ */
+class HUDFramePool
+{
+public:
+    explicit HUDFramePool(int capacity);
+    ~HUDFramePool();
+
+    /** @brief A frame of this size and format, or a null pointer if all are in use */
+    HUDFramePtr acquire(const QSize& size, QImage::Format format);
+
+private:
+    class Data
+    {
+    public:
+        ~Data();
+        QMutex lock;
+        QList<HUDFrame*> free;
+        int capacity;
+        int allocated;
+    };
+    /** @brief Deleter of the lent out frames. Holds the pool data, so frames may outlive the pool. */
+    class Recycler
+    {
+    public:
+        explicit Recycler(const QSharedPointer<Data>& data) : d(data) {}
+        void operator()(HUDFrame *frame);
+        QSharedPointer<Data> d;
+    };
+    QSharedPointer<Data> d;
+};
+
+/**
+ * @brief Turns incoming image data into frames ready to be drawn by the HUD.
+ *
+ * Raw streams (startRawFrame, appendRawData, finishRawFrame) are written
+ * straight into a pooled frame. Encoded images and image files are decoded
+ * on a worker thread, into pooled frames as well. The worker then converts
+ * each frame into a display frame of the widget's size, in a format that can
+ * be drawn without conversion, and hands it over to currentFrame() without a
+ * copy. While the image log is enabled, frames are written to disk on a
+ * second worker thread.
+ *
+ * A frame that can't get a buffer, arrives while the worker is still busy
+ * with earlier ones, or is started before it was complete, is dropped. A
+ * frame shown more than lateFrameTime() after its data was complete counts
+ * as late.
+ */
+class HUDFramePipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HUDFramePipeline(QObject *parent = 0);
+    ~HUDFramePipeline();
+
+    /** @brief Start a raw frame of depth bits per channel, 8 bit greyscale or 32 bit ARGB */
+    void startRawFrame(int width, int height, int depth, int channels);
+    void appendRawData(const unsigned char* data, int length, int startIndex);
+    /** @brief Send the raw frame on to be displayed, if it is complete */
+    void finishRawFrame();
+    bool isRawFrameStarted() const { return !rawFrame.isNull(); }
+
+    /** @brief Decode an encoded image (JPEG, PNG, BMP, PGM), or 8 bit greyscale pixels when raw is set */
+    void decodeFrame(const QByteArray& data, bool raw, int width, int height);
+    /** @brief Load and display an image file */
+    void loadFrame(const QString& fileName);
+
+    /** @brief Size of the display frames, the image is scaled to this width */
+    void setDisplaySize(const QSize& size);
+    /** @brief The latest display frame, null before the first */
+    HUDFramePtr currentFrame() const { return displayFrame; }
+    /** @brief Size of the latest source frame */
+    QSize sourceSize() const { return lastSource.isNull() ? QSize() : lastSource->image.size(); }
+
+    /** @brief Directory every displayed frame is saved to, empty to stop saving */
+    void setLogDirectory(const QString& directory);
+    /** @brief Save the latest source frame, in the background */
+    void saveFrame(const QString& fileName);
+
+    quint64 getShownFrames() const { return shownFrames; }
+    quint64 getDroppedFrames() const { return droppedFrames; }
+    quint64 getLateFrames() const { return lateFrames; }
+    static int lateFrameTime() { return LATE_FRAME_MSECS; }
+
+signals:
+    /** @brief A new display frame is available */
+    void frameReady();
+
+private slots:
+    /** @param refresh The shown frame converted again, for a new display size */
+    void frameDone(HUDFramePtr source, HUDFramePtr display, bool refresh);
+    void frameFailed();
+
+private:
+    bool startWork();
+    void dropFrame();
+
+    static const int RECEIVE_FRAMES = 8;    ///< Frames being received, decoded, kept as the last source or being saved
+    static const int DISPLAY_FRAMES = 3;    ///< Frame shown, frame being prepared and one spare
+    static const int MAX_PENDING = 2;       ///< Frames queued for the worker before new ones are dropped
+    static const int MAX_PENDING_SAVES = 4; ///< Frames queued for saving before new ones are skipped
+    static const int LATE_FRAME_MSECS = 200;
+
+    HUDFramePool receivePool;
+    HUDFramePool displayPool;
+    QThreadPool workerPool;     ///< Decoding and display conversion, one thread so frames stay in order
+    QThreadPool savePool;       ///< Image log, one thread so files are written in order
+    QAtomicInt pending;
+    QAtomicInt pendingSaves;
+    QElapsedTimer clock;
+
+    HUDFramePtr rawFrame;       ///< Raw frame being received
+    int rawExpectedBytes;
+    int rawBytesPerLine;
+    int rawReceivedBytes;
+
+    HUDFramePtr lastSource;     ///< Latest frame shown, as received
+    HUDFramePtr displayFrame;   ///< Latest frame shown, ready to draw
+    QSize displaySize;
+
+    QString logDirectory;
+    unsigned int logCounter;
+
+    quint64 shownFrames;
+    quint64 droppedFrames;
+    quint64 lateFrames;
+};
+
+#endif // HUDFRAMEPIPELINE_H
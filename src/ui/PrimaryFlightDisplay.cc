@@ -1,5 +1,6 @@
 #include "PrimaryFlightDisplay.h"
 #include "UASManager.h"
+#include "FrameScheduler.h"
 
 //#include "ui_primaryflightdisplay.h"
 #include <QDebug>
@@ -160,14 +161,21 @@ PrimaryFlightDisplay::PrimaryFlightDisplay(int width, int height, QWidget *paren
     instrumentBackground(QColor::fromHsvF(0, 0, 0.3, 0.3)),
     instrumentOpagueBackground(QColor::fromHsvF(0, 0, 0.3, 1.0)),
 
-    font("Bitstream Vera Sans"),
-    refreshTimer(new QTimer(this))
+    font("Bitstream Vera Sans")
 {
     Q_UNUSED(width);
     Q_UNUSED(height);
 
     preArmCheckFailure = false;
     preArmCheckMessage = "";
+
+    layersValid = false;
+    layersPixelRatio = 1;
+    layersLayout = layout;
+    layersStyle = style;
+    lastRenderTime = 0;
+    averageRenderTime = 0;
+
     preArmMessageTimer = new QTimer(this);
     connect(preArmMessageTimer,SIGNAL(timeout()),this,SLOT(preArmMessageTimeout()));
 
@@ -181,15 +189,12 @@ PrimaryFlightDisplay::PrimaryFlightDisplay(int width, int height, QWidget *paren
     connect(UASManager::instance(), SIGNAL(UASDeleted(UASInterface*)), this, SLOT(forgetUAS(UASInterface*)));
     connect(UASManager::instance(), SIGNAL(activeUASSet(UASInterface*)), this, SLOT(setActiveUAS(UASInterface*)));
 
-    // Refresh timer
-    refreshTimer->setInterval(updateInterval);
-    //    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(paintHUD()));
-    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(update()));
+    // Repainted by the frame scheduler when new data has arrived
+    FrameScheduler::instance()->registerWidget(this, FrameScheduler::OnDemand, SLOT(repaint()), updateInterval);
 }
 
 PrimaryFlightDisplay::~PrimaryFlightDisplay()
 {
-    refreshTimer->stop();
 }
 
 
@@ -203,7 +208,6 @@ void PrimaryFlightDisplay::showEvent(QShowEvent* event)
     // React only to internal (pre-display)
     // events
     QWidget::showEvent(event);
-    refreshTimer->start(updateInterval);
     emit visibilityChanged(true);
 }
 
@@ -211,7 +215,6 @@ void PrimaryFlightDisplay::hideEvent(QHideEvent* event)
 {
     // React only to internal (pre-display)
     // events
-    refreshTimer->stop();
     QWidget::hideEvent(event);
     emit visibilityChanged(false);
 }
@@ -232,6 +235,8 @@ void PrimaryFlightDisplay::resizeEvent(QResizeEvent *e) {
     mediumTextSize = size * MEDIUM_TEXT_SIZE;
     largeTextSize = size * LARGE_TEXT_SIZE;
 
+    invalidateLayers();
+
     /*
      * Try without layout Change-O-Matic. It was too complicated.
     qreal aspect = e->size().width() / e->size().height();
@@ -243,6 +248,14 @@ void PrimaryFlightDisplay::resizeEvent(QResizeEvent *e) {
     // qDebug("Width %d height %d decision %d", e->size().width(), e->size().height(), layout);
 }
 
+void PrimaryFlightDisplay::changeEvent(QEvent *e)
+{
+    QWidget::changeEvent(e);
+    if (e->type() == QEvent::StyleChange || e->type() == QEvent::PaletteChange || e->type() == QEvent::FontChange) {
+        invalidateLayers();
+    }
+}
+
 void PrimaryFlightDisplay::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
@@ -346,6 +359,7 @@ void PrimaryFlightDisplay::uasTextMessage(int uasid, int componentid, int severi
         preArmCheckMessage =  QString("M%1:%2").arg(uasid).arg(text);
         preArmCheckFailure = true;
         preArmMessageTimer->start(4000);
+        FrameScheduler::instance()->markDirty(this);
     }
 }
 
@@ -373,7 +387,7 @@ void PrimaryFlightDisplay::updateAttitude(UASInterface* uas, double roll, double
             if (yaw<0) yaw+=360;
             this->heading = yaw;
         }
-
+        FrameScheduler::instance()->markDirty(this);
 }
 
 void PrimaryFlightDisplay::updateAttitude(UASInterface* uas, int component, double roll, double pitch,
@@ -390,6 +404,7 @@ void PrimaryFlightDisplay::speedChanged(UASInterface* uas, double groundspeed, d
     Q_UNUSED(timestamp);
     m_groundspeed = groundspeed;
     m_airspeed = airspeed;
+    FrameScheduler::instance()->markDirty(this);
 }
 
 void PrimaryFlightDisplay::altitudeChanged(UASInterface* uas, double altitudeAMSL,
@@ -400,6 +415,7 @@ void PrimaryFlightDisplay::altitudeChanged(UASInterface* uas, double altitudeAMS
     m_altitudeAMSL = altitudeAMSL;
     m_altitudeRelative = altitudeRelative;;
     m_climbRate = climbRate/10.0f;
+    FrameScheduler::instance()->markDirty(this);
 }
 
 void PrimaryFlightDisplay::updateNavigationControllerErrors(UASInterface* uas, double altitudeError, double speedError, double xtrackError) {
@@ -407,6 +423,7 @@ void PrimaryFlightDisplay::updateNavigationControllerErrors(UASInterface* uas, d
     this->navigationAltitudeError = altitudeError;
     this->navigationSpeedError = speedError;
     this->navigationCrosstrackError = xtrackError;
+    FrameScheduler::instance()->markDirty(this);
 }
 
 
@@ -792,56 +809,34 @@ void PrimaryFlightDisplay::drawAIAttitudeScales(
     float displayRoll = this->roll;
     if (displayRoll == UNKNOWN_ATTITUDE)
         displayRoll = 0;
-    // To save computations, we do these transformations once for both scales:
+    // The roll scale only turns with the roll, so it comes from the layer cache.
+    drawLayer(painter, rollScaleLayer, area.center(), -displayRoll);
+
     painter.resetTransform();
     painter.translate(area.center());
     painter.rotate(-displayRoll);
-    QTransform saved = painter.transform();
-
-    drawRollScale(painter, area, true, true);
-    painter.setTransform(saved);
     drawPitchScale(painter, area, intrusion, true, true);
 }
 
-void PrimaryFlightDisplay::drawAICompassDisk(QPainter& painter, QRectF area, float halfspan) {
-    float displayHeading = this->heading;
-    if(displayHeading == UNKNOWN_ATTITUDE)
-        displayHeading = 0;
-
-    float start = displayHeading - halfspan;
-    float end = displayHeading + halfspan;
-
-    int firstTick = ceil(start / COMPASS_DISK_RESOLUTION) * COMPASS_DISK_RESOLUTION;
-    int lastTick = floor(end / COMPASS_DISK_RESOLUTION) * COMPASS_DISK_RESOLUTION;
-
-    float radius = area.width()/2;
+void PrimaryFlightDisplay::drawCompassRose(QPainter& painter, qreal radius, bool drawLabels) {
+    // Drawn north up around the origin. Rotated by the heading when composited.
     float innerRadius = radius * 0.96;
-    painter.resetTransform();
     painter.setBrush(instrumentBackground);
     painter.setPen(instrumentEdgePen);
-    painter.drawEllipse(area);
+    painter.drawEllipse(QPointF(0, 0), radius, radius);
     painter.setBrush(Qt::NoBrush);
 
     QPen scalePen(Qt::black);
     scalePen.setWidthF(fineLineWidth);
 
-    for (int tickYaw = firstTick; tickYaw <= lastTick; tickYaw += COMPASS_DISK_RESOLUTION) {
-        int displayTick = tickYaw;
-        if (displayTick < 0) displayTick+=360;
-        else if (displayTick>=360) displayTick-=360;
-
-        // yaw is in center.
-        float off = tickYaw - displayHeading;
-        // wrap that to ]-180..180]
-        if (off<=-180) off+= 360; else if (off>180) off -= 360;
-
-        painter.translate(area.center());
-        painter.rotate(off);
+    for (int displayTick = 0; displayTick < 360; displayTick += COMPASS_DISK_RESOLUTION) {
+        painter.save();
+        painter.rotate(displayTick);
         bool drewArrow = false;
         bool isMajor = displayTick % COMPASS_DISK_MAJORTICK == 0;
 
         // If heading unknown, still draw marks but no numbers.
-        if (this->heading != UNKNOWN_ATTITUDE &&
+        if (drawLabels &&
                 (displayTick==30 || displayTick==60 ||
                 displayTick==120 || displayTick==150 ||
                 displayTick==210 || displayTick==240 ||
@@ -866,7 +861,7 @@ void PrimaryFlightDisplay::drawAICompassDisk(QPainter& painter, QRectF area, flo
                     drewArrow = true;
                 }
                 // If heading unknown, still draw marks but no N S E W.
-                if (this->heading != UNKNOWN_ATTITUDE && displayTick%90 == 0) {
+                if (drawLabels && displayTick%90 == 0) {
                     // Also draw a label
                     QString name = compassWindNames[displayTick / 45];
                     painter.setPen(scalePen);
@@ -881,9 +876,24 @@ void PrimaryFlightDisplay::drawAICompassDisk(QPainter& painter, QRectF area, flo
 
         painter.setPen(scalePen);
         painter.drawLine(p_start, p_end);
-        painter.resetTransform();
+        painter.restore();
     }
+}
+
+void PrimaryFlightDisplay::drawAICompassDisk(QPainter& painter, QRectF area) {
+    float displayHeading = this->heading;
+    if(displayHeading == UNKNOWN_ATTITUDE)
+        displayHeading = 0;
+
+    float radius = area.width()/2;
+
+    drawLayer(painter, this->heading == UNKNOWN_ATTITUDE ? compassRoseNoLabelsLayer : compassRoseLayer,
+              area.center(), -displayHeading);
+
+    QPen scalePen(Qt::black);
+    scalePen.setWidthF(fineLineWidth);
 
+    painter.resetTransform();
     painter.setPen(scalePen);
     //painter.setBrush(Qt::SolidPattern);
     painter.translate(area.center());
@@ -966,8 +976,8 @@ void PrimaryFlightDisplay::drawAltimeter(
         float vv
     ) {
 
+    // The tape background comes from the layer cache.
     painter.resetTransform();
-    fillInstrumentBackground(painter, area);
 
     QPen pen;
     pen.setWidthF(lineWidth);
@@ -1096,8 +1106,8 @@ void PrimaryFlightDisplay::drawVelocityMeter(
         )
 {
 
+    // The tape background comes from the layer cache.
     painter.resetTransform();
-    fillInstrumentBackground(painter, area);
 
     QPen pen;
     pen.setWidthF(lineWidth);
@@ -1246,6 +1256,8 @@ inline qreal tapesGaugeWidthFor(qreal containerWidth, qreal preferredAIWidth) {
 }
 
 void PrimaryFlightDisplay::doPaint() {
+    renderTimer.start();
+
     QPainter painter;
     painter.begin(this);
     painter.setRenderHint(QPainter::Antialiasing, true);
@@ -1269,7 +1281,6 @@ void PrimaryFlightDisplay::doPaint() {
     painter.fillRect(rect(), Qt::black);
     qreal tapeGaugeWidth;
 
-    qreal compassHalfSpan = 180;
     float compassAIIntrusion = 0;
 
     switch(layout) {
@@ -1406,11 +1417,6 @@ void PrimaryFlightDisplay::doPaint() {
                              compassSize,
                              compassSize);
 
-        if (height()-compassCenterY < compassSize/2) {
-            compassHalfSpan = acos((compassCenterY-height())*2/compassSize) * 180/M_PI + COMPASS_DISK_RESOLUTION;
-            if (compassHalfSpan > 180) compassHalfSpan = 180;
-        }
-
         compassAIIntrusion = compassSize/2 + AIMainArea.bottom() - compassCenterY;
         if (compassAIIntrusion<0) compassAIIntrusion = 0;
 
@@ -1490,6 +1496,8 @@ void PrimaryFlightDisplay::doPaint() {
     }
     }
 
+    updateLayers(AIMainArea, AIPaintArea, compassArea, altimeterArea, velocityMeterArea);
+
     bool hadClip = painter.hasClipping();
 
     painter.setClipping(true);
@@ -1497,15 +1505,19 @@ void PrimaryFlightDisplay::doPaint() {
 
     drawAIGlobalFeatures(painter, AIMainArea, AIPaintArea);
     drawAIAttitudeScales(painter, AIMainArea, compassAIIntrusion);
-    drawAIAirframeFixedFeatures(painter, AIMainArea);
+    painter.resetTransform();
+    painter.drawPixmap(0, 0, airframeLayer);
 
    // if(layout ==COMPASS_SEPARATED)
         //drawSeparateCompassDisk(painter, compassArea);
    // else
-        drawAICompassDisk(painter, compassArea, compassHalfSpan);
+        drawAICompassDisk(painter, compassArea);
 
     painter.setClipping(hadClip);
 
+    painter.resetTransform();
+    painter.drawPixmap(0, 0, tapesLayer);
+
     drawAltimeter(painter, altimeterArea, m_altitudeRelative, m_altitudeAMSL, m_climbRate);
 
     drawVelocityMeter(painter, velocityMeterArea, m_groundspeed, m_airspeed);
@@ -1543,12 +1555,107 @@ void PrimaryFlightDisplay::doPaint() {
         p2.drawText((this->width()/2.0) - (textwidth/2.0),this->height()/4.0,preArmCheckMessage);
     }
     p2.end();
+
+    lastRenderTime = renderTimer.nsecsElapsed() / 1000000.0;
+    if (averageRenderTime == 0)
+        averageRenderTime = lastRenderTime;
+    else
+        averageRenderTime = averageRenderTime * 0.9 + lastRenderTime * 0.1;
+    emit frameRendered(lastRenderTime);
+}
+
+void PrimaryFlightDisplay::invalidateLayers() {
+    layersValid = false;
+}
+
+QPixmap PrimaryFlightDisplay::createLayer(QSizeF size) {
+    // Backed at the screen's pixel density, so the layers aren't upscaled on high DPI screens.
+    // Painters and drawPixmap() keep working in widget coordinates.
+    qreal ratio = devicePixelRatio();
+    QPixmap layer(qCeil(size.width() * ratio), qCeil(size.height() * ratio));
+    layer.setDevicePixelRatio(ratio);
+    layer.fill(Qt::transparent);
+    return layer;
+}
+
+void PrimaryFlightDisplay::drawLayer(QPainter& painter, const QPixmap& layer, QPointF center, qreal rotation) {
+    painter.resetTransform();
+    painter.translate(center);
+    painter.rotate(rotation);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    qreal ratio = layer.devicePixelRatio();
+    painter.drawPixmap(QPointF(-layer.width()/ratio/2.0, -layer.height()/ratio/2.0), layer);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+}
+
+void PrimaryFlightDisplay::updateLayers(
+        QRectF AIMainArea,
+        QRectF AIPaintArea,
+        QRectF compassArea,
+        QRectF altimeterArea,
+        QRectF velocityMeterArea) {
+
+    if (layersValid && layersSize == size() && layersPixelRatio == devicePixelRatio()
+            && layersLayout == layout && layersStyle == style)
+        return;
+
+    // The rotated layers get a margin so the edge pens and labels are not cut off.
+    qreal margin = lineWidth * 2 + 2;
+
+    QSizeF compassSize(compassArea.width() + margin*2, compassArea.height() + margin*2);
+    compassRoseLayer = createLayer(compassSize);
+    compassRoseNoLabelsLayer = createLayer(compassSize);
+    for (int i=0; i<2; i++) {
+        QPixmap& layer = i == 0 ? compassRoseLayer : compassRoseNoLabelsLayer;
+        QPainter painter(&layer);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setRenderHint(QPainter::HighQualityAntialiasing, true);
+        painter.translate(layer.width()/layer.devicePixelRatio()/2.0, layer.height()/layer.devicePixelRatio()/2.0);
+        drawCompassRose(painter, compassArea.width()/2, i == 0);
+    }
+
+    qreal w = AIMainArea.width();
+    if (w<AIMainArea.height()) w = AIMainArea.height();
+    qreal rollScaleExtent = (ROLL_SCALE_RADIUS+ROLL_SCALE_TICKMARKLENGTH*1.7)*w + mediumTextSize*2 + margin;
+    rollScaleLayer = createLayer(QSizeF(rollScaleExtent*2, rollScaleExtent*2));
+    {
+        QPainter painter(&rollScaleLayer);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setRenderHint(QPainter::HighQualityAntialiasing, true);
+        painter.translate(rollScaleLayer.width()/rollScaleLayer.devicePixelRatio()/2.0,
+                          rollScaleLayer.height()/rollScaleLayer.devicePixelRatio()/2.0);
+        drawRollScale(painter, AIMainArea, true, true);
+    }
+
+    airframeLayer = createLayer(size());
+    {
+        QPainter painter(&airframeLayer);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setRenderHint(QPainter::HighQualityAntialiasing, true);
+        painter.setClipRect(AIPaintArea);
+        drawAIAirframeFixedFeatures(painter, AIMainArea);
+    }
+
+    tapesLayer = createLayer(size());
+    {
+        QPainter painter(&tapesLayer);
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setRenderHint(QPainter::HighQualityAntialiasing, true);
+        fillInstrumentBackground(painter, altimeterArea);
+        fillInstrumentBackground(painter, velocityMeterArea);
+    }
+
+    layersValid = true;
+    layersSize = size();
+    layersPixelRatio = devicePixelRatio();
+    layersLayout = layout;
+    layersStyle = style;
 }
 void PrimaryFlightDisplay::preArmMessageTimeout()
 {
     preArmMessageTimer->stop();
     preArmCheckFailure = false;
-
+    FrameScheduler::instance()->markDirty(this);
 }
 
 void PrimaryFlightDisplay:: createActions() {}
@@ -3,6 +3,8 @@
 
 #include <QWidget>
 #include <QPen>
+#include <QPixmap>
+#include <QElapsedTimer>
 #include "UASInterface.h"
 
 class PrimaryFlightDisplay : public QWidget
@@ -31,6 +33,12 @@ public slots:
     void forgetUAS(UASInterface* uas);
     void setActiveUAS(UASInterface* uas);
 
+public:
+    /** @brief Time taken to render the last frame, in milliseconds */
+    qreal getLastRenderTime() const { return lastRenderTime; }
+    /** @brief Moving average of the frame render time, in milliseconds */
+    qreal getAverageRenderTime() const { return averageRenderTime; }
+
 protected:
     enum Layout {
         COMPASS_INTEGRATED,
@@ -45,6 +53,7 @@ protected:
 
     void paintEvent(QPaintEvent *event);
     void resizeEvent(QResizeEvent *e);
+    void changeEvent(QEvent *e);
 
     // from HUD.h:
 
@@ -64,6 +73,8 @@ protected:
 
 signals:
     void visibilityChanged(bool visible);
+    /** @brief Emitted after each frame with its render time in milliseconds */
+    void frameRendered(qreal milliseconds);
 
 private:
     /*
@@ -99,7 +110,8 @@ private:
     void drawPitchScale(QPainter& painter, QRectF area, float intrusion, bool drawNumbersLeft, bool drawNumbersRight);
     void drawRollScale(QPainter& painter, QRectF area, bool drawTicks, bool drawNumbers);
     void drawAIAttitudeScales(QPainter& painter, QRectF area, float intrusion);
-    void drawAICompassDisk(QPainter& painter, QRectF area, float halfspan);
+    void drawAICompassDisk(QPainter& painter, QRectF area);
+    void drawCompassRose(QPainter& painter, qreal radius, bool drawLabels);
     void drawSeparateCompassDisk(QPainter& painter, QRectF area);
 
     void drawAltimeter(QPainter& painter, QRectF area, float altitudeRelative, float altitudeAMSL, float vv);
@@ -117,6 +129,35 @@ private:
 
     void doPaint();
 
+    /*
+     * Layer cache. The parts of the display that only move as a whole with the
+     * attitude, or not at all, are rendered once into pixmaps and composited
+     * each frame: the compass rose (rotated by heading), the roll scale (rotated
+     * by roll), the airframe markers and the tape backgrounds. They are rebuilt
+     * when the widget is resized or the layout, style or palette changes.
+     */
+    void invalidateLayers();
+    void updateLayers(QRectF AIMainArea, QRectF AIPaintArea, QRectF compassArea,
+                      QRectF altimeterArea, QRectF velocityMeterArea);
+    QPixmap createLayer(QSizeF size);
+    void drawLayer(QPainter& painter, const QPixmap& layer, QPointF center, qreal rotation);
+
+    bool layersValid;
+    QSize layersSize;
+    qreal layersPixelRatio;
+    Layout layersLayout;
+    Style layersStyle;
+
+    QPixmap compassRoseLayer;           ///< Compass rose with labels, north up
+    QPixmap compassRoseNoLabelsLayer;   ///< Marks only, shown while the heading is unknown
+    QPixmap rollScaleLayer;             ///< Roll scale for wings level
+    QPixmap airframeLayer;              ///< Fixed airframe markers, widget sized
+    QPixmap tapesLayer;                 ///< Altimeter and velocity tape backgrounds, widget sized
+
+    QElapsedTimer renderTimer;
+    qreal lastRenderTime;
+    qreal averageRenderTime;
+
     UASInterface* uas;          ///< The uas currently monitored
 
     /*
@@ -175,12 +216,10 @@ private:
 
     QFont font;
 
-    QTimer* refreshTimer;       ///< The main timer, controls the update rate
-
     static const int tickValues[];
     static const QString compassWindNames[];
 
-    static const int updateInterval = 250;
+    static const int updateInterval = 250;    ///< Minimum milliseconds between repaints
 };
 
 #endif // PRIMARYFLIGHTDISPLAY_H
@@ -8,6 +8,7 @@
 #include "MAVLinkProtocol.h"
 #include "MAVLinkSettingsWidget.h"
 #include "GAudioOutput.h"
+#include "FrameScheduler.h"
 #include "ArduPilotMegaMAV.h"
 
 #include <QFileDialog>
@@ -52,6 +53,10 @@ void QGCSettingsWidget::showEvent(QShowEvent *evt)
         ui->lowPowerCheckBox->setChecked(MainWindow::instance()->lowPowerModeEnabled());
         connect(ui->lowPowerCheckBox, SIGNAL(clicked(bool)), MainWindow::instance(), SLOT(enableLowPowerMode(bool)));
 
+        // Instrument frame rate
+        ui->frameRateSpinBox->setValue(FrameScheduler::instance()->getTargetRate());
+        connect(ui->frameRateSpinBox, SIGNAL(valueChanged(int)), FrameScheduler::instance(), SLOT(setTargetRate(int)));
+
         // Automatic use of system Proxies
         ui->autoProxyCheckBox->setChecked(MainWindow::instance()->autoProxyModeEnabled());
         connect(ui->autoProxyCheckBox, SIGNAL(clicked(bool)), MainWindow::instance(), SLOT(enableAutoProxyMode(bool)));
@@ -24,6 +24,7 @@ This file is part of the QGROUNDCONTROL project
 #include "QGCToolBar.h"
 #include "UASManager.h"
 #include "MainWindow.h"
+#include "FrameScheduler.h"
 
 #include <QToolButton>
 #include <QLabel>
@@ -207,8 +208,7 @@ void QGCToolBar::createUI()
     }
 
     // Set the toolbar to be updated every 2s
-    connect(&updateViewTimer, SIGNAL(timeout()), this, SLOT(updateView()));
-    updateViewTimer.start(2000);
+    FrameScheduler::instance()->registerWidget(this, FrameScheduler::Continuous, SLOT(updateView()), 2000);
 
     loadSettings();
 
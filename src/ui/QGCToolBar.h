@@ -118,7 +118,6 @@ protected:
     QString systemName;
     QString lastSystemMessage;
     quint64 lastSystemMessageTimeMs;
-    QTimer updateViewTimer;
     bool systemArmed;
     LinkInterface* currentLink;
     QAction* firstAction;
@@ -91,6 +91,33 @@ void DataSelectionScreen::disableItem(QString name)
     QLOG_ERROR() << "No item found in DataSelectionScreen:disableItem:" << name;
 }
 
+void DataSelectionScreen::removeItem(QString name)
+{
+    QString first = name.split(".")[0];
+    QString second = name.split(".")[1];
+    QList<QTreeWidgetItem*> items = ui.treeWidget->findItems(second,Qt::MatchExactly | Qt::MatchRecursive,0);
+    for (int i=0;i<items.size();i++)
+    {
+        QTreeWidgetItem *parent = items[i]->parent();
+        if (parent && parent->text(0) == first)
+        {
+            if (items[i]->checkState(0) != Qt::Unchecked)
+            {
+                //This will trigger the disabling of the graph automatically
+                items[i]->setCheckState(0,Qt::Unchecked);
+            }
+            m_enabledList.removeOne(name);
+            delete items[i];
+            if (parent->childCount() == 0)
+            {
+                delete parent;
+            }
+            return;
+        }
+    }
+    QLOG_ERROR() << "No item found in DataSelectionScreen:removeItem:" << name;
+}
+
 void DataSelectionScreen::addItem(QString name)
 {
     if (name.contains(":"))
@@ -15,6 +15,8 @@ public:
 	void clear();
     void enableItem(QString name);
     void disableItem(QString name);
+    //Take an item out of the tree, disabling it first if it is enabled
+    void removeItem(QString name);
 signals:
 	void itemEnabled(QString name);
 	void itemDisabled(QString name);
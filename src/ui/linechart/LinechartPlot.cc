@@ -13,6 +13,7 @@
 #include "QsLog.h"
 #include "float.h"
 #include "QGC.h"
+#include "FrameScheduler.h"
 
 #include <QTimer>
 #include <qwt_plot.h>
@@ -121,10 +122,9 @@ LinechartPlot::LinechartPlot(QWidget *parent, int plotid, quint64 interval): Qwt
     zoomer->setRubberBandPen(QPen(Qt::blue, 1.2, Qt::DotLine));
     zoomer->setTrackerPen(QPen(Qt::blue));
 
-    // Start QTimer for plot update
-    updateTimer = new QTimer(this);
-    connect(updateTimer, SIGNAL(timeout()), this, SLOT(paintRealtime()));
-    //updateTimer->start(DEFAULT_REFRESH_RATE);
+    // Plot updates come from the frame scheduler, which skips them while hidden
+    refreshRate = DEFAULT_REFRESH_RATE;
+    FrameScheduler::instance()->registerWidget(this, FrameScheduler::Continuous, SLOT(paintRealtime()), refreshRate);
 
     connect(&timeoutTimer, SIGNAL(timeout()), this, SLOT(removeTimedOutCurves()));
     //timeoutTimer.start(5000);
@@ -157,18 +157,6 @@ LinechartPlot::~LinechartPlot()
 //    datalock.unlock();
 }
 
-void LinechartPlot::showEvent(QShowEvent* event)
-{
-    Q_UNUSED(event);
-    updateTimer->start(DEFAULT_REFRESH_RATE);
-}
-
-void LinechartPlot::hideEvent(QHideEvent* event)
-{
-    Q_UNUSED(event);
-    updateTimer->stop();
-}
-
 int LinechartPlot::getPlotId()
 {
     return this->plotid;
@@ -218,7 +206,8 @@ int LinechartPlot::getAverageWindow()
  **/
 void LinechartPlot::setRefreshRate(int ms)
 {
-    updateTimer->setInterval(ms);
+    refreshRate = ms;
+    FrameScheduler::instance()->registerWidget(this, FrameScheduler::Continuous, SLOT(paintRealtime()), refreshRate);
 }
 
 void LinechartPlot::setActive(bool active)
@@ -250,6 +239,11 @@ void LinechartPlot::removeTimedOutCurves()
             delete d;
             // Set the pointer null
             d = NULL;
+            lastUpdate.remove(key);
+            stagingLock.lock();
+            staging.remove(key);
+            staged.remove(key);
+            stagingLock.unlock();
             emit curveRemoved(key);
         }
     }
@@ -273,21 +267,15 @@ void LinechartPlot::setZeroValue(QString id, double zeroValue)
 
 void LinechartPlot::appendData(QString dataname, quint64 ms, double value)
 {
-    /* Lock resource to ensure data integrity */
-    datalock.lock();
-
     /* Check if dataset identifier already exists */
     if(!data.contains(dataname)) {
+        /* Lock resource to ensure data integrity */
+        datalock.lock();
         addCurve(dataname);
         enforceGroundTime(m_groundTime);
-//        QLOG_DEBUG() << "ADDING CURVE WITH" << dataname << ms << value;
-//        QLOG_DEBUG() << "MINTIME:" << minTime << "MAXTIME:" << maxTime;
-//        QLOG_DEBUG() << "LASTTIME:" << lastTime;
+        datalock.unlock();
     }
 
-    // Add new value
-    TimeSeriesData* dataset = data.value(dataname);
-
     quint64 time;
 
     // Append data
@@ -300,32 +288,69 @@ void LinechartPlot::appendData(QString dataname, quint64 ms, double value)
     {
         time = QGC::groundTimeMilliseconds();
     }
-    dataset->append(time, value);
 
-    lastUpdate.insert(dataname, time);
+    // Only stage the sample, the curve is updated once per refresh tick
+    stagingLock.lock();
+    StagedSamples& samples = staging[dataname];
+    if (samples.ms.size() >= MAX_STAGED_SAMPLES)
+    {
+        // Not drained for a long time, the plot is inactive
+        samples.ms.remove(0, MAX_STAGED_SAMPLES / 2);
+        samples.value.remove(0, MAX_STAGED_SAMPLES / 2);
+    }
+    samples.ms.append(time);
+    samples.value.append(value);
+    stagingLock.unlock();
+}
 
-    // Scaling values
-    if(ms < minTime) minTime = ms;
-    if(ms > maxTime) maxTime = ms;
-    storageInterval = maxTime - minTime;
+void LinechartPlot::flushStaging()
+{
+    // Swap buffers, so appendData() can go on staging while this drains
+    stagingLock.lock();
+    staging.swap(staged);
+    stagingLock.unlock();
 
-    if(time > lastTime)
+    datalock.lock();
+    QHash<QString, StagedSamples>::iterator i;
+    for(i = staged.begin(); i != staged.end(); ++i)
     {
-        //QLOG_DEBUG() << "UPDATED LAST TIME!" << dataname << time << lastTime;
-        lastTime = time;
-    }
+        StagedSamples& samples = i.value();
+        int count = samples.ms.size();
+        TimeSeriesData* dataset = data.value(i.key(), NULL);
+        QwtPlotCurve* curve = curves.value(i.key(), NULL);
+        if (count == 0 || !dataset || !curve)
+        {
+            continue;
+        }
+        dataset->append(samples.ms.constData(), samples.value.constData(), count);
 
-    //
-    if (value < minValue) minValue = value;
-    if (value > maxValue) maxValue = value;
-    valueInterval = maxValue - minValue;
+        quint64 time = samples.ms.at(count - 1);
+        lastUpdate.insert(i.key(), time);
 
-    // Assign dataset to curve
-    QwtPlotCurve* curve = curves.value(dataname);
-    curve->setRawData(dataset->getPlotX(), dataset->getPlotY(), dataset->getPlotCount());
+        // Scaling values
+        for (int j = 0; j < count; ++j)
+        {
+            double value = samples.value.at(j);
+            if (value < minValue) minValue = value;
+            if (value > maxValue) maxValue = value;
+            if (samples.ms.at(j) < minTime) minTime = samples.ms.at(j);
+            if (samples.ms.at(j) > maxTime) maxTime = samples.ms.at(j);
+        }
+        storageInterval = maxTime - minTime;
+        valueInterval = maxValue - minValue;
 
-    //    QLOG_DEBUG() << "mintime" << minTime << "maxtime" << maxTime << "last max time" << "window position" << getWindowPosition();
+        if(time > lastTime)
+        {
+            lastTime = time;
+        }
 
+        // Assign dataset to curve
+        curve->setRawData(dataset->getPlotX(), dataset->getPlotY(), dataset->getPlotCount());
+
+        // Keep the capacity for the next round
+        samples.ms.resize(0);
+        samples.value.resize(0);
+    }
     datalock.unlock();
 }
 
@@ -687,6 +712,7 @@ void LinechartPlot::setAverageWindow(int windowSize)
 void LinechartPlot::paintRealtime()
 {
     if (m_active) {
+        flushStaging();
 #if (QGC_EVENTLOOP_DEBUG)
         static quint64 timestamp = 0;
         QLOG_DEBUG() << "EVENTLOOP: (" << MG::TIME::getGroundTimeNow() - timestamp << ")" << __FILE__ << __LINE__;
@@ -796,6 +822,10 @@ void LinechartPlot::removeAllData()
         // Set the pointer null
         d = NULL;
     }
+    stagingLock.lock();
+    staging.clear();
+    staged.clear();
+    stagingLock.unlock();
     datalock.unlock();
     replot();
 }
@@ -806,10 +836,16 @@ TimeSeriesData::TimeSeriesData(QwtPlot* plot, QString friendlyName, quint64 plot
     maxValue(DBL_MIN),
     zeroValue(0),
     count(0),
+    first(0),
+    plotFirst(0),
+    capacity(INITIAL_CAPACITY),
     mean(0.0),
     median(0.0),
     variance(0.0),
-    averageWindow(50)
+    sumSquares(0.0),
+    averageWindow(50),
+    windowCount(0),
+    windowNext(0)
 {
     this->plot = plot;
     this->friendlyName = friendlyName;
@@ -821,7 +857,9 @@ TimeSeriesData::TimeSeriesData(QwtPlot* plot, QString friendlyName, quint64 plot
     startTime = QUINT64_MAX;
     stopTime = QUINT64_MIN;
 
-    plotCount = 0;
+    ms.resize(capacity * 2);
+    value.resize(capacity * 2);
+    windowValues.resize(averageWindow);
 }
 
 TimeSeriesData::~TimeSeriesData()
@@ -831,12 +869,148 @@ TimeSeriesData::~TimeSeriesData()
 
 void TimeSeriesData::setInterval(quint64 ms)
 {
+    dataMutex.lock();
     plotInterval = ms;
+    // The interval may have grown, so start again from the oldest sample
+    plotFirst = first;
+    updatePlotFirst();
+    dataMutex.unlock();
 }
 
 void TimeSeriesData::setAverageWindowSize(int windowSize)
 {
-    this->averageWindow = windowSize;
+    dataMutex.lock();
+    this->averageWindow = qMax(windowSize, 1);
+    resetWindow();
+    dataMutex.unlock();
+}
+
+/**
+ * @brief Double the ring capacity, keeping the stored samples
+ **/
+void TimeSeriesData::grow()
+{
+    int newCapacity = capacity * 2;
+    QwtArray<double> newMs(newCapacity * 2);
+    QwtArray<double> newValue(newCapacity * 2);
+    for (quint64 n = first; n < count; ++n) {
+        int from = slot(n);
+        int to = static_cast<int>(n & static_cast<quint64>(newCapacity - 1));
+        newMs[to] = newMs[to + newCapacity] = this->ms[from];
+        newValue[to] = newValue[to + newCapacity] = this->value[from];
+    }
+    capacity = newCapacity;
+    this->ms = newMs;
+    this->value = newValue;
+}
+
+/**
+ * @brief Move the start of the plot selection up to the plot interval before the last sample
+ **/
+void TimeSeriesData::updatePlotFirst()
+{
+    if (plotFirst < first) plotFirst = first;
+    if (count == 0) return;
+    double plotStart = (stopTime > plotInterval) ? static_cast<double>(stopTime - plotInterval) : 0.0;
+    while (plotFirst < count - 1 && this->ms[slot(plotFirst)] < plotStart) {
+        plotFirst++;
+    }
+}
+
+/**
+ * @brief Add a value to the average window statistics
+ *
+ * Mean and variance use Welford's update. The median iterator is moved so
+ * that it stays on the lower median of the ordered set.
+ **/
+void TimeSeriesData::addToWindow(double value)
+{
+    windowCount++;
+    double delta = value - mean;
+    mean += delta / windowCount;
+    sumSquares += delta * (value - mean);
+
+    size_t size = windowSorted.size();
+    // Equal values are inserted after the existing ones, so after the median
+    std::multiset<double>::iterator inserted = windowSorted.insert(value);
+    if (size == 0) {
+        windowMedian = inserted;
+    } else if (value < *windowMedian) {
+        if (size % 2 == 1) --windowMedian;
+    } else {
+        if (size % 2 == 0) ++windowMedian;
+    }
+
+    variance = sumSquares / windowCount;
+    if (windowCount % 2 == 1) {
+        median = *windowMedian;
+    } else {
+        std::multiset<double>::iterator next = windowMedian;
+        ++next;
+        median = (*windowMedian + *next) / 2.0;
+    }
+}
+
+/**
+ * @brief Remove a value from the average window statistics, the reverse of addToWindow()
+ **/
+void TimeSeriesData::removeFromWindow(double value)
+{
+    if (windowCount <= 1) {
+        windowCount = 0;
+        mean = 0.0;
+        sumSquares = 0.0;
+        windowSorted.clear();
+        return;
+    }
+    double delta = value - mean;
+    mean -= delta / (windowCount - 1);
+    sumSquares -= delta * (value - mean);
+    if (sumSquares < 0.0) sumSquares = 0.0; // Rounding
+    windowCount--;
+
+    size_t size = windowSorted.size();
+    std::multiset<double>::iterator erased;
+    if (value == *windowMedian) {
+        erased = windowMedian;
+        if (size % 2 == 0) ++windowMedian;
+        else --windowMedian;
+    } else {
+        erased = windowSorted.find(value);
+        if (value < *windowMedian) {
+            if (size % 2 == 0) ++windowMedian;
+        } else {
+            if (size % 2 == 1) --windowMedian;
+        }
+    }
+    windowSorted.erase(erased);
+}
+
+/**
+ * @brief Refill the average window from the latest stored samples, after its size changed
+ **/
+void TimeSeriesData::resetWindow()
+{
+    windowValues.resize(averageWindow);
+    windowCount = 0;
+    windowNext = 0;
+    mean = 0.0;
+    sumSquares = 0.0;
+    windowSorted.clear();
+
+    quint64 n = count - first;
+    if (n > averageWindow) n = averageWindow;
+    for (quint64 i = count - n; i < count; ++i) {
+        double v = this->value[slot(i)];
+        if (v != v) continue; // NaN has no place in an ordered set
+        windowValues[windowNext] = v;
+        windowNext = (windowNext + 1) % averageWindow;
+        addToWindow(v);
+    }
+    if (windowCount == 0) {
+        variance = 0.0;
+        median = 0.0;
+    }
 }
 
 /**
@@ -848,56 +1022,59 @@ void TimeSeriesData::setAverageWindowSize(int windowSize)
 void TimeSeriesData::append(quint64 ms, double value)
 {
     dataMutex.lock();
-    // Pre- allocate new space
-    // FIXME Check this for validity
-    if(static_cast<quint64>(size()) < (count + 100)) {
-        this->ms.resize(size() + 10000);
-        this->value.resize(size() + 10000);
+    appendSample(ms, value);
+    updatePlotFirst();
+    dataMutex.unlock();
+}
+
+/**
+ * @brief Append a batch of data points to this data set
+ *
+ * @param ms The times in milliseconds
+ * @param values The data values
+ * @param count The number of points
+ **/
+void TimeSeriesData::append(const quint64* ms, const double* values, int count)
+{
+    dataMutex.lock();
+    for (int i = 0; i < count; ++i) {
+        appendSample(ms[i], values[i]);
     }
-    this->ms[count] = ms;
-    this->value[count] = value;
-    this->lastValue = value;
-    this->mean = 0;
-    //QList<double> medianList = QList<double>();
-    for (unsigned int i = 0; (i < averageWindow) && (((int)count - (int)i) >= 0); ++i) {
-        this->mean += this->value[count-i];
-        //medianList.append(this->value[count-i]);
+    updatePlotFirst();
+    dataMutex.unlock();
+}
+
+void TimeSeriesData::appendSample(quint64 ms, double value)
+{
+    if (count - first == static_cast<quint64>(capacity)) {
+        if (capacity < MAX_CAPACITY) {
+            grow();
+        } else {
+            // Full, overwrite the oldest sample
+            first++;
+        }
     }
-    this->mean = mean / static_cast<double>(qMin(averageWindow,static_cast<unsigned int>(count)));
+    int s = slot(count);
+    this->ms[s] = this->ms[s + capacity] = ms;
+    this->value[s] = this->value[s + capacity] = value;
+    this->lastValue = value;
 
-    this->variance = 0;
-    for (unsigned int i = 0; (i < averageWindow) && (((int)count - (int)i) >= 0); ++i) {
-        this->variance += (this->value[count-i] - mean) * (this->value[count-i] - mean);
+    // Update the sliding window statistics with the new value and without the one it replaces
+    if (value == value) {
+        if (static_cast<unsigned int>(windowCount) >= averageWindow) {
+            removeFromWindow(windowValues[windowNext]);
+        }
+        windowValues[windowNext] = value;
+        windowNext = (windowNext + 1) % averageWindow;
+        addToWindow(value);
     }
-    this->variance = this->variance / static_cast<double>(qMin(averageWindow,static_cast<unsigned int>(count)));
-
-//    qSort(medianList);
-
-//    if (medianList.count() > 2)
-//    {
-//        if (medianList.count() % 2 == 0)
-//        {
-//            median = (medianList.at(medianList.count()/2) + medianList.at(medianList.count()/2+1)) / 2.0;
-//        }
-//        else
-//        {
-//            median = medianList.at(medianList.count()/2+1);
-//        }
-//    }
 
     // Update statistical values
     if(ms < startTime) startTime = ms;
     if(ms > stopTime) stopTime = ms;
     interval = stopTime - startTime;
 
-    if (interval > plotInterval) {
-        while (this->ms[count - plotCount] < stopTime - plotInterval) {
-            plotCount--;
-        }
-    }
-
     count++;
-    plotCount++;
 
     if(minValue > value) minValue = value;
     if(maxValue < value) maxValue = value;
@@ -906,18 +1083,16 @@ void TimeSeriesData::append(quint64 ms, double value)
     if(maxInterval > 0) {
         // maxInterval = 0 means infinite
 
-        if(interval > maxInterval && !this->ms.isEmpty() && !this->value.isEmpty()) {
+        if(interval > maxInterval) {
             // The time at which this time series should be cut
             double minTime = stopTime - maxInterval;
-            // Delete elements from the start of the list as long the time
-            // value of this elements is before the cut time
-            while(this->ms.first() < minTime) {
-                this->ms.pop_front();
-                this->value.pop_front();
+            // Drop samples from the start of the ring as long the time
+            // value of this samples is before the cut time
+            while(first < count - 1 && this->ms[slot(first)] < minTime) {
+                first++;
             }
         }
     }
-    dataMutex.unlock();
 }
 
 /**
@@ -1008,7 +1183,7 @@ void TimeSeriesData::setZeroValue(double zeroValue)
  **/
 int TimeSeriesData::getCount() const
 {
-    return count;
+    return static_cast<int>(count - first);
 }
 
 /**
@@ -1018,48 +1193,48 @@ int TimeSeriesData::getCount() const
  **/
 int TimeSeriesData::getPlotCount() const
 {
-    return plotCount;
+    return static_cast<int>(count - plotFirst);
 }
 
 /**
- * @brief Get the data array size
- * The data array size is \e NOT equal to the number of items in the data set, as
- * array space is pre-allocated. Use getCount() to get the number of data points.
+ * @brief Get the ring capacity
+ * The capacity is \e NOT equal to the number of items in the data set, as
+ * ring space is pre-allocated. Use getCount() to get the number of data points.
  *
- * @return The data array size
+ * @return The number of samples that can be stored before the ring grows or wraps
  * @see getCount()
  **/
 int TimeSeriesData::size() const
 {
-    return ms.size();
+    return capacity;
 }
 
 /**
  * @brief Get the X (time) values
  *
- * @return The x values
+ * @return getCount() contiguous x values, oldest first
  **/
 const double* TimeSeriesData::getX() const
 {
-    return ms.data();
+    return ms.data() + slot(first);
 }
 
 const double* TimeSeriesData::getPlotX() const
 {
-    return ms.data() + (count - plotCount);
+    return ms.data() + slot(plotFirst);
 }
 
 /**
  * @brief Get the Y (data) values
  *
- * @return The y values
+ * @return getCount() contiguous y values, oldest first
  **/
 const double* TimeSeriesData::getY() const
 {
-    return value.data();
+    return value.data() + slot(first);
 }
 
 const double* TimeSeriesData::getPlotY() const
 {
-    return value.data() + (count - plotCount);
+    return value.data() + slot(plotFirst);
 }
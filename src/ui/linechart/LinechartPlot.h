@@ -36,10 +36,12 @@ This file is part of the PIXHAWK project
 #define QUINT64_MAX Q_UINT64_C(18446744073709551615)
 
 #include <QMap>
+#include <QHash>
 #include <QList>
 #include <QMutex>
 #include <QTime>
 #include <QTimer>
+#include <set>
 #include <qwt_plot_panner.h>
 #include <qwt_plot_curve.h>
 #include <qwt_scale_draw.h>
@@ -102,6 +104,15 @@ class QwtPlotCurve;
 /**
  * @brief Container class for the time series data
  *
+ * Samples are kept in a ring buffer, so appending never shifts or reallocates
+ * the stored data. Each sample is written twice, at its slot and one capacity
+ * further on, so the samples in the plot interval can always be handed to the
+ * curve as one contiguous array. The ring grows up to MAX_CAPACITY samples,
+ * after which the oldest are overwritten.
+ *
+ * Mean and variance over the average window are updated incrementally as
+ * samples enter and leave it, and the median is tracked in an ordered set,
+ * so a sample costs O(log window) regardless of the window size.
  **/
 class TimeSeriesData
 {
@@ -111,6 +122,8 @@ public:
     ~TimeSeriesData();
 
     void append(quint64 ms, double value);
+    /** @brief Append a batch of data points, taking the lock once */
+    void append(const quint64* ms, const double* values, int count);
 
     QwtScaleMap* getScaleMap();
 
@@ -148,7 +161,6 @@ protected:
     quint64 plotInterval;
     quint64 maxInterval;
     int id;
-    quint64 plotCount;
     QString friendlyName;
 
     double lastValue; ///< The last inserted value
@@ -163,15 +175,34 @@ protected:
     void updateScaleMap();
 
 private:
-    quint64 count;
-    QwtArray<double> ms;
+    static const int INITIAL_CAPACITY = 1024;
+    static const int MAX_CAPACITY = 65536;
+
+    /** @brief Slot of the sample with sequence number n */
+    int slot(quint64 n) const { return static_cast<int>(n & static_cast<quint64>(capacity - 1)); }
+    void appendSample(quint64 ms, double value);
+    void grow();
+    void updatePlotFirst();
+    void addToWindow(double value);
+    void removeFromWindow(double value);
+    void resetWindow();
+
+    quint64 count;       ///< Number of samples appended in total, the sequence number of the next one
+    quint64 first;       ///< Sequence number of the oldest stored sample
+    quint64 plotFirst;   ///< Sequence number of the oldest sample in the plot interval
+    int capacity;        ///< Ring size in samples, a power of two
+    QwtArray<double> ms;    ///< Ring of 2 * capacity, see the class description
     QwtArray<double> value;
     double mean;
     double median;
     double variance;
+    double sumSquares;   ///< Sum of squared differences from the mean over the window
     unsigned int averageWindow;
-    QwtArray<double> outputMs;
-    QwtArray<double> outputValue;
+    QwtArray<double> windowValues; ///< The values in the average window, as a ring
+    int windowCount;
+    int windowNext;
+    std::multiset<double> windowSorted;
+    std::multiset<double>::iterator windowMedian; ///< Lower median of windowSorted
 };
 
 
@@ -230,7 +261,8 @@ public slots:
      * @brief Append data to the plot
      *
      * The new data point is appended to the curve with the id-String id. If the curve
-     * doesn't yet exist it is created and added to the plot.
+     * doesn't yet exist it is created and added to the plot. The point is staged and
+     * only reaches the curve on the next refresh tick of an active plot.
      *
      * @param uasId id of originating UAS
      * @param dataname unique string (also used to label the data)
@@ -312,7 +344,7 @@ protected:
 
     quint64 plotInterval;
     quint64 plotPosition;
-    QTimer* updateTimer;
+    int refreshRate; ///< Minimum milliseconds between plot updates
     QMutex datalock;
     QMutex windowLock;
     quint64 timeScaleStep;
@@ -323,11 +355,23 @@ protected:
     bool m_groundTime; ///< Enforce the use of the receive timestamp instead of the data timestamp
     QTimer timeoutTimer;
 
+    /** @brief Samples received for one curve since the last refresh tick */
+    class StagedSamples
+    {
+    public:
+        QVector<quint64> ms;
+        QVector<double> value;
+    };
+    static const int MAX_STAGED_SAMPLES = 65536; ///< Per curve, the oldest half is dropped beyond this
+    QHash<QString, StagedSamples> staging; ///< Filled by appendData()
+    QHash<QString, StagedSamples> staged;  ///< Swapped with staging and drained on each refresh tick
+    QMutex stagingLock;
+
     // Methods
     void addCurve(QString id);
+    /** @brief Move the staged samples into the curves, updating each curve once */
+    void flushStaging();
     QColor getNextColor();
-    void showEvent(QShowEvent* event);
-    void hideEvent(QHideEvent* event);
 
 private:
     TimeSeriesData* d_data;
@@ -36,6 +36,7 @@ This file is part of the PIXHAWK project
 #include "LogCompressor.h"
 #include "MainWindow.h"
 #include "QGC.h"
+#include "FrameScheduler.h"
 #include "MG.h"
 
 
@@ -72,7 +73,6 @@ LinechartWidget::LinechartWidget(int systemid, QWidget *parent) : QWidget(parent
     logindex(1),
     logging(false),
     logStartTime(0),
-    updateTimer(new QTimer()),
     selectedMAV(-1)
 {
     // Add elements defined in Qt Designer
@@ -143,8 +143,6 @@ LinechartWidget::LinechartWidget(int systemid, QWidget *parent) : QWidget(parent
     //connect(this, SIGNAL(plotWindowPositionUpdated(int)), scrollbar, SLOT(setValue(int)));
     //connect(scrollbar, SIGNAL(sliderMoved(int)), this, SLOT(setPlotWindowPosition(int)));
 
-    updateTimer->setInterval(updateInterval);
-    connect(updateTimer, SIGNAL(timeout()), this, SLOT(refresh()));
     connect(ui.uasSelectionBox, SIGNAL(currentIndexChanged(int)), this, SLOT(selectActiveSystem(int)));
     readSettings();
 }
@@ -892,9 +890,9 @@ void LinechartWidget::setActive(bool active)
         activePlot->setActive(active);
     }
     if (active) {
-        updateTimer->start(updateInterval);
+        FrameScheduler::instance()->registerWidget(this, FrameScheduler::Continuous, SLOT(refresh()), updateInterval);
     } else {
-        updateTimer->stop();
+        FrameScheduler::instance()->unregisterWidget(this);
     }
 }
 
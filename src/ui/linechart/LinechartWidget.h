@@ -169,7 +169,6 @@ protected:
     unsigned int logindex;
     bool logging;
     quint64 logStartTime;
-    QTimer* updateTimer;
     LogCompressor* compressor;
     QCheckBox* selectAllCheckBox;
     int selectedMAV; ///< The MAV for which plot items are accepted, -1 for all systems
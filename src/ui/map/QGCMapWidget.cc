@@ -666,6 +666,20 @@ void QGCMapWidget::cacheVisibleRegion()
 
     if (rect.IsEmpty())
     {
+        // Without a selection, offer to resume caching that was cancelled
+        int zoom = 0;
+        int tilesLeft = SavedRipTilesLeft(&zoom);
+        if (tilesLeft >= 0)
+        {
+            QMessageBox::StandardButton button = QMessageBox::question(this, "Resume caching tiles",
+                    QString("Caching tiles for offline use stopped with %1 tiles left at zoom level %2. Resume it?").arg(tilesLeft).arg(zoom),
+                    QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+            if (button == QMessageBox::Yes)
+            {
+                ResumeRipMap();
+                return;
+            }
+        }
         QMessageBox msgBox(this);
         msgBox.setIcon(QMessageBox::Information);
         msgBox.setText("Cannot cache tiles for offline use");
@@ -2,6 +2,7 @@
 #include "UASQuickViewItemSelect.h"
 #include "UASQuickViewTextItem.h"
 #include "QsLog.h"
+#include "FrameScheduler.h"
 #include <QMetaMethod>
 #include <QSettings>
 #include <QInputDialog>
@@ -57,9 +58,8 @@ UASQuickView::UASQuickView(QWidget *parent) : QWidget(parent)
     connect(columnaction,SIGNAL(triggered()),this,SLOT(columnActionTriggered()));
     this->addAction(columnaction);
 
-    updateTimer = new QTimer(this);
-    connect(updateTimer,SIGNAL(timeout()),this,SLOT(updateTimerTick()));
-    updateTimer->start(1000);
+    //Values are copied to the items at most once a second, only while they can be seen
+    FrameScheduler::instance()->registerWidget(this,FrameScheduler::OnDemand,SLOT(updateTimerTick()),1000);
 
 }
 UASQuickView::~UASQuickView()
@@ -390,6 +390,7 @@ void UASQuickView::valueChanged(const int uasId, const QString& name, const QStr
     if (!ok){
         QLOG_ERROR() << "Quick View: Error Converting QuickView Item Value: " << propername;
     }
+    FrameScheduler::instance()->markDirty(this);
 }
 
 void UASQuickView::actionTriggered(bool checked)
@@ -32,7 +32,6 @@ private:
 
 
     /** Timer for updating the UI */
-    QTimer *updateTimer;
 
     /** Selection dialog for selectin/deselecting gauge items */
     UASQuickViewItemSelect *quickViewSelectDialog;